@@ -64,6 +64,15 @@ namespace opt {
 		//! maximum node longitude to include into imported data
 		static const char* max_lon					= "importer.max-lon";
 
+		//! clip closed ways crossing the import bounds (type: bool)
+		static const char* clip_polygons			= "importer.clip-polygons";
+
+		//! margin in degrees around the import bounds kept when clipping closed ways (type: double)
+		static const char* clip_margin				= "importer.clip-margin";
+
+		//! file to write a JSON summary of the import phases to (type: string)
+		static const char* stats_file				= "importer.stats-file";
+
 	}
 
 	namespace server {
@@ -77,6 +86,21 @@ namespace opt {
 		//! Option to get number of worker threads (type: int)
 		static const char* num_threads				= "server.num-threads";
 
+		//! Option to get number of threads matching the stylesheet (type: int)
+		static const char* match_threads			= "server.match-threads";
+
+		//! Option to get number of threads rendering metatiles (type: int)
+		static const char* render_threads			= "server.render-threads";
+
+		//! Option to get number of threads slicing and encoding rendered metatiles (type: int)
+		static const char* encode_threads			= "server.encode-threads";
+
+		//! Option to get the maximal number of metatiles waiting for each stage of rendering (type: int)
+		static const char* stage_queue_size			= "server.stage-queue";
+
+		//! Option to get the number of tiles in x and y direction of a metatile per zoomlevel (type: string)
+		static const char* metatile_size			= "server.metatile-size";
+
 		//! Path to be observed for stylesheets (type: string)
 		static const char* style_source				= "server.style-src";
 
@@ -89,6 +113,27 @@ namespace opt {
 		//! Maximum size for the queue (type: int)
 		static const char* max_queue_size			= "server.max-queue";
 
+		//! Option to get the order of waiting requests: fifo, lifo or zoom (type: string)
+		static const char* queue_policy				= "server.queue-policy";
+
+		//! Option to get the milliseconds after which waiting requests are dropped, 0 to keep them (type: int)
+		static const char* queue_deadline			= "server.queue-deadline";
+
+		//! Option to get the maximal number of metatiles waiting to be prefetched (type: int)
+		static const char* prefetch_queue_size		= "server.prefetch-queue";
+
+		//! Option to get whether the neighbours of requested metatiles are prefetched (type: bool)
+		static const char* prefetch_neighbours		= "server.prefetch-neighbours";
+
+		//! Option to get the maximal number of metatiles waiting to be prerendered, 0 for no limit (type: int)
+		static const char* prerender_queue_size		= "server.prerender-queue";
+
+		//! Option to get if metatiles are rendered and cached although all clients disconnected (type: bool)
+		static const char* render_abandoned			= "server.render-abandoned";
+
+		//! Option to get if clients that only closed their sending side are still answered (type: bool)
+		static const char* keep_half_closed			= "server.keep-half-closed";
+
 		//! Path to the default stylesheet (type: string)
 		static const char* path_to_default_style	= "server.default-style";
 
@@ -98,12 +143,42 @@ namespace opt {
 		//! Option to get the cache size (type: int)
 		static const char* cache_size				= "server.cache-size";
 
+		//! Option to get the memory in megabytes available for cached tiles (type: int)
+		static const char* cache_memory				= "server.cache-memory";
+
 		//! Option to get the zoomlevel until tiles are kept on harddrive (type: int)
 		static const char* cache_keep_tile			= "server.cache-keep-tile";
 
 		//! Option to get the cache path (type: string)
 		static const char* cache_path				= "server.cache-path";
 
+		//! Option to get how tiles are stored in the cache path: bundle or files (type: string)
+		static const char* cache_layout				= "server.cache-layout";
+
+		//! Option to get the number of independently locked parts of the cache (type: int)
+		static const char* cache_shards				= "server.cache-shards";
+
+		//! Option to get the maximal number of evicted tiles waiting to be written (type: int)
+		static const char* cache_write_queue		= "server.cache-write-queue";
+
+		//! Option to get the number of evicted tiles written at once (type: int)
+		static const char* cache_write_batch		= "server.cache-write-batch";
+
+		//! Option to get when written tiles are flushed to disk: none, batch or always (type: string)
+		static const char* cache_sync				= "server.cache-sync";
+
+		//! Option to get the policy deciding which tiles are evicted: lru, tinylfu or arc (type: string)
+		static const char* cache_policy				= "server.cache-policy";
+
+		//! Option to get the seconds between two snapshots of the cache index, 0 to disable it (type: int)
+		static const char* cache_index_interval		= "server.cache-index-interval";
+
+		//! Option to get the maximal number of tiles loaded from the cache index on startup (type: int)
+		static const char* cache_preload			= "server.cache-preload";
+
+		//! Option to get the number of threads loading tiles from the cache index (type: int)
+		static const char* cache_preload_threads	= "server.cache-preload-threads";
+
 		//! Option to get the timeout for stylesheet-parsing (type: int)
 		static const char* parse_timeout			= "server.parse-timeout";
 
@@ -113,6 +188,18 @@ namespace opt {
 		//! Option to get the highest zoomlevel that is enqueued for prerendering (type: int)
 		static const char* prerender_level			= "server.prerender-level";
 
+		//! Option to get the percentage of the render threads used for prerendering (type: int)
+		static const char* prerender_share			= "server.prerender-share";
+
+		//! Option to get the milliseconds user requests may wait before prerendering pauses (type: int)
+		static const char* prerender_pause			= "server.prerender-pause";
+
+		//! Option to get the number of most requested metatiles to prerender above the prerender level (type: int)
+		static const char* prerender_popular		= "server.prerender-popular";
+
+		//! Option to get the seconds a stale tile is served while it is rendered again (type: int)
+		static const char* max_staleness			= "server.max-staleness";
+
 		//! Option to get the muted Components
 		static const char* log_mute_component		= "server.log-mute-component";
 
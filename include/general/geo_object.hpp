@@ -30,6 +30,8 @@
 
 #include <boost/serialization/map.hpp>
 
+#include "general/tag_set.hpp"
+
 class GeoObject
 {
 private:
@@ -38,19 +40,29 @@ public:
 	GeoObject() = default;
 	GeoObject(const GeoObject& other) = default;
 	GeoObject(GeoObject&& other) = default;
-	GeoObject(const DataMap<CachedString, CachedString>& tags);
+	GeoObject(const TagSet& tags);
 	virtual ~GeoObject() = default;
 
 	//! Returns a map with key-to-tag-mapping for osm-tags. 
 	TESTABLE const DataMap<CachedString, CachedString>& getTags() const;
+	//! Returns the id of the shared tag set or TagSet::NotInterned.
+	inline TagSetId getTagSetId() const { return tags.getId(); }
+	//! Returns the tag set of this object.
+	inline const TagSet& getTagSet() const { return tags; }
+	void setTagSet(const TagSet& tags);
+
 protected:
 	
+	//! Only the id of the tag set is saved, the tags are stored once by the Geodata.
 	template<typename Archive>
 	void serialize(Archive &ar, const unsigned int version){
-		ar & tags;
+		TagSetId id = tags.getId();
+		ar & id;
+		if (Archive::is_loading::value)
+			tags = TagSet::Unresolved(id);
 	}
 private:
-	DataMap<CachedString, CachedString> tags;
+	TagSet tags;
 };
 
 
@@ -34,6 +34,8 @@
 class Node;
 class Way;
 class Relation;
+class TagSetTable;
+class PhaseTimer;
 class NodeKdTree;
 template<class id_t, class data_t>
 class RTree;
@@ -44,6 +46,7 @@ public:
 	Geodata() = default;
 	virtual ~Geodata() = default;
 
+	TESTABLE void insertTagSets(const shared_ptr<TagSetTable>& tagSets);
 	TESTABLE void insertNodes(const shared_ptr<std::vector<Node> >& nodes);
 	TESTABLE void insertWays(const shared_ptr<std::vector<Way> >& ways);
 	TESTABLE void insertRelations(const shared_ptr<std::vector<Relation> >& relations);
@@ -57,11 +60,15 @@ public:
 	TESTABLE Node* getNode(NodeId id) const;
 	TESTABLE Way* getWay(WayId id) const ;
 	TESTABLE Relation* getRelation(RelId id) const;
+	const shared_ptr<TagSetTable>& getTagSets() const { return tagSets; }
 
 	TESTABLE void load(const string& path);
-	TESTABLE void save(const string& path);
+	TESTABLE void save(const string& path, PhaseTimer* timer = nullptr);
+	TESTABLE void setThreadCount(unsigned int threads);
 
 protected:
+	//! every distinct tag set of the contained objects, referenced by id
+	shared_ptr<TagSetTable> tagSets;
 	shared_ptr<std::vector<Way> > ways;
 	shared_ptr<std::vector<Node> > nodes;
 	shared_ptr<std::vector<Relation> > relations;
@@ -71,8 +78,15 @@ protected:
 	shared_ptr<RTree<WayId, FixedRect>> waysTree;
 	shared_ptr<RTree<RelId, FixedRect>> relTree;
 
+	//! threads used to build the trees, 0 for one per core
+	unsigned int threadCount = 0;
+
 private:
-	void buildTrees(const string& nodePath, const string& wayPath, const string& relationPath);
+	void buildTrees(const string& nodePath, const string& wayPath, const string& relationPath, PhaseTimer& timer);
+	template<typename Object>
+	void internTags(std::vector<Object>& objects);
+	template<typename Object>
+	void resolveTags(std::vector<Object>& objects);
 	void serialize(const string& serPath) const;
 	TESTABLE FixedRect calculateBoundingBox(const Way& way) const;
 	TESTABLE FixedRect calculateBoundingBox(const Relation& relation) const;
@@ -82,6 +96,7 @@ private:
 	friend class boost::serialization::access;
 	template<typename Archive>
 	void serialize(Archive &ar, const unsigned int version){
+		ar & tagSets;
 		ar & nodes;
 		ar & ways;
 		ar & relations;
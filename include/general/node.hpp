@@ -33,7 +33,7 @@ public:
 	Node() = default;
 	Node(const Node& other) = default;
 	Node(Node&& other) = default;
-	Node(const FloatPoint& location, const DataMap<CachedString, CachedString>& tags);
+	Node(const FloatPoint& location, const TagSet& tags);
 	virtual ~Node() = default;
 
 	TESTABLE const FixedPoint& getLocation() const;
@@ -40,7 +40,7 @@ public:
 				const DataMap<NodeId, CachedString>& nodeRoles,
 				const std::vector<WayId>& wayIDs,
 				const DataMap<WayId, CachedString>& wayRoles,
-				const DataMap<CachedString, CachedString>& tags);
+				const TagSet& tags);
 	virtual ~Relation() = default;
 	
 	TESTABLE const std::vector<WayId>& getWayIDs() const;
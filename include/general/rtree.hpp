@@ -33,6 +33,7 @@
 #include <fstream>
 #include <algorithm>
 #include <stack>
+#include <cstring>
 
 #include "utils/transform.hpp"
 
@@ -76,7 +77,11 @@ private:
 		//! number of contained elements
 		uint8_t size;
 
-		RNode(): size(0) {}
+		RNode(): size(0)
+		{
+			// unused slots are serialized as well
+			std::fill(children, children + NUM_CHILDREN, (uint32_t) -1);
+		}
 
 		// for leaf nodes the index is -1 (0xFFFFFFFF)
 		void addChild(const FixedRect& bound, uint32_t index = (uint32_t) -1)
@@ -276,6 +281,8 @@ void RTree<id_t, data_t>::writeLeaves (const std::vector<id_t>& ids,
 	// fill data in leaves and write to disk
 	RNode node;
 	RLeaf<id_t, data_t> leaf;
+	// clear padding bytes, so the leaf file only depends on the data
+	std::memset(&leaf, 0, sizeof(leaf));
 	for (id_t id : ids)
 	{
 		leaf.addData(data[id.getRaw()], id);
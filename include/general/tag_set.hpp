@@ -0,0 +1,120 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Lisa Winter
+ */
+
+#pragma once
+#ifndef TAG_SET_HPP
+#define TAG_SET_HPP
+
+
+#include "settings.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+
+//! Index of an interned tag set inside a TagSetTable
+typedef uint32 TagSetId;
+
+/**
+ * @brief Immutable set of osm tags shared by all objects with exactly the same tags.
+ *
+ * A TagSet is either interned, then it is owned by a TagSetTable and has a valid id,
+ * or private to one object (e.g. objects created in tests).
+ **/
+class TagSet
+{
+public:
+	typedef DataMap<CachedString, CachedString> TagMap;
+
+	//! Id of tag sets not owned by a TagSetTable
+	static const TagSetId NotInterned = (TagSetId) -1;
+
+	TagSet();
+	TagSet(const TagMap& tags);
+	TagSet(TagSetId id, const shared_ptr<const TagMap>& tags);
+
+	//! Creates a tag set with only the id set. Used by deserialisation until the table is available.
+	static TagSet Unresolved(TagSetId id) { return TagSet(id, shared_ptr<const TagMap>()); }
+
+	inline TagSetId getId() const { return id; }
+	inline bool isInterned() const { return id != NotInterned; }
+	inline bool isResolved() const { return tags.get() != nullptr; }
+	inline const TagMap& getTags() const { assert(tags); return *tags; }
+
+private:
+	TagSetId id;
+	shared_ptr<const TagMap> tags;
+};
+
+/**
+ * @brief Table holding every distinct tag set exactly once.
+ *
+ * Filled by the importer and loaded read-only by the server.
+ * \Note Interning is not thread safe.
+ **/
+class TagSetTable : private boost::noncopyable
+{
+	friend class boost::serialization::access;
+public:
+	typedef TagSet::TagMap TagMap;
+
+	TagSetTable() = default;
+
+	TagSet intern(const TagMap& tags);
+	TagSet get(TagSetId id) const;
+	std::size_t size() const { return sets.size(); }
+
+private:
+	static std::size_t hashTags(const TagMap& tags);
+
+	template<typename Archive>
+	void save(Archive& ar, const unsigned int version) const
+	{
+		uint32 s = sets.size();
+		ar << s;
+		for (auto& set : sets)
+			ar << *set;
+	}
+	template<typename Archive>
+	void load(Archive& ar, const unsigned int version)
+	{
+		uint32 s;
+		ar >> s;
+
+		sets.clear();
+		index.clear();
+		sets.reserve(s);
+		while (s--)
+		{
+			shared_ptr<TagMap> set = boost::make_shared<TagMap>();
+			ar >> *set;
+			index.insert(std::make_pair(hashTags(*set), sets.size()));
+			sets.push_back(set);
+		}
+	}
+
+	BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+private:
+	std::vector<shared_ptr<const TagMap>> sets;
+	//! maps the hash of a tag set to the ids of all sets with that hash
+	boost::unordered_multimap<std::size_t, TagSetId> index;
+};
+
+#endif
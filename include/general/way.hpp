@@ -36,7 +36,7 @@ public:
 	Way() = default;
 	Way(const Way& other) = default;
 	Way(Way&& other) = default;
-	Way(const std::vector<NodeId>& nodeIDs, const DataMap<CachedString, CachedString>& tags)
+	Way(const std::vector<NodeId>& nodeIDs, const TagSet& tags)
 	: GeoObject(tags)
 	, nodeIDs(nodeIDs)
 	{ }
@@ -26,6 +26,7 @@
 
 class Configuration;
 class Geodata;
+class PhaseTimer;
 
 class Importer
 {
@@ -37,8 +38,12 @@ public:
 
 	TESTABLE shared_ptr<Geodata> importXML();
 
+	const shared_ptr<PhaseTimer>& getPhaseTimer() const { return timer; }
+
 private:
 	shared_ptr<Configuration> config;
+	//! measures the phases of the import
+	shared_ptr<PhaseTimer> timer;
 };
 
 
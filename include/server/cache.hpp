@@ -25,56 +25,143 @@
 #include "settings.hpp"
 
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/filesystem.hpp>
-#include <list>
+#include <atomic>
+#include <vector>
 
 #include "server/tile_identifier.hpp"
 #include "server/tile.hpp"
+#include "utils/rect.hpp"
 
 class Configuration;
 class Stylesheet;
+class CacheIndex;
+class CachePolicy;
+class ImagePool;
+class MetaIdentifier;
+class TileStore;
+class TileWriter;
 
 class Cache
 {
 public:
   
 	/**
-	 * @brief A list that will store the last recently used tiles.
+	 * @brief An element stored in the cache. Consists of shared_ptr to the Tile and the amount of memory charged for the tile.
 	 **/
-	typedef std::list<shared_ptr<Tile>> TileList;
-	
-	/**
-	 * @brief An element stored in the cache. Consists of shared_ptr to the Tile and an iterator pointing to the element in the least recently used list.
-	 **/
-	typedef std::pair<shared_ptr<Tile>, TileList::iterator> CacheElement;
+	struct CacheElement
+	{
+		shared_ptr<Tile> tile;
+		//! memory of the tile including its image, as reported to the policy
+		std::size_t size;
+		//! image charged to the shard, counted once for all tiles of the shard using it
+		Tile::ImageType image;
+		//! number of requests, saved in the cache index
+		std::size_t hits;
+		//! the image is already on the hard drive or queued to be written
+		bool stored;
+	};
 	
 	/**
 	 * @brief HashMap with TileIdentifier as key and shared_ptr to Tiles as value.
 	 **/
-	typedef boost::unordered_map<TileIdentifier, CacheElement> CacheOfOneStylesheet;
-	
+	typedef boost::unordered_map<TileIdentifier, CacheElement> TileMap;
+
 	/**
-	 * @brief HashMap with path to MapCSS as key and shared_ptr to CacheOfOneStylesheet as value.
+	 * @brief Counters to compare cache policies.
 	 **/
-	typedef boost::unordered_map<string, shared_ptr<CacheOfOneStylesheet> > CacheContainer;
-	
+	struct Statistics
+	{
+		//! requests answered from memory
+		std::size_t hits;
+		//! requests for tiles that were not in memory
+		std::size_t misses;
+		//! misses answered from the hard drive or the write queue
+		std::size_t loads;
+		//! tiles removed to stay within the limits
+		std::size_t evictions;
+	};
 	
 	Cache(const shared_ptr<Configuration>& config);
+	~Cache();
 	
-	TESTABLE shared_ptr<Tile> getTile(const shared_ptr<TileIdentifier>& tl);
+	TESTABLE shared_ptr<Tile> getTile(const shared_ptr<TileIdentifier>& tl, bool countAccess = true);
 	TESTABLE shared_ptr<Tile> getDefaultTile();
 	TESTABLE void deleteTiles(const string path);
+	TESTABLE std::size_t invalidateTiles(const string path);
+	TESTABLE std::vector<shared_ptr<MetaIdentifier>> invalidate(const FixedRect& area, int minZoom, int maxZoom, const string& stylesheet = "");
+	TESTABLE void updateTile(const shared_ptr<Tile>& tile);
+	TESTABLE void flush();
+	TESTABLE std::size_t getShardCount() const;
+	TESTABLE std::size_t getMemoryUsage() const;
+	TESTABLE std::size_t getMemoryBudget() const;
+	TESTABLE const shared_ptr<ImagePool>& getImagePool() const;
+	TESTABLE Statistics getStatistics();
+	TESTABLE void saveIndex();
+	TESTABLE std::size_t waitForPreload();
 
 private:
+	/**
+	 * @brief Part of the cache with its own lock and eviction policy.
+	 *
+	 * Every tile belongs to exactly one shard, selected by the hash of its TileIdentifier.
+	 **/
+	struct Shard
+	{
+		boost::mutex Lock;
+		TileMap Tiles;
+		shared_ptr<CachePolicy> Policy;
+		//! Memory charged for all tiles of this shard
+		std::size_t Bytes = 0;
+		//! Number of tiles of this shard using each image buffer
+		boost::unordered_map<const Tile::ImageType::element_type*, std::size_t> Images;
+		Statistics Stats = Statistics();
+	};
+
 	shared_ptr<Configuration> Config;
-	boost::mutex GlobalCacheLock;
-	CacheContainer AllCaches;
-	TileList RecentlyUsedList;
+	//! Configuration values needed on every access
+	string CachePath;
+	int KeepTileZoom;
+	//! Maximal number of tiles per shard, 0 if only the memory is limited
+	std::size_t ShardCapacity;
+	std::size_t ShardBudget;
+	std::atomic<std::size_t> MemoryUsage;
+	std::vector<shared_ptr<Shard>> Shards;
+	boost::mutex DefaultTileLock;
 	shared_ptr<Tile> DefaultTile;
+	//! Shares image buffers between tiles with the same content
+	shared_ptr<ImagePool> Pool;
+	//! Keeps evicted tiles on the hard drive
+	shared_ptr<TileStore> Store;
+	//! Writes evicted tiles in the background
+	scoped_ptr<TileWriter> Writer;
+	//! Snapshot of the most requested tiles, null if disabled
+	scoped_ptr<CacheIndex> Index;
+	//! Seconds between two snapshots of the index
+	int IndexInterval;
+	boost::mutex IndexLock;
+	boost::condition_variable IndexStop;
+	bool Stopping;
+	boost::thread IndexThread;
+	//! Tiles of the last snapshot that are loaded after startup
+	std::vector<std::pair<TileIdentifier, std::size_t>> PreloadList;
+	std::atomic<std::size_t> PreloadPosition;
+	std::atomic<std::size_t> Preloaded;
+	std::atomic<bool> StopPreload;
+	boost::thread_group PreloadThreads;
+
+	Shard& getShard(const TileIdentifier& ti);
+	shared_ptr<Tile> lookup(Shard& shard, const TileIdentifier& ti, bool countAccess);
+	void hold(Shard& shard, CacheElement& element);
+	void release(Shard& shard, CacheElement& element);
+	bool isFull(const Shard& shard) const;
+	void evict(Shard& shard);
+	void runIndex();
+	void preload();
 	void readFile(const Tile::ImageType& image, const boost::filesystem::path& filename);
-	void writeFile(shared_ptr<Tile> tile, const boost::filesystem::path& filename);
-	const boost::filesystem::path getTilePath(const shared_ptr<TileIdentifier>& ti);
 };
 
 #endif
@@ -0,0 +1,58 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef CACHE_INDEX_HPP
+#define CACHE_INDEX_HPP
+
+#include "settings.hpp"
+
+#include <boost/filesystem.hpp>
+#include <vector>
+
+#include "server/tile_identifier.hpp"
+
+/**
+ * @brief Snapshot of the most requested tiles of the cache, used to warm the cache after a restart.
+ *
+ * The file contains one line "<frequency> <zoom> <x> <y> <format> <stylesheet>" per tile,
+ * sorted by descending frequency. It is replaced atomically, so a crash while saving
+ * leaves the previous snapshot intact.
+ **/
+class CacheIndex
+{
+public:
+	struct Entry
+	{
+		TileIdentifier tile;
+		//! number of requests while the tile was cached
+		std::size_t frequency;
+	};
+
+	CacheIndex(const boost::filesystem::path& path);
+
+	TESTABLE void save(std::vector<Entry> entries);
+	TESTABLE std::vector<Entry> load(std::size_t limit) const;
+
+private:
+	const boost::filesystem::path path;
+};
+
+#endif
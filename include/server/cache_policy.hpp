@@ -0,0 +1,62 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef CACHE_POLICY_HPP
+#define CACHE_POLICY_HPP
+
+#include "settings.hpp"
+
+#include "server/tile_identifier.hpp"
+
+/**
+ * @brief Decides which tile of a cache shard is evicted next.
+ *
+ * The policy is informed about every access and change of the shard and is only used
+ * while the shard is locked. Sizes are the bytes charged for a tile.
+ *
+ * Available policies:
+ *  - "lru": evicts the least recently used tile.
+ *  - "tinylfu": W-TinyLFU, a small LRU window in front of a segmented LRU. Tiles leaving
+ *    the window are only admitted if they were requested more often than the tile they
+ *    would replace, estimated with a count-min sketch. Scans only pass through the window.
+ *  - "arc": Adaptive Replacement Cache, balances recency and frequency using the history
+ *    of recently evicted tiles.
+ **/
+class CachePolicy
+{
+public:
+	static shared_ptr<CachePolicy> Create(const string& name, std::size_t capacity);
+
+	virtual ~CachePolicy();
+
+	//! A cached tile was requested.
+	virtual void onHit(const TileIdentifier& ti) = 0;
+	//! A tile was added after a miss.
+	virtual void onInsert(const TileIdentifier& ti, std::size_t size) = 0;
+	//! The memory charged for a cached tile changed.
+	virtual void onResize(const TileIdentifier& ti, std::size_t size) = 0;
+	//! A tile was removed, evicted is false if it was deleted explicitly.
+	virtual void onRemove(const TileIdentifier& ti, bool evicted) = 0;
+	//! Returns the tile to evict next. Must only be called while tiles are cached.
+	virtual TileIdentifier victim() = 0;
+};
+
+#endif
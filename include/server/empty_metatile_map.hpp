@@ -0,0 +1,62 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef EMPTY_METATILE_MAP_HPP
+#define EMPTY_METATILE_MAP_HPP
+
+#include "settings.hpp"
+
+#include <boost/scoped_array.hpp>
+#include <atomic>
+#include <vector>
+
+class TileIdentifier;
+
+/**
+ * @brief Remembers metatiles that contain no data, so they are not searched in the Geodata again.
+ *
+ * One bit per metatile and zoomlevel up to MAX_ZOOM, about 3 MB in total with the default
+ * metatile size. A metatile on a higher zoomlevel is empty if its ancestor on MAX_ZOOM is,
+ * as its area including the overlap is part of the area of the ancestor. The map is
+ * filled while rendering and uses the metatile sizes configured when it is created.
+ **/
+class EmptyMetatileMap
+{
+public:
+	//! Highest zoomlevel with its own bitmap
+	static const int MAX_ZOOM = 14;
+
+	EmptyMetatileMap();
+
+	TESTABLE bool isEmpty(const TileIdentifier& ti) const;
+	TESTABLE void markEmpty(const TileIdentifier& ti);
+	TESTABLE std::size_t getMarkedCount() const;
+
+private:
+	bool locate(const TileIdentifier& ti, bool exact, std::size_t& word, uint64_t& mask) const;
+
+	//! index of the first word of every zoomlevel
+	std::vector<std::size_t> offsets;
+	boost::scoped_array<std::atomic<uint64_t>> bits;
+	std::atomic<std::size_t> marked;
+};
+
+#endif
@@ -25,6 +25,7 @@
 #include "settings.hpp"
 #include <server/http/request_parser.hpp>
 #include <array>
+#include <atomic>
 
 class HttpServer;
 class Tile;
@@ -75,8 +76,9 @@ public:
 		std::vector<Header> headers;
 		/// The content to be sent in the Reply.
 		std::string content;
-		/// The Tile to be sent in the Reply.
-		shared_ptr<Tile> tile;
+		/// The image of the Tile to be sent in the Reply, taken once so
+		/// Content-Length and the body always match.
+		shared_ptr< std::vector<uint8_t> > image;
 		/// Convert the Reply into a vector of buffers. The buffers do not own the
 		/// underlying memory blocks, therefore the reply object must remain valid and
 		/// not be changed until the write operation has completed.
@@ -87,9 +89,11 @@ public:
 	explicit HttpRequest ( boost::asio::io_service &ioService, const shared_ptr<HttpServer>& server, const shared_ptr<RequestManager> &manager );
 
 	TESTABLE const string& getURL() const;
+	TESTABLE string getClient() const;
 
 	TESTABLE void answer ( const  shared_ptr<Tile>& tile, Reply::StatusType status = Reply::ok );
 	TESTABLE void answer ( Reply::StatusType status );
+	TESTABLE bool isDisconnected() const;
 	/// Start the first asynchronous operation for the connection.
 	void startCollectingData();
 
@@ -104,23 +108,35 @@ private:
 	/// Handle completion of a write operation.
 	void handleWrite ( const boost::system::error_code &e );
 
-	void answer();
-	bool checkifAnswered();
+	/// Handle completion of the read that waits for the client to close the connection.
+	void handleDisconnect ( const boost::system::error_code &e, std::size_t bytes_transferred );
+
+	void write();
+	bool claimAnswer();
 	void readSome();
+	void watchConnection();
+	bool keepsHalfClosed() const;
+	void release();
 	
 protected:
-	bool answered;
+	/// Set by the worker that answers, read by the thread of the server.
+	std::atomic<bool> answered;
+	/// The connection to the client broke before it was answered.
+	std::atomic<bool> disconnected;
 	/// The reply to be sent back to the client.
 	Reply reply;
 	RequestData data;
 private:
 	
+	boost::asio::io_service &ioService;
 	/// Socket for the connection.
 	boost::asio::ip::tcp::socket socket;
 	/// Buffer for incoming data.
 	std::array<char, 8192> buffer;
 	/// The parser for the incoming request.
 	HttpRequestParser parser;
+	/// Address of the client, read once so workers do not use the socket.
+	string client;
 	
 	weak_ptr<RequestManager> manager;
 	weak_ptr<HttpServer> server;
@@ -42,6 +42,7 @@ public:
 	TESTABLE void listen();
 	TESTABLE void quit();
 	void stopRequest ( shared_ptr<HttpRequest> request );
+	bool keepsHalfClosed() const;
 
 private:
 	void start_accept();
@@ -65,6 +66,8 @@ private:
 
 	shared_ptr<Configuration> config;
 	shared_ptr<RequestManager> manager;
+	/// Clients that closed their sending side are still answered.
+	bool keepHalfClosed;
 };
 
 #endif
@@ -0,0 +1,73 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef IMAGE_POOL_HPP
+#define IMAGE_POOL_HPP
+
+#include "settings.hpp"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include "server/tile.hpp"
+
+/**
+ * @brief Shares one buffer between all tiles with identical image data.
+ *
+ * Large areas like open ocean or empty land render to the same bytes on every tile.
+ * The pool only holds weak references, a buffer is freed as soon as no tile uses it.
+ **/
+class ImagePool
+{
+public:
+	ImagePool();
+
+	static std::size_t Hash(const Tile::ImageType& image);
+
+	TESTABLE Tile::ImageType intern(const Tile::ImageType& image, bool* shared = nullptr);
+	TESTABLE bool isDuplicate(const Tile::ImageType& image);
+
+	TESTABLE std::size_t getLookups();
+	TESTABLE std::size_t getHits();
+	TESTABLE std::size_t getSavedBytes();
+	TESTABLE std::size_t size();
+
+private:
+	struct Entry
+	{
+		boost::weak_ptr<Tile::ImageType::element_type> image;
+		//! number of times the image was found again
+		std::size_t hits;
+	};
+
+	void removeExpired();
+
+	boost::mutex lock;
+	boost::unordered_map<std::size_t, Entry> images;
+	//! number of insertions until expired entries are removed
+	std::size_t cleanupCountdown;
+	std::size_t lookups;
+	std::size_t hits;
+	std::size_t savedBytes;
+};
+
+#endif
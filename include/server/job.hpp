@@ -24,6 +24,8 @@
 
 #include "settings.hpp"
 
+#include <boost/thread/mutex.hpp>
+
 #include "server/tile_identifier.hpp"
 #include "utils/statistic.hpp"
 
@@ -34,9 +36,15 @@ class Configuration;
 class Stylesheet;
 class HttpRequest;
 class RenderCanvas;
+class RenderCanvasFactory;
+class RenderCanvasPool;
+class RenderAttributes;
 
 /**
- * @brief Abstract Class which computes Tiles by a given TileIdentifier.
+ * @brief Computes the Tiles of a MetaIdentifier.
+ *
+ * The stages query, match, render and deliver are run one after another by the JobPipeline,
+ * possibly on different threads. Each stage except render can end the job early.
  **/
 class Job
 {
@@ -44,35 +52,60 @@ public:
 	Job(const shared_ptr<MetaIdentifier>& mid,
 		const shared_ptr<Configuration>& config,
 		const shared_ptr<RequestManager>& manager,
-		const shared_ptr<RenderCanvas>& canvas);
+		const shared_ptr<RenderCanvasPool>& canvases);
+	virtual ~Job() = default;
 
-	void process();
-	void deliver();
+	TESTABLE bool query();
+	TESTABLE bool match();
+	TESTABLE void render();
+	TESTABLE void deliver();
 	void addRequest(const shared_ptr<HttpRequest>& req, const shared_ptr<TileIdentifier>& id)
 	{
+		boost::mutex::scoped_lock lock(requestsMutex);
 		requests[*id].push_back(req);
 	}
 	bool isEmpty() { return empty; }
+	//! @return true if the metatile was rendered, it was neither empty nor cached nor abandoned
+	bool wasRendered() { return !empty && !cached && !aborted; }
 	const shared_ptr<MetaIdentifier>& getIdentifier() { return mid; }
 
 private:
 	TESTABLE shared_ptr<Tile> computeEmpty();
-	TESTABLE FixedRect computeRect(const shared_ptr<TileIdentifier>& ti);
 	TESTABLE FixedRect computeRect(const shared_ptr<MetaIdentifier>& ti);
 	bool initTiles();
+	bool isAbandoned();
+
+	struct Encoding;
+	void encodeTiles(const shared_ptr<RenderCanvas>& canvas, const std::vector<shared_ptr<Tile>>& rendered, bool outdated);
+	void encodeNextTiles(const shared_ptr<Encoding>& encoding);
+	void finishTile(const shared_ptr<Tile>& tile, bool outdated);
+	void answer(const shared_ptr<Tile>& tile);
 
 private:
 	//! RequestManager which holds all important components.
 	shared_ptr<RequestManager> manager;
-	//! supplied by worker thread
-	shared_ptr<RenderCanvas> canvas;
+	//! canvases are borrowed from the pool for rendering until the tiles are sliced
+	shared_ptr<RenderCanvasPool> canvasPool;
+	shared_ptr<RenderCanvasFactory> canvases;
 	shared_ptr<Configuration> config;
 	shared_ptr<MetaIdentifier> mid;
 	bool empty;
 	bool cached;
+	//! rendering was stopped because all clients disconnected
+	bool aborted;
+	//! generation of the stylesheet used for rendering
+	int generation;
 	//! initialized by initTiles
 	std::vector<shared_ptr<Tile>> tiles;
+	//! results of the query stage
+	shared_ptr<std::vector<NodeId>> nodeIDs;
+	shared_ptr<std::vector<WayId>> wayIDs;
+	shared_ptr<std::vector<RelId>> relationIDs;
+	//! result of the match stage
+	shared_ptr<RenderAttributes> renderAttributes;
 	boost::unordered_map<TileIdentifier, std::list<shared_ptr<HttpRequest>>> requests;
+	//! requests are added by other workers while the job runs
+	boost::mutex requestsMutex;
 
 	//! used to generate statistics
 	shared_ptr<Statistic::JobMeasurement> measurement;
@@ -0,0 +1,110 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef JOB_PIPELINE_HPP
+#define JOB_PIPELINE_HPP
+
+#include "settings.hpp"
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <chrono>
+
+class Configuration;
+class Job;
+class WorkerPool;
+
+/**
+ * @brief Runs the stages of jobs on separate threads, connected by bounded queues.
+ *
+ * The query stage runs on the thread calling process, the other stages have their own
+ * threads. A stage whose queue is full blocks the previous stage, so a slow stage slows
+ * down the stages before it instead of letting jobs pile up.
+ **/
+class JobPipeline
+{
+public:
+	enum Stage
+	{
+		//! geodata queries, run by the workers of the RequestManager
+		Query,
+		//! matching of the stylesheet
+		Match,
+		//! rendering of the metatile
+		Render,
+		//! slicing, encoding and answering the requests
+		Encode,
+		StageCount
+	};
+
+	//! Called when a job leaves the pipeline, has to deliver it
+	typedef boost::function<void(const shared_ptr<Job>&)> Handler;
+
+	struct StageStatistic
+	{
+		std::size_t threads;
+		//! jobs that finished the stage
+		std::size_t processed;
+		//! jobs waiting for the stage
+		std::size_t waiting;
+		//! total time spent in the stage
+		std::chrono::microseconds busy;
+		//! total time jobs waited for the stage
+		std::chrono::microseconds waited;
+	};
+
+	static const char* StageName(Stage stage);
+
+	JobPipeline(const shared_ptr<Configuration>& config);
+	~JobPipeline();
+
+	TESTABLE void process(const shared_ptr<Job>& job, const Handler& finished);
+	TESTABLE void assist(Stage stage, const boost::function<void()>& task);
+	TESTABLE std::size_t getThreadCount(Stage stage) const;
+	TESTABLE void stop();
+	TESTABLE StageStatistic getStatistic(Stage stage) const;
+	TESTABLE void printStatistic() const;
+
+private:
+	struct Queue
+	{
+		scoped_ptr<WorkerPool> workers;
+		//! maximal number of waiting jobs
+		std::size_t capacity;
+		std::size_t waiting;
+		mutable boost::mutex lock;
+		boost::condition_variable notFull;
+
+		std::atomic<std::size_t> processed;
+		std::atomic<int64_t> busy;
+		std::atomic<int64_t> waited;
+	};
+
+	void submit(Stage stage, const shared_ptr<Job>& job, const Handler& finished);
+	void run(Stage stage, const shared_ptr<Job>& job, const Handler& finished, std::chrono::steady_clock::time_point enqueued);
+
+	Queue stages[StageCount];
+	std::atomic<bool> stopped;
+};
+
+#endif
@@ -25,13 +25,27 @@
 #include "settings.hpp"
 #include "server/tile_identifier.hpp"
 
+class Configuration;
+
 /**
  * @brief A MetaIdentifier identifies a set of Tiles that a rendered together
+ *
+ * The number of tiles in x and y direction depends on the zoomlevel and is configured
+ * by Init, by default META_TILE_SIZE on all zoomlevels.
  **/
 class MetaIdentifier : public TileIdentifier
 {
 public:
+	//! Largest allowed metatile size, limits the memory used by the canvases
+	static const int MAX_SIZE = 8;
+
+	static std::vector<int> ParseSizes(const shared_ptr<Configuration>& config);
+	static void Init(const shared_ptr<Configuration>& config);
+	static int Size(int zoom);
+	static int MaxSize();
+
 	static shared_ptr<MetaIdentifier> Create(const shared_ptr<TileIdentifier>& origin);
+	static TileIdentifier Origin(const TileIdentifier& tile);
 	MetaIdentifier(const TileIdentifier& origin);
 
 	TESTABLE int getWidth() const;
@@ -42,6 +56,9 @@ public:
 	TESTABLE void getSubIdentifiers(std::vector<shared_ptr<MetaIdentifier>>& tiles) const;
 
 private:
+	//! metatile size of every zoomlevel
+	static std::vector<int> sizes;
+
 	//! with of the meta tile in tiles
 	int width;
 	//! height of the meta tile in tiles
@@ -0,0 +1,62 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef POPULARITY_TRACKER_HPP
+#define POPULARITY_TRACKER_HPP
+
+#include "settings.hpp"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <vector>
+
+#include "server/tile_identifier.hpp"
+
+class MetaIdentifier;
+
+/**
+ * @brief Counts the requests per metatile, so the most popular ones can be prerendered.
+ *
+ * The counts are seeded from the access log of the previous run and updated for every request.
+ * At most capacity metatiles are counted, when the table is full all counts are halved and
+ * metatiles requested only once are forgotten, so recent requests weigh more.
+ **/
+class PopularityTracker
+{
+public:
+	PopularityTracker(std::size_t capacity);
+
+	TESTABLE void hit(const TileIdentifier& ti);
+	TESTABLE std::size_t load(const string& accessLog, const string& defaultStylesheet);
+	TESTABLE std::vector<shared_ptr<MetaIdentifier>> top(const string& stylesheet, std::size_t count, int minZoom);
+	TESTABLE std::size_t size();
+
+private:
+	void add(const TileIdentifier& ti, uint32_t requests);
+	void decay();
+
+	std::size_t capacity;
+	boost::mutex lock;
+	//! requests per metatile, indexed by the origin of the metatile as png
+	boost::unordered_map<TileIdentifier, uint32_t> hits;
+};
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef PREFETCHER_HPP
+#define PREFETCHER_HPP
+
+#include "settings.hpp"
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <chrono>
+#include <deque>
+
+#include "server/tile_identifier.hpp"
+
+class MetaIdentifier;
+
+/**
+ * @brief Predicts the next metatiles of every client and prefetches them while the workers are idle.
+ *
+ * Requests are grouped into streams by client address and stylesheet. When a stream moves to
+ * another metatile, the next metatile in the direction of the move, the metatile on the zoomlevel
+ * above and the metatiles on the zoomlevel below are prefetched. Only metatiles that were actually
+ * rendered for the prefetcher count as prefetched, not those that were already cached. A prefetched
+ * metatile that is requested later is a hit, one that is forgotten without being requested is wasted.
+ **/
+class Prefetcher
+{
+public:
+	//! Enqueues a metatile to be prefetched, @return false if the queue is full
+	typedef boost::function<bool(const shared_ptr<MetaIdentifier>&)> Submit;
+	//! @return true if no user request waits for a worker
+	typedef boost::function<bool()> Idle;
+
+	struct Statistics
+	{
+		//! metatiles enqueued to be prefetched
+		std::size_t submitted;
+		//! enqueued metatiles that had to be rendered
+		std::size_t prefetched;
+		//! prefetched metatiles requested afterwards
+		std::size_t hits;
+		//! prefetched metatiles forgotten without being requested
+		std::size_t wasted;
+	};
+
+	//! Number of clients that are followed
+	static const std::size_t MAX_STREAMS = 1024;
+	//! Number of prefetched metatiles remembered to detect hits
+	static const std::size_t MAX_PREFETCHED = 4096;
+
+	Prefetcher(const Submit& submit, const Idle& idle);
+
+	TESTABLE void requested(const string& client, const TileIdentifier& ti);
+	TESTABLE void rendered(const TileIdentifier& origin);
+	TESTABLE Statistics getStatistics();
+	TESTABLE void printStatistic();
+
+private:
+	struct Stream
+	{
+		//! origin of the last requested metatile
+		int x, y, zoom;
+		std::chrono::steady_clock::time_point seen;
+	};
+
+	struct Prefetched
+	{
+		//! number of the submission, to find the entry in prefetchOrder
+		std::size_t sequence;
+		//! the metatile was rendered, it was not cached before
+		bool rendered;
+	};
+
+	void predict(const Stream& last, const TileIdentifier& origin, std::vector<shared_ptr<MetaIdentifier>>& next) const;
+	void remember(const TileIdentifier& origin);
+
+	Submit submit;
+	Idle idle;
+
+	boost::mutex lock;
+	//! indexed by client address and stylesheet
+	boost::unordered_map<string, Stream> streams;
+	//! submitted metatiles that were not requested yet
+	boost::unordered_map<TileIdentifier, Prefetched> prefetched;
+	//! oldest prefetch first, entries of requested metatiles are skipped
+	std::deque<std::pair<TileIdentifier, std::size_t>> prefetchOrder;
+	Statistics stats;
+};
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef PRERENDER_CONTROLLER_HPP
+#define PRERENDER_CONTROLLER_HPP
+
+#include "settings.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_set.hpp>
+#include <chrono>
+#include <ctime>
+#include <deque>
+#include <vector>
+
+#include "server/tile_identifier.hpp"
+
+class Configuration;
+class MetaIdentifier;
+
+/**
+ * @brief Prerenders all metatiles of a stylesheet up to the prerender level, zoomlevel by zoomlevel.
+ *
+ * Only a limited number of metatiles is handed to the workers at once, so prerendering uses
+ * at most the configured share of the render threads. It pauses while users wait longer than
+ * the configured latency. The rendered metatiles of every zoomlevel are remembered in a file
+ * <cache path>/<stylesheet>.prerender, so a restarted server continues where it stopped as
+ * long as the stylesheet did not change. Children of metatiles without data are skipped.
+ * Popular metatiles above the prerender level can be given to start, they are rendered first.
+ **/
+class PrerenderController
+{
+public:
+	//! Hands a metatile to the workers, @return false if it can not be enqueued now
+	typedef boost::function<bool(const shared_ptr<MetaIdentifier>&)> Submit;
+	//! @return number of user requests waiting for a worker
+	typedef boost::function<std::size_t()> Backlog;
+
+	PrerenderController(const shared_ptr<Configuration>& config, const Submit& submit, const Backlog& backlog);
+	~PrerenderController();
+
+	TESTABLE void start(const string& stylesheet, std::time_t version, const std::vector<shared_ptr<MetaIdentifier>>& popular = std::vector<shared_ptr<MetaIdentifier>>());
+	TESTABLE void remove(const string& stylesheet);
+	TESTABLE void finished(const shared_ptr<MetaIdentifier>& mid, bool empty);
+	TESTABLE void userRequestStarted(std::chrono::milliseconds waited);
+	TESTABLE void stop();
+
+	TESTABLE bool isPaused();
+	TESTABLE std::size_t getRunning();
+	TESTABLE std::size_t getMaxRunning() const;
+	TESTABLE std::size_t getRendered(const string& stylesheet, int zoom);
+
+private:
+	//! Progress of prerendering one stylesheet
+	struct Walk
+	{
+		string stylesheet;
+		//! modification time of the stylesheet, progress of other versions is discarded
+		std::time_t version;
+		int maxZoom;
+		//! next metatile to render, in rows of the zoomlevel
+		int zoom;
+		std::size_t next;
+		//! metatiles of the current zoomlevel handed to the workers
+		std::size_t running;
+		bool active;
+		std::chrono::steady_clock::time_point started;
+		//! metatiles rendered or skipped, one bitmap per zoomlevel
+		std::vector<std::vector<uint64_t>> rendered;
+		//! metatiles without data, their children are skipped
+		std::vector<std::vector<uint64_t>> empty;
+		std::size_t unsaved;
+		//! metatiles above the prerender level to render before the walk
+		std::deque<shared_ptr<MetaIdentifier>> popular;
+	};
+
+	//! Copy of the progress of a walk that is written without holding the lock
+	struct Checkpoint
+	{
+		string stylesheet;
+		std::time_t version;
+		//! metatile size of every zoomlevel
+		std::vector<int> sizes;
+		std::vector<std::vector<uint64_t>> rendered;
+		std::vector<std::vector<uint64_t>> empty;
+	};
+
+	void release();
+	shared_ptr<MetaIdentifier> nextMetatile(Walk& walk);
+	bool parentHasData(const Walk& walk, int zoom, int x, int y) const;
+	void reset(Walk& walk, std::time_t version);
+	void load(Walk& walk);
+	void checkpoint(Walk& walk);
+	void writeCheckpoints();
+	void save(const Checkpoint& checkpoint) const;
+	boost::filesystem::path progressPath(const string& stylesheet) const;
+
+	shared_ptr<Configuration> config;
+	Submit submit;
+	Backlog backlog;
+	boost::filesystem::path directory;
+	std::size_t maxRunning;
+	std::chrono::milliseconds pauseLatency;
+
+	//! held while progress files are written, taken before the lock
+	boost::mutex saveLock;
+	boost::mutex lock;
+	std::vector<Walk> walks;
+	//! progress to be written once the lock is released
+	std::vector<Checkpoint> checkpoints;
+	//! metatiles handed to the workers, others are not reported to the walks
+	boost::unordered_set<TileIdentifier> running;
+	//! moving average of the time user requests waited for a worker
+	double latency;
+	bool stopped;
+};
+
+#endif
@@ -24,6 +24,9 @@
 #include "settings.hpp"
 
 #include <cairo.h>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "server/tile.hpp"
 
@@ -83,8 +86,16 @@ public:
 	virtual CairoLayer& getSliceLayer() = 0;
 	//! Returns the rendered slice
 	virtual Tile::ImageType copySliceImage() = 0;
+	//! Encodes a part of the metatile without the slice layer, can be called by several threads at once.
+	//! Returns an empty image if the format has to be sliced.
+	virtual Tile::ImageType encodeTile(int x, int y, int width, int height) { return Tile::ImageType(); }
 };
 
+/**
+ * @brief Creates the canvases of every format and metatile size when they are first used.
+ *
+ * Not thread-safe, a factory is used by one job at a time.
+ **/
 class RenderCanvasFactory
 {
 public:
@@ -93,27 +104,31 @@ public:
 	/**
 	 * Returns an empty shared_ptr if format is not supported.
 	 */
-	shared_ptr<RenderCanvas> getCanvas(TileIdentifier::Format type)
-	{
-		shared_ptr<RenderCanvas> canvas;
-		switch(type)
-		{
-			case TileIdentifier::Format::PNG:
-				canvas = pngCanvas;
-				break;
-			case TileIdentifier::Format::SVG:
-				canvas = svgCanvas;
-				break;
-			default:
-				break;
-		}
-
-		return canvas;
-	}
+	shared_ptr<RenderCanvas> getCanvas(TileIdentifier::Format type, int metaTileSize = META_TILE_SIZE);
 
 private:
-	shared_ptr<RenderCanvas> svgCanvas;
-	shared_ptr<RenderCanvas> pngCanvas;
+	boost::unordered_map<int, shared_ptr<RenderCanvas>> svgCanvases;
+	boost::unordered_map<int, shared_ptr<RenderCanvas>> pngCanvases;
+};
+
+/**
+ * @brief Lends canvas factories to jobs, which keep them from rendering until their tiles are sliced.
+ **/
+class RenderCanvasPool : public boost::enable_shared_from_this<RenderCanvasPool>
+{
+public:
+	RenderCanvasPool(std::size_t size);
+
+	shared_ptr<RenderCanvasFactory> acquire();
+	std::size_t getSize() const;
+
+private:
+	void release(RenderCanvasFactory* factory);
+
+	std::vector<shared_ptr<RenderCanvasFactory>> factories;
+	std::vector<RenderCanvasFactory*> available;
+	boost::mutex lock;
+	boost::condition_variable released;
 };
 
 #endif
@@ -46,6 +46,17 @@ class AssetCache;
 class RenderCanvas;
 struct CairoLayer;
 
+//! Area of a metatile on the canvas and of its neighbours, used to place labels
+struct MetaTileBounds
+{
+	MetaTileBounds(double size);
+
+	FloatRect area;
+	FloatRect neighbours[8];
+	//! neighbours including the overlap queried for them
+	FloatRect neighbourRequests[8];
+};
+
 class Renderer
 {
 public:
@@ -54,24 +65,24 @@ public:
 	TESTABLE void renderEmptyTile(RenderAttributes& map, const shared_ptr<RenderCanvas>& canvas, const shared_ptr<Tile>& tile);
 	TESTABLE void renderMetaTile(RenderAttributes& map,  const shared_ptr<RenderCanvas>& canvas, const shared_ptr<MetaIdentifier>& id);
 	TESTABLE void sliceTile(const shared_ptr<RenderCanvas>& canvas, const shared_ptr<MetaIdentifier>& id, const shared_ptr<Tile>& tile) const;
+	TESTABLE bool encodeTile(const shared_ptr<RenderCanvas>& canvas, const shared_ptr<MetaIdentifier>& id, const shared_ptr<Tile>& tile) const;
 
 protected:
 	void placeLabels(const std::list<shared_ptr<Label> >& labels,
-					 std::vector<shared_ptr<Label> >& placed);
+					 std::vector<shared_ptr<Label> >& placed,
+					 const MetaTileBounds& bounds);
 	void placeShields(const std::list<shared_ptr<Shield> >& shields,
-					 std::vector<shared_ptr<Shield> >& placed);
+					 std::vector<shared_ptr<Shield> >& placed,
+					 const MetaTileBounds& bounds);
 
 private:
 
 	//! stores the actual data
 	const shared_ptr<Geodata> data;
-	FloatRect bounds;
-	FloatRect neighbours[8];
-	FloatRect neighbourRequests[8];
 
 	void printTileId(cairo_t* cr, const shared_ptr<TileIdentifier>& id) const;
 	void sortObjects(RenderAttributes& map, std::vector<NodeId>& nodes, std::vector<WayId>& ways, std::vector<RelId>& relations) const;
-	bool isCutOff(const FloatRect& box, const FloatRect& owner);
+	bool isCutOff(const FloatRect& box, const FloatRect& owner, const MetaTileBounds& bounds);
 	void compositeLayers(CairoLayer* layers) const;
 	void paintBackground(CairoLayer& layer, const Style* canvasStyle) const;
 	void renderObjects(CairoLayer* layers, RenderAttributes& map, const cairo_matrix_t* transform,
@@ -84,6 +95,7 @@ private:
 	void renderArea(const FixedRect& area,
 					const shared_ptr<RenderCanvas>& canvas,
 					double width, double height,
+					const MetaTileBounds& bounds,
 					RenderAttributes& map,
 					AssetCache& cache);
 
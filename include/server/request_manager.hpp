@@ -23,10 +23,14 @@
 
 
 #include <chrono>
+#include <ctime>
 #include <boost/asio.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/unordered_set.hpp>
 
 #include "server/job.hpp"
+#include "server/request_scheduler.hpp"
+#include "utils/rect.hpp"
 
 #include "settings.hpp"
 
@@ -37,7 +41,13 @@ class Geodata;
 class StylesheetManager;
 class HttpRequest;
 class TileIdentifier;
-class RenderCanvasFactory;
+class RenderCanvasPool;
+class EmptyMetatileMap;
+class WorkerPool;
+class JobPipeline;
+class PrerenderController;
+class PopularityTracker;
+class Prefetcher;
 
 class RequestManager : public boost::enable_shared_from_this<RequestManager>
 {
@@ -48,16 +58,33 @@ public:
 	void stop();
 
 	TESTABLE void enqueue(const shared_ptr<HttpRequest>& r);
-	TESTABLE void enqueue(const shared_ptr<MetaIdentifier>& ti);
+	TESTABLE void enqueue(const shared_ptr<MetaIdentifier>& ti, bool recursive = true);
+	TESTABLE bool prefetch(const shared_ptr<MetaIdentifier>& ti);
+	TESTABLE void prerender(const string& stylesheet, std::time_t version);
+	TESTABLE void cancelPrerendering(const string& stylesheet);
+	TESTABLE std::size_t invalidate(const FixedRect& area, int minZoom, int maxZoom, const string& stylesheet = "", bool rerender = true);
+	TESTABLE std::size_t invalidate(const FloatRect& bounds, int minZoom, int maxZoom, const string& stylesheet = "", bool rerender = true);
 	TESTABLE shared_ptr<Geodata> getGeodata() const;
 	TESTABLE shared_ptr<StylesheetManager> getStylesheetManager() const;
 	TESTABLE shared_ptr<Cache> getCache() const;
 	TESTABLE shared_ptr<Renderer> getRenderer() const;
+	TESTABLE EmptyMetatileMap& getEmptyMetatiles() const;
+	TESTABLE JobPipeline& getPipeline() const;
 
 private:
 	void processNextRequest();
-	bool nextUserRequest();
-	bool nextPreRenderRequest();
+	void processUserRequest(const RequestScheduler::Task& task);
+	void processPreRenderRequest(const RequestScheduler::Task& task);
+	void finishUserJob(const shared_ptr<Job>& job);
+	void finishPreRenderJob(const shared_ptr<Job>& job, const RequestScheduler::Task& task);
+	void prerendered(const RequestScheduler::Task& task, bool empty);
+	bool isCached(const shared_ptr<MetaIdentifier>& mid);
+	bool answerFromCache(const shared_ptr<HttpRequest>& req, const shared_ptr<TileIdentifier>& ti);
+	bool answerWithoutRendering(const shared_ptr<HttpRequest>& req, const shared_ptr<TileIdentifier>& ti, bool expired);
+	void drop(const shared_ptr<HttpRequest>& req, const shared_ptr<TileIdentifier>& ti, bool expired);
+	void drop(const RequestScheduler::Task& task);
+	void dispatch();
+	void revalidate(const shared_ptr<MetaIdentifier>& mid);
 
 private:
 	shared_ptr<Geodata> data;
@@ -66,25 +93,36 @@ private:
 	shared_ptr<StylesheetManager> ssm;
 	shared_ptr<Configuration> config;
 
-	boost::asio::io_service jobPool;
-	boost::asio::io_service::work preventStop;
-	std::vector< shared_ptr<boost::thread> > workers;
+	//! runs processNextRequest once for every enqueued request, and the query stage of its job
+	scoped_ptr<WorkerPool> workers;
+	//! runs the remaining stages of jobs
+	scoped_ptr<JobPipeline> pipeline;
 
-	std::queue<shared_ptr<RenderCanvasFactory>> factories;
-	boost::mutex factoriesMutex;
+	//! metatiles known to contain no data
+	scoped_ptr<EmptyMetatileMap> emptyMetatiles;
 
-	boost::mutex userRJMutex;
-	boost::mutex preRJMutex;
-	std::queue< shared_ptr<HttpRequest> > userRequests;
-	std::queue< shared_ptr<MetaIdentifier> > preRenderRequests;
+	//! canvases borrowed by jobs from rendering until their tiles are sliced
+	shared_ptr<RenderCanvasPool> canvases;
 
-	//! thread-safe queue of running jobs
-	class RunningQueue;
-	scoped_ptr<RunningQueue> running;
+	//! requests waiting for a worker
+	scoped_ptr<RequestScheduler> scheduler;
 
-	unsigned int currentPrerenderingThreads;
+	//! prerenders the metatiles of the stylesheets
+	scoped_ptr<PrerenderController> prerenderer;
+	//! requests per metatile, null if popular metatiles are not prerendered
+	scoped_ptr<PopularityTracker> popularity;
+	//! prefetches the metatiles clients will request next, null if disabled
+	scoped_ptr<Prefetcher> prefetcher;
 
-	std::chrono::system_clock::time_point prerender_start, prerender_stop;
+	//! how long stale tiles are served while they are rendered again
+	std::chrono::steady_clock::duration maxStaleness;
+	boost::mutex revalidatingMutex;
+	//! metatiles with stale tiles that are enqueued to be rendered again
+	boost::unordered_set<TileIdentifier> revalidating;
+
+	//! metatiles that are queued or rendered, indexed by their origin
+	class InFlightTable;
+	scoped_ptr<InFlightTable> inFlight;
 };
 
 
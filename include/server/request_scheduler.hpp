@@ -0,0 +1,121 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef REQUEST_SCHEDULER_HPP
+#define REQUEST_SCHEDULER_HPP
+
+#include "settings.hpp"
+
+#include <boost/thread/mutex.hpp>
+#include <chrono>
+#include <vector>
+
+class Configuration;
+class HttpRequest;
+class TileIdentifier;
+class MetaIdentifier;
+
+/**
+ * @brief Orders the requests waiting for a worker in separate bounded lanes.
+ *
+ * Interactive requests are served before prefetching and prefetching before prerendering.
+ * Inside a lane, the policy decides which request comes next. Requests that waited longer
+ * than the deadline of their lane are returned as expired instead of being processed.
+ **/
+class RequestScheduler
+{
+public:
+	enum Lane
+	{
+		//! requests of users, answered as soon as possible
+		Interactive,
+		//! tiles that will probably be requested soon
+		Prefetch,
+		//! tiles rendered in advance or again after they became stale
+		Prerender,
+		LaneCount
+	};
+
+	enum Policy
+	{
+		//! oldest request first
+		Fifo,
+		//! newest request first, tiles the user panned away from wait
+		Lifo,
+		//! lowest zoomlevel first, the newest request on the same zoomlevel
+		ByZoom
+	};
+
+	struct Task
+	{
+		Lane lane;
+		//! request to answer, only for interactive tasks
+		shared_ptr<HttpRequest> request;
+		//! requested tile, only for interactive tasks
+		shared_ptr<TileIdentifier> tile;
+		//! metatile to render, only for prefetch and prerender tasks
+		shared_ptr<MetaIdentifier> meta;
+		//! the children up to the prerender level are enqueued after the metatile
+		bool recursive;
+		//! the task waited longer than the deadline and should be dropped
+		bool expired;
+
+		int zoom;
+		std::size_t sequence;
+		std::chrono::steady_clock::time_point enqueued;
+	};
+
+	static Policy ParsePolicy(const string& name);
+
+	RequestScheduler(const shared_ptr<Configuration>& config);
+
+	TESTABLE void setLane(Lane lane, Policy policy, std::size_t capacity, std::chrono::milliseconds deadline);
+	TESTABLE bool push(const shared_ptr<HttpRequest>& request, const shared_ptr<TileIdentifier>& tile);
+	TESTABLE bool push(Lane lane, const shared_ptr<MetaIdentifier>& meta, bool recursive = false);
+	TESTABLE bool pop(Task& task);
+	TESTABLE std::size_t size(Lane lane);
+
+private:
+	//! Comparison for the heap of a lane, true if a is processed after b.
+	struct Later
+	{
+		Policy policy;
+		bool operator()(const Task& a, const Task& b) const;
+	};
+
+	struct Queue
+	{
+		Later order;
+		//! maximal number of waiting tasks, 0 for no limit
+		std::size_t capacity;
+		//! maximal time a task may wait, 0 to wait forever
+		std::chrono::milliseconds deadline;
+		std::vector<Task> heap;
+	};
+
+	bool insert(Task& task);
+
+	boost::mutex lock;
+	Queue lanes[LaneCount];
+	std::size_t sequence;
+};
+
+#endif
@@ -27,6 +27,7 @@
 #include <boost/unordered_map.hpp>
 #include "../extras/dirwatch/dir_monitor.hpp"
 #include <boost/filesystem/path.hpp>
+#include <ctime>
 
 #include "settings.hpp"
 
@@ -39,8 +40,8 @@ namespace fs = boost::filesystem;
 
 /**
  * The StylesheetManager provides an interface to get arbitrary Stylesheets from the stylesheet directory.
- * Additionally, it observes the stylesheet directory for changes to prerender new stylesheets, and
- * drop deleted ones off the Cache.
+ * Additionally, it observes the stylesheet directory for changes to prerender new stylesheets,
+ * mark the tiles of changed ones as stale and drop deleted ones off the Cache.
  */
 class StylesheetManager
 	: public boost::enable_shared_from_this<StylesheetManager>
@@ -57,7 +58,8 @@ public:
 	/**
 	 * @brief starts observing the Stylesheet directory.
 	 * On new or changed stylesheet files, the Tiles to prerender get enqueued in the RequestManager. 
-	 * On changed or deleted stylesheet files, the Cache gets notified to drop the cached Tiles.
+	 * On changed stylesheet files, the cached Tiles are marked as stale,
+	 * on deleted stylesheet files, the Cache gets notified to drop the cached Tiles.
 	 * 
 	 * @param manager the RequestManager to use to enqueue new Tiles to prerender
 	 */
@@ -79,15 +81,43 @@ public:
 	TESTABLE shared_ptr<Stylesheet> getStylesheet(const string& path);
 	TESTABLE bool hasStylesheet(const string& path);
 
+	/**
+	 * @brief Returns the generation of the Stylesheet specified, which is increased whenever it changes.
+	 *
+	 * Tiles rendered with an older generation are stale.
+	 *
+	 * @param path path of the stylesheet
+	 * @return the generation, 0 for stylesheets that never changed
+	 */
+	TESTABLE int getGeneration(const string& path);
+
 private:
+	/**
+	 * @brief tries to read and parse the given file, logs errors.
+	 * @return the Stylesheet or a null pointer if parsing failed.
+	 */
+	TESTABLE shared_ptr<Stylesheet> parseStylesheet(const fs::path& stylesheet_path);
+
+	/**
+	 * @return the modification time of the stylesheet, prerendering continues only for the same version.
+	 */
+	TESTABLE std::time_t getVersion(const fs::path& stylesheet_path);
+
 	/**
 	 * @brief tries to read and parse the given file.
-	 * 			If that succeeds, saves it in the Stylesheet Cache and enqueues it for prerendering.
+	 * 			If that succeeds, saves it in the Stylesheet Cache and starts or continues prerendering it.
 	 */
 	TESTABLE void onNewStylesheet(const fs::path& stylesheet_path);
 
 	/**
-	 * @brief removes the Stylesheet from the Stylesheet Cache and the prerendered tiles from the Cache.
+	 * @brief replaces the Stylesheet if the changed file can be parsed and marks its Tiles in the Cache as stale.
+	 * 			The stale Tiles are served until they are rendered again, prerendering starts from the beginning.
+	 */
+	TESTABLE void onModifiedStylesheet(const fs::path& stylesheet_path);
+
+	/**
+	 * @brief removes the Stylesheet from the Stylesheet Cache and the prerendered tiles from the Cache,
+	 * 			prerendering stops.
 	 */
 	TESTABLE void onRemovedStylesheet(const fs::path& stylesheet_path);
 
@@ -102,6 +132,7 @@ private:
 
 	boost::shared_mutex stylesheetsLock;
 	boost::unordered_map<fs::path, shared_ptr<Stylesheet> > parsedStylesheets;
+	boost::unordered_map<fs::path, int> generations;
 
 	fs::path stylesheetFolder;
 
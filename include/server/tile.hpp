@@ -24,6 +24,9 @@
 
 #include "settings.hpp"
 
+#include <atomic>
+#include <chrono>
+
 class TileIdentifier;
 class Cache;
 
@@ -37,11 +40,19 @@ public:
 	TESTABLE bool isRendered() const;
 	TESTABLE const ImageType& getImage() const;
 	TESTABLE void setImage(const ImageType& image);
+	TESTABLE bool isStale() const;
+	TESTABLE void markStale();
+	TESTABLE std::chrono::steady_clock::duration getStaleness() const;
 	TESTABLE const shared_ptr<TileIdentifier>& getIdentifier() const;
 
 private:
 	//! Pointer to a memory block, which contains the rendered Image.
+	//! Not changed once the Tile is in the cache, a new image is stored in a new Tile.
 	ImageType image;
+	//! The image no longer matches the data or the stylesheet and has to be rendered again.
+	std::atomic<bool> stale;
+	//! When the tile was marked as stale, in ticks of the steady clock.
+	std::atomic<std::chrono::steady_clock::rep> staleSince;
 	//! TileIdentifier which identifies this Tile.
 	const shared_ptr<TileIdentifier> id;
 };
@@ -0,0 +1,167 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef TILE_STORE_HPP
+#define TILE_STORE_HPP
+
+#include "settings.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <vector>
+
+#include "server/tile.hpp"
+
+class TileIdentifier;
+class ImagePool;
+
+/**
+ * @brief Keeps rendered tiles on the hard drive.
+ *
+ * Files are written into a temporary file first and renamed when they are complete,
+ * so reading a tile never sees a partially written file. Files containing only images
+ * that the ImagePool found several times are hard links to one file in <stylesheet>/shared.
+ * Invalidated files are renamed to <file>.stale and are only read if no fresh file exists.
+ * A stale file is deleted as soon as a fresh file contains all of its tiles.
+ **/
+class TileStore
+{
+public:
+	//! When written files are flushed to the disk
+	enum SyncPolicy
+	{
+		//! leave it to the operating system
+		SyncNever,
+		//! after each call to write
+		SyncBatch,
+		//! after each file
+		SyncAlways
+	};
+
+	static SyncPolicy ParsePolicy(const string& name);
+	static shared_ptr<TileStore> Create(const string& layout, const string& path, SyncPolicy policy, const shared_ptr<ImagePool>& pool = shared_ptr<ImagePool>());
+
+	TileStore(const string& path, SyncPolicy policy, const shared_ptr<ImagePool>& pool);
+	virtual ~TileStore();
+
+	/**
+	 * @brief Reads the image of a tile.
+	 *
+	 * @param stale set to true if the image was invalidated.
+	 * @return the image or a null pointer if the tile is not stored.
+	 **/
+	virtual Tile::ImageType read(const TileIdentifier& ti, bool* stale = nullptr) = 0;
+	/**
+	 * @brief Stores the images of the given tiles, tiles that are not rendered or stale are skipped.
+	 **/
+	virtual void write(const std::vector<shared_ptr<Tile>>& tiles) = 0;
+	virtual void remove(const string& stylesheet);
+	/**
+	 * @brief Marks the stored tiles of a stylesheet in the range [x0, x1] x [y0, y1] as stale.
+	 *
+	 * Only the directories of the range that exist are visited.
+	 * @return the first tile of every file that was marked.
+	 **/
+	virtual std::vector<TileIdentifier> markStale(const string& stylesheet, int zoom, int x0, int y0, int x1, int y1) = 0;
+	TESTABLE std::size_t markAllStale(const string& stylesheet);
+
+	TESTABLE std::size_t getLinkedFiles() const;
+
+protected:
+	//! File that is written but not yet moved to its place
+	struct PendingFile
+	{
+		boost::filesystem::path path;
+		int fd;
+		//! file with the same content to link to, empty if the file is not shared
+		boost::filesystem::path shared;
+		//! true if the file replaces all tiles of its stale file
+		bool dropStale;
+	};
+
+	std::vector<std::pair<int, boost::filesystem::path>> listFiles(const string& stylesheet, int zoom, int x0, int x1) const;
+	boost::filesystem::path getSharedPath(const TileIdentifier& ti, std::size_t hash, const string& extension) const;
+	bool isDuplicate(const Tile::ImageType& image) const;
+	bool beginFile(const boost::filesystem::path& path, PendingFile& file);
+	bool append(PendingFile& file, const void* data, std::size_t size);
+	void commitFiles(std::vector<PendingFile>& files);
+	bool renameStale(const boost::filesystem::path& file);
+
+	const boost::filesystem::path path;
+	const SyncPolicy policy;
+	const shared_ptr<ImagePool> pool;
+	//! held while files are rewritten or marked stale, so an invalidation is never overwritten
+	boost::mutex lock;
+
+private:
+	void linkShared(PendingFile& file, const boost::filesystem::path& tmp);
+
+	std::atomic<std::size_t> linkedFiles;
+};
+
+/**
+ * @brief Stores every tile in its own file at <path>/<stylesheet>/<z>/<x>/<y>.<format>.
+ **/
+class FileTileStore : public TileStore
+{
+public:
+	FileTileStore(const string& path, SyncPolicy policy, const shared_ptr<ImagePool>& pool = shared_ptr<ImagePool>());
+
+	virtual Tile::ImageType read(const TileIdentifier& ti, bool* stale = nullptr);
+	virtual void write(const std::vector<shared_ptr<Tile>>& tiles);
+	virtual std::vector<TileIdentifier> markStale(const string& stylesheet, int zoom, int x0, int y0, int x1, int y1);
+
+	TESTABLE boost::filesystem::path getTilePath(const TileIdentifier& ti) const;
+
+private:
+	Tile::ImageType readFile(const boost::filesystem::path& file);
+};
+
+/**
+ * @brief Stores the tiles of a metatile together in one bundle file.
+ *
+ * A bundle at <path>/<stylesheet>/<z>/<x / BUNDLE_SIZE>/<y / BUNDLE_SIZE>.<format>.bundle
+ * starts with a header containing the magic "ACTB", the version and the number of entries,
+ * followed by offset and size of every tile (all 32 bit, native byte order) and the image data.
+ * Missing tiles have a size of 0, identical tiles point to the same data.
+ **/
+class BundleTileStore : public TileStore
+{
+public:
+	//! Number of tiles in x and y direction stored in one bundle, independent of the metatile size
+	static const int BUNDLE_SIZE = 4;
+
+	BundleTileStore(const string& path, SyncPolicy policy, const shared_ptr<ImagePool>& pool = shared_ptr<ImagePool>());
+
+	virtual Tile::ImageType read(const TileIdentifier& ti, bool* stale = nullptr);
+	virtual void write(const std::vector<shared_ptr<Tile>>& tiles);
+	virtual std::vector<TileIdentifier> markStale(const string& stylesheet, int zoom, int x0, int y0, int x1, int y1);
+
+	TESTABLE boost::filesystem::path getBundlePath(const TileIdentifier& ti) const;
+
+private:
+	static int getIndex(const TileIdentifier& ti);
+	Tile::ImageType readEntry(const boost::filesystem::path& bundle, int index);
+	void readBundle(const boost::filesystem::path& bundle, std::vector<Tile::ImageType>& images);
+};
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef TILE_WRITER_HPP
+#define TILE_WRITER_HPP
+
+#include "settings.hpp"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <deque>
+
+#include "server/tile_identifier.hpp"
+
+class Tile;
+class TileStore;
+
+/**
+ * @brief Writes evicted tiles to the hard drive on a background thread.
+ *
+ * Tiles stay readable via find() until they were written. If the queue is full
+ * the write of the tile with the highest zoomlevel is dropped, as it is the
+ * cheapest to render again.
+ **/
+class TileWriter
+{
+public:
+	TileWriter(const shared_ptr<TileStore>& store, std::size_t queueSize, std::size_t batchSize);
+	~TileWriter();
+
+	TESTABLE bool enqueue(const shared_ptr<Tile>& tile);
+	TESTABLE shared_ptr<Tile> find(const TileIdentifier& ti);
+	TESTABLE void discard(const string& stylesheet);
+	TESTABLE void flush();
+	TESTABLE std::size_t getDroppedCount();
+
+private:
+	void run();
+	bool dropLeastValuable(int zoom);
+
+	const shared_ptr<TileStore> store;
+	const std::size_t queueSize;
+	const std::size_t batchSize;
+
+	boost::mutex lock;
+	boost::condition_variable queueChanged;
+	boost::condition_variable batchDone;
+	//! order in which the tiles are written
+	std::deque<TileIdentifier> queue;
+	//! tiles that are queued or currently written
+	boost::unordered_map<TileIdentifier, shared_ptr<Tile>> pending;
+	bool writing;
+	bool stopped;
+	std::size_t dropped;
+	boost::thread thread;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+#pragma once
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include "settings.hpp"
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+/**
+ * @brief Runs tasks on a fixed number of threads, each with its own queue.
+ *
+ * Tasks posted by a worker are put into its own queue, other tasks are distributed round-robin.
+ * A worker takes the newest task of its own queue and steals the oldest task of another
+ * queue when its own is empty.
+ **/
+class WorkerPool
+{
+public:
+	typedef boost::function<void()> Task;
+
+	//! Index of the worker running the calling thread, -1 for other threads.
+	static int CurrentWorker();
+
+	WorkerPool(std::size_t threads);
+	~WorkerPool();
+
+	TESTABLE void post(const Task& task);
+	TESTABLE void stop();
+	TESTABLE std::size_t getThreadCount() const;
+
+private:
+	struct Queue
+	{
+		boost::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	void run(std::size_t index);
+	bool take(std::size_t index, Task& task);
+
+	std::vector<shared_ptr<Queue>> queues;
+	std::vector<shared_ptr<boost::thread>> threads;
+	//! queue for the next task posted from outside of the pool
+	std::atomic<std::size_t> next;
+	//! number of tasks in all queues
+	std::atomic<std::size_t> pending;
+	//! number of workers waiting for tasks
+	std::atomic<std::size_t> sleeping;
+	std::atomic<bool> stopped;
+	boost::mutex idleMutex;
+	boost::condition_variable wakeUp;
+};
+
+#endif
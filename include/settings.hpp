@@ -127,7 +127,9 @@ typedef std::int32_t	coord_t;
 #define DEFAULT_CONFIG_NAME "alacarte-maps.conf"
 
 #define DEFAULT_FONT "DejaVu Sans"
-#define TILE_OVERLAP (1.0/META_TILE_SIZE * 0.25)
+//! Border around a metatile in tiles, objects in it may reach into the metatile
+#define TILE_OVERLAP 0.25
+//! Default number of tiles in x and y direction of a metatile, see MetaIdentifier::Size
 #define META_TILE_SIZE 4
 #define ALAC_ZOOM_BOTTOM 0
 #define ALAC_ZOOM_TOP 18
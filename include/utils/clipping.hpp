@@ -0,0 +1,39 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Tobias Kahlert
+ */
+
+#pragma once
+#ifndef CLIPPING_HPP
+#define CLIPPING_HPP
+
+#include "settings.hpp"
+
+//! Vertex of a clipped polygon
+struct ClippedVertex
+{
+	FloatPoint location;
+	//! index of the vertex in the input polygon or -1 if the vertex was created by clipping
+	int source;
+};
+
+bool segmentIntersectsRect(const FloatPoint& a, const FloatPoint& b, const FloatRect& rect);
+bool polygonContains(const std::vector<FloatPoint>& ring, const FloatPoint& p);
+void clipPolygon(const std::vector<FloatPoint>& ring, const FloatRect& rect, std::vector<ClippedVertex>& result);
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Tobias Kahlert
+ */
+
+#pragma once
+#ifndef DECOMPRESSING_STREAM_HPP
+#define DECOMPRESSING_STREAM_HPP
+
+#include "settings.hpp"
+
+#include <atomic>
+#include <istream>
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "utils/ring_buffer.hpp"
+
+/**
+ * @brief Input stream decompressing a gzip or bzip2 file on a separate thread.
+ *
+ * A producer thread reads and decompresses the file and feeds the result
+ * through a lock-free RingBuffer, so decompression overlaps with whatever the
+ * consumer does with the data (e.g. xml parsing). A thread finding the buffer
+ * full or empty spins briefly and then sleeps until the other one made progress.
+ **/
+class DecompressingStream : public std::istream
+{
+public:
+	enum Compression
+	{
+		None,
+		Gzip,
+		Bzip2
+	};
+
+	static Compression DetectCompression(const boost::filesystem::path& file);
+
+	DecompressingStream(const boost::filesystem::path& file, Compression compression, std::size_t bufferSize = 16 * 1024 * 1024);
+	~DecompressingStream();
+
+	//! Number of compressed bytes consumed from the file so far.
+	std::uintmax_t getCompressedBytesRead() const { return buf.compressedRead.load(std::memory_order_relaxed); }
+	//! Returns the error of the producer thread or an empty string.
+	string getError() const;
+
+private:
+	class StreamBuf : public std::streambuf
+	{
+	public:
+		StreamBuf(std::size_t bufferSize);
+
+		void produce(const boost::filesystem::path& file, Compression compression);
+		void notify();
+
+		RingBuffer<char> ring;
+		std::atomic<std::uintmax_t> compressedRead;
+		std::atomic<bool> cancelled;
+		std::atomic<bool> failed;
+		string error;
+
+	protected:
+		virtual int_type underflow();
+
+	private:
+		void waitUntil(const boost::function<bool()>& ready);
+
+		std::vector<char> readArea;
+		//! number of threads sleeping until the other one made progress
+		std::atomic<std::size_t> sleeping;
+		boost::mutex waitMutex;
+		boost::condition_variable changed;
+	};
+
+	StreamBuf buf;
+	boost::thread producer;
+};
+
+#endif
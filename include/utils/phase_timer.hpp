@@ -0,0 +1,69 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Tobias Kahlert
+ */
+
+#pragma once
+#ifndef PHASE_TIMER_HPP
+#define PHASE_TIMER_HPP
+
+#include "settings.hpp"
+
+#include <chrono>
+#include <boost/noncopyable.hpp>
+
+/**
+ * @brief Measures the duration, throughput and peak memory of consecutive phases of a batch process.
+ *
+ * Used by the importer to find out which step of an import is the bottleneck.
+ **/
+class PhaseTimer : private boost::noncopyable
+{
+public:
+	typedef std::chrono::steady_clock clock;
+
+	struct Phase
+	{
+		string name;
+		double seconds;
+		//! number of objects processed, 0 if not applicable
+		uint64_t objects;
+		//! peak resident set size in bytes while the phase was running, 0 if unknown
+		std::size_t peakRss;
+	};
+
+	void start(const string& name);
+	void stop(uint64_t objects = 0);
+	void add(const string& name, double seconds, uint64_t objects);
+
+	const std::vector<Phase>& getPhases() const { return phases; }
+	double getTotalSeconds() const;
+
+	void log() const;
+	void writeSummary(std::ostream& out) const;
+
+	static std::size_t PeakResidentSetSize();
+	static void ResetPeakResidentSetSize();
+
+private:
+	std::vector<Phase> phases;
+	string runningPhase;
+	clock::time_point startTime;
+};
+
+#endif
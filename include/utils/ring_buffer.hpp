@@ -0,0 +1,122 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Tobias Kahlert
+ */
+
+#pragma once
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include "settings.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+
+/**
+ * @brief Lock-free ring buffer for exactly one producer and one consumer thread.
+ *
+ * The producer may only call push() and close(), the consumer only pop().
+ * Both calls never block, they transfer as many elements as currently possible.
+ **/
+template<typename T>
+class RingBuffer : private boost::noncopyable
+{
+public:
+	/**
+	 * @brief Creates a new buffer
+	 *
+	 * @param capacity minimal number of elements the buffer can hold, rounded up to a power of two
+	 **/
+	explicit RingBuffer(std::size_t capacity)
+		: head(0)
+		, tail(0)
+		, closed(false)
+	{
+		std::size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		buffer.resize(size);
+		mask = size - 1;
+	}
+
+	/**
+	 * @brief Copies up to count elements into the buffer. Producer only.
+	 *
+	 * @return number of elements actually copied
+	 **/
+	std::size_t push(const T* data, std::size_t count)
+	{
+		const std::size_t h = head.load(std::memory_order_relaxed);
+		const std::size_t t = tail.load(std::memory_order_acquire);
+		count = std::min(count, buffer.size() - (h - t));
+
+		for (std::size_t i = 0; i < count; ++i)
+			buffer[(h + i) & mask] = data[i];
+
+		head.store(h + count, std::memory_order_release);
+		return count;
+	}
+
+	/**
+	 * @brief Moves up to count elements out of the buffer. Consumer only.
+	 *
+	 * @return number of elements actually copied to dest
+	 **/
+	std::size_t pop(T* dest, std::size_t count)
+	{
+		const std::size_t t = tail.load(std::memory_order_relaxed);
+		const std::size_t h = head.load(std::memory_order_acquire);
+		count = std::min(count, h - t);
+
+		for (std::size_t i = 0; i < count; ++i)
+			dest[i] = buffer[(t + i) & mask];
+
+		tail.store(t + count, std::memory_order_release);
+		return count;
+	}
+
+	//! Signals the consumer that no more data will be pushed.
+	void close() { closed.store(true, std::memory_order_release); }
+
+	//! True if the producer has finished and all data was consumed.
+	bool isDrained() const
+	{
+		return closed.load(std::memory_order_acquire)
+			&& head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+	//! Number of elements currently in the buffer, may be outdated as soon as it is returned.
+	std::size_t size() const
+	{
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+	std::size_t capacity() const { return buffer.size(); }
+
+private:
+	std::vector<T> buffer;
+	std::size_t mask;
+	//! total number of elements ever pushed (written by producer only)
+	std::atomic<std::size_t> head;
+	//! total number of elements ever popped (written by consumer only)
+	std::atomic<std::size_t> tail;
+	std::atomic<bool> closed;
+};
+
+#endif
@@ -19,6 +19,9 @@
  */
 
 
+#include <fstream>
+#include <sstream>
+
 #include "config.hpp"
 #include "settings.hpp"
 
@@ -29,6 +32,8 @@
 
 #include "importer/importer.hpp"
 
+#include "utils/phase_timer.hpp"
+
 
 
 
@@ -68,6 +73,9 @@ public:
 			(opt::importer::min_lon, value<double>(), "minimum node longitude")
 			(opt::importer::max_lat, value<double>(), "maximum node latitude")
 			(opt::importer::max_lon, value<double>(), "maximum node longitude")
+			(opt::importer::clip_polygons, value<bool>()->default_value(false), "clip closed ways like coastlines at the bounds plus margin")
+			(opt::importer::clip_margin, value<double>()->default_value(0.01), "margin in degrees kept around the bounds when clipping closed ways")
+			(opt::importer::stats_file, value<string>(), "file to write a JSON summary of the import phases to")
 			;
 
 
@@ -105,7 +113,21 @@ protected:
 			return;
 		}
 
-		geodata->save(config->get<string>(opt::importer::path_to_geodata));
+		const shared_ptr<PhaseTimer>& timer = importer->getPhaseTimer();
+		geodata->save(config->get<string>(opt::importer::path_to_geodata), timer.get());
+
+		timer->log();
+		std::ostringstream summary;
+		timer->writeSummary(summary);
+		LOG_SEV(importer_log, info) << "Summary: " << summary.str();
+
+		if (config->has(opt::importer::stats_file))
+		{
+			std::ofstream statsFile(config->get<string>(opt::importer::stats_file));
+			statsFile << summary.str() << std::endl;
+			if (!statsFile)
+				LOG_SEV(importer_log, error) << "Could not write \"" << config->get<string>(opt::importer::stats_file) << "\"";
+		}
 	}
 
 };
@@ -33,6 +33,7 @@
 
 #include "server/cache.hpp"
 #include "server/http_server.hpp"
+#include "server/meta_identifier.hpp"
 #include "server/renderer/renderer.hpp"
 #include "server/request_manager.hpp"
 #include "server/stylesheet_manager.hpp"
@@ -78,15 +79,41 @@ public:
 			(OPT(opt::server::path_to_default_style, "d"),	value<string>()->default_value("default"),										"default stylesheet")
 			(OPT(opt::server::path_to_default_tile, "t"),	value<string>()->default_value("default.png")/*->value_name("image")*/,			"default tile")
 			(OPT(opt::server::num_threads, "n"),	value<int>()->default_value(std::thread::hardware_concurrency())/*->value_name("num")*/,"number of threads used to process a request")
+			(opt::server::match_threads,				value<int>()->default_value(std::thread::hardware_concurrency())/*->value_name("num")*/,	"number of threads matching the stylesheet")
+			(opt::server::render_threads,				value<int>()->default_value(std::thread::hardware_concurrency())/*->value_name("num")*/,	"number of threads rendering metatiles")
+			(opt::server::encode_threads,				value<int>()->default_value(std::thread::hardware_concurrency())/*->value_name("num")*/,	"number of threads slicing and encoding rendered metatiles")
+			(opt::server::stage_queue_size,				value<int>()->default_value(4)/*->value_name("size")*/,								"maximal amount of metatiles waiting for each stage of rendering")
+			(opt::server::metatile_size,				value<string>()->default_value("4")/*->value_name("sizes")*/,						"tiles per metatile side, per zoomlevel as list of <first zoom>:<size>")
 			(OPT(opt::server::parse_timeout, "o"),	value<int>()->default_value(750)/*->value_name("ms")*/,									"maximal time in ms to parse a stylesheet")
 			//(OPT(opt::server::request_timeout, "r"),	value<int>()/*->value_name("ms")*/,													"maximal time in ms to process a request")
 			(OPT(opt::server::prerender_level, "z"),	value<int>()->default_value(12)/*->value_name("ms")*/,								"highest zoomlevel to enqueue for prerendering")
+			(opt::server::prerender_share,				value<int>()->default_value(50)/*->value_name("percent")*/,							"percentage of the render threads used for prerendering")
+			(opt::server::prerender_pause,				value<int>()->default_value(500)/*->value_name("ms")*/,								"milliseconds user requests may wait before prerendering pauses, 0 to never pause")
+			(opt::server::prerender_popular,			value<int>()->default_value(0)/*->value_name("num")*/,								"number of most requested metatiles above the prerender level to prerender, 0 to disable")
+			(opt::server::max_staleness,				value<int>()->default_value(3600)/*->value_name("seconds")*/,						"seconds a stale tile is served while it is rendered again, 0 to wait for the new tile")
 			(opt::server::server_address,				value<string>()->default_value("0.0.0.0")/*->value_name("addr")*/,				"Address of the server")
 			(OPT(opt::server::server_port, "p"),		value<string>()->required()->default_value("8080")/*->value_name("port")*/,			"port to bind the server")
 			(OPT(opt::server::max_queue_size, "q"),		value<int>()->default_value(1024)/*->value_name("size")*/,							"size for server queue")
-			(opt::server::cache_size,					value<int>()->default_value(1024)/*->value_name("size")*/,							"maximal amount of tiles in cache")
+			(opt::server::queue_policy,					value<string>()->default_value("lifo")/*->value_name("policy")*/,					"order of waiting requests: fifo, lifo or zoom")
+			(opt::server::queue_deadline,				value<int>()->default_value(30000)/*->value_name("ms")*/,							"milliseconds after which waiting requests are dropped, 0 to keep them")
+			(opt::server::prefetch_queue_size,			value<int>()->default_value(256)/*->value_name("size")*/,							"maximal amount of metatiles waiting to be prefetched")
+			(opt::server::prefetch_neighbours,			value<bool>()->default_value(false)/*->value_name("bool")*/,						"prefetch the metatiles clients will probably request next while the workers are idle")
+			(opt::server::prerender_queue_size,			value<int>()->default_value(1024)/*->value_name("size")*/,							"maximal amount of metatiles waiting to be prerendered, 0 for no limit")
+			(opt::server::render_abandoned,				value<bool>()->default_value(false)/*->value_name("bool")*/,						"finish and cache metatiles although all clients disconnected")
+			(opt::server::keep_half_closed,				value<bool>()->default_value(false)/*->value_name("bool")*/,						"answer clients that closed their sending side instead of treating them as disconnected")
+			(opt::server::cache_size,					value<int>()->default_value(0)/*->value_name("size")*/,								"maximal amount of tiles in cache, 0 for no limit")
+			(opt::server::cache_memory,					value<int>()->default_value(256)/*->value_name("mb")*/,								"maximal memory in megabytes used by cached tiles")
 			(opt::server::cache_keep_tile,				value<int>()->default_value(12)/*->value_name("size")*/,							"from 0 this zoomlevel, tiles are written to harddrive")
 			(opt::server::cache_path,					value<string>()->default_value("cache")/*->value_name("path")*/,					"path to store evicted prerendered tiles")
+			(opt::server::cache_layout,					value<string>()->default_value("files")/*->value_name("layout")*/,					"how tiles are stored in the cache path: files or bundle")
+			(opt::server::cache_shards,					value<int>()->default_value(16)/*->value_name("num")*/,								"number of independently locked parts of the cache")
+			(opt::server::cache_write_queue,			value<int>()->default_value(1024)/*->value_name("size")*/,							"maximal amount of evicted tiles waiting to be written")
+			(opt::server::cache_write_batch,			value<int>()->default_value(32)/*->value_name("size")*/,							"amount of evicted tiles written at once")
+			(opt::server::cache_sync,					value<string>()->default_value("none")/*->value_name("policy")*/,					"when written tiles are flushed to disk: none, batch or always")
+			(opt::server::cache_policy,					value<string>()->default_value("tinylfu")/*->value_name("policy")*/,				"which tiles are evicted from memory: lru, tinylfu or arc")
+			(opt::server::cache_index_interval,			value<int>()->default_value(300)/*->value_name("seconds")*/,						"seconds between two snapshots of the most requested tiles, 0 to disable")
+			(opt::server::cache_preload,				value<int>()->default_value(10000)/*->value_name("num")*/,							"maximal amount of tiles loaded from the hard drive on startup")
+			(opt::server::cache_preload_threads,		value<int>()->default_value(2)/*->value_name("num")*/,								"number of threads loading tiles on startup")
 			(opt::server::log_mute_component, 			value<std::vector<string> >()->multitoken(), 										"List of all components which should be muted.")
 			(opt::server::performance_log, 				value<string>(), 																	"path, where the performance log will be saved. If not set the performance log will not be created.")
 			;
@@ -124,6 +151,32 @@ protected:
 			return false;
 		}
 
+		for (const char* stage : {opt::server::match_threads, opt::server::render_threads, opt::server::encode_threads}) {
+			if (config->get<int>(stage) < 1) {
+				LOG_SEV(server_log, error) << "It's not possible to use less then 1 thread for " << stage << ".";
+				return false;
+			}
+		}
+
+		if (config->get<int>(opt::server::stage_queue_size) < 1) {
+			LOG_SEV(server_log, error) << "It's not possible to use a " << opt::server::stage_queue_size << " less than 1";
+			return false;
+		}
+
+		int prerender_share = config->get<int>(opt::server::prerender_share);
+		if (prerender_share < 1 || prerender_share > 100) {
+			LOG_SEV(server_log, error) << opt::server::prerender_share << " has to be between 1 and 100";
+			return false;
+		}
+
+		try {
+			// the sizes are only used once onRun calls Init
+			MetaIdentifier::ParseSizes(config);
+		} catch (excp::InputFormatException& e) {
+			LOG_SEV(server_log, error) << "Invalid " << opt::server::metatile_size << ": " << excp::ErrorOut<excp::InfoWhat>(e, "unknown reason!");
+			return false;
+		}
+
 		int parse_timeout = config->get<int>(opt::server::parse_timeout);
 		if (parse_timeout < 50) {
 			LOG_SEV(server_log, error) << "It's not possible to use less than 50ms for " << opt::server::parse_timeout;
@@ -172,6 +225,8 @@ protected:
 
 		logging::add_file_log(
 			keywords::file_name = config->get<string>(opt::server::access_log),
+			// kept across restarts, popular tiles are read from it
+			keywords::open_mode = std::ios_base::out | std::ios_base::app,
 			keywords::rotation_size = 10 * 1024 * 1024,
 			keywords::time_based_rotation = logging::sinks::file::rotation_at_time_point(0, 0, 0),
 			keywords::format = "%Message%",
@@ -188,6 +243,7 @@ protected:
 	virtual void onRun( const shared_ptr<Configuration>& config )
 	{
 		Statistic::Init(config);
+		MetaIdentifier::Init(config);
 
 		shared_ptr<Geodata> geodata = make_shared<Geodata>();
 		try {
@@ -22,12 +22,22 @@
 
 #include "general/geo_object.hpp"
 
-GeoObject::GeoObject(const DataMap<CachedString, CachedString>& tags)
+GeoObject::GeoObject(const TagSet& tags)
 	: tags(tags)
 {
 }
 
 const DataMap<CachedString, CachedString>& GeoObject::getTags() const
 {
-	return tags;
+	return tags.getTags();
+}
+
+/**
+ * @brief Replaces the tag set, e.g. to share interned tags or after loading.
+ *
+ * @param tags the new tag set
+ **/
+void GeoObject::setTagSet(const TagSet& tags)
+{
+	this->tags = tags;
 }
@@ -33,7 +33,10 @@
 #include <boost/serialization/base_object.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/exception_ptr.hpp>
 
+#include <functional>
 #include <limits>
 
 #include "general/geodata.hpp"
@@ -41,44 +44,167 @@
 #include "general/node.hpp"
 #include "general/way.hpp"
 #include "general/relation.hpp"
+#include "general/tag_set.hpp"
 #include "general/rtree.hpp"
 #include "utils/rect.hpp"
 #include "utils/archive.hpp"
+#include "utils/phase_timer.hpp"
 
-//! called when data is serialized to file
-void Geodata::buildTrees(const string& nodePath, const string& wayPath, const string& relationPath)
-{
-	if (nodes->size() > 0)
+namespace {
+	//! Runs all tasks on separate threads and rethrows the first exception after all finished
+	void runConcurrently(const std::vector<std::function<void()>>& tasks)
 	{
-		std::vector<FixedPoint> points;;
-		for (auto& n : *nodes)
-			points.push_back(n.getLocation());
-
-		nodesTree->build(points, nodePath);
+		std::vector<boost::exception_ptr> errors(tasks.size());
+		boost::thread_group threads;
+		for (std::size_t t = 0; t < tasks.size(); t++)
+		{
+			threads.create_thread([&, t]() {
+				try {
+					tasks[t]();
+				} catch (...) {
+					errors[t] = boost::current_exception();
+				}
+			});
+		}
+		threads.join_all();
+
+		for (auto& e : errors)
+		{
+			if (e)
+				boost::rethrow_exception(e);
+		}
 	}
 
-	if (ways->size() > 0)
+	/**
+	 * @brief Calls func for every index in [0, count) in consecutive chunks, one chunk per thread.
+	 *
+	 * func must only write to data belonging to its index, so the result does not depend on the scheduling.
+	 * @param maxThreads number of threads to use at most, 0 for one per core.
+	 **/
+	template<typename Func>
+	void parallelFor(std::size_t count, unsigned int maxThreads, const Func& func)
 	{
-		std::vector<FixedRect> rects;
-		for (auto& w : *ways)
-			rects.push_back(calculateBoundingBox(w));
-
-		waysTree->build(rects, wayPath);
+		if (maxThreads == 0)
+			maxThreads = std::max(1u, boost::thread::hardware_concurrency());
+		// small inputs are not worth starting threads
+		const std::size_t minChunkSize = 4096;
+		const std::size_t threads = std::min<std::size_t>(maxThreads, (count + minChunkSize - 1) / minChunkSize);
+		if (threads <= 1)
+		{
+			for (std::size_t i = 0; i < count; i++)
+				func(i);
+			return;
+		}
+
+		const std::size_t chunkSize = (count + threads - 1) / threads;
+		std::vector<std::function<void()>> tasks;
+		for (std::size_t start = 0; start < count; start += chunkSize)
+		{
+			const std::size_t end = std::min(count, start + chunkSize);
+			tasks.push_back([&func, start, end]() {
+				for (std::size_t i = start; i < end; i++)
+					func(i);
+			});
+		}
+		runConcurrently(tasks);
 	}
+}
 
+/**
+ * @brief Builds the node, way and relation trees. Called when data is serialized to file.
+ *
+ * Bounding boxes are computed in parallel chunks and the three trees are built concurrently.
+ * Every tree only depends on its own input, so the result is the same as building them one after another.
+ **/
+void Geodata::buildTrees(const string& nodePath, const string& wayPath, const string& relationPath, PhaseTimer& timer)
+{
+	const uint64_t objects = nodes->size() + ways->size() + relations->size();
+
+	timer.start("bounding-boxes");
+	std::vector<FixedPoint> points(nodes->size());
+	parallelFor(nodes->size(), threadCount, [&](std::size_t i) {
+		points[i] = (*nodes)[i].getLocation();
+	});
+
+	std::vector<FixedRect> wayRects(ways->size());
+	parallelFor(ways->size(), threadCount, [&](std::size_t i) {
+		wayRects[i] = calculateBoundingBox((*ways)[i]);
+	});
+
+	std::vector<FixedRect> relationRects(relations->size());
+	parallelFor(relations->size(), threadCount, [&](std::size_t i) {
+		relationRects[i] = calculateBoundingBox((*relations)[i]);
+	});
+	timer.stop(objects);
+
+	timer.start("rtree-build");
+	std::vector<std::function<void()>> builds;
+	if (nodes->size() > 0)
+		builds.push_back([&]() { nodesTree->build(points, nodePath); });
+	if (ways->size() > 0)
+		builds.push_back([&]() { waysTree->build(wayRects, wayPath); });
 	if (relations->size() > 0)
-	{
-		std::vector<FixedRect> rects;
-		for (auto& r : *relations)
-			rects.push_back(calculateBoundingBox(r));
+		builds.push_back([&]() { relTree->build(relationRects, relationPath); });
+	if (threadCount == 1) {
+		for (auto& build : builds)
+			build();
+	} else {
+		runConcurrently(builds);
+	}
+	timer.stop(objects);
+}
+
+/**
+ * @brief Sets the number of threads used to build the trees when the data is saved.
+ *
+ * The saved files are the same for every number of threads.
+ * @param threads 0 for one thread per core, 1 to build everything on the calling thread.
+ **/
+void Geodata::setThreadCount(unsigned int threads)
+{
+	threadCount = threads;
+}
 
-		relTree->build(rects, relationPath);
+/**
+ * @brief Interns the tags of all objects which do not yet reference the tag set table.
+ *
+ * Objects already interned must reference the table of this geodata.
+ **/
+template<typename Object>
+void Geodata::internTags(std::vector<Object>& objects)
+{
+	if (!tagSets)
+		tagSets = boost::make_shared<TagSetTable>();
+
+	for (auto& o : objects)
+	{
+		if (!o.getTagSet().isInterned())
+			o.setTagSet(tagSets->intern(o.getTags()));
 	}
 }
 
+//! called after deserialisation to let the objects point to their shared tags
+template<typename Object>
+void Geodata::resolveTags(std::vector<Object>& objects)
+{
+	for (auto& o : objects)
+		o.setTagSet(tagSets->get(o.getTagSetId()));
+}
+
+/**
+ * @brief Sets the table containing the tag sets referenced by the objects inserted afterwards.
+ *
+ * @param tagSets table used to intern the tags of the objects
+ **/
+void Geodata::insertTagSets(const shared_ptr<TagSetTable>& tagSets)
+{
+	this->tagSets = tagSets;
+}
+
 void Geodata::insertNodes(const shared_ptr<std::vector<Node> >& nodes)
 {
 	this->nodes = nodes;
+	internTags(*nodes);
 	if (nodes->size() > 0)
 		this->nodesTree = boost::make_shared<RTree<NodeId, FixedPoint> >();
 }
@@ -86,6 +212,7 @@ void Geodata::insertNodes(const shared_ptr<std::vector<Node> >& nodes)
 void Geodata::insertWays(const shared_ptr<std::vector<Way> >& ways)
 {
 	this->ways = ways;
+	internTags(*ways);
 	if (ways->size() > 0)
 		this->waysTree = boost::make_shared<RTree<WayId, FixedRect> >();
 }
@@ -93,6 +220,7 @@ void Geodata::insertWays(const shared_ptr<std::vector<Way> >& ways)
 void Geodata::insertRelations(const shared_ptr<std::vector<Relation> >& relations)
 {
 	this->relations = relations;
+	internTags(*relations);
 	if (relations->size() > 0)
 		this->relTree = boost::make_shared<RTree<RelId, FixedRect>>();
 }
@@ -157,6 +285,13 @@ void Geodata::load(const string& path)
 	boost::archive::binary_iarchive ia(ifs);
 	ia >> *this;
 
+	if (!tagSets)
+		tagSets = boost::make_shared<TagSetTable>();
+	LOG_SEV(geo_log, info) << "Tag sets: " << tagSets->size();
+	resolveTags(*nodes);
+	resolveTags(*ways);
+	resolveTags(*relations);
+
 	// set offsets of leaf inside archive file
 	if (nodesTree) {
 		nodesTree->setLeafFile(path, entries[i].offset, entries[i].length);
@@ -181,8 +316,12 @@ void Geodata::serialize(const string& serPath) const
 	oa << *this;
 }
 
-void Geodata::save(const string& outPath)
+void Geodata::save(const string& outPath, PhaseTimer* phaseTimer)
 {
+	PhaseTimer localTimer;
+	PhaseTimer& timer = phaseTimer ? *phaseTimer : localTimer;
+	const uint64_t objects = nodes->size() + ways->size() + relations->size();
+
 	boost::filesystem::path out = boost::filesystem::absolute(boost::filesystem::path(outPath));
 	boost::filesystem::path base = out.parent_path();
 	string serPath = (base / "data.ser").string();
@@ -190,11 +329,14 @@ void Geodata::save(const string& outPath)
 	string waysPath = (base / "ways.bin").string();
 	string relationsPath = (base / "relations.bin").string();
 
-	buildTrees(nodesPath, waysPath, relationsPath);
+	buildTrees(nodesPath, waysPath, relationsPath, timer);
 
+	timer.start("serialize");
 	serialize(serPath);
+	timer.stop(objects);
 
 	LOG_SEV(geo_log, info) << "Save geodata to \"" << outPath << "\"";
+	timer.start("archive");
 	Archive a(outPath);
 	a.addFile(serPath);
 	if (nodesTree)
@@ -204,6 +346,7 @@ void Geodata::save(const string& outPath)
 	if (relTree)
 		a.addFile(relationsPath);
 	a.write();
+	timer.stop();
 
 	// remove temp files
 	remove(serPath.c_str());
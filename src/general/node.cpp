@@ -33,7 +33,7 @@
 #include "general/node.hpp"
 #include "utils/transform.hpp"
 
-Node::Node(const FloatPoint& sphereLocation, const DataMap<CachedString, CachedString>& tags)
+Node::Node(const FloatPoint& sphereLocation, const TagSet& tags)
 	: GeoObject(tags)
 {
 	projectMercator(sphereLocation, location.x, location.y);
@@ -27,7 +27,7 @@ Relation::Relation(	const std::vector<NodeId>& nodeIDs,
 					const DataMap<NodeId, CachedString>& nodeRoles,
 					const std::vector<WayId>& wayIDs,
 					const DataMap<WayId, CachedString>& wayRoles,
-					const DataMap<CachedString, CachedString>& tags)
+					const TagSet& tags)
 	: GeoObject(tags)
 	, nodeIDs(nodeIDs)
 	, nodeRoles(nodeRoles)
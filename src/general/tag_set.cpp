@@ -0,0 +1,95 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Lisa Winter
+ */
+
+
+#include "general/tag_set.hpp"
+
+TagSet::TagSet()
+	: id(NotInterned)
+	, tags(boost::make_shared<TagMap>())
+{
+}
+
+/**
+ * @brief Creates a tag set private to one object
+ *
+ * @param tags the tags to copy
+ **/
+TagSet::TagSet(const TagMap& tags)
+	: id(NotInterned)
+	, tags(boost::make_shared<TagMap>(tags))
+{
+}
+
+TagSet::TagSet(TagSetId id, const shared_ptr<const TagMap>& tags)
+	: id(id)
+	, tags(tags)
+{
+}
+
+/**
+ * @brief Returns the shared tag set containing exactly the given tags. Adds it if it is not yet known.
+ *
+ * @param tags the tags to look up
+ * @return interned tag set
+ **/
+TagSet TagSetTable::intern(const TagMap& tags)
+{
+	std::size_t hash = hashTags(tags);
+
+	auto range = index.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		const TagMap& candidate = *sets[it->second];
+		if (candidate == tags)
+			return TagSet(it->second, sets[it->second]);
+	}
+
+	TagSetId id = sets.size();
+	sets.push_back(boost::make_shared<TagMap>(tags));
+	index.insert(std::make_pair(hash, id));
+	return TagSet(id, sets.back());
+}
+
+/**
+ * @brief Returns the tag set with the given id
+ *
+ * @param id id of an interned tag set
+ **/
+TagSet TagSetTable::get(TagSetId id) const
+{
+	return TagSet(id, sets.at(id));
+}
+
+/**
+ * @brief Computes a hash of the tags that does not depend on the iteration order.
+ **/
+std::size_t TagSetTable::hashTags(const TagMap& tags)
+{
+	std::size_t hash = tags.size();
+	for (auto& tag : tags)
+	{
+		std::size_t seed = 0;
+		boost::hash_combine(seed, tag.first);
+		boost::hash_combine(seed, tag.second);
+		hash += seed;
+	}
+	return hash;
+}
@@ -38,6 +38,12 @@
 #include "general/node.hpp"
 #include "general/way.hpp"
 #include "general/relation.hpp"
+#include "general/tag_set.hpp"
+
+#include "utils/decompressing_stream.hpp"
+#include "utils/clipping.hpp"
+#include "utils/transform.hpp"
+#include "utils/phase_timer.hpp"
 
 
 using boost::filesystem::path;
@@ -68,14 +74,22 @@ public:
 	 * @brief Creates a new parser and sets default settings                                                                     
 	 *
 	 **/
-	OsmXmlParser(bool ignoreUnknownEntities, const FloatRect& bounds = { -nl::max(), -nl::max(), nl::max(), nl::max() })
+	OsmXmlParser(bool ignoreUnknownEntities,
+				 const FloatRect& bounds = { -nl::max(), -nl::max(), nl::max(), nl::max() },
+				 bool clipPolygons = false,
+				 double clipMargin = 0.0)
 		: ignoreUnknownEntities(ignoreUnknownEntities)
 		, clippingBounds(bounds)
+		, polygonBounds(bounds.grow(clipMargin, clipMargin))
+		, clipPolygons(clipPolygons)
+		, clippedWays(0)
+		, clippedPolygons(0)
 		, alreadyRead(0)
 		, fileSize(0)
 		, segmentSize(1024 * 1024)
 		, outputIgnoreRelation(false)
 		, outputIgnoreBounds(false)
+		, tagSets(boost::make_shared<TagSetTable>())
 	{
 	}
 
@@ -96,23 +110,34 @@ public:
 		assert(!ways);
 		assert(!relations);
 
-		std::ifstream xml_stream(xml_file.string());
+		// compressed files are decompressed on a separate thread while parsing
+		std::ifstream plain_stream;
+		std::istream* xml_stream = &plain_stream;
+		DecompressingStream::Compression compression = DecompressingStream::DetectCompression(xml_file);
+		if(compression == DecompressingStream::None)
+		{
+			plain_stream.open(xml_file.string());
+		} else {
+			decompressor.reset(new DecompressingStream(xml_file, compression));
+			xml_stream = decompressor.get();
+		}
 
-		if(!xml_stream)
+		if(!*xml_stream)
 			BOOST_THROW_EXCEPTION(excp::FileNotFoundException()  << excp::InfoFileName(xml_file.string()));
 
 		LOG_SEV(importer_log, info) << "Load xml-file \"" << xml_file.string() << "\"";
 		
 		fileSize = boost::filesystem::file_size(xml_file);
 
-		LOG_SEV(importer_log, info) << "File size is " << fileSize / (1024) << "kb";
+		LOG_SEV(importer_log, info) << "File size is " << fileSize / (1024) << "kb"
+									<< (compression == DecompressingStream::Gzip ? " (gzip)" : compression == DecompressingStream::Bzip2 ? " (bzip2)" : "");
 
 		nodes = boost::make_shared<std::vector<Node> >();
 		ways = boost::make_shared<std::vector<Way> >();
 		relations = boost::make_shared<std::vector<Relation> >();
 
 		// Use a cache with an 8 mb buffer
-		eaglexml::stream_cache<> cache(xml_stream, 8 * 1024 * 1024);
+		eaglexml::stream_cache<> cache(*xml_stream, 8 * 1024 * 1024);
 		eaglexml::xml_document<> document;
 
 		cache.segment_size(segmentSize);
@@ -136,8 +161,13 @@ public:
 			throw;
 		}catch(eaglexml::parse_error& e)
 		{
-			BOOST_THROW_EXCEPTION(excp::InputFormatException() << excp::InfoFileName(xml_file.string()) << excp::InfoWhat(e.what()));
+			// a truncated or corrupt archive usually shows up as a parse error
+			string what = (decompressor && !decompressor->getError().empty()) ? decompressor->getError() : string(e.what());
+			BOOST_THROW_EXCEPTION(excp::InputFormatException() << excp::InfoFileName(xml_file.string()) << excp::InfoWhat(what));
 		}
+
+		if(decompressor && !decompressor->getError().empty())
+			BOOST_THROW_EXCEPTION(excp::InputFormatException() << excp::InfoFileName(xml_file.string()) << excp::InfoWhat(decompressor->getError()));
 	}
 
 	/**
@@ -173,6 +203,16 @@ public:
 		return relations;
 	}
 
+	/**
+	 * @brief Returns the table with the distinct tag sets of all parsed objects
+	 *
+	 * @return table of tag sets
+	 **/
+	shared_ptr<TagSetTable> getTagSets() const
+	{
+		return tagSets;
+	}
+
 	/**
 	 * @brief Returns the number of clipped nodes
 	 * 
@@ -180,7 +220,53 @@ public:
 	 */
 	std::size_t getNumberOfClippedNodes() const
 	{
-		return clippedNodes.size();
+		return outsideNodes.size() - outsideNodesUsed;
+	}
+
+	/**
+	 * @brief Returns the number of ways lying completely outside of the clipping bounds
+	 *
+	 * @return number of clipped ways
+	 */
+	std::size_t getNumberOfClippedWays() const
+	{
+		return clippedWays;
+	}
+
+	/**
+	 * @brief Returns the number of closed ways cut at the clipping bounds plus margin
+	 *
+	 * @return number of clipped polygons
+	 */
+	std::size_t getNumberOfClippedPolygons() const
+	{
+		return clippedPolygons;
+	}
+
+	/**
+	 * @brief Enables measuring the time spent in parts of the parsing.
+	 *
+	 * Reads the clock twice per way and object, so it is only enabled when a summary is written.
+	 */
+	void setMeasureParts(bool measure)
+	{
+		measureParts = measure;
+	}
+
+	/**
+	 * @brief Returns the time spent resolving and clipping the nodes of ways
+	 */
+	double getResolveSeconds() const
+	{
+		return std::chrono::duration<double>(resolveTime).count();
+	}
+
+	/**
+	 * @brief Returns the time spent interning tags
+	 */
+	double getTagSeconds() const
+	{
+		return std::chrono::duration<double>(tagTime).count();
 	}
 	
 private:
@@ -214,9 +300,7 @@ private:
 				(this->*(entityIt->second))(&*it);
 			}catch(excp::BadOsmIdException& e) {
 				const auto id = *boost::get_error_info<excp::InfoUnresolvableId>(e);
-				if (!clippedNodes.count(id)) {
-					LOG_SEV(importer_log, warning) << "Bad osm id[" << id << "]. Entity is skipped!";
-				}
+				LOG_SEV(importer_log, warning) << "Bad osm id[" << id << "]. Entity is skipped!";
 			}
 		}
 	}
@@ -253,12 +337,13 @@ private:
 		FloatPoint loc = {lon, lat};
 		if (clippingBounds.contains(loc)) {
 			DataMap<CachedString, CachedString> tags;
-			parseProperties<Node>(node->first_node(), &tags, nullptr, nullptr, nullptr, nullptr);
+			parseProperties<Node>(node->first_node(), &tags, nullptr, nullptr, nullptr, nullptr, nullptr);
 
 			nodeIdMapping.insert(std::make_pair(id, NodeId(nodes->size())));
-			nodes->push_back(Node(loc, tags));
+			nodes->push_back(Node(loc, internTags(tags)));
 		} else {
-			clippedNodes.insert(id);
+			// only the location is kept, the node is added if a way crossing the bounds needs it
+			outsideNodes.insert(std::make_pair(id, OutsideNode{ loc, NodeId() }));
 		}
 	}
 	
@@ -276,15 +361,31 @@ private:
 
 
 		DataMap<CachedString, CachedString> tags;
+		std::vector<OsmIdType> nodeRefs;
 		std::vector<NodeId> nodeIds;
 
-		parseProperties<Way>(way->first_node(), &tags, &nodeIds, nullptr, nullptr, nullptr);
+		parseProperties<Way>(way->first_node(), &tags, &nodeRefs, nullptr, nullptr, nullptr, nullptr);
+
+		if (nodeRefs.size() == 0)
+			return;
 
-		if (nodeIds.size() == 0)
+		bool inside;
+		if (measureParts) {
+			auto resolveStart = PhaseTimer::clock::now();
+			inside = clipWay(nodeRefs, &nodeIds);
+			resolveTime += PhaseTimer::clock::now() - resolveStart;
+		} else {
+			inside = clipWay(nodeRefs, &nodeIds);
+		}
+		if (!inside)
+		{
+			clippedWayIds.insert(id);
+			clippedWays++;
 			return;
+		}
 
 		wayIdMapping.insert(std::make_pair(id, WayId(ways->size())));
-		ways->push_back(Way(nodeIds, tags));
+		ways->push_back(Way(nodeIds, internTags(tags)));
 	}
 	
 	/**
@@ -306,15 +407,174 @@ private:
 		DataMap<WayId, CachedString> wayRoles;
 
 
-		parseProperties<Relation>(relation->first_node(), &tags, &nodeIds, &nodeRoles, &wayIds, &wayRoles);
+		parseProperties<Relation>(relation->first_node(), &tags, nullptr, &nodeIds, &nodeRoles, &wayIds, &wayRoles);
 
 		if (nodeIds.size() == 0 && wayIds.size() == 0)
 			return;
 
-		relations->push_back(Relation(nodeIds, nodeRoles, wayIds, wayRoles, tags));
+		relations->push_back(Relation(nodeIds, nodeRoles, wayIds, wayRoles, internTags(tags)));
+	}
+
+
+	//! Interns the tags of a parsed object and measures the time needed if enabled
+	TagSet internTags(const TagSet::TagMap& tags)
+	{
+		if (!measureParts)
+			return tagSets->intern(tags);
+
+		auto start = PhaseTimer::clock::now();
+		TagSet set = tagSets->intern(tags);
+		tagTime += PhaseTimer::clock::now() - start;
+		return set;
+	}
+
+	/**
+	 * @brief Resolves the nodes of a way and removes the parts outside of the clipping bounds.
+	 *
+	 * Nodes just outside of the bounds are kept, if the way crosses the border between them and
+	 * a node inside, so the way is not cut off at the last node inside. Open ways are trimmed to
+	 * the part between the first and the last node touching the bounds. Closed ways are kept
+	 * complete or, if enabled, clipped at the bounds plus margin.
+	 *
+	 * @param nodeRefs osm ids of the nodes of the way
+	 * @param nodeIds list, where the ids of the remaining nodes are saved
+	 * @return false if the way lies completely outside of the bounds
+	 * @throws BadOsmIdException if a node is unknown
+	 **/
+	bool clipWay(const std::vector<OsmIdType>& nodeRefs, std::vector<NodeId>* nodeIds)
+	{
+		assert(nodeIds);
+
+		if (outsideNodes.empty())
+		{
+			for (OsmIdType ref : nodeRefs)
+				nodeIds->push_back(resolveOsmId(ref, nodeIdMapping));
+			return true;
+		}
+
+		const std::size_t count = nodeRefs.size();
+		std::vector<FloatPoint> locations(count);
+		std::vector<bool> inside(count);
+		bool anyOutside = false;
+		for (std::size_t i = 0; i < count; i++)
+		{
+			auto outside = outsideNodes.find(nodeRefs[i]);
+			if (outside != outsideNodes.end())
+			{
+				locations[i] = outside->second.location;
+				inside[i] = false;
+				anyOutside = true;
+			} else {
+				NodeId id = resolveOsmId(nodeRefs[i], nodeIdMapping);
+				inverseMercator(nodes->at(id.getRaw()).getLocation(), locations[i].lat, locations[i].lon);
+				inside[i] = true;
+			}
+		}
+
+		if (!anyOutside)
+		{
+			for (OsmIdType ref : nodeRefs)
+				nodeIds->push_back(nodeIdMapping.at(ref));
+			return true;
+		}
+
+		// a node is needed if it is inside or one of its segments touches the bounds
+		auto touches = [&](std::size_t a, std::size_t b) {
+			return inside[a] || inside[b] || segmentIntersectsRect(locations[a], locations[b], clippingBounds);
+		};
+		std::size_t first = count, last = 0;
+		for (std::size_t i = 0; i < count; i++)
+		{
+			if (inside[i] || (i > 0 && touches(i - 1, i)) || (i + 1 < count && touches(i, i + 1)))
+			{
+				first = std::min(first, i);
+				last = i;
+			}
+		}
+		const bool closed = (count > 3 && nodeRefs.front() == nodeRefs.back());
+		if (first == count)
+		{
+			// a closed way may still enclose the whole bounds
+			if (!closed || !polygonContains(locations, clippingBounds.getCenter()))
+				return false;
+		}
+
+		if (closed)
+		{
+			first = 0;
+			last = count - 1;
+
+			if (clipPolygons)
+				return clipRing(nodeRefs, locations, nodeIds);
+		}
+
+		for (std::size_t i = first; i <= last; i++)
+			nodeIds->push_back(inside[i] ? nodeIdMapping.at(nodeRefs[i]) : useOutsideNode(nodeRefs[i]));
+		return true;
+	}
+
+	/**
+	 * @brief Clips a closed way at the clipping bounds grown by the margin.
+	 *
+	 * Nodes at the new border are created without tags.
+	 *
+	 * @return false if nothing of the way remains
+	 **/
+	bool clipRing(const std::vector<OsmIdType>& nodeRefs, const std::vector<FloatPoint>& locations, std::vector<NodeId>* nodeIds)
+	{
+		bool insideMargin = true;
+		for (const FloatPoint& p : locations)
+			insideMargin = insideMargin && polygonBounds.contains(p);
+
+		if (!insideMargin)
+		{
+			std::vector<FloatPoint> ring(locations.begin(), locations.end() - 1);
+			std::vector<ClippedVertex> clipped;
+			clipPolygon(ring, polygonBounds, clipped);
+			if (clipped.size() < 3)
+				return false;
+
+			clippedPolygons++;
+			for (const ClippedVertex& v : clipped)
+			{
+				if (v.source >= 0) {
+					auto ref = nodeRefs[v.source];
+					nodeIds->push_back(outsideNodes.count(ref) ? useOutsideNode(ref) : nodeIdMapping.at(ref));
+				} else {
+					nodeIds->push_back(NodeId(nodes->size()));
+					nodes->push_back(Node(v.location, tagSets->intern(TagSet::TagMap())));
+				}
+			}
+			nodeIds->push_back(nodeIds->front());
+			return true;
+		}
+
+		for (OsmIdType ref : nodeRefs)
+			nodeIds->push_back(outsideNodes.count(ref) ? useOutsideNode(ref) : nodeIdMapping.at(ref));
+		return true;
+	}
+
+	/**
+	 * @brief Adds a node outside of the clipping bounds to the data, if it was not already added.
+	 *
+	 * The tags of such nodes are not kept.
+	 *
+	 * @param osmId id of a node inside of outsideNodes
+	 * @return internal id of the node
+	 **/
+	NodeId useOutsideNode(OsmIdType osmId)
+	{
+		OutsideNode& outside = outsideNodes.at(osmId);
+		if (outside.id == NodeId())
+		{
+			outside.id = NodeId(nodes->size());
+			nodes->push_back(Node(outside.location, tagSets->intern(TagSet::TagMap())));
+			nodeIdMapping.insert(std::make_pair(osmId, outside.id));
+			outsideNodesUsed++;
+		}
+		return outside.id;
 	}
 
-	
 	/**
 	 * @brief parses properties of an osm-object
 	 *
@@ -325,6 +585,7 @@ private:
 	 *
 	 * @param firstProp first xml-property-node
 	 * @param tagMap map, where tags are saved
+	 * @param wayNodeRefs list, where the osm ids of the nodes of a way are saved
 	 * @param nodeRefIds list, where references to nodes are saved
 	 * @param nodeRoleMap map, where roles of nodes are saved
 	 * @param wayRefIds list, where references to ways are saved
@@ -333,6 +594,7 @@ private:
 	template<typename Target>
 	inline void parseProperties(eaglexml::xml_node<>* firstProp,
 								DataMap<CachedString, CachedString>* tagMap,
+								std::vector<OsmIdType>* wayNodeRefs,
 								std::vector<NodeId>* nodeRefIds,
 								DataMap<NodeId, CachedString>* nodeRoleMap,
 								std::vector<WayId>* wayRefIds,
@@ -359,12 +621,12 @@ private:
 
 			}else if(boost::is_same<Target, Way>::value && std::strcmp(propName, "nd") == 0)
 			{
-				assert(nodeRefIds);
+				assert(wayNodeRefs);
 
-				// Parse a node reference
+				// Parse a node reference, it is resolved when the way is clipped
 				OsmIdType osmId;
 				extractAttributeFromNode("ref", prop, &osmId);
-				nodeRefIds->push_back(resolveOsmId(osmId, nodeIdMapping));
+				wayNodeRefs->push_back(osmId);
 			}else if(boost::is_same<Target, Relation>::value && std::strcmp(propName, "member") == 0)
 			{
 				// Parse a relation member
@@ -387,11 +649,18 @@ private:
 				const char* type = attr->value();
 				if(std::strcmp(type, "node") == 0)
 				{
+					// members outside of the clipping bounds are dropped
+					if(outsideNodes.count(osmRefId) && !nodeIdMapping.count(osmRefId))
+						continue;
+
 					NodeId nodeId = resolveOsmId(osmRefId, nodeIdMapping);
 					nodeRefIds->push_back(nodeId);
 					extractAttributeFromNode("role", prop, &((*nodeRoleMap)[nodeId]));
 				}else if(std::strcmp(type, "way") == 0)
 				{
+					if(clippedWayIds.count(osmRefId))
+						continue;
+
 					WayId wayId = resolveOsmId(osmRefId, wayIdMapping);
 					wayRefIds->push_back(wayId);
 					extractAttributeFromNode("role", prop, &((*wayRoleMap)[wayId]));
@@ -472,7 +741,11 @@ private:
 	virtual void on_read_begin( unsigned int segments )
 	{
 		int before = int(100 * (double)alreadyRead / (double)fileSize);
-		alreadyRead += segments * segmentSize;
+		// for compressed input the progress is measured on the compressed file
+		if(decompressor)
+			alreadyRead = decompressor->getCompressedBytesRead();
+		else
+			alreadyRead += segments * segmentSize;
 		int after  = int(100 * (double)alreadyRead / (double)fileSize);
 
 		if(after != before)
@@ -497,8 +770,38 @@ private:
 	//! Mapping from osm ids to internal ids for ways
 	boost::unordered_map<OsmIdType, WayId>	wayIdMapping;
 
-	//! Id of clipped nodes
-	std::unordered_set<OsmIdType> clippedNodes;
+	//! Specifies the area closed ways are clipped to. It contains the clipping bounds plus a margin.
+	const FloatRect polygonBounds;
+
+	//! Specifies weather closed ways crossing the polygon bounds are clipped.
+	bool clipPolygons;
+
+	//! Node outside of the clipping bounds
+	struct OutsideNode
+	{
+		FloatPoint location;
+		//! internal id once the node is used by a way, otherwise invalid
+		NodeId id;
+	};
+
+	//! Nodes outside of the clipping bounds, kept in case a way crossing the bounds needs them
+	boost::unordered_map<OsmIdType, OutsideNode> outsideNodes;
+
+	//! Number of outside nodes added to the data
+	std::size_t outsideNodesUsed = 0;
+
+	//! Osm ids of ways lying completely outside of the clipping bounds
+	std::unordered_set<OsmIdType> clippedWayIds;
+
+	//! Statistics about clipped ways and polygons
+	std::size_t clippedWays, clippedPolygons;
+
+	//! Whether resolveTime and tagTime are measured
+	bool measureParts = false;
+
+	//! Time spent in parts of the parsing, accumulated over all objects
+	PhaseTimer::clock::duration resolveTime = PhaseTimer::clock::duration::zero();
+	PhaseTimer::clock::duration tagTime = PhaseTimer::clock::duration::zero();
 
 	//! List to be filled with nodes
 	shared_ptr< std::vector<Node> > nodes;
@@ -509,6 +812,9 @@ private:
 	//! List to be filled with relations
 	shared_ptr< std::vector<Relation> > relations;
 
+	//! Table with all distinct tag sets. Objects with the same tags share one set.
+	shared_ptr<TagSetTable> tagSets;
+
 	//! Size of the xml file in bytes
 	std::uintmax_t	fileSize;
 
@@ -520,6 +826,9 @@ private:
 
 	//! Booleans for some output, which should only appear once
 	bool outputIgnoreRelation, outputIgnoreBounds;
+
+	//! Stream decompressing the input, only set for compressed files
+	scoped_ptr<DecompressingStream> decompressor;
 };
 
 
@@ -537,6 +846,7 @@ private:
  **/
 Importer::Importer(const shared_ptr<Configuration>& config)
 	: config(config)
+	, timer(boost::make_shared<PhaseTimer>())
 {
 }
 
@@ -551,21 +861,41 @@ shared_ptr<Geodata> Importer::importXML()
 		FloatPoint(config->get(opt::importer::min_lon, -nl::max()), config->get(opt::importer::min_lat, -nl::max())),
 		FloatPoint(config->get(opt::importer::max_lon, nl::max()), config->get(opt::importer::max_lat, nl::max()))
 	};
+	const bool clipPolygons = config->get<bool>(opt::importer::clip_polygons, false);
+	const double clipMargin = config->get<double>(opt::importer::clip_margin, 0.01);
 	LOG_SEV(importer_log, info) << "Clipping nodes with [lon: " << bounds.minX << " to " << bounds.maxX << ", lat: " << bounds.minY << " to " << bounds.maxY << "]";
-	OsmXmlParser parser(!config->get<bool>(opt::importer::check_xml_entities), bounds);
+	if (clipPolygons)
+		LOG_SEV(importer_log, info) << "Clipping closed ways with a margin of " << clipMargin << " degrees";
+	OsmXmlParser parser(!config->get<bool>(opt::importer::check_xml_entities), bounds, clipPolygons, clipMargin);
+	// the parts of the parsing are only timed for the summary, as it costs two clock reads per object
+	const bool measureParts = config->has(opt::importer::stats_file);
+	parser.setMeasureParts(measureParts);
 	shared_ptr<Geodata>	geodata = boost::make_shared<Geodata>();
 
 	path xml_file = config->get<string>(opt::importer::path_to_osmdata);
 	LOG_SEV(importer_log, info) << "Start parsing...";
+	timer->start("parse");
 	parser.parse(xml_file);
 
+	const auto node_count = parser.getParsedNodes()->size();
+	const auto object_count = node_count + parser.getParsedWays()->size() + parser.getParsedRelations()->size();
+	timer->stop(object_count);
+	if (measureParts) {
+		timer->add("parse/resolve-ids", parser.getResolveSeconds(), parser.getParsedWays()->size());
+		timer->add("parse/tags", parser.getTagSeconds(), object_count);
+	}
+
 	LOG_SEV(importer_log, info) << "Insert into geodata...";
+	timer->start("insert");
+	geodata->insertTagSets(parser.getTagSets());
 	geodata->insertNodes(parser.getParsedNodes());
 	geodata->insertWays(parser.getParsedWays());
 	geodata->insertRelations(parser.getParsedRelations());
+	timer->stop(object_count);
 
-	const auto node_count = parser.getParsedNodes()->size();
+	LOG_SEV(importer_log, info) << object_count << " objects share " << parser.getTagSets()->size() << " distinct tag sets.";
 	LOG_SEV(importer_log, info) << "Clipped " << parser.getNumberOfClippedNodes() << " / " << (parser.getNumberOfClippedNodes() + node_count) << " nodes. " << node_count << " nodes remaining.";
+	LOG_SEV(importer_log, info) << "Clipped " << parser.getNumberOfClippedWays() << " ways outside of the bounds and cut " << parser.getNumberOfClippedPolygons() << " polygons.";
 
 	return geodata;
 }
@@ -25,20 +25,301 @@
 #include "general/configuration.hpp"
 #include "server/tile_identifier.hpp"
 #include "server/tile.hpp"
+#include "server/cache_index.hpp"
+#include "server/cache_policy.hpp"
+#include "server/image_pool.hpp"
+#include "server/meta_identifier.hpp"
+#include "server/tile_store.hpp"
+#include "server/tile_writer.hpp"
 #include "server/stylesheet.hpp"
 
 #include "utils/exceptions.hpp"
+#include "utils/transform.hpp"
 
 #include <boost/unordered_map.hpp>
+#include <algorithm>
 #include <fstream>
 
 
+namespace {
+	//! Shards are only created if each of them can hold at least this many tiles
+	const std::size_t MIN_TILES_PER_SHARD = 64;
+	//! Shards are only created if each of them gets at least this much memory
+	const std::size_t MIN_BYTES_PER_SHARD = 1024 * 1024;
+	//! Estimated memory used by the hash map and the policy for every tile
+	const std::size_t ELEMENT_OVERHEAD = 64;
+	//! Name of the cache index inside the cache path
+	const char* INDEX_FILE = "cache.index";
+
+	//! @return memory used by an image buffer.
+	std::size_t imageSize(const Tile::ImageType& image)
+	{
+		return image ? sizeof(*image) + image->capacity() : 0;
+	}
+
+	/**
+	 * @brief Estimates the memory used by a cached tile.
+	 *
+	 * @param withImage false to leave out the image buffer, which may be shared with other tiles.
+	 **/
+	std::size_t tileSize(const Tile& tile, bool withImage)
+	{
+		const shared_ptr<TileIdentifier>& id = tile.getIdentifier();
+		// the identifier is kept by the map and the policy
+		std::size_t size = sizeof(Tile) + 2 * sizeof(TileIdentifier) + sizeof(Cache::CacheElement) + ELEMENT_OVERHEAD;
+		size += 2 * id->getStylesheetPath().capacity();
+		if (withImage)
+			size += imageSize(tile.getImage());
+		return size;
+	}
+
+	/**
+	 * @brief Computes the tiles of a zoomlevel touching an area, including the overlap rendered around every tile.
+	 **/
+	void tileRange(const FixedRect& area, int zoom, int& x0, int& y0, int& x1, int& y1)
+	{
+		int n = (1 << zoom);
+		coord_t left, top, right, bottom;
+		tileToMercator(0, 0, zoom, left, top);
+		tileToMercator(1, 1, zoom, right, bottom);
+		FixedRect grown = area.grow((right - left) * TILE_OVERLAP, (top - bottom) * TILE_OVERLAP);
+
+		mercatorToTile(grown.minX, grown.maxY, zoom, x0, y0);
+		mercatorToTile(grown.maxX, grown.minY, zoom, x1, y1);
+		x0 = std::min(std::max(x0, 0), n - 1);
+		y0 = std::min(std::max(y0, 0), n - 1);
+		x1 = std::min(std::max(x1, 0), n - 1);
+		y1 = std::min(std::max(y1, 0), n - 1);
+	}
+}
+
 Cache::Cache(const shared_ptr<Configuration>& config)
 	: Config(config)
-	, AllCaches()
-	, RecentlyUsedList()
+	, CachePath(config->get<string>(opt::server::cache_path))
+	, KeepTileZoom(config->get<int>(opt::server::cache_keep_tile))
+	, MemoryUsage(0)
 	, DefaultTile()
+	, IndexInterval(config->get<int>(opt::server::cache_index_interval))
+	, Stopping(false)
+	, PreloadPosition(0)
+	, Preloaded(0)
+	, StopPreload(false)
+{
+	std::size_t size = std::max(config->get<int>(opt::server::cache_size), 0);
+	std::size_t budget = (std::size_t) std::max(config->get<int>(opt::server::cache_memory), 1) * 1024 * 1024;
+	std::size_t shards = std::max(config->get<int>(opt::server::cache_shards), 1);
+	// a small cache should still evict in the order of its policy
+	shards = std::min(shards, budget / MIN_BYTES_PER_SHARD);
+	if (size > 0)
+		shards = std::min(shards, size / MIN_TILES_PER_SHARD);
+	shards = std::max<std::size_t>(shards, 1);
+
+	ShardCapacity = (size + shards - 1) / shards;
+	ShardBudget = budget / shards;
+	string policy = config->get<string>(opt::server::cache_policy);
+	for (std::size_t i = 0; i < shards; i++) {
+		shared_ptr<Shard> shard = boost::make_shared<Shard>();
+		shard->Policy = CachePolicy::Create(policy, ShardBudget);
+		Shards.push_back(shard);
+	}
+
+	LOG_SEV(cache_log, debug) << "Using " << shards << " cache shards with " << ShardBudget << " bytes each and policy " << policy << ".";
+
+	Pool = boost::make_shared<ImagePool>();
+	Store = TileStore::Create(config->get<string>(opt::server::cache_layout), CachePath,
+							  TileStore::ParsePolicy(config->get<string>(opt::server::cache_sync)), Pool);
+	Writer.reset(new TileWriter(Store,
+								config->get<int>(opt::server::cache_write_queue),
+								config->get<int>(opt::server::cache_write_batch)));
+
+	if (IndexInterval > 0) {
+		Index.reset(new CacheIndex(boost::filesystem::path(CachePath) / INDEX_FILE));
+		for (const CacheIndex::Entry& entry : Index->load(std::max(config->get<int>(opt::server::cache_preload), 0))) {
+			if (entry.tile.getZoom() <= KeepTileZoom)
+				PreloadList.push_back(std::make_pair(entry.tile, entry.frequency));
+		}
+		if (!PreloadList.empty()) {
+			LOG_SEV(cache_log, info) << "Preloading " << PreloadList.size() << " tiles from the hard drive.";
+			int threads = std::max(config->get<int>(opt::server::cache_preload_threads), 1);
+			for (int i = 0; i < threads; i++)
+				PreloadThreads.create_thread(boost::bind(&Cache::preload, this));
+		}
+		IndexThread = boost::thread(boost::bind(&Cache::runIndex, this));
+	}
+}
+
+/**
+ * @brief Writes the tiles still waiting for the hard drive.
+ **/
+Cache::~Cache()
+{
+	StopPreload = true;
+	PreloadThreads.join_all();
+	if (Index) {
+		{
+			boost::mutex::scoped_lock lock(IndexLock);
+			Stopping = true;
+		}
+		IndexStop.notify_all();
+		IndexThread.join();
+		saveIndex();
+	}
+
+	Statistics stats = getStatistics();
+	std::size_t requests = stats.hits + stats.misses;
+	if (requests > 0) {
+		LOG_SEV(cache_log, info) << "Cache hits: " << stats.hits << " of " << requests << " requests ("
+								 << stats.hits * 100 / requests << "%), " << stats.loads << " loaded from the hard drive, "
+								 << stats.evictions << " evicted.";
+	}
+	std::size_t lookups = Pool->getLookups();
+	if (lookups > 0) {
+		LOG_SEV(cache_log, info) << "Shared images of " << Pool->getHits() << " of " << lookups << " tiles ("
+								 << Pool->getHits() * 100 / lookups << "%), saved " << Pool->getSavedBytes() << " bytes.";
+	}
+	Writer.reset();
+	LOG_SEV(cache_log, info) << "Linked " << Store->getLinkedFiles() << " identical files on the hard drive.";
+}
+
+/**
+ * @return number of shards the cache is split into.
+ **/
+std::size_t Cache::getShardCount() const
+{
+	return Shards.size();
+}
+
+/**
+ * @return estimated memory in bytes used by all cached tiles.
+ **/
+std::size_t Cache::getMemoryUsage() const
+{
+	return MemoryUsage;
+}
+
+/**
+ * @return the pool sharing identical images, e.g. to report how many tiles were deduplicated.
+ **/
+const shared_ptr<ImagePool>& Cache::getImagePool() const
+{
+	return Pool;
+}
+
+/**
+ * @return hit and eviction counters summed over all shards.
+ **/
+Cache::Statistics Cache::getStatistics()
+{
+	Statistics total = Statistics();
+	for (const shared_ptr<Shard>& shard : Shards) {
+		boost::mutex::scoped_lock lock(shard->Lock);
+		total.hits += shard->Stats.hits;
+		total.misses += shard->Stats.misses;
+		total.loads += shard->Stats.loads;
+		total.evictions += shard->Stats.evictions;
+	}
+	return total;
+}
+
+/**
+ * @brief Saves the most requested tiles to the cache index.
+ *
+ * Rendered tiles that are not yet on the hard drive are queued for writing,
+ * so they can be loaded after a restart.
+ **/
+void Cache::saveIndex()
+{
+	if (!Index)
+		return;
+
+	std::vector<CacheIndex::Entry> entries;
+	for (const shared_ptr<Shard>& shard : Shards) {
+		boost::mutex::scoped_lock lock(shard->Lock);
+		for (auto& cached : shard->Tiles) {
+			CacheElement& element = cached.second;
+			if (cached.first.getZoom() > KeepTileZoom || !element.tile->isRendered())
+				continue;
+			if (!element.stored && !element.tile->isStale())
+				element.stored = Writer->enqueue(element.tile);
+			entries.push_back(CacheIndex::Entry{cached.first, element.hits});
+		}
+	}
+	LOG_SEV(cache_log, debug) << "Saving " << entries.size() << " tiles to the cache index.";
+	Index->save(entries);
+}
+
+/**
+ * @brief Saves the cache index periodically until the cache is destroyed.
+ **/
+void Cache::runIndex()
+{
+	boost::mutex::scoped_lock lock(IndexLock);
+	while (!Stopping) {
+		IndexStop.timed_wait(lock, boost::posix_time::seconds(IndexInterval));
+		if (Stopping)
+			break;
+		lock.unlock();
+		saveIndex();
+		lock.lock();
+	}
+}
+
+/**
+ * @brief Loads tiles of the last index snapshot from the hard drive, the most requested first.
+ *
+ * Stops as soon as the memory budget is used up, tiles that were requested
+ * in the meantime are not replaced.
+ **/
+void Cache::preload()
 {
+	while (!StopPreload && MemoryUsage < getMemoryBudget()) {
+		std::size_t position = PreloadPosition++;
+		if (position >= PreloadList.size())
+			break;
+
+		const TileIdentifier& ti = PreloadList[position].first;
+		bool stale;
+		Tile::ImageType image = Store->read(ti, &stale);
+		if (!image)
+			continue;
+		shared_ptr<Tile> tile = boost::make_shared<Tile>(boost::make_shared<TileIdentifier>(ti));
+		tile->setImage(Pool->intern(image));
+		if (stale)
+			tile->markStale();
+
+		Shard& shard = getShard(ti);
+		boost::mutex::scoped_lock lock(shard.Lock);
+		if (shard.Tiles.find(ti) != shard.Tiles.end())
+			continue;
+		CacheElement& element = shard.Tiles[ti];
+		element.tile = tile;
+		// old requests count less than new ones
+		element.hits = PreloadList[position].second / 2;
+		element.stored = true;
+		hold(shard, element);
+		shard.Policy->onInsert(ti, element.size);
+		evict(shard);
+		Preloaded++;
+	}
+}
+
+/**
+ * @brief Blocks until the tiles of the cache index are loaded.
+ *
+ * @return number of preloaded tiles.
+ **/
+std::size_t Cache::waitForPreload()
+{
+	PreloadThreads.join_all();
+	return Preloaded;
+}
+
+/**
+ * @return maximal memory in bytes the cached tiles may use.
+ **/
+std::size_t Cache::getMemoryBudget() const
+{
+	return ShardBudget * Shards.size();
 }
 
 void Cache::readFile(const Tile::ImageType& image, const boost::filesystem::path& filename) {
@@ -57,129 +338,218 @@ void Cache::readFile(const Tile::ImageType& image, const boost::filesystem::path
 	}
 }
 
-void Cache::writeFile(shared_ptr<Tile> tile, const boost::filesystem::path& filename) {
-	boost::filesystem::create_directories(filename.parent_path());
-	std::ofstream out(filename.string(), std::ios::out | std::ios::binary);
-	if(out.is_open())
-	{
-		Tile::ImageType png = tile->getImage();
-		if (png==0) {
-			out.close();
-			boost::filesystem::remove(filename);
-			BOOST_THROW_EXCEPTION(excp::InputFormatException());
-		} else {
-			auto size = png->size();
-			out.write((const char*) png->data(), size);
+Cache::Shard& Cache::getShard(const TileIdentifier& ti)
+{
+	return *Shards[hash_value(ti) % Shards.size()];
+}
+
+/**
+ * @brief Searches a tile in a shard and reports the access to the policy. The shard has to be locked.
+ *
+ * @param countAccess false to leave the hits of the tile and the policy untouched.
+ * @return the cached Tile or a null pointer.
+ **/
+shared_ptr<Tile> Cache::lookup(Shard& shard, const TileIdentifier& ti, bool countAccess)
+{
+	auto tileIt = shard.Tiles.find(ti);
+	if (tileIt == shard.Tiles.end())
+		return shared_ptr<Tile>();
+
+	CacheElement& element = tileIt->second;
+	if (countAccess) {
+		element.hits++;
+		shard.Policy->onHit(ti);
+	}
+	return element.tile;
+}
+
+/**
+ * @brief Charges a tile to its shard. The shard has to be locked.
+ *
+ * An image buffer is charged once per shard as long as any tile of the shard uses it,
+ * so tiles sharing an image are never left uncharged when the first of them is removed.
+ **/
+void Cache::hold(Shard& shard, CacheElement& element)
+{
+	element.image = element.tile->getImage();
+	element.size = tileSize(*element.tile, true);
+	std::size_t bytes = tileSize(*element.tile, false);
+	if (element.image && shard.Images[element.image.get()]++ == 0)
+		bytes += imageSize(element.image);
+	shard.Bytes += bytes;
+	MemoryUsage += bytes;
+}
+
+/**
+ * @brief Removes the charge of a tile from its shard, see hold. The shard has to be locked.
+ **/
+void Cache::release(Shard& shard, CacheElement& element)
+{
+	std::size_t bytes = tileSize(*element.tile, false);
+	if (element.image) {
+		auto it = shard.Images.find(element.image.get());
+		if (--it->second == 0) {
+			shard.Images.erase(it);
+			bytes += imageSize(element.image);
 		}
-	} else {
-		// e.g. Disk full
-		BOOST_THROW_EXCEPTION(excp::FileNotFoundException() << excp::InfoFileName(filename.string()));
 	}
+	shard.Bytes -= bytes;
+	MemoryUsage -= bytes;
+	element.image.reset();
+}
+
+/**
+ * @return true if the shard holds more tiles or memory than allowed. The shard has to be locked.
+ **/
+bool Cache::isFull(const Shard& shard) const
+{
+	return shard.Bytes > ShardBudget
+		|| (ShardCapacity > 0 && shard.Tiles.size() > ShardCapacity);
 }
 
-const boost::filesystem::path Cache::getTilePath(const shared_ptr<TileIdentifier>& ti) {
-	std::stringstream path;
-	path << Config->get<string>(opt::server::cache_path) << "/";
-	path << ti->getStylesheetPath() << "/";
-	path << ti->getZoom() << "/";
-	path << ti->getX() << "/";
-	path << ti->getY();
-	path << "." << ti->getImageFormatString();
-	boost::filesystem::path file(path.str());
-	return file;
+/**
+ * @brief Removes the tiles chosen by the policy until the shard fits its limits. The shard has to be locked.
+ *
+ * Tiles that should be kept on the hard drive are handed to the writer,
+ * which keeps them available until they are written.
+ *
+ * @param shard the shard to shrink.
+ **/
+void Cache::evict(Shard& shard)
+{
+	// the last tile is kept even if it exceeds the limit on its own
+	while (shard.Tiles.size() > 1 && isFull(shard)) {
+		TileIdentifier victim = shard.Policy->victim();
+		auto tileIt = shard.Tiles.find(victim);
+		shared_ptr<Tile> tileToDelete = tileIt->second.tile;
+		if (victim.getZoom() <= KeepTileZoom && !tileToDelete->isStale()) {
+			if (!tileToDelete->isRendered()) {
+				// Tile is not rendered yet, keep it until it can be written.
+				LOG_SEV(cache_log, debug) << "Evict: Image not yet rendered " << victim;
+				shard.Policy->onHit(victim);
+				break;
+			}
+			// Evict to hard drive, unless the image is already there.
+			if (!tileIt->second.stored)
+				Writer->enqueue(tileToDelete);
+		}
+		LOG_SEV(cache_log, debug) << "Deleting Tile chosen by the cache policy." << victim;
+		release(shard, tileIt->second);
+		shard.Tiles.erase(tileIt);
+		shard.Policy->onRemove(victim, true);
+		shard.Stats.evictions++;
+	}
 }
 
 /**
  * @brief Gets a Tile where the image data can be stored. If the Tile isn't cached a new Tile is returned.
+ *
+ * Only the shard of the tile is locked and no disk access happens while holding the lock.
  * 
  * @param ti A shared pointer to the TileIdentifier of the Tile.
+ * @param countAccess false for internal lookups that are no user request,
+ *        they are neither counted in the statistics nor reported to the policy.
  **/
-shared_ptr<Tile> Cache::getTile(const shared_ptr<TileIdentifier>& ti)
+shared_ptr<Tile> Cache::getTile(const shared_ptr<TileIdentifier>& ti, bool countAccess)
 {
-	// TODO: Finer Synchronization
-	GlobalCacheLock.lock();
-	shared_ptr<CacheOfOneStylesheet> cache;
-	const string& stylesheet = ti->getStylesheetPath();
-	auto cacheIt = AllCaches.find(stylesheet);
-	if (cacheIt != AllCaches.end()) {
-		// Found cache for Stylesheet.
-		cache = cacheIt->second;
-	} else {
-		// Creating a new cache for stylesheet.
-		cache = boost::make_shared<CacheOfOneStylesheet>();
-		AllCaches[stylesheet] = cache;
-		boost::filesystem::path dir(Config->get<string>(opt::server::cache_path) + "/" + ti->getStylesheetPath());
-		boost::filesystem::create_directories(dir);
-		LOG_SEV(cache_log, debug) << "Stylesheetcache " << stylesheet << " created.";
-	}
-	// Get tile from map
-	shared_ptr<Tile> tile;
-	auto tileIt = cache->find(*ti);
-	if (tileIt != cache->end()) {
-		// Cache hit
-		tile = tileIt->second.first;
-		RecentlyUsedList.erase(tileIt->second.second);
-		RecentlyUsedList.push_front(tileIt->second.first);
-		tileIt->second.second = RecentlyUsedList.begin();
-	}  else {
-		// Cache miss
-		tile = boost::make_shared<Tile>(ti);
-		if (ti->getZoom() <= Config->get<int>(opt::server::cache_keep_tile)) {
-			// Try to load prerendered image data from file.
-			boost::filesystem::path path = getTilePath(ti);
-			Tile::ImageType image = boost::make_shared<Tile::ImageType::element_type>();
-			try {
-				readFile(image, path);
-				tile->setImage(image);
-			} catch (excp::FileNotFoundException) {
-				LOG_SEV(cache_log, debug) << "readFile: Not found: " << path.string();
-			}
-		}
-		RecentlyUsedList.push_front(tile);
-		cache->insert(std::make_pair(*ti, CacheElement(tile, RecentlyUsedList.begin())));
-	}
-	while (RecentlyUsedList.size() > Config->get<int>(opt::server::cache_size)) {
-		shared_ptr<Tile> tileToDelete = RecentlyUsedList.back();
-		// Evict a Tile when cache is full.
-		if (tileToDelete->getIdentifier()->getZoom() <= Config->get<int>(opt::server::cache_keep_tile)) {
-			// Evict to hard drive.
-			shared_ptr<TileIdentifier> tiToDelete = tileToDelete->getIdentifier();
-			boost::filesystem::path path = getTilePath(tiToDelete);
-			try {
-				writeFile(tileToDelete, path);
-			} catch (excp::FileNotFoundException) {
-				LOG_SEV(cache_log, debug) << "WriteFile: Could not open file " << path.string();
-				// Disk is full
-			} catch (excp::InputFormatException) {
-				LOG_SEV(cache_log, debug) << "WriteFile: Image not yet rendered " << *tile->getIdentifier();
-				RecentlyUsedList.push_front(tileToDelete);
-				cacheIt = AllCaches.find(tileToDelete->getIdentifier()->getStylesheetPath());
-				if (cacheIt != AllCaches.end()) {
-					cacheIt->second->erase(*tileToDelete->getIdentifier());
-					cacheIt->second->insert(std::make_pair(*tiToDelete, CacheElement(tileToDelete, RecentlyUsedList.begin())));
-				}
-				RecentlyUsedList.pop_back();
-				break;
-			}
+	Shard& shard = getShard(*ti);
+
+	{
+		boost::mutex::scoped_lock lock(shard.Lock);
+		shared_ptr<Tile> tile = lookup(shard, *ti, countAccess);
+		if (tile) {
+			// Cache hit
+			if (countAccess)
+				shard.Stats.hits++;
+			return tile;
 		}
-		// Delete tile
-		LOG_SEV(cache_log, debug) << "Deleting least recently used Tile." << *tileToDelete->getIdentifier();
-		cacheIt = AllCaches.find(tileToDelete->getIdentifier()->getStylesheetPath());
-		if (cacheIt != AllCaches.end()) {
-			cacheIt->second->erase(*tileToDelete->getIdentifier());
+		if (countAccess)
+			shard.Stats.misses++;
+	}
+
+	// Cache miss, but the tile could still be waiting to be written.
+	shared_ptr<Tile> tile = Writer->find(*ti);
+	if (!tile) {
+		tile = boost::make_shared<Tile>(ti);
+		if (ti->getZoom() <= KeepTileZoom) {
+			// Try to load prerendered image data from the hard drive.
+			bool stale;
+			Tile::ImageType image = Store->read(*ti, &stale);
+			if (image)
+				tile->setImage(Pool->intern(image));
+			if (stale)
+				tile->markStale();
 		}
-		RecentlyUsedList.pop_back();
 	}
-	GlobalCacheLock.unlock();
+
+	{
+		boost::mutex::scoped_lock lock(shard.Lock);
+		// The tile could have been inserted while we were reading the file.
+		shared_ptr<Tile> cached = lookup(shard, *ti, countAccess);
+		if (cached)
+			return cached;
+
+		if (countAccess && tile->isRendered())
+			shard.Stats.loads++;
+		CacheElement& element = shard.Tiles[*ti];
+		element.tile = tile;
+		element.hits = 0;
+		element.stored = tile->isRendered();
+		hold(shard, element);
+		shard.Policy->onInsert(*ti, element.size);
+		evict(shard);
+	}
+
 	return tile;
 }
 
+/**
+ * @brief Replaces the cached tile with the same identifier by a tile that was just rendered.
+ *
+ * Cached tiles may still be answered or written by other threads, so their image is never
+ * changed. The rendered tile must not be handed out before it is stored here.
+ * Evicts tiles of the same shard if the tile no longer fits into the memory budget.
+ *
+ * @param tile the tile that was rendered.
+ **/
+void Cache::updateTile(const shared_ptr<Tile>& tile)
+{
+	bool stale = tile->isStale();
+	tile->setImage(Pool->intern(tile->getImage()));
+	// rendered with a stylesheet that changed in the meantime
+	if (stale)
+		tile->markStale();
+
+	Shard& shard = getShard(*tile->getIdentifier());
+	boost::mutex::scoped_lock lock(shard.Lock);
+	auto tileIt = shard.Tiles.find(*tile->getIdentifier());
+	// evicted or deleted while rendering
+	if (tileIt == shard.Tiles.end())
+		return;
+
+	release(shard, tileIt->second);
+	tileIt->second.tile = tile;
+	tileIt->second.stored = false;
+	hold(shard, tileIt->second);
+	shard.Policy->onResize(tileIt->first, tileIt->second.size);
+	evict(shard);
+}
+
+/**
+ * @brief Blocks until all evicted tiles are written to the hard drive.
+ **/
+void Cache::flush()
+{
+	Writer->flush();
+}
+
 /**
  * @brief Get the default tile used for error and such.
  * 
  * @return shared_ptr to the default Tile with loaded png (image can be null if file not found).
  **/
 shared_ptr<Tile> Cache::getDefaultTile() {
+	boost::mutex::scoped_lock lock(DefaultTileLock);
 	if (!DefaultTile) {
 		string path = Config->get<string>(opt::server::path_to_default_tile);
 		shared_ptr<TileIdentifier> ti = boost::make_shared<TileIdentifier>(-1, -1, -1, "/", TileIdentifier::Format::PNG);
@@ -203,16 +573,132 @@ shared_ptr<Tile> Cache::getDefaultTile() {
  **/
 void Cache::deleteTiles(const string path)
 {
-	try {
-		boost::filesystem::path dir(Config->get<string>(opt::server::cache_path) + path);
-		boost::system::error_code ec;
-		boost::filesystem::remove_all(dir, ec);
-		if (ec.value() == 39) {
-			LOG_SEV(cache_log, warning) << "could not delete all tiles in folder.";
+	string stylesheet = path;
+	if (!stylesheet.empty() && stylesheet[0] == '/')
+		stylesheet.erase(0, 1);
+
+	for (const shared_ptr<Shard>& shard : Shards) {
+		boost::mutex::scoped_lock lock(shard->Lock);
+		for (auto it = shard->Tiles.begin(); it != shard->Tiles.end();) {
+			if (it->first.getStylesheetPath() == stylesheet) {
+				shard->Policy->onRemove(it->first, false);
+				release(*shard, it->second);
+				it = shard->Tiles.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	Writer->discard(stylesheet);
+	Store->remove(stylesheet);
+}
+
+/**
+ * @brief Marks all Tiles of the Stylesheet with the given path as stale, in memory and on the hard drive.
+ *
+ * Unlike deleteTiles, the old images stay available until the tiles are rendered again.
+ *
+ * @param path The path to the stylesheet.
+ * @return number of tiles marked in memory.
+ **/
+std::size_t Cache::invalidateTiles(const string path)
+{
+	string stylesheet = path;
+	if (!stylesheet.empty() && stylesheet[0] == '/')
+		stylesheet.erase(0, 1);
+
+	std::size_t marked = 0;
+	for (const shared_ptr<Shard>& shard : Shards) {
+		boost::mutex::scoped_lock lock(shard->Lock);
+		for (auto& cached : shard->Tiles) {
+			if (cached.first.getStylesheetPath() == stylesheet) {
+				cached.second.tile->markStale();
+				cached.second.stored = false;
+				marked++;
+			}
 		}
-		AllCaches.erase(path);
-	} catch (std::out_of_range) {
-		LOG_SEV(cache_log, warning) << "trying to delete Tiles of non existant Stylesheet.";
 	}
+
+	// evicted tiles could be marked before they are written
+	Writer->flush();
+	std::size_t files = Store->markAllStale(stylesheet);
+
+	LOG_SEV(cache_log, info) << "Invalidated " << marked << " tiles in memory and " << files << " files of stylesheet " << stylesheet << ".";
+	return marked;
 }
 
+/**
+ * @brief Marks all tiles touching an area as stale, in memory and on the hard drive.
+ *
+ * Stale tiles are rendered again when they are requested. Until then the hard drive
+ * keeps their old image, which is not overwritten by evicted stale tiles.
+ *
+ * @param area the invalidated area in mercator coordinates.
+ * @param minZoom lowest invalidated zoomlevel.
+ * @param maxZoom highest invalidated zoomlevel.
+ * @param stylesheet path of the stylesheet, empty for all stylesheets.
+ * @return the affected metatiles, lower zoomlevels and more requested metatiles first.
+ **/
+std::vector<shared_ptr<MetaIdentifier>> Cache::invalidate(const FixedRect& area, int minZoom, int maxZoom, const string& stylesheet)
+{
+	string style = stylesheet;
+	if (!style.empty() && style[0] == '/')
+		style.erase(0, 1);
+
+	// affected metatiles with the number of requests of their cached tiles
+	boost::unordered_map<TileIdentifier, std::size_t> metatiles;
+	for (const shared_ptr<Shard>& shard : Shards) {
+		boost::mutex::scoped_lock lock(shard->Lock);
+		for (auto& cached : shard->Tiles) {
+			const TileIdentifier& ti = cached.first;
+			if (ti.getZoom() < minZoom || ti.getZoom() > maxZoom)
+				continue;
+			if (!style.empty() && ti.getStylesheetPath() != style)
+				continue;
+			int x0, y0, x1, y1;
+			tileRange(area, ti.getZoom(), x0, y0, x1, y1);
+			if (ti.getX() < x0 || ti.getX() > x1 || ti.getY() < y0 || ti.getY() > y1)
+				continue;
+
+			cached.second.tile->markStale();
+			cached.second.stored = false;
+			metatiles[MetaIdentifier::Origin(ti)] += cached.second.hits + 1;
+		}
+	}
+
+	// evicted tiles could be marked before they are written
+	Writer->flush();
+
+	std::vector<string> stylesheets;
+	if (!style.empty()) {
+		stylesheets.push_back(style);
+	} else {
+		boost::system::error_code ec;
+		for (boost::filesystem::directory_iterator it(CachePath, ec), end; !ec && it != end; it.increment(ec)) {
+			if (boost::filesystem::is_directory(it->status()))
+				stylesheets.push_back(it->path().filename().string());
+		}
+	}
+	for (int zoom = std::max(minZoom, 0); zoom <= std::min(maxZoom, KeepTileZoom); zoom++) {
+		int x0, y0, x1, y1;
+		tileRange(area, zoom, x0, y0, x1, y1);
+		for (const string& s : stylesheets) {
+			for (const TileIdentifier& ti : Store->markStale(s, zoom, x0, y0, x1, y1))
+				metatiles[MetaIdentifier::Origin(ti)];
+		}
+	}
+
+	std::vector<std::pair<TileIdentifier, std::size_t>> order(metatiles.begin(), metatiles.end());
+	std::sort(order.begin(), order.end(), [](const std::pair<TileIdentifier, std::size_t>& a, const std::pair<TileIdentifier, std::size_t>& b) {
+		if (a.first.getZoom() != b.first.getZoom())
+			return a.first.getZoom() < b.first.getZoom();
+		return a.second > b.second;
+	});
+	std::vector<shared_ptr<MetaIdentifier>> result;
+	for (auto& metatile : order)
+		result.push_back(boost::make_shared<MetaIdentifier>(metatile.first));
+
+	LOG_SEV(cache_log, info) << "Invalidated " << result.size() << " metatiles of zoomlevel " << minZoom << " to " << maxZoom << ".";
+	return result;
+}
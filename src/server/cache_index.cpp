@@ -0,0 +1,87 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/cache_index.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+
+CacheIndex::CacheIndex(const boost::filesystem::path& path)
+	: path(path)
+{
+}
+
+/**
+ * @brief Replaces the snapshot with the given tiles, the most requested first.
+ **/
+void CacheIndex::save(std::vector<Entry> entries)
+{
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.frequency > b.frequency;
+	});
+
+	boost::system::error_code ec;
+	boost::filesystem::create_directories(path.parent_path(), ec);
+	boost::filesystem::path tmp = path.string() + ".tmp";
+	{
+		std::ofstream file(tmp.string(), std::ios::out | std::ios::trunc);
+		for (const Entry& entry : entries) {
+			const TileIdentifier& ti = entry.tile;
+			file << entry.frequency << ' ' << ti.getZoom() << ' ' << ti.getX() << ' ' << ti.getY() << ' '
+				 << (int) ti.getImageFormat() << ' ' << ti.getStylesheetPath() << '\n';
+		}
+		if (!file) {
+			LOG_SEV(cache_log, warning) << "Could not write the cache index " << tmp;
+			boost::filesystem::remove(tmp, ec);
+			return;
+		}
+	}
+	boost::filesystem::rename(tmp, path, ec);
+	if (ec)
+		LOG_SEV(cache_log, warning) << "Could not replace the cache index " << path << ": " << ec.message();
+}
+
+/**
+ * @return the most requested tiles of the last snapshot, empty if there is none.
+ *
+ * @param limit maximal number of tiles to return.
+ **/
+std::vector<CacheIndex::Entry> CacheIndex::load(std::size_t limit) const
+{
+	std::vector<Entry> entries;
+	std::ifstream file(path.string());
+	std::size_t frequency;
+	int zoom, x, y, format;
+	string stylesheet;
+	while (entries.size() < limit && file >> frequency >> zoom >> x >> y >> format) {
+		file.ignore(1);
+		if (!std::getline(file, stylesheet))
+			break;
+		if (format < 0 || format >= TileIdentifier::enumSize) {
+			LOG_SEV(cache_log, warning) << "Invalid entry in the cache index " << path;
+			continue;
+		}
+		entries.push_back(Entry{TileIdentifier(x, y, zoom, stylesheet, (TileIdentifier::Format) format), frequency});
+	}
+	return entries;
+}
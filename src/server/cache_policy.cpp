@@ -0,0 +1,387 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/cache_policy.hpp"
+
+#include "utils/exceptions.hpp"
+
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <list>
+#include <vector>
+
+
+namespace {
+	/**
+	 * @brief Tiles ordered by their last use together with their sizes.
+	 **/
+	class TileQueue
+	{
+	public:
+		TileQueue() : bytes(0) {}
+
+		bool contains(const TileIdentifier& ti) const { return positions.find(ti) != positions.end(); }
+		bool empty() const { return order.empty(); }
+		std::size_t getBytes() const { return bytes; }
+		const TileIdentifier& back() const { return order.back().first; }
+		std::size_t backSize() const { return order.back().second; }
+
+		void pushFront(const TileIdentifier& ti, std::size_t size)
+		{
+			order.push_front(std::make_pair(ti, size));
+			positions[ti] = order.begin();
+			bytes += size;
+		}
+
+		//! Marks a tile as most recently used.
+		void touch(const TileIdentifier& ti)
+		{
+			auto it = positions.find(ti);
+			if (it != positions.end())
+				order.splice(order.begin(), order, it->second);
+		}
+
+		//! @return false if the tile is not part of this queue.
+		bool resize(const TileIdentifier& ti, std::size_t size)
+		{
+			auto it = positions.find(ti);
+			if (it == positions.end())
+				return false;
+			bytes += size - it->second->second;
+			it->second->second = size;
+			return true;
+		}
+
+		//! @return the size of the removed tile or 0 if the tile is not part of this queue.
+		std::size_t remove(const TileIdentifier& ti)
+		{
+			auto it = positions.find(ti);
+			if (it == positions.end())
+				return 0;
+			std::size_t size = it->second->second;
+			bytes -= size;
+			order.erase(it->second);
+			positions.erase(it);
+			return size;
+		}
+
+		void popBack() { remove(order.back().first); }
+
+	private:
+		typedef std::list<std::pair<TileIdentifier, std::size_t>> Order;
+		Order order;
+		boost::unordered_map<TileIdentifier, Order::iterator> positions;
+		std::size_t bytes;
+	};
+
+	/**
+	 * @brief Evicts the least recently used tile.
+	 **/
+	class LruPolicy : public CachePolicy
+	{
+	public:
+		virtual void onHit(const TileIdentifier& ti) { tiles.touch(ti); }
+		virtual void onInsert(const TileIdentifier& ti, std::size_t size) { tiles.pushFront(ti, size); }
+		virtual void onResize(const TileIdentifier& ti, std::size_t size) { tiles.resize(ti, size); }
+		virtual void onRemove(const TileIdentifier& ti, bool) { tiles.remove(ti); }
+		virtual TileIdentifier victim() { return tiles.back(); }
+
+	private:
+		TileQueue tiles;
+	};
+
+	/**
+	 * @brief Estimates how often a tile was requested recently.
+	 *
+	 * Four rows of 4 bit counters, the smallest counter of a tile is its estimate.
+	 * All counters are halved after 10 increments per counter, so old popularity fades.
+	 **/
+	class FrequencySketch
+	{
+	public:
+		static const int DEPTH = 4;
+		static const uint8_t MAX_COUNT = 15;
+
+		explicit FrequencySketch(std::size_t expectedTiles)
+			: width(1)
+			, additions(0)
+		{
+			while (width < expectedTiles)
+				width *= 2;
+			counters.assign(width * DEPTH, 0);
+			resetInterval = 10 * width;
+		}
+
+		void increment(const TileIdentifier& ti)
+		{
+			std::size_t hash = hash_value(ti);
+			for (int row = 0; row < DEPTH; row++) {
+				uint8_t& counter = counters[index(hash, row)];
+				if (counter < MAX_COUNT)
+					counter++;
+			}
+			if (++additions >= resetInterval)
+				age();
+		}
+
+		int frequency(const TileIdentifier& ti) const
+		{
+			std::size_t hash = hash_value(ti);
+			int count = MAX_COUNT;
+			for (int row = 0; row < DEPTH; row++)
+				count = std::min<int>(count, counters[index(hash, row)]);
+			return count;
+		}
+
+	private:
+		std::size_t index(std::size_t hash, int row) const
+		{
+			// derive independent hashes for every row
+			std::size_t h = (hash + row) * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 32;
+			return row * width + (h & (width - 1));
+		}
+
+		void age()
+		{
+			for (uint8_t& counter : counters)
+				counter /= 2;
+			additions /= 2;
+		}
+
+		std::size_t width;
+		std::vector<uint8_t> counters;
+		std::size_t additions;
+		std::size_t resetInterval;
+	};
+
+	/**
+	 * @brief W-TinyLFU: an LRU window followed by a segmented LRU guarded by a frequency filter.
+	 *
+	 * New tiles enter the window. A tile pushed out of the window replaces the oldest tile of the
+	 * probation segment only if it was requested more often, otherwise it is evicted itself.
+	 * Tiles requested again while on probation move to the protected segment.
+	 **/
+	class TinyLfuPolicy : public CachePolicy
+	{
+	public:
+		//! Share of the capacity used for the window in percent
+		static const std::size_t WINDOW_PERCENT = 1;
+		//! Share of the main segment used for protected tiles in percent
+		static const std::size_t PROTECTED_PERCENT = 80;
+		//! Assumed size of an average tile to size the sketch
+		static const std::size_t AVERAGE_TILE_SIZE = 4096;
+
+		explicit TinyLfuPolicy(std::size_t capacity)
+			: windowCapacity(std::max<std::size_t>(capacity * WINDOW_PERCENT / 100, 1))
+			, mainCapacity(capacity - std::min(capacity, windowCapacity))
+			, protectedCapacity(mainCapacity * PROTECTED_PERCENT / 100)
+			, sketch(std::max<std::size_t>(capacity / AVERAGE_TILE_SIZE, 1024))
+		{
+		}
+
+		virtual void onHit(const TileIdentifier& ti)
+		{
+			sketch.increment(ti);
+			if (window.contains(ti)) {
+				window.touch(ti);
+			} else if (probation.contains(ti)) {
+				protect.pushFront(ti, probation.remove(ti));
+				while (protect.getBytes() > protectedCapacity && !protect.empty()) {
+					probation.pushFront(protect.back(), protect.backSize());
+					protect.popBack();
+				}
+			} else {
+				protect.touch(ti);
+			}
+		}
+
+		virtual void onInsert(const TileIdentifier& ti, std::size_t size)
+		{
+			sketch.increment(ti);
+			window.pushFront(ti, size);
+		}
+
+		virtual void onResize(const TileIdentifier& ti, std::size_t size)
+		{
+			if (!window.resize(ti, size) && !probation.resize(ti, size))
+				protect.resize(ti, size);
+		}
+
+		virtual void onRemove(const TileIdentifier& ti, bool)
+		{
+			if (!window.remove(ti) && !probation.remove(ti))
+				protect.remove(ti);
+		}
+
+		virtual TileIdentifier victim()
+		{
+			while (window.getBytes() > windowCapacity && !window.empty()) {
+				if (probation.getBytes() + protect.getBytes() + window.backSize() <= mainCapacity) {
+					// the main segment has room left
+					moveToProbation();
+					continue;
+				}
+				TileQueue& main = probation.empty() ? protect : probation;
+				if (main.empty())
+					break;
+				if (sketch.frequency(window.back()) > sketch.frequency(main.back())) {
+					TileIdentifier rejected = main.back();
+					moveToProbation();
+					return rejected;
+				}
+				return window.back();
+			}
+
+			if (!probation.empty())
+				return probation.back();
+			if (!protect.empty())
+				return protect.back();
+			return window.back();
+		}
+
+	private:
+		void moveToProbation()
+		{
+			probation.pushFront(window.back(), window.backSize());
+			window.popBack();
+		}
+
+		const std::size_t windowCapacity;
+		const std::size_t mainCapacity;
+		const std::size_t protectedCapacity;
+		FrequencySketch sketch;
+		TileQueue window;
+		TileQueue probation;
+		TileQueue protect;
+	};
+
+	/**
+	 * @brief Adaptive Replacement Cache, weighted by the size of the tiles.
+	 *
+	 * Tiles seen once are kept in t1, tiles seen again in t2. Evicted tiles are remembered
+	 * in b1 and b2. A miss on a remembered tile shifts the target size of t1 towards the
+	 * list that would have kept it.
+	 **/
+	class ArcPolicy : public CachePolicy
+	{
+	public:
+		explicit ArcPolicy(std::size_t capacity)
+			: capacity(capacity)
+			, target(0)
+		{
+		}
+
+		virtual void onHit(const TileIdentifier& ti)
+		{
+			if (t1.contains(ti))
+				t2.pushFront(ti, t1.remove(ti));
+			else
+				t2.touch(ti);
+		}
+
+		virtual void onInsert(const TileIdentifier& ti, std::size_t size)
+		{
+			if (b1.contains(ti)) {
+				std::size_t delta = std::max<std::size_t>(b2.getBytes() / std::max<std::size_t>(b1.getBytes(), 1), 1) * size;
+				target = std::min(capacity, target + delta);
+				b1.remove(ti);
+				t2.pushFront(ti, size);
+			} else if (b2.contains(ti)) {
+				std::size_t delta = std::max<std::size_t>(b1.getBytes() / std::max<std::size_t>(b2.getBytes(), 1), 1) * size;
+				target = target > delta ? target - delta : 0;
+				b2.remove(ti);
+				t2.pushFront(ti, size);
+			} else {
+				t1.pushFront(ti, size);
+			}
+			trimHistory();
+		}
+
+		virtual void onResize(const TileIdentifier& ti, std::size_t size)
+		{
+			if (!t1.resize(ti, size))
+				t2.resize(ti, size);
+		}
+
+		virtual void onRemove(const TileIdentifier& ti, bool evicted)
+		{
+			if (t1.contains(ti)) {
+				std::size_t size = t1.remove(ti);
+				if (evicted)
+					b1.pushFront(ti, size);
+			} else {
+				std::size_t size = t2.remove(ti);
+				if (evicted)
+					b2.pushFront(ti, size);
+			}
+			trimHistory();
+		}
+
+		virtual TileIdentifier victim()
+		{
+			if (!t1.empty() && (t1.getBytes() > target || t2.empty()))
+				return t1.back();
+			return t2.back();
+		}
+
+	private:
+		//! Forgets evicted tiles so the history stays as large as the cache.
+		void trimHistory()
+		{
+			while (!b1.empty() && t1.getBytes() + b1.getBytes() > capacity)
+				b1.popBack();
+			while (!b2.empty() && t1.getBytes() + t2.getBytes() + b1.getBytes() + b2.getBytes() > 2 * capacity)
+				b2.popBack();
+		}
+
+		const std::size_t capacity;
+		//! target size of t1 in bytes
+		std::size_t target;
+		TileQueue t1;
+		TileQueue t2;
+		TileQueue b1;
+		TileQueue b2;
+	};
+}
+
+/**
+ * @brief Creates the policy with the given name as used in the configuration.
+ *
+ * @param name "lru", "tinylfu" or "arc".
+ * @param capacity memory in bytes available for the tiles managed by the policy.
+ **/
+shared_ptr<CachePolicy> CachePolicy::Create(const string& name, std::size_t capacity)
+{
+	if (name == "lru")
+		return boost::make_shared<LruPolicy>();
+	if (name == "tinylfu")
+		return boost::make_shared<TinyLfuPolicy>(capacity);
+	if (name == "arc")
+		return boost::make_shared<ArcPolicy>(capacity);
+
+	BOOST_THROW_EXCEPTION(excp::InputFormatException() << excp::InfoWhat("Unknown cache policy: " + name));
+}
+
+CachePolicy::~CachePolicy()
+{
+}
@@ -0,0 +1,116 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/empty_metatile_map.hpp"
+
+#include "server/tile_identifier.hpp"
+#include "server/meta_identifier.hpp"
+
+#include <algorithm>
+
+
+namespace {
+	//! @return number of metatiles in x or y direction on a zoomlevel.
+	std::size_t metatilesPerAxis(int zoom)
+	{
+		std::size_t size = MetaIdentifier::Size(zoom);
+		return ((std::size_t(1) << zoom) + size - 1) / size;
+	}
+}
+
+EmptyMetatileMap::EmptyMetatileMap()
+	: marked(0)
+{
+	std::size_t words = 0;
+	for (int zoom = 0; zoom <= MAX_ZOOM; zoom++) {
+		offsets.push_back(words);
+		std::size_t count = metatilesPerAxis(zoom) * metatilesPerAxis(zoom);
+		words += (count + 63) / 64;
+	}
+	bits.reset(new std::atomic<uint64_t>[words]());
+}
+
+/**
+ * @brief Finds the bit of the metatile containing ti.
+ *
+ * @param exact false if the bit of the ancestor on MAX_ZOOM may be used for higher zoomlevels.
+ * @return false if there is no bit for the tile.
+ **/
+bool EmptyMetatileMap::locate(const TileIdentifier& ti, bool exact, std::size_t& word, uint64_t& mask) const
+{
+	int zoom = ti.getZoom();
+	if (zoom < 0 || ti.getX() < 0 || ti.getY() < 0 || (exact && zoom > MAX_ZOOM))
+		return false;
+	if (ti.getX() >= (1 << std::min(zoom, 30)) || ti.getY() >= (1 << std::min(zoom, 30)))
+		return false;
+
+	std::size_t x = ti.getX();
+	std::size_t y = ti.getY();
+	if (zoom > MAX_ZOOM) {
+		// the metatile has to be part of the ancestor
+		if (MetaIdentifier::Size(zoom) > (MetaIdentifier::Size(MAX_ZOOM) << std::min(zoom - MAX_ZOOM, 16)))
+			return false;
+		x >>= zoom - MAX_ZOOM;
+		y >>= zoom - MAX_ZOOM;
+		zoom = MAX_ZOOM;
+	}
+	std::size_t size = MetaIdentifier::Size(zoom);
+	std::size_t index = y / size * metatilesPerAxis(zoom) + x / size;
+	word = offsets[zoom] + index / 64;
+	mask = uint64_t(1) << (index % 64);
+	return true;
+}
+
+/**
+ * @return true if the metatile containing ti is known to contain no data.
+ **/
+bool EmptyMetatileMap::isEmpty(const TileIdentifier& ti) const
+{
+	std::size_t word;
+	uint64_t mask;
+	if (!locate(ti, false, word, mask))
+		return false;
+	return (bits[word].load(std::memory_order_relaxed) & mask) != 0;
+}
+
+/**
+ * @brief Remembers that the metatile containing ti contains no data.
+ *
+ * Metatiles above MAX_ZOOM are not remembered, as their bit covers a larger area.
+ **/
+void EmptyMetatileMap::markEmpty(const TileIdentifier& ti)
+{
+	std::size_t word;
+	uint64_t mask;
+	if (!locate(ti, true, word, mask))
+		return;
+	if ((bits[word].fetch_or(mask, std::memory_order_relaxed) & mask) == 0)
+		marked++;
+}
+
+/**
+ * @return number of metatiles marked as empty.
+ **/
+std::size_t EmptyMetatileMap::getMarkedCount() const
+{
+	return marked;
+}
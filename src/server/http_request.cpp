@@ -29,10 +29,12 @@
 #include "server/cache.hpp"
 
 HttpRequest::HttpRequest ( boost::asio::io_service &ioService, const shared_ptr<HttpServer>& server, const shared_ptr<RequestManager> &manager )
-	: socket ( ioService )
+	: ioService ( ioService )
+	, socket ( ioService )
 	, server ( server )
 	, manager ( manager )
 	, answered (false)
+	, disconnected (false)
 {
 
 };
@@ -66,9 +68,14 @@ void HttpRequest::handleRead ( const boost::system::error_code &e, std::size_t b
 		boost::tie ( result, boost::tuples::ignore ) = parser.parse ( shared_from_this(), buffer.data(), buffer.data() + bytes_transferred );
 
 		if ( result ) {
+			// workers must not use the socket, it belongs to the thread of the server
+			boost::system::error_code ec;
+			boost::asio::ip::tcp::endpoint endpoint = socket.remote_endpoint(ec);
+			if (!ec)
+				client = endpoint.address().to_string();
+			watchConnection();
 			manager->enqueue ( shared_from_this() );
 		} else if ( !result ) {
-			if (checkifAnswered()) return;
 			answer ( HttpRequest::Reply::bad_request );
 		} else {
 			readSome();
@@ -79,6 +86,50 @@ void HttpRequest::handleRead ( const boost::system::error_code &e, std::size_t b
 
 }
 
+/**
+ * @brief Reads from the socket until the client closes the connection, to notice clients that leave early.
+ **/
+void HttpRequest::watchConnection()
+{
+	socket.async_read_some ( boost::asio::buffer ( buffer ),
+							 boost::bind(&HttpRequest::handleDisconnect, shared_from_this(),
+										 boost::asio::placeholders::error,
+										 boost::asio::placeholders::bytes_transferred
+										)
+						   );
+}
+
+void HttpRequest::handleDisconnect ( const boost::system::error_code &e, std::size_t bytes_transferred )
+{
+	if ( !e ) {
+		// ignore anything the client sends after the request
+		watchConnection();
+	} else if ( e == boost::asio::error::eof && keepsHalfClosed() ) {
+		// the client only closed its sending side and still waits for the answer
+		LOG_SEV(server_log, debug) << "Client half-closed the connection for \"" << data.uri << "\"";
+	} else if ( e != boost::asio::error::operation_aborted && !answered ) {
+		// browsers close the connection of an aborted tile request, which arrives as eof
+		LOG_SEV(server_log, debug) << "Client disconnected before \"" << data.uri << "\" was answered";
+		disconnected = true;
+	}
+}
+
+bool HttpRequest::keepsHalfClosed() const
+{
+	shared_ptr<HttpServer> server = this->server.lock();
+	return server && server->keepsHalfClosed();
+}
+
+/**
+ * @brief Removes the request from the server, has to run in the thread of the server.
+ **/
+void HttpRequest::release()
+{
+	shared_ptr<HttpServer> server = this->server.lock();
+	if (server)
+		server->stopRequest ( shared_from_this() );
+}
+
 void HttpRequest::handleWrite ( const boost::system::error_code &e )
 {
 	shared_ptr<HttpServer> server = this->server.lock();
@@ -105,17 +156,43 @@ boost::asio::ip::tcp::socket &HttpRequest::getSocket()
 	return socket;
 }
 
-bool HttpRequest::checkifAnswered()
+/**
+ * @return the address of the client, empty if it was not connected when the request was read.
+ **/
+string HttpRequest::getClient() const
+{
+	return client;
+}
+
+/**
+ * @return true if the connection to the client broke, the answer would be discarded.
+ **/
+bool HttpRequest::isDisconnected() const
 {
-	if (answered) {
+	return disconnected;
+}
+
+/**
+ * @brief Marks the request as answered, only the first caller may answer it.
+ *
+ * @return false if the request was already answered.
+ **/
+bool HttpRequest::claimAnswer()
+{
+	if (answered.exchange(true)) {
 		LOG_SEV(server_log, error) << "Tried to answer an already answered HttpRequest: " << getURL();
+		return false;
 	}
-	return answered;
+	return true;
 }
 
-void HttpRequest::answer()
+/**
+ * @brief Sends the reply, has to run in the thread of the server.
+ *
+ * The socket always has a read pending there to notice disconnects, so workers must not write to it.
+ **/
+void HttpRequest::write()
 {
-	answered = true;
 	boost::asio::async_write ( socket, reply.toBuffers(),
 							   boost::bind ( &HttpRequest::handleWrite, shared_from_this(),
 									   boost::asio::placeholders::error ) );
@@ -131,13 +208,17 @@ void HttpRequest::answer ( Reply::StatusType status )
 
 void HttpRequest::answer ( const shared_ptr<Tile>& tile, Reply::StatusType status )
 {
-	if (checkifAnswered()) return;
+	if (!claimAnswer()) return;
+	if (disconnected) {
+		ioService.post(boost::bind(&HttpRequest::release, shared_from_this()));
+		return;
+	}
 	reply.status = status;
 	reply.content = "";
-	reply.tile = tile;
+	reply.image = tile->getImage();
 	reply.headers.resize ( 2 );
 	reply.headers[0].name = "Content-Length";
-	reply.headers[0].value = boost::lexical_cast<string> ( tile->getImage()->size() );
+	reply.headers[0].value = boost::lexical_cast<string> ( reply.image->size() );
 	reply.headers[1].name = "Content-Type";
 	reply.headers[1].value = "image/";
 	reply.headers[1].value.append ( tile->getIdentifier()->getImageFormatString() );
@@ -145,7 +226,7 @@ void HttpRequest::answer ( const shared_ptr<Tile>& tile, Reply::StatusType statu
 	//	IP					Date				Method		url			Version  Reply Size duration
 	//80.101.90.180 - [02/Jun/2009:15:11:52 -0400] "GET /css/style.css HTTP/1.1" 200 2816 12
 	auto now = boost::posix_time::second_clock::local_time();
-	LOG_SEV(access_log, info) << socket.remote_endpoint().address().to_string()
+	LOG_SEV(access_log, info) << getClient()
 						<< " - ["
 						<< now.date().day() << "/" << now.date().month() << "/" << now.date().year()
 						<< ":" << now.time_of_day().hours() << ":" << now.time_of_day().minutes() << ":" << now.time_of_day().seconds()
@@ -154,7 +235,7 @@ void HttpRequest::answer ( const shared_ptr<Tile>& tile, Reply::StatusType statu
 						<< reply.status << " " << reply.headers[0].value;
 
 	LOG_SEV(server_log, info) << "Answered \"" << data.uri << "\"";
-	answer();
+	ioService.post(boost::bind(&HttpRequest::write, shared_from_this()));
 }
 
 namespace status_strings
@@ -252,8 +333,8 @@ std::vector<boost::asio::const_buffer> HttpRequest::Reply::toBuffers ()
 
 	buffers.push_back ( boost::asio::buffer ( crlf ) );
 	buffers.push_back ( boost::asio::buffer ( content ) );
-	if (tile) {
-		buffers.push_back ( boost::asio::const_buffer ( ( void * ) tile->getImage()->data(), tile->getImage()->size() ) );
+	if (image) {
+		buffers.push_back ( boost::asio::const_buffer ( ( void * ) image->data(), image->size() ) );
 	}
 	return buffers;
 }
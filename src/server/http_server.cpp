@@ -38,6 +38,7 @@ HttpServer::HttpServer( const shared_ptr<Configuration>& config, const shared_pt
 	, io_service()
 	, signals(io_service)
 	, acceptor(io_service)
+	, keepHalfClosed(config->get<bool>(opt::server::keep_half_closed, false))
 {
 	// Register to handle the signals that indicate when the server should exit.
 	// It is safe to register for the same signal multiple times in a program,
@@ -142,3 +143,10 @@ void HttpServer::quit()
 	Statistic::Get()->printStatistic();
 }
 
+/**
+ * @return true if clients that closed their sending side are answered instead of treated as disconnected.
+ **/
+bool HttpServer::keepsHalfClosed() const
+{
+	return keepHalfClosed;
+}
@@ -0,0 +1,159 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/image_pool.hpp"
+
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+
+
+namespace {
+	//! Minimal number of insertions between two scans for expired entries
+	const std::size_t CLEANUP_INTERVAL = 4096;
+}
+
+ImagePool::ImagePool()
+	: cleanupCountdown(CLEANUP_INTERVAL)
+	, lookups(0)
+	, hits(0)
+	, savedBytes(0)
+{
+}
+
+/**
+ * @return hash of the bytes of an image.
+ **/
+std::size_t ImagePool::Hash(const Tile::ImageType& image)
+{
+	return boost::hash_range(image->begin(), image->end());
+}
+
+/**
+ * @brief Returns the shared buffer with the same content as image.
+ *
+ * If no such buffer exists, image becomes the shared buffer.
+ *
+ * @param image rendered image data, must not be changed afterwards.
+ * @param shared set to true if an existing buffer is returned.
+ **/
+Tile::ImageType ImagePool::intern(const Tile::ImageType& image, bool* shared)
+{
+	if (shared)
+		*shared = false;
+	if (!image)
+		return image;
+
+	std::size_t hash = Hash(image);
+	boost::mutex::scoped_lock guard(lock);
+	lookups++;
+
+	auto it = images.find(hash);
+	if (it != images.end()) {
+		Tile::ImageType existing = it->second.image.lock();
+		if (existing == image)
+			return image;
+		if (existing && *existing == *image) {
+			it->second.hits++;
+			hits++;
+			savedBytes += image->capacity();
+			if (shared)
+				*shared = true;
+			return existing;
+		}
+		if (existing) {
+			// hash collision, keep the first image
+			return image;
+		}
+		it->second.image = image;
+		it->second.hits = 0;
+		return image;
+	}
+
+	images[hash] = Entry{image, 0};
+	if (--cleanupCountdown == 0)
+		removeExpired();
+	return image;
+}
+
+/**
+ * @return true if the image is a shared buffer that was found more than once.
+ **/
+bool ImagePool::isDuplicate(const Tile::ImageType& image)
+{
+	if (!image)
+		return false;
+
+	std::size_t hash = Hash(image);
+	boost::mutex::scoped_lock guard(lock);
+	auto it = images.find(hash);
+	return it != images.end() && it->second.hits > 0 && it->second.image.lock() == image;
+}
+
+/**
+ * @brief Removes entries of buffers that are no longer used. Must be called with the lock held.
+ **/
+void ImagePool::removeExpired()
+{
+	for (auto it = images.begin(); it != images.end();) {
+		if (it->second.image.expired())
+			it = images.erase(it);
+		else
+			++it;
+	}
+	cleanupCountdown = std::max(CLEANUP_INTERVAL, images.size());
+}
+
+/**
+ * @return number of images given to intern.
+ **/
+std::size_t ImagePool::getLookups()
+{
+	boost::mutex::scoped_lock guard(lock);
+	return lookups;
+}
+
+/**
+ * @return number of images replaced by an existing buffer.
+ **/
+std::size_t ImagePool::getHits()
+{
+	boost::mutex::scoped_lock guard(lock);
+	return hits;
+}
+
+/**
+ * @return number of bytes that did not need to be kept because of shared buffers.
+ **/
+std::size_t ImagePool::getSavedBytes()
+{
+	boost::mutex::scoped_lock guard(lock);
+	return savedBytes;
+}
+
+/**
+ * @return number of distinct images known to the pool.
+ **/
+std::size_t ImagePool::size()
+{
+	boost::mutex::scoped_lock guard(lock);
+	return images.size();
+}
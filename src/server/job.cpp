@@ -21,6 +21,7 @@
 
 
 #include "server/job.hpp"
+#include "server/job_pipeline.hpp"
 #include "server/request_manager.hpp"
 #include "server/cache.hpp"
 #include "server/tile.hpp"
@@ -28,7 +29,9 @@
 #include "server/stylesheet_manager.hpp"
 #include "server/stylesheet.hpp"
 #include "server/renderer/renderer.hpp"
+#include "server/renderer/render_canvas.hpp"
 #include "server/meta_identifier.hpp"
+#include "server/empty_metatile_map.hpp"
 #include "server/http_request.hpp"
 #include "general/geodata.hpp"
 #include "general/configuration.hpp"
@@ -37,6 +40,10 @@
 #include "utils/transform.hpp"
 #include "utils/statistic.hpp"
 
+#include <boost/thread/condition_variable.hpp>
+#include <algorithm>
+#include <atomic>
+
 #define STAT_START(_X) 			Statistic::Get()->start(measurement, _X)
 #define STAT_STOP(_X) 			Statistic::Get()->stop(measurement, _X)
 #define STAT_STATS(_X, _Y, _Z) 	Statistic::Get()->setStats(measurement, _X, _Y, _Z)
@@ -47,41 +54,24 @@
  *
  * @param config The Configuration, e.g. for the prerender_level.
  * @param manager The RequestManager which holds all important components.
+ * @param canvases The pool to borrow canvases from for rendering.
  **/
 Job::Job(const shared_ptr<MetaIdentifier>& mid,
 		 const shared_ptr<Configuration>& config,
 		 const shared_ptr<RequestManager>& manager,
-		 const shared_ptr<RenderCanvas>& canvas)
+		 const shared_ptr<RenderCanvasPool>& canvases)
 	: manager(manager)
 	, config(config)
 	, mid(mid)
-	, canvas(canvas)
+	, canvasPool(canvases)
+	, empty(false)
+	, cached(false)
+	, aborted(false)
+	, generation(0)
 	, measurement(Statistic::Get()->startNewMeasurement(mid->getStylesheetPath(), mid->getZoom()))
 {
 }
 
-/**
- * @brief Computes an rectangle for the given TileIdentifier.
- *
- * @param ti The TileIdentifier.
- **/
-FixedRect Job::computeRect(const shared_ptr<TileIdentifier>& ti)
-{
-	int zoom = ti->getZoom();
-	coord_t x0, x1, y0, y1;
-	tileToMercator(ti->getX(), ti->getY(), zoom, x0, y0);
-	tileToMercator(ti->getX() + 1, ti->getY() + 1, zoom, x1, y1);
-
-	coord_t minX = std::min(x0, x1);
-	coord_t minY = std::min(y0, y1);
-	coord_t maxX = std::max(x0, x1);
-	coord_t maxY = std::max(y0, y1);
-
-	FixedRect tile(minX, minY, maxX, maxY);
-	return tile.grow(tile.getWidth()  * TILE_OVERLAP,
-					 tile.getHeight() * TILE_OVERLAP);
-}
-
 /**
  * @brief Computes an rectangle for the given MetaIdentifier.
  *
@@ -102,8 +92,8 @@ FixedRect Job::computeRect(const shared_ptr<MetaIdentifier>& ti)
 	coord_t maxY = std::max(y0, y1);
 
 	FixedRect tile(minX, minY, maxX, maxY);
-	return tile.grow(tile.getWidth()  * TILE_OVERLAP,
-					 tile.getHeight() * TILE_OVERLAP);
+	return tile.grow(tile.getWidth()  / ti->getWidth()  * TILE_OVERLAP,
+					 tile.getHeight() / ti->getHeight() * TILE_OVERLAP);
 }
 
 /**
@@ -116,9 +106,11 @@ shared_ptr<Tile> Job::computeEmpty()
 	const TileIdentifier::Format format = mid->getImageFormat();
 	shared_ptr<Stylesheet> stylesheet = manager->getStylesheetManager()->getStylesheet(mid->getStylesheetPath());
 	shared_ptr<TileIdentifier> emptyID = TileIdentifier::CreateEmptyTID(path, format);
-	shared_ptr<Tile> tile = manager->getCache()->getTile(emptyID);
+	shared_ptr<Tile> tile = manager->getCache()->getTile(emptyID, false);
 
 	if(!tile->isRendered()) {
+		// the cached tile may already be handed out, it is replaced instead of changed
+		tile = boost::make_shared<Tile>(emptyID);
 		shared_ptr<std::vector<NodeId>> nodeIDs 	= boost::make_shared< std::vector<NodeId>>();
 		shared_ptr<std::vector<WayId>> 	wayIDs 		= boost::make_shared< std::vector<WayId>>();
 		shared_ptr<std::vector<RelId>> 	relationIDs = boost::make_shared< std::vector<RelId>>();
@@ -126,7 +118,9 @@ shared_ptr<Tile> Job::computeEmpty()
 		RenderAttributes renderAttributes;
 
 		stylesheet->match(nodeIDs, wayIDs, relationIDs, mid, &renderAttributes);
-		manager->getRenderer()->renderEmptyTile(renderAttributes, canvas, tile);
+		shared_ptr<RenderCanvasFactory> factory = canvasPool->acquire();
+		manager->getRenderer()->renderEmptyTile(renderAttributes, factory->getCanvas(format), tile);
+		manager->getCache()->updateTile(tile);
 	}
 
 	return tile;
@@ -134,15 +128,16 @@ shared_ptr<Tile> Job::computeEmpty()
 
 /**
  * @brief Inits the internal list of tiles that are part of the MetaTile.
- * @return true if all contained tiles are in cache
+ * @return true if all contained tiles are in cache and not stale
  */
 bool Job::initTiles()
 {
 	bool rendered = true;
 	for (auto& id : mid->getIdentifiers())
 	{
-		shared_ptr<Tile> tile = manager->getCache()->getTile(id);
-		rendered = rendered && tile->isRendered();
+		// the requests were already counted when they were answered from the cache
+		shared_ptr<Tile> tile = manager->getCache()->getTile(id, false);
+		rendered = rendered && tile->isRendered() && !tile->isStale();
 		tiles.push_back(tile);
 	}
 
@@ -150,53 +145,115 @@ bool Job::initTiles()
 }
 
 /**
- * @brief Computes a all tiles contained in the MetaIdentifier.
+ * @brief Checks if nobody waits for the result.
+ * @return true if requests were attached and all their clients disconnected.
+ */
+bool Job::isAbandoned()
+{
+	if (config->get<bool>(opt::server::render_abandoned, false))
+		return false;
+
+	boost::mutex::scoped_lock lock(requestsMutex);
+	if (requests.empty())
+		return false;
+	for (auto& tile : requests) {
+		for (auto& req : tile.second) {
+			if (!req->isDisconnected())
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Checks if the metatile contains data and queries the Geodata for its objects.
  *
+ * Stops after querying the Geodata if all clients disconnected.
+ * @return false if there is nothing to render, the job can be delivered at once.
  **/
-void Job::process()
+bool Job::query()
 {
 	shared_ptr<Geodata> geodata = manager->getGeodata();
+	EmptyMetatileMap& emptyMetatiles = manager->getEmptyMetatiles();
 
 	FixedRect rect = computeRect(mid);
 	STAT_START(Statistic::GeoContainsData);
-		empty = !geodata->containsData(rect);
+		empty = emptyMetatiles.isEmpty(*mid);
+		if (!empty) {
+			empty = !geodata->containsData(rect);
+			if (empty)
+				emptyMetatiles.markEmpty(*mid);
+		}
 	STAT_STOP(Statistic::GeoContainsData);
 
-	if(empty) {
-		STAT_WRITE();
-		return;
-	}
+	if (empty)
+		return false;
 
 	cached = initTiles();
-	if (cached) {
-		STAT_WRITE();
-		return;
-	}
+	if (cached)
+		return false;
 
 	STAT_START(Statistic::GeoNodes);
-		auto nodeIDs = geodata->getNodeIDs(rect);
+		nodeIDs = geodata->getNodeIDs(rect);
 	STAT_STOP(Statistic::GeoNodes);
 
 	STAT_START(Statistic::GeoWays);
-		auto wayIDs = geodata->getWayIDs(rect);
+		wayIDs = geodata->getWayIDs(rect);
 	STAT_STOP(Statistic::GeoWays);
 
 	STAT_START(Statistic::GeoRelation);
-		auto relationIDs = geodata->getRelationIDs(rect);
+		relationIDs = geodata->getRelationIDs(rect);
 	STAT_STOP(Statistic::GeoRelation);
 
 	STAT_STATS(nodeIDs->size(), wayIDs->size(), relationIDs->size());
 
+	if (isAbandoned()) {
+		aborted = true;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Matches the stylesheet against the queried objects.
+ *
+ * Stops after matching if all clients disconnected.
+ * @return false if rendering was stopped.
+ **/
+bool Job::match()
+{
+	// read before the stylesheet, so a concurrent change is never missed
+	generation = manager->getStylesheetManager()->getGeneration(mid->getStylesheetPath());
 	shared_ptr<Stylesheet> stylesheet = manager->getStylesheetManager()->getStylesheet(mid->getStylesheetPath());
-	RenderAttributes renderAttributes;
+	renderAttributes = boost::make_shared<RenderAttributes>();
 	STAT_START(Statistic::StylesheetMatch);
-		stylesheet->match(nodeIDs, wayIDs, relationIDs, mid, &renderAttributes);
+		stylesheet->match(nodeIDs, wayIDs, relationIDs, mid, renderAttributes.get());
 	STAT_STOP(Statistic::StylesheetMatch);
 
+	nodeIDs.reset();
+	wayIDs.reset();
+	relationIDs.reset();
+
+	if (isAbandoned()) {
+		aborted = true;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Renders the metatile onto canvases borrowed from the pool, waits if none is free.
+ **/
+void Job::render()
+{
+	canvases = canvasPool->acquire();
+
 	const shared_ptr<Renderer>& renderer = manager->getRenderer();
 	STAT_START(Statistic::Renderer);
-		renderer->renderMetaTile(renderAttributes, canvas, mid);
+		renderer->renderMetaTile(*renderAttributes, canvases->getCanvas(mid->getImageFormat(), MetaIdentifier::Size(mid->getZoom())), mid);
 	STAT_STOP(Statistic::Renderer);
+
+	renderAttributes.reset();
 }
 
 /*
@@ -204,7 +261,21 @@ void Job::process()
  */
 void Job::deliver()
 {
-	if (empty)
+	if (aborted)
+	{
+		LOG_SEV(request_log, debug) << "Stopped rendering " << *mid << ", all clients disconnected.";
+		for (auto& entry : requests)
+		{
+			for (auto& req : entry.second) {
+				// requests added after the check still need the tile
+				if (req->isDisconnected())
+					req->answer(HttpRequest::Reply::service_unavailable);
+				else
+					manager->enqueue(req);
+			}
+		}
+	}
+	else if (empty)
 	{
 		shared_ptr<Tile> tile = computeEmpty();
 		for (auto& id : mid->getIdentifiers())
@@ -214,18 +285,119 @@ void Job::deliver()
 		}
 	} else {
 		const shared_ptr<Renderer>& renderer = manager->getRenderer();
+		// the stylesheet changed while rendering
+		bool outdated = !cached && generation != manager->getStylesheetManager()->getGeneration(mid->getStylesheetPath());
+		shared_ptr<RenderCanvas> canvas;
+		if (canvases)
+			canvas = canvases->getCanvas(mid->getImageFormat(), MetaIdentifier::Size(mid->getZoom()));
 		STAT_START(Statistic::Slicing);
+		std::vector<shared_ptr<Tile>> rendered;
 		for (auto& tile : tiles) {
-			if (!tile->isRendered())
-				renderer->sliceTile(canvas, mid, tile);
+			// tiles that were cached when the job started are not rendered, even if they are stale now
+			// stale tiles may be answered by other threads, the new image goes into a new Tile
+			if (canvas && (!tile->isRendered() || tile->isStale()))
+				rendered.push_back(boost::make_shared<Tile>(tile->getIdentifier()));
+			else
+				answer(tile);
+		}
 
-			for (auto& req : requests[*tile->getIdentifier()])
-				req->answer(tile);
+		if (!rendered.empty() && renderer->encodeTile(canvas, mid, rendered.front())) {
+			finishTile(rendered.front(), outdated);
+			encodeTiles(canvas, rendered, outdated);
+		} else {
+			// the canvas has only one slice layer
+			for (auto& tile : rendered) {
+				renderer->sliceTile(canvas, mid, tile);
+				finishTile(tile, outdated);
+			}
 		}
 		if (!cached)
 			STAT_STOP(Statistic::Slicing);
 	}
 
+	// return the canvases to the pool
+	canvases.reset();
+
 	STAT_WRITE();
 }
 
+/**
+ * @brief Tiles of a metatile encoded by the delivering thread and helpers of the encode stage.
+ *
+ * Shared with the helpers, which may only start after the job is delivered.
+ **/
+struct Job::Encoding
+{
+	std::vector<shared_ptr<Tile>> tiles;
+	shared_ptr<RenderCanvas> canvas;
+	bool outdated;
+	//! index of the next tile to encode, the first tile is already encoded
+	std::atomic<std::size_t> next;
+	std::size_t done;
+	boost::mutex lock;
+	boost::condition_variable finished;
+};
+
+/**
+ * @brief Encodes the remaining tiles of a rendered metatile in parallel.
+ *
+ * Returns after all tiles are encoded, so the canvas can be returned to the pool.
+ **/
+void Job::encodeTiles(const shared_ptr<RenderCanvas>& canvas, const std::vector<shared_ptr<Tile>>& rendered, bool outdated)
+{
+	shared_ptr<Encoding> encoding = boost::make_shared<Encoding>();
+	encoding->tiles = rendered;
+	encoding->canvas = canvas;
+	encoding->outdated = outdated;
+	encoding->next = 1;
+	encoding->done = 1;
+
+	JobPipeline& pipeline = manager->getPipeline();
+	std::size_t helpers = std::min(pipeline.getThreadCount(JobPipeline::Encode), rendered.size()) - 1;
+	for (std::size_t i = 0; i < helpers; i++)
+		pipeline.assist(JobPipeline::Encode, [this, encoding] { encodeNextTiles(encoding); });
+
+	encodeNextTiles(encoding);
+
+	boost::mutex::scoped_lock lock(encoding->lock);
+	while (encoding->done < encoding->tiles.size())
+		encoding->finished.wait(lock);
+}
+
+//! Encodes tiles until none is left, the job must not be used once all tiles are done.
+void Job::encodeNextTiles(const shared_ptr<Encoding>& encoding)
+{
+	for (std::size_t i = encoding->next++; i < encoding->tiles.size(); i = encoding->next++) {
+		const shared_ptr<Tile>& tile = encoding->tiles[i];
+		manager->getRenderer()->encodeTile(encoding->canvas, mid, tile);
+		finishTile(tile, encoding->outdated);
+
+		boost::mutex::scoped_lock lock(encoding->lock);
+		if (++encoding->done == encoding->tiles.size())
+			encoding->finished.notify_all();
+	}
+}
+
+//! Stores a rendered tile in the cache and answers its requests.
+void Job::finishTile(const shared_ptr<Tile>& tile, bool outdated)
+{
+	if (outdated)
+		tile->markStale();
+	manager->getCache()->updateTile(tile);
+	answer(tile);
+}
+
+void Job::answer(const shared_ptr<Tile>& tile)
+{
+	std::list<shared_ptr<HttpRequest>> waiting;
+	{
+		boost::mutex::scoped_lock lock(requestsMutex);
+		auto it = requests.find(*tile->getIdentifier());
+		if (it != requests.end())
+			waiting = it->second;
+	}
+
+	for (auto& req : waiting)
+		req->answer(tile);
+}
+
@@ -0,0 +1,217 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/job_pipeline.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+#include "server/job.hpp"
+#include "server/worker_pool.hpp"
+#include "general/configuration.hpp"
+
+
+const char* JobPipeline::StageName(Stage stage)
+{
+	switch (stage) {
+	case Query:
+		return "Query";
+	case Match:
+		return "Match";
+	case Render:
+		return "Render";
+	case Encode:
+		return "Encode";
+	default:
+		return "Unknown";
+	}
+}
+
+/**
+ * @brief Starts the threads of the match, render and encode stages.
+ **/
+JobPipeline::JobPipeline(const shared_ptr<Configuration>& config)
+	: stopped(false)
+{
+	const char* threads[StageCount] = {
+		opt::server::num_threads,
+		opt::server::match_threads,
+		opt::server::render_threads,
+		opt::server::encode_threads
+	};
+	std::size_t capacity = std::max(config->get<int>(opt::server::stage_queue_size), 1);
+
+	for (int stage = 0; stage < StageCount; stage++) {
+		Queue& queue = stages[stage];
+		queue.capacity = capacity;
+		queue.waiting = 0;
+		queue.processed = 0;
+		queue.busy = 0;
+		queue.waited = 0;
+		// the query stage runs on the threads of the caller
+		if (stage != Query)
+			queue.workers.reset(new WorkerPool(std::max(config->get<int>(threads[stage]), 1)));
+	}
+}
+
+JobPipeline::~JobPipeline()
+{
+	stop();
+}
+
+/**
+ * @brief Runs the query stage of the job and hands it to the next stage.
+ *
+ * @param finished called on the last stage or when a stage ended the job early.
+ **/
+void JobPipeline::process(const shared_ptr<Job>& job, const Handler& finished)
+{
+	run(Query, job, finished, std::chrono::steady_clock::now());
+}
+
+/**
+ * @brief Lets the threads of a stage help with the job they are running, e.g. encoding its tiles.
+ *
+ * The task does not take a place in the queue of the stage. Helpers may start after the job
+ * is finished, so the caller must not rely on them.
+ **/
+void JobPipeline::assist(Stage stage, const boost::function<void()>& task)
+{
+	if (stages[stage].workers)
+		stages[stage].workers->post(task);
+}
+
+//! @return number of threads of the stage, 0 for the query stage.
+std::size_t JobPipeline::getThreadCount(Stage stage) const
+{
+	return stages[stage].workers ? stages[stage].workers->getThreadCount() : 0;
+}
+
+/**
+ * @brief Stops all stages, jobs waiting for a stage are discarded.
+ **/
+void JobPipeline::stop()
+{
+	if (stopped.exchange(true))
+		return;
+
+	// wake up stages waiting for a full queue
+	for (Queue& queue : stages) {
+		boost::mutex::scoped_lock lock(queue.lock);
+		queue.notFull.notify_all();
+	}
+	for (Queue& queue : stages) {
+		if (queue.workers)
+			queue.workers->stop();
+	}
+
+	printStatistic();
+}
+
+JobPipeline::StageStatistic JobPipeline::getStatistic(Stage stage) const
+{
+	const Queue& queue = stages[stage];
+	StageStatistic statistic;
+	statistic.threads = getThreadCount(stage);
+	statistic.processed = queue.processed;
+	{
+		boost::mutex::scoped_lock lock(queue.lock);
+		statistic.waiting = queue.waiting;
+	}
+	statistic.busy = std::chrono::microseconds(queue.busy);
+	statistic.waited = std::chrono::microseconds(queue.waited);
+	return statistic;
+}
+
+void JobPipeline::printStatistic() const
+{
+	std::stringstream ss;
+	for (int stage = 0; stage < StageCount; stage++) {
+		StageStatistic statistic = getStatistic((Stage) stage);
+		if (statistic.processed == 0)
+			continue;
+
+		ss << "\n" << StageName((Stage) stage) << ": " << statistic.processed << " metatiles";
+		if (statistic.threads > 0)
+			ss << " on " << statistic.threads << " threads";
+		ss << ", average " << statistic.busy.count() / statistic.processed << " µs busy, "
+		   << statistic.waited.count() / statistic.processed << " µs waiting";
+	}
+
+	if (!ss.str().empty())
+		LOG_SEV(stat_log, info) << "Rendering stages:" << ss.str();
+}
+
+/**
+ * @brief Enqueues the job for a stage, waits while the queue of the stage is full.
+ **/
+void JobPipeline::submit(Stage stage, const shared_ptr<Job>& job, const Handler& finished)
+{
+	Queue& queue = stages[stage];
+	{
+		boost::mutex::scoped_lock lock(queue.lock);
+		while (queue.waiting >= queue.capacity && !stopped)
+			queue.notFull.wait(lock);
+		if (stopped)
+			return;
+		queue.waiting++;
+	}
+
+	queue.workers->post(boost::bind(&JobPipeline::run, this, stage, job, finished, std::chrono::steady_clock::now()));
+}
+
+void JobPipeline::run(Stage stage, const shared_ptr<Job>& job, const Handler& finished, std::chrono::steady_clock::time_point enqueued)
+{
+	Queue& queue = stages[stage];
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (stage != Query) {
+		boost::mutex::scoped_lock lock(queue.lock);
+		queue.waiting--;
+		queue.notFull.notify_one();
+		queue.waited += std::chrono::duration_cast<std::chrono::microseconds>(start - enqueued).count();
+	}
+
+	bool next = false;
+	switch (stage) {
+	case Query:
+		next = job->query();
+		break;
+	case Match:
+		next = job->match();
+		break;
+	case Render:
+		job->render();
+		next = true;
+		break;
+	default:
+		break;
+	}
+
+	if (!next)
+		finished(job);
+
+	queue.busy += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	queue.processed++;
+
+	if (next)
+		submit((Stage) (stage + 1), job, finished);
+}
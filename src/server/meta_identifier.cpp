@@ -22,6 +22,83 @@
 
 #include "server/tile_identifier.hpp"
 #include "server/meta_identifier.hpp"
+#include "general/configuration.hpp"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+
+
+std::vector<int> MetaIdentifier::sizes(ALAC_ZOOM_TOP + 1, META_TILE_SIZE);
+
+namespace {
+	int parseNumber(const string& value, const string& range)
+	{
+		try {
+			return boost::lexical_cast<int>(boost::trim_copy(value));
+		} catch (boost::bad_lexical_cast&) {
+			BOOST_THROW_EXCEPTION(excp::InputFormatException() << excp::InfoWhat("Expected a number in \"" + range + "\"."));
+		}
+	}
+}
+
+/**
+ * @brief Reads the metatile size of every zoomlevel from the configuration.
+ *
+ * The option is a comma separated list of "<size>" or "<first zoom>:<size>", each size is used
+ * up to the next zoomlevel in the list, e.g. "8,10:4,17:2". Sizes have to be powers of two
+ * up to MAX_SIZE, so metatiles of neighbouring zoomlevels are aligned: a metatile is either part
+ * of one metatile of the zoomlevel above or, if the size grows by more than a factor of two,
+ * covers several whole ones.
+ * The sizes in use are not changed, this is done by Init.
+ *
+ * @return the size of every zoomlevel
+ **/
+std::vector<int> MetaIdentifier::ParseSizes(const shared_ptr<Configuration>& config)
+{
+	std::vector<int> parsed(ALAC_ZOOM_TOP + 1, META_TILE_SIZE);
+	string value = config->get<string>(opt::server::metatile_size);
+	std::vector<string> ranges;
+	boost::split(ranges, value, boost::is_any_of(","));
+
+	int lastZoom = -1;
+	for (const string& range : ranges) {
+		std::size_t colon = range.find(':');
+		int zoom = (colon == string::npos) ? 0 : parseNumber(range.substr(0, colon), range);
+		int size = parseNumber(colon == string::npos ? range : range.substr(colon + 1), range);
+
+		if (zoom <= lastZoom || zoom > ALAC_ZOOM_TOP)
+			BOOST_THROW_EXCEPTION(excp::InputFormatException() << excp::InfoWhat("Zoomlevels have to be ascending and at most " + std::to_string(ALAC_ZOOM_TOP) + " in \"" + range + "\"."));
+		if (size < 1 || size > MAX_SIZE || (size & (size - 1)) != 0)
+			BOOST_THROW_EXCEPTION(excp::InputFormatException() << excp::InfoWhat("Size has to be a power of two up to " + std::to_string(MAX_SIZE) + " in \"" + range + "\"."));
+
+		std::fill(parsed.begin() + zoom, parsed.end(), size);
+		lastZoom = zoom;
+	}
+	return parsed;
+}
+
+/**
+ * @brief Uses the metatile sizes of the configuration, see ParseSizes.
+ *
+ * Has to be called before the RequestManager is created.
+ **/
+void MetaIdentifier::Init(const shared_ptr<Configuration>& config)
+{
+	sizes = ParseSizes(config);
+}
+
+//! @return number of tiles in x and y direction of the metatiles on the zoomlevel.
+int MetaIdentifier::Size(int zoom)
+{
+	return sizes[std::min(std::max(zoom, 0), ALAC_ZOOM_TOP)];
+}
+
+//! @return largest metatile size of all zoomlevels.
+int MetaIdentifier::MaxSize()
+{
+	return *std::max_element(sizes.begin(), sizes.end());
+}
 
 /**
  * @brief Constructs a new TileIdentifier with the given parameters.
@@ -33,20 +110,33 @@ shared_ptr<MetaIdentifier> MetaIdentifier::Create(const shared_ptr<TileIdentifie
 	return boost::make_shared<MetaIdentifier>(*origin);
 }
 
+/**
+ * @brief Returns the top left tile of the metatile containing the given tile.
+ *
+ * Equal to the MetaIdentifier of the tile, without creating the contained tiles.
+ **/
+TileIdentifier MetaIdentifier::Origin(const TileIdentifier& tile)
+{
+	// round to neared multiple of the metatile size
+	int size = Size(tile.getZoom());
+	return TileIdentifier(tile.getX() / size * size,
+						  tile.getY() / size * size,
+						  tile.getZoom(),
+						  tile.getStylesheetPath(),
+						  tile.getImageFormat());
+}
+
 MetaIdentifier::MetaIdentifier(const TileIdentifier& origin)
-	: TileIdentifier(origin)
+	: TileIdentifier(Origin(origin))
 {
-	// round to neared multiple of META_TILE_SIZE
-	int x0 = origin.getX() / META_TILE_SIZE * META_TILE_SIZE;
-	int y0 = origin.getY() / META_TILE_SIZE * META_TILE_SIZE;
-	int x1 = x0 + META_TILE_SIZE;
-	int y1 = y0 + META_TILE_SIZE;
+	int x0 = x;
+	int y0 = y;
+	int x1 = x0 + Size(origin.getZoom());
+	int y1 = y0 + Size(origin.getZoom());
 	x1 = std::min(x1, (1 << origin.getZoom()));
 	y1 = std::min(y1, (1 << origin.getZoom()));
 	this->width  = x1 - x0;
 	this->height = y1 - y0;
-	this->x = x0;
-	this->y = y0;
 
 	for (int tx = x; tx < x1; tx++)
 		for (int ty = y; ty < y1; ty++)
@@ -87,19 +177,20 @@ bool MetaIdentifier::contains(const shared_ptr<TileIdentifier> tid) const
 /**
  * @brief get all tiles that are below this tile on the next zoom level.
  *        Used by RequestManager to enqueue meta tile for pre-rendering.
+ *
+ * A larger metatile on the next zoom level is only returned by the metatile containing its origin.
  */
 void MetaIdentifier::getSubIdentifiers(std::vector<shared_ptr<MetaIdentifier>>& tiles) const
 {
 	int z = this->zoom + 1;
-	int x = this->x*2;
-	int y = this->y*2;
-	int n = META_TILE_SIZE;
-
-	tiles.push_back(boost::make_shared<MetaIdentifier>(TileIdentifier(x,   y,   z, styleSheetpath, imageFormat)));
-	if (x+n < (1 << z))
-		tiles.push_back(boost::make_shared<MetaIdentifier>(TileIdentifier(x+n, y,   z, styleSheetpath, imageFormat)));
-	if (y+n < (1 << z))
-		tiles.push_back(boost::make_shared<MetaIdentifier>(TileIdentifier(x,   y+n, z, styleSheetpath, imageFormat)));
-	if (x+n < (1 << z) && y+n < (1 << z))
-		tiles.push_back(boost::make_shared<MetaIdentifier>(TileIdentifier(x+n, y+n, z, styleSheetpath, imageFormat)));
+	int n = Size(z);
+	int x1 = std::min(2 * (x + width), 1 << z);
+	int y1 = std::min(2 * (y + height), 1 << z);
+
+	for (int ty = 2 * y / n * n; ty < y1; ty += n)
+		for (int tx = 2 * x / n * n; tx < x1; tx += n)
+		{
+			if (tx / 2 >= x && ty / 2 >= y)
+				tiles.push_back(boost::make_shared<MetaIdentifier>(TileIdentifier(tx, ty, z, styleSheetpath, imageFormat)));
+		}
 }
@@ -0,0 +1,168 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/popularity_tracker.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <boost/algorithm/string.hpp>
+
+#include "server/meta_identifier.hpp"
+
+
+PopularityTracker::PopularityTracker(std::size_t capacity)
+	: capacity(std::max(capacity, std::size_t(1)))
+{
+}
+
+/**
+ * @brief Counts a request for the metatile of the tile.
+ **/
+void PopularityTracker::hit(const TileIdentifier& ti)
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	add(ti, 1);
+}
+
+/**
+ * @brief Counts the tiles requested in an access log.
+ *
+ * Lines look like: 80.101.90.180 - [2/Jun/2009:15:11:52] "GET /default/15/17600/10747.png HTTP/1.1" 200 2816
+ * Lines that are not tile requests are ignored.
+ *
+ * @param defaultStylesheet used for urls without stylesheet.
+ * @return number of counted requests, 0 if the file could not be read.
+ **/
+std::size_t PopularityTracker::load(const string& accessLog, const string& defaultStylesheet)
+{
+	std::ifstream file(accessLog);
+	std::size_t counted = 0;
+	string line;
+	while (std::getline(file, line)) {
+		std::size_t begin = line.find("\"GET ");
+		if (begin == string::npos)
+			continue;
+		begin += 5;
+		std::size_t end = line.find(' ', begin);
+		if (end == string::npos)
+			continue;
+
+		// /stylesheet/zoom/x/y.format, the stylesheet may contain slashes or be omitted
+		std::vector<string> parts;
+		string url = line.substr(begin, end - begin);
+		boost::split(parts, url, boost::is_any_of("/"));
+		std::size_t length = parts.size();
+		if (length < 4)
+			continue;
+
+		int zoom, x, y;
+		try {
+			zoom = std::stoi(parts[length - 3]);
+			x = std::stoi(parts[length - 2]);
+			y = std::stoi(parts[length - 1]);
+		} catch (std::exception&) {
+			continue;
+		}
+		if (zoom < 0 || zoom > ALAC_ZOOM_TOP || x < 0 || y < 0 || x >= (1 << zoom) || y >= (1 << zoom))
+			continue;
+
+		string stylesheet;
+		for (std::size_t i = 1; i < length - 3; i++)
+			stylesheet += (i != 1 ? "/" : "") + parts[i];
+		if (stylesheet.empty())
+			stylesheet = defaultStylesheet;
+
+		boost::mutex::scoped_lock scopedLock(lock);
+		add(TileIdentifier(x, y, zoom, stylesheet, TileIdentifier::PNG), 1);
+		counted++;
+	}
+	return counted;
+}
+
+/**
+ * @brief Returns the most requested metatiles of a stylesheet, most requested first.
+ *
+ * @param minZoom lowest zoomlevel to consider, lower ones are prerendered anyway.
+ **/
+std::vector<shared_ptr<MetaIdentifier>> PopularityTracker::top(const string& stylesheet, std::size_t count, int minZoom)
+{
+	typedef std::pair<TileIdentifier, uint32_t> Entry;
+	std::vector<Entry> entries;
+	{
+		boost::mutex::scoped_lock scopedLock(lock);
+		for (auto& entry : hits) {
+			if (entry.first.getStylesheetPath() == stylesheet && entry.first.getZoom() >= minZoom)
+				entries.push_back(entry);
+		}
+	}
+
+	count = std::min(count, entries.size());
+	std::partial_sort(entries.begin(), entries.begin() + count, entries.end(), [](const Entry& a, const Entry& b) {
+		if (a.second != b.second)
+			return a.second > b.second;
+		// lower zoomlevels cover more area
+		if (a.first.getZoom() != b.first.getZoom())
+			return a.first.getZoom() < b.first.getZoom();
+		return a.first.getY() != b.first.getY() ? a.first.getY() < b.first.getY() : a.first.getX() < b.first.getX();
+	});
+
+	std::vector<shared_ptr<MetaIdentifier>> metatiles;
+	for (std::size_t i = 0; i < count; i++)
+		metatiles.push_back(boost::make_shared<MetaIdentifier>(entries[i].first));
+	return metatiles;
+}
+
+//! @return number of counted metatiles.
+std::size_t PopularityTracker::size()
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	return hits.size();
+}
+
+//! Has to be called with the lock held.
+void PopularityTracker::add(const TileIdentifier& ti, uint32_t requests)
+{
+	TileIdentifier origin = MetaIdentifier::Origin(ti);
+	TileIdentifier key(origin.getX(), origin.getY(), origin.getZoom(), origin.getStylesheetPath(), TileIdentifier::PNG);
+
+	auto it = hits.find(key);
+	if (it == hits.end()) {
+		if (hits.size() >= capacity)
+			decay();
+		hits.emplace(key, requests);
+	} else
+		it->second += requests;
+}
+
+/**
+ * @brief Halves all counts and forgets metatiles requested only once.
+ **/
+void PopularityTracker::decay()
+{
+	for (auto it = hits.begin(); it != hits.end();) {
+		it->second /= 2;
+		if (it->second == 0)
+			it = hits.erase(it);
+		else
+			++it;
+	}
+}
@@ -0,0 +1,181 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/prefetcher.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "server/meta_identifier.hpp"
+
+
+const std::size_t Prefetcher::MAX_STREAMS;
+const std::size_t Prefetcher::MAX_PREFETCHED;
+
+Prefetcher::Prefetcher(const Submit& submit, const Idle& idle)
+	: submit(submit)
+	, idle(idle)
+	, stats(Statistics())
+{
+}
+
+/**
+ * @brief Follows the stream of the client and prefetches the metatiles it will probably request next.
+ *
+ * @param client address of the client.
+ * @param ti the requested tile.
+ **/
+void Prefetcher::requested(const string& client, const TileIdentifier& ti)
+{
+	TileIdentifier origin = MetaIdentifier::Origin(ti);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	boost::mutex::scoped_lock scopedLock(lock);
+	auto prefetchedIt = prefetched.find(origin);
+	if (prefetchedIt != prefetched.end()) {
+		if (prefetchedIt->second.rendered)
+			stats.hits++;
+		prefetched.erase(prefetchedIt);
+	}
+
+	string key = client + "/" + ti.getStylesheetPath();
+	auto it = streams.find(key);
+	if (it == streams.end()) {
+		if (streams.size() >= MAX_STREAMS) {
+			// forget the client that was not seen for the longest time
+			auto oldest = std::min_element(streams.begin(), streams.end(), [](const std::pair<const string, Stream>& a, const std::pair<const string, Stream>& b) {
+				return a.second.seen < b.second.seen;
+			});
+			streams.erase(oldest);
+		}
+		Stream stream = { origin.getX(), origin.getY(), origin.getZoom(), now };
+		streams.emplace(key, stream);
+		return;
+	}
+
+	Stream& stream = it->second;
+	stream.seen = now;
+	if (stream.x == origin.getX() && stream.y == origin.getY() && stream.zoom == origin.getZoom())
+		return;
+
+	std::vector<shared_ptr<MetaIdentifier>> next;
+	predict(stream, origin, next);
+	stream.x = origin.getX();
+	stream.y = origin.getY();
+	stream.zoom = origin.getZoom();
+
+	// users waiting for a worker come first
+	if (!idle())
+		return;
+
+	for (auto& mid : next) {
+		if (prefetched.count(*mid) > 0)
+			continue;
+		if (!submit(mid))
+			break;
+		remember(*mid);
+	}
+}
+
+/**
+ * @brief Reports that a submitted metatile was rendered, only those count as prefetched.
+ *
+ * @param origin top left tile of the metatile.
+ **/
+void Prefetcher::rendered(const TileIdentifier& origin)
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	auto it = prefetched.find(origin);
+	if (it == prefetched.end() || it->second.rendered)
+		return;
+	it->second.rendered = true;
+	stats.prefetched++;
+}
+
+Prefetcher::Statistics Prefetcher::getStatistics()
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	return stats;
+}
+
+void Prefetcher::printStatistic()
+{
+	Statistics statistics = getStatistics();
+	if (statistics.prefetched == 0)
+		return;
+
+	LOG_SEV(stat_log, info) << "Prefetched " << statistics.prefetched << " of " << statistics.submitted << " submitted metatiles, "
+							<< statistics.hits << " requested afterwards (" << statistics.hits * 100 / statistics.prefetched << "%), "
+							<< statistics.wasted << " wasted.";
+}
+
+/**
+ * @brief Predicts the next metatiles after the stream moved from the last metatile to the origin.
+ *
+ * A move to a neighbour continues in the same direction, the zoomlevels above and below are
+ * always predicted as the user might zoom.
+ **/
+void Prefetcher::predict(const Stream& last, const TileIdentifier& origin, std::vector<shared_ptr<MetaIdentifier>>& next) const
+{
+	int zoom = origin.getZoom();
+	int size = MetaIdentifier::Size(zoom);
+	int n = 1 << zoom;
+
+	if (last.zoom == zoom) {
+		int dx = (origin.getX() - last.x) / size;
+		int dy = (origin.getY() - last.y) / size;
+		// jumps to another area are no movement
+		if (std::abs(dx) <= 1 && std::abs(dy) <= 1) {
+			int x = origin.getX() + dx * size;
+			int y = origin.getY() + dy * size;
+			if (x >= 0 && y >= 0 && x < n && y < n)
+				next.push_back(boost::make_shared<MetaIdentifier>(TileIdentifier(x, y, zoom, origin.getStylesheetPath(), origin.getImageFormat())));
+		}
+	}
+
+	if (zoom > 0)
+		next.push_back(boost::make_shared<MetaIdentifier>(TileIdentifier(origin.getX() / 2, origin.getY() / 2, zoom - 1, origin.getStylesheetPath(), origin.getImageFormat())));
+	if (zoom < ALAC_ZOOM_TOP)
+		MetaIdentifier(origin).getSubIdentifiers(next);
+}
+
+/**
+ * @brief Remembers a submitted metatile, the oldest ones are forgotten and count as wasted if they were rendered.
+ *
+ * Has to be called with the lock held.
+ **/
+void Prefetcher::remember(const TileIdentifier& origin)
+{
+	std::size_t sequence = stats.submitted++;
+	prefetched[origin] = Prefetched{sequence, false};
+	prefetchOrder.push_back(std::make_pair(origin, sequence));
+
+	while (prefetched.size() > MAX_PREFETCHED || prefetchOrder.size() > 2 * MAX_PREFETCHED) {
+		auto it = prefetched.find(prefetchOrder.front().first);
+		if (it != prefetched.end() && it->second.sequence == prefetchOrder.front().second) {
+			if (it->second.rendered)
+				stats.wasted++;
+			prefetched.erase(it);
+		}
+		prefetchOrder.pop_front();
+	}
+}
@@ -0,0 +1,485 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/prerender_controller.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+#include "server/meta_identifier.hpp"
+#include "general/configuration.hpp"
+
+
+namespace {
+	//! First line of a progress file
+	const char* PROGRESS_MAGIC = "alacarte-prerender";
+	const int PROGRESS_VERSION = 1;
+	//! Number of rendered metatiles after which the progress is saved
+	const std::size_t CHECKPOINT_INTERVAL = 1024;
+
+	//! @return number of metatiles in x or y direction on a zoomlevel.
+	std::size_t metatilesPerAxis(int zoom)
+	{
+		std::size_t size = MetaIdentifier::Size(zoom);
+		return ((std::size_t(1) << zoom) + size - 1) / size;
+	}
+
+	std::size_t indexOf(int zoom, int x, int y)
+	{
+		std::size_t size = MetaIdentifier::Size(zoom);
+		return y / size * metatilesPerAxis(zoom) + x / size;
+	}
+
+	//! @return number of words of the bitmap of a zoomlevel.
+	std::size_t wordsOf(int zoom)
+	{
+		return (metatilesPerAxis(zoom) * metatilesPerAxis(zoom) + 63) / 64;
+	}
+
+	bool test(const std::vector<uint64_t>& bits, std::size_t index)
+	{
+		return (bits[index / 64] & (uint64_t(1) << (index % 64))) != 0;
+	}
+
+	void set(std::vector<uint64_t>& bits, std::size_t index)
+	{
+		bits[index / 64] |= uint64_t(1) << (index % 64);
+	}
+}
+
+/**
+ * @param submit called to hand a metatile to the workers.
+ * @param backlog called to check if users wait while the latency is too high.
+ **/
+PrerenderController::PrerenderController(const shared_ptr<Configuration>& config, const Submit& submit, const Backlog& backlog)
+	: config(config)
+	, submit(submit)
+	, backlog(backlog)
+	, directory(config->get<string>(opt::server::cache_path))
+	, pauseLatency(std::max(config->get<int>(opt::server::prerender_pause), 0))
+	, latency(0.0)
+	, stopped(false)
+{
+	int share = std::min(std::max(config->get<int>(opt::server::prerender_share), 1), 100);
+	maxRunning = std::max(config->get<int>(opt::server::render_threads) * share / 100, 1);
+}
+
+PrerenderController::~PrerenderController()
+{
+	stop();
+}
+
+/**
+ * @brief Starts or continues prerendering a stylesheet.
+ *
+ * @param version modification time of the stylesheet, prerendering starts from the
+ *        beginning if it differs from the saved progress.
+ * @param popular metatiles above the prerender level to render first. For an unchanged
+ *        stylesheet only those not kept on the hard drive are rendered.
+ **/
+void PrerenderController::start(const string& stylesheet, std::time_t version, const std::vector<shared_ptr<MetaIdentifier>>& popular)
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	auto walk = std::find_if(walks.begin(), walks.end(), [&](const Walk& w) { return w.stylesheet == stylesheet; });
+	if (walk == walks.end()) {
+		walks.push_back(Walk());
+		walk = walks.end() - 1;
+		walk->stylesheet = stylesheet;
+		walk->running = 0;
+		walk->maxZoom = std::min(config->get<int>(opt::server::prerender_level), ALAC_ZOOM_TOP);
+		load(*walk);
+	}
+
+	bool modified = (walk->version != version);
+	if (modified) {
+		reset(*walk, version);
+		LOG_SEV(request_log, info) << "Prerendering " << stylesheet << " up to zoomlevel " << walk->maxZoom << ".";
+	} else {
+		LOG_SEV(request_log, info) << "Continuing to prerender " << stylesheet << " up to zoomlevel " << walk->maxZoom << ".";
+	}
+
+	int keepZoom = config->get<int>(opt::server::cache_keep_tile);
+	walk->popular.clear();
+	for (auto& mid : popular) {
+		if (mid->getZoom() > walk->maxZoom && (modified || mid->getZoom() > keepZoom))
+			walk->popular.push_back(mid);
+	}
+	if (!walk->popular.empty())
+		LOG_SEV(request_log, info) << "Prerendering " << walk->popular.size() << " popular metatiles of " << stylesheet << ".";
+
+	walk->zoom = 0;
+	walk->next = 0;
+	walk->active = true;
+	walk->started = std::chrono::steady_clock::now();
+	release();
+	scopedLock.unlock();
+
+	writeCheckpoints();
+}
+
+/**
+ * @brief Stops prerendering a removed stylesheet and deletes its progress.
+ **/
+void PrerenderController::remove(const string& stylesheet)
+{
+	// a progress file written right now would be restored
+	boost::mutex::scoped_lock writeLock(saveLock);
+	boost::mutex::scoped_lock scopedLock(lock);
+	walks.erase(std::remove_if(walks.begin(), walks.end(), [&](const Walk& w) { return w.stylesheet == stylesheet; }), walks.end());
+	checkpoints.erase(std::remove_if(checkpoints.begin(), checkpoints.end(), [&](const Checkpoint& c) { return c.stylesheet == stylesheet; }), checkpoints.end());
+
+	boost::system::error_code ec;
+	boost::filesystem::remove(progressPath(stylesheet), ec);
+}
+
+/**
+ * @brief Remembers a prerendered metatile and hands the next ones to the workers.
+ *
+ * Called for every metatile that was prerendered, metatiles not handed out by the
+ * controller only make room for the next ones.
+ **/
+void PrerenderController::finished(const shared_ptr<MetaIdentifier>& mid, bool empty)
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	if (running.erase(*mid) > 0) {
+		for (Walk& walk : walks) {
+			// popular metatiles are not part of the walk
+			if (walk.stylesheet != mid->getStylesheetPath() || mid->getZoom() > walk.maxZoom)
+				continue;
+
+			walk.running--;
+			std::size_t index = indexOf(mid->getZoom(), mid->getX(), mid->getY());
+			set(walk.rendered[mid->getZoom()], index);
+			if (empty)
+				set(walk.empty[mid->getZoom()], index);
+			if (++walk.unsaved >= CHECKPOINT_INTERVAL)
+				checkpoint(walk);
+		}
+	}
+
+	release();
+	scopedLock.unlock();
+
+	writeCheckpoints();
+}
+
+/**
+ * @brief Measures how long users wait, prerendering pauses while they wait too long.
+ *
+ * @param waited time the request of the user waited for a worker.
+ **/
+void PrerenderController::userRequestStarted(std::chrono::milliseconds waited)
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	latency = 0.8 * latency + 0.2 * waited.count();
+
+	// continues as soon as the latency is low again or no user waits
+	release();
+	scopedLock.unlock();
+
+	writeCheckpoints();
+}
+
+/**
+ * @brief Saves the progress, no more metatiles are handed to the workers.
+ **/
+void PrerenderController::stop()
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	if (stopped)
+		return;
+	stopped = true;
+
+	for (Walk& walk : walks)
+		checkpoint(walk);
+	scopedLock.unlock();
+
+	writeCheckpoints();
+}
+
+bool PrerenderController::isPaused()
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	return pauseLatency.count() > 0 && latency > pauseLatency.count() && backlog() > 0;
+}
+
+//! @return number of metatiles handed to the workers and not finished.
+std::size_t PrerenderController::getRunning()
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	return running.size();
+}
+
+//! @return maximal number of metatiles rendered at once.
+std::size_t PrerenderController::getMaxRunning() const
+{
+	return maxRunning;
+}
+
+//! @return number of metatiles of the zoomlevel that are rendered or skipped.
+std::size_t PrerenderController::getRendered(const string& stylesheet, int zoom)
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	std::size_t count = 0;
+	for (const Walk& walk : walks) {
+		if (walk.stylesheet != stylesheet || zoom < 0 || zoom > walk.maxZoom)
+			continue;
+		for (uint64_t word : walk.rendered[zoom])
+			count += __builtin_popcountll(word);
+	}
+	return count;
+}
+
+/**
+ * @brief Hands metatiles to the workers until the limit is reached or users wait too long.
+ *
+ * Has to be called with the lock held.
+ **/
+void PrerenderController::release()
+{
+	if (stopped)
+		return;
+
+	bool paused = pauseLatency.count() > 0 && latency > pauseLatency.count();
+	if (paused && backlog() > 0)
+		return;
+
+	for (Walk& walk : walks) {
+		while (running.size() < maxRunning && !walk.popular.empty()) {
+			shared_ptr<MetaIdentifier> mid = walk.popular.front();
+			if (running.count(*mid) == 0) {
+				if (!submit(mid))
+					return;
+				running.insert(*mid);
+			}
+			walk.popular.pop_front();
+		}
+
+		while (running.size() < maxRunning) {
+			shared_ptr<MetaIdentifier> mid = nextMetatile(walk);
+			if (!mid)
+				break;
+			if (!submit(mid))
+				return;
+			walk.next++;
+			walk.running++;
+			running.insert(*mid);
+		}
+	}
+}
+
+/**
+ * @brief Finds the next metatile of the walk to render, skipping rendered and empty ones.
+ *
+ * The next zoomlevel is started when all metatiles of the current one are rendered,
+ * as only then it is known which of them are empty.
+ * @return null if there is none at the moment.
+ **/
+shared_ptr<MetaIdentifier> PrerenderController::nextMetatile(Walk& walk)
+{
+	while (walk.active && walk.zoom <= walk.maxZoom) {
+		int size = MetaIdentifier::Size(walk.zoom);
+		std::size_t perAxis = metatilesPerAxis(walk.zoom);
+		for (; walk.next < perAxis * perAxis; walk.next++) {
+			if (test(walk.rendered[walk.zoom], walk.next))
+				continue;
+
+			int x = walk.next % perAxis * size;
+			int y = walk.next / perAxis * size;
+			if (walk.zoom > 0 && !parentHasData(walk, walk.zoom, x, y)) {
+				set(walk.rendered[walk.zoom], walk.next);
+				set(walk.empty[walk.zoom], walk.next);
+				continue;
+			}
+
+			return boost::make_shared<MetaIdentifier>(TileIdentifier(x, y, walk.zoom, walk.stylesheet, TileIdentifier::PNG));
+		}
+
+		if (walk.running > 0)
+			return shared_ptr<MetaIdentifier>();
+
+		checkpoint(walk);
+		walk.zoom++;
+		walk.next = 0;
+	}
+
+	if (walk.active) {
+		walk.active = false;
+		int elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - walk.started).count();
+		LOG_SEV(request_log, info) << "Prerendering of " << walk.stylesheet << " finished in "
+			<< std::setfill('0') << std::setw(2) << elapsed / 60 << ":" << std::setw(2) << elapsed % 60;
+	}
+	return shared_ptr<MetaIdentifier>();
+}
+
+/**
+ * @return true if one of the metatiles on the zoomlevel above covering the metatile contains data.
+ **/
+bool PrerenderController::parentHasData(const Walk& walk, int zoom, int x, int y) const
+{
+	int parentZoom = zoom - 1;
+	int parentSize = MetaIdentifier::Size(parentZoom);
+	int n = 1 << parentZoom;
+	int x1 = std::min((x + MetaIdentifier::Size(zoom) + 1) / 2, n);
+	int y1 = std::min((y + MetaIdentifier::Size(zoom) + 1) / 2, n);
+
+	for (int py = y / 2 / parentSize * parentSize; py < y1; py += parentSize) {
+		for (int px = x / 2 / parentSize * parentSize; px < x1; px += parentSize) {
+			if (!test(walk.empty[parentZoom], indexOf(parentZoom, px, py)))
+				return true;
+		}
+	}
+	return false;
+}
+
+void PrerenderController::reset(Walk& walk, std::time_t version)
+{
+	walk.version = version;
+	walk.rendered.clear();
+	walk.empty.clear();
+	for (int zoom = 0; zoom <= walk.maxZoom; zoom++) {
+		walk.rendered.push_back(std::vector<uint64_t>(wordsOf(zoom), 0));
+		walk.empty.push_back(std::vector<uint64_t>(wordsOf(zoom), 0));
+	}
+	walk.unsaved = 0;
+}
+
+/**
+ * @brief Reads the saved progress of the walk.
+ *
+ * Zoomlevels saved with another metatile size and the zoomlevels below them are
+ * rendered again. Tiles above the zoomlevel kept on the hard drive are lost after a
+ * restart, so only their empty metatiles are skipped.
+ **/
+void PrerenderController::load(Walk& walk)
+{
+	reset(walk, -1);
+
+	std::ifstream file(progressPath(walk.stylesheet).string());
+	string magic;
+	int formatVersion;
+	long long version;
+	if (!(file >> magic >> formatVersion >> version) || magic != PROGRESS_MAGIC || formatVersion != PROGRESS_VERSION)
+		return;
+	walk.version = (std::time_t) version;
+
+	int keepZoom = config->get<int>(opt::server::cache_keep_tile);
+	int zoom, size;
+	std::size_t words;
+	while (file >> std::dec >> zoom >> size >> words) {
+		if (zoom < 0 || zoom > walk.maxZoom || size != MetaIdentifier::Size(zoom) || words != wordsOf(zoom))
+			break;
+
+		file >> std::hex;
+		for (uint64_t& word : walk.rendered[zoom])
+			file >> word;
+		for (uint64_t& word : walk.empty[zoom])
+			file >> word;
+		if (!file) {
+			walk.rendered[zoom].assign(words, 0);
+			walk.empty[zoom].assign(words, 0);
+			break;
+		}
+		if (zoom > keepZoom)
+			walk.rendered[zoom] = walk.empty[zoom];
+	}
+}
+
+/**
+ * @brief Copies the progress of the walk to be written by writeCheckpoints.
+ *
+ * Has to be called with the lock held.
+ **/
+void PrerenderController::checkpoint(Walk& walk)
+{
+	walk.unsaved = 0;
+
+	// an older copy that was not written yet is replaced
+	auto it = std::find_if(checkpoints.begin(), checkpoints.end(), [&](const Checkpoint& c) { return c.stylesheet == walk.stylesheet; });
+	if (it == checkpoints.end())
+		it = checkpoints.insert(checkpoints.end(), Checkpoint());
+
+	it->stylesheet = walk.stylesheet;
+	it->version = walk.version;
+	it->sizes.clear();
+	for (int zoom = 0; zoom <= walk.maxZoom; zoom++)
+		it->sizes.push_back(MetaIdentifier::Size(zoom));
+	it->rendered = walk.rendered;
+	it->empty = walk.empty;
+}
+
+/**
+ * @brief Writes the progress copied by checkpoint, has to be called without holding the lock.
+ **/
+void PrerenderController::writeCheckpoints()
+{
+	// copies are written in the order they were taken
+	boost::mutex::scoped_lock writeLock(saveLock);
+	std::vector<Checkpoint> pending;
+	{
+		boost::mutex::scoped_lock scopedLock(lock);
+		pending.swap(checkpoints);
+	}
+
+	for (const Checkpoint& checkpoint : pending)
+		save(checkpoint);
+}
+
+/**
+ * @brief Replaces the saved progress of a stylesheet.
+ *
+ * Has to be called with the saveLock held.
+ **/
+void PrerenderController::save(const Checkpoint& checkpoint) const
+{
+	boost::system::error_code ec;
+	boost::filesystem::create_directories(directory, ec);
+	boost::filesystem::path path = progressPath(checkpoint.stylesheet);
+	boost::filesystem::path tmp = path.string() + ".tmp";
+	{
+		std::ofstream file(tmp.string(), std::ios::out | std::ios::trunc);
+		file << PROGRESS_MAGIC << ' ' << PROGRESS_VERSION << '\n' << (long long) checkpoint.version << '\n';
+		for (std::size_t zoom = 0; zoom < checkpoint.sizes.size(); zoom++) {
+			file << std::dec << zoom << ' ' << checkpoint.sizes[zoom] << ' ' << checkpoint.rendered[zoom].size() << '\n' << std::hex;
+			for (uint64_t word : checkpoint.rendered[zoom])
+				file << word << ' ';
+			file << '\n';
+			for (uint64_t word : checkpoint.empty[zoom])
+				file << word << ' ';
+			file << '\n';
+		}
+		if (!file) {
+			LOG_SEV(request_log, warning) << "Could not write the prerender progress " << tmp;
+			boost::filesystem::remove(tmp, ec);
+			return;
+		}
+	}
+	boost::filesystem::rename(tmp, path, ec);
+	if (ec)
+		LOG_SEV(request_log, warning) << "Could not replace the prerender progress " << path << ": " << ec.message();
+}
+
+boost::filesystem::path PrerenderController::progressPath(const string& stylesheet) const
+{
+	return directory / (stylesheet + ".prerender");
+}
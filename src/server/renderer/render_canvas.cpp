@@ -49,9 +49,9 @@ private:
 	CairoLayer slice;
 
 public:
-	PNGRenderCanvas()
-	: PNGRenderCanvas(META_TILE_SIZE*TILE_SIZE,
-					  META_TILE_SIZE*TILE_SIZE,
+	PNGRenderCanvas(int metaTileSize)
+	: PNGRenderCanvas(metaTileSize*TILE_SIZE,
+					  metaTileSize*TILE_SIZE,
 					  TILE_SIZE,
 					  TILE_SIZE)
 	{
@@ -64,6 +64,7 @@ public:
 	virtual CairoLayer* getImageLayers() { return layers; }
 	virtual CairoLayer& getSliceLayer() { return slice; }
 	virtual Tile::ImageType copySliceImage();
+	virtual Tile::ImageType encodeTile(int x, int y, int width, int height);
 };
 
 class SVGRenderCanvas : public RenderCanvas
@@ -74,9 +75,9 @@ private:
 	Tile::ImageType buffer;
 
 public:
-	SVGRenderCanvas()
-	: SVGRenderCanvas(META_TILE_SIZE*TILE_SIZE,
-					  META_TILE_SIZE*TILE_SIZE,
+	SVGRenderCanvas(int metaTileSize)
+	: SVGRenderCanvas(metaTileSize*TILE_SIZE,
+					  metaTileSize*TILE_SIZE,
 					  TILE_SIZE,
 					  TILE_SIZE)
 	{
@@ -92,13 +93,75 @@ public:
 };
 
 
+RenderCanvasFactory::RenderCanvasFactory()
+{
+}
+
 /**
- * \param numCavas Number of canvas objects to allocate per type.
+ * @param metaTileSize number of tiles in x and y direction of the metatile to render.
  */
-RenderCanvasFactory::RenderCanvasFactory()
-: svgCanvas(boost::dynamic_pointer_cast<RenderCanvas>(boost::make_shared<SVGRenderCanvas>()))
-, pngCanvas(boost::dynamic_pointer_cast<RenderCanvas>(boost::make_shared<PNGRenderCanvas>()))
+shared_ptr<RenderCanvas> RenderCanvasFactory::getCanvas(TileIdentifier::Format type, int metaTileSize)
+{
+	shared_ptr<RenderCanvas> canvas;
+	switch(type)
+	{
+		case TileIdentifier::Format::PNG:
+			canvas = pngCanvases[metaTileSize];
+			if (!canvas)
+				canvas = pngCanvases[metaTileSize] = boost::make_shared<PNGRenderCanvas>(metaTileSize);
+			break;
+		case TileIdentifier::Format::SVG:
+			canvas = svgCanvases[metaTileSize];
+			if (!canvas)
+				canvas = svgCanvases[metaTileSize] = boost::make_shared<SVGRenderCanvas>(metaTileSize);
+			break;
+		default:
+			break;
+	}
+
+	return canvas;
+}
+
+/**
+ * @brief Creates the given number of factories, at least one.
+ **/
+RenderCanvasPool::RenderCanvasPool(std::size_t size)
 {
+	size = std::max<std::size_t>(size, 1);
+	for (std::size_t i = 0; i < size; i++) {
+		factories.push_back(boost::make_shared<RenderCanvasFactory>());
+		available.push_back(factories.back().get());
+	}
+}
+
+/**
+ * @brief Waits for a factory that is not used by another job.
+ *
+ * @return the factory, it is returned to the pool when the last copy is destroyed.
+ **/
+shared_ptr<RenderCanvasFactory> RenderCanvasPool::acquire()
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	while (available.empty())
+		released.wait(scopedLock);
+
+	RenderCanvasFactory* factory = available.back();
+	available.pop_back();
+
+	shared_ptr<RenderCanvasPool> self = shared_from_this();
+	return shared_ptr<RenderCanvasFactory>(factory, [self](RenderCanvasFactory* f) { self->release(f); });
+}
+
+std::size_t RenderCanvasPool::getSize() const
+{
+	return factories.size();
+}
+
+void RenderCanvasPool::release(RenderCanvasFactory* factory)
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	available.push_back(factory);
+	released.notify_one();
 }
 
 //! Write function to capture the final PNG image
@@ -154,6 +217,25 @@ Tile::ImageType PNGRenderCanvas::copySliceImage()
 	return buffer;
 }
 
+/**
+ * @brief Encodes the part of the metatile through a surface sharing its pixels.
+ *
+ * The metatile has to be flushed before, it is only read.
+ **/
+Tile::ImageType PNGRenderCanvas::encodeTile(int x, int y, int width, int height)
+{
+	cairo_surface_t* metatile = layers[0].surface;
+	int stride = cairo_image_surface_get_stride(metatile);
+	unsigned char* data = cairo_image_surface_get_data(metatile) + y * stride + x * 4;
+	cairo_surface_t* part = cairo_image_surface_create_for_data(data, CAIRO_FORMAT_ARGB32, width, height, stride);
+
+	Tile::ImageType buffer = boost::make_shared<Tile::ImageType::element_type>();
+	buffer->reserve(10*1024);
+	cairo_surface_write_to_png_stream(part, cairoWriter, (void*) buffer.get());
+	cairo_surface_destroy(part);
+	return buffer;
+}
+
 /*
  * SVG Canvas.
  */
@@ -87,27 +87,29 @@ bool CompareLabels(const shared_ptr<LabelType>& first, const shared_ptr<LabelTyp
 }
 
 
+/**
+ * @param size width and height of the metatile in pixels.
+ **/
+MetaTileBounds::MetaTileBounds(double size)
+	: area(0.0, 0.0, size, size)
+{
+	double border = TILE_SIZE * TILE_OVERLAP;
+	neighbours[0] = area.translate( size,  size);
+	neighbours[1] = area.translate(-size,  size);
+	neighbours[2] = area.translate( size, -size);
+	neighbours[3] = area.translate(-size, -size);
+	neighbours[4] = area.translate(0.0,  size);
+	neighbours[5] = area.translate(0.0, -size);
+	neighbours[6] = area.translate( size, 0.0);
+	neighbours[7] = area.translate(-size, 0.0);
+	for (int i = 0; i < 8; i++)
+		neighbourRequests[i] = neighbours[i].grow(border, border);
+}
+
+
 Renderer::Renderer(const shared_ptr<Geodata>& data)
-	: 	data(data), bounds(FloatRect(0.0, 0.0, TILE_SIZE*META_TILE_SIZE, TILE_SIZE*META_TILE_SIZE))
+	: 	data(data)
 {
-	double borderX = bounds.getWidth() * TILE_OVERLAP;
-	double borderY = bounds.getHeight() * TILE_OVERLAP;
-	neighbours[0] = bounds.translate( bounds.getWidth(),  bounds.getHeight());
-	neighbours[1] = bounds.translate(-bounds.getWidth(),  bounds.getHeight());
-	neighbours[2] = bounds.translate( bounds.getWidth(), -bounds.getHeight());
-	neighbours[3] = bounds.translate(-bounds.getWidth(), -bounds.getHeight());
-	neighbours[4] = bounds.translate(0.0,  bounds.getHeight());
-	neighbours[5] = bounds.translate(0.0, -bounds.getHeight());
-	neighbours[6] = bounds.translate( bounds.getWidth(), 0.0);
-	neighbours[7] = bounds.translate(-bounds.getWidth(), 0.0);
-	neighbourRequests[0] = neighbours[0].grow(borderX, borderY);
-	neighbourRequests[1] = neighbours[1].grow(borderX, borderY);
-	neighbourRequests[2] = neighbours[2].grow(borderX, borderY);
-	neighbourRequests[3] = neighbours[3].grow(borderX, borderY);
-	neighbourRequests[4] = neighbours[4].grow(borderX, borderY);
-	neighbourRequests[5] = neighbours[5].grow(borderX, borderY);
-	neighbourRequests[6] = neighbours[6].grow(borderX, borderY);
-	neighbourRequests[7] = neighbours[7].grow(borderX, borderY);
 }
 
 
@@ -350,27 +352,28 @@ void Renderer::renderLabels(cairo_t* cr,
 }
 
 //! Checks if all neighbour tile know about the owner of the label
-bool Renderer::isCutOff(const FloatRect& box, const FloatRect& owner)
+bool Renderer::isCutOff(const FloatRect& box, const FloatRect& owner, const MetaTileBounds& bounds)
 {
 	bool tooLarge = false;
 	for (int i = 0; i < 8 && !tooLarge; i++)
-		tooLarge = box.intersects(neighbours[i]) && !neighbourRequests[i].intersects(owner);
+		tooLarge = box.intersects(bounds.neighbours[i]) && !bounds.neighbourRequests[i].intersects(owner);
 	return tooLarge;
 }
 
 //! Place labels with greedy algorithm
 void Renderer::placeLabels(const std::list<shared_ptr<Label> >& labels,
-						   std::vector<shared_ptr<Label> >& placed)
+						   std::vector<shared_ptr<Label> >& placed,
+						   const MetaTileBounds& bounds)
 {
 	std::vector<shared_ptr<Label>> contained;
 	contained.reserve(labels.size());
 
 	// first sort out all out-of-bounds labels
 	for (auto& l : labels) {
-		if (bounds.contains(l->box))
+		if (bounds.area.contains(l->box))
 			contained.push_back(l);
-		else if (bounds.getIntersection(l->box).getArea() > 0.0){
-			if (isCutOff(l->box, l->owner))
+		else if (bounds.area.getIntersection(l->box).getArea() > 0.0){
+			if (isCutOff(l->box, l->owner, bounds))
 				continue;
 
 			double intersect_max = 0.0;
@@ -409,7 +412,7 @@ void Renderer::placeLabels(const std::list<shared_ptr<Label> >& labels,
 		int min = 0;
 		for (int i = 1; i < 5; i++)
 			if (intersect_max[i] < intersect_max[min]
-			 && bounds.contains(possible[i])) // don't push label outside of the bounding-box
+			 && bounds.area.contains(possible[i])) // don't push label outside of the bounding-box
 				min = i;
 
 		// only place label if intersecting area is 1/10 the label
@@ -422,14 +425,15 @@ void Renderer::placeLabels(const std::list<shared_ptr<Label> >& labels,
 
 //! Place labels with greedy algorithm
 void Renderer::placeShields(const std::list<shared_ptr<Shield> >& shields,
-						   std::vector<shared_ptr<Shield> >& placed)
+						   std::vector<shared_ptr<Shield> >& placed,
+						   const MetaTileBounds& bounds)
 {
 	std::vector<shared_ptr<Shield>> contained;
 	contained.reserve(10);
 
 	// first sort out all out-of-bounds labels
 	for (auto& shield : shields) {
-		if (!bounds.contains(shield->shield))
+		if (!bounds.area.contains(shield->shield))
 			continue;
 
 		// stores the size of the intersecting area
@@ -510,6 +514,7 @@ void Renderer::renderEmptyTile(RenderAttributes& map,
 void Renderer::renderArea(const FixedRect& area,
 						  const shared_ptr<RenderCanvas>& canvas,
 						  double width, double height,
+						  const MetaTileBounds& bounds,
 						  RenderAttributes& map,
 						  AssetCache& cache)
 {
@@ -539,7 +544,7 @@ void Renderer::renderArea(const FixedRect& area,
 	std::vector<shared_ptr<Shield> > placedShields;
 	placedShields.reserve(10);
 	shields.sort(&CompareLabels<Shield>);
-	placeShields(shields, placedShields);
+	placeShields(shields, placedShields, bounds);
 	renderShields(layers[RenderCanvas::LAYER_LABELS].cr, placedShields);
 	renderLabels<Shield>(layers[RenderCanvas::LAYER_LABELS].cr, placedShields, cache);
 
@@ -547,7 +552,7 @@ void Renderer::renderArea(const FixedRect& area,
 	std::vector<shared_ptr<Label> > placedLabels;
 	placedLabels.reserve(labels.size());
 	labels.sort(&CompareLabels<Label>);
-	placeLabels(labels, placedLabels);
+	placeLabels(labels, placedLabels, bounds);
 	renderLabels<Label>(layers[RenderCanvas::LAYER_LABELS].cr, placedLabels, cache);
 
 	compositeLayers(layers);
@@ -580,6 +585,33 @@ void Renderer::sliceTile(const shared_ptr<RenderCanvas>& canvas,
 	tile->setImage(canvas->copySliceImage());
 }
 
+/**
+ * @brief Encodes a tile directly from the rendered metatile.
+ *
+ * Unlike sliceTile, several tiles of the same metatile can be encoded at once.
+ * @return false if the canvas has to be sliced with sliceTile.
+ **/
+bool Renderer::encodeTile(const shared_ptr<RenderCanvas>& canvas,
+						  const shared_ptr<MetaIdentifier>& mid,
+						  const shared_ptr<Tile>& tile) const
+{
+#if DEBUG_BUILD
+	// the tile id is printed onto the slice layer
+	return false;
+#else
+	const shared_ptr<TileIdentifier>& tid = tile->getIdentifier();
+	int dx = (tid->getX() - mid->getX()) * TILE_SIZE;
+	int dy = (tid->getY() - mid->getY()) * TILE_SIZE;
+
+	Tile::ImageType image = canvas->encodeTile(dx, dy, TILE_SIZE, TILE_SIZE);
+	if (!image)
+		return false;
+
+	tile->setImage(image);
+	return true;
+#endif
+}
+
 void Renderer::renderMetaTile(RenderAttributes& map, const shared_ptr<RenderCanvas>& canvas, const shared_ptr<MetaIdentifier>& id)
 {
 	int width = id->getWidth() * TILE_SIZE;
@@ -601,7 +633,12 @@ void Renderer::renderMetaTile(RenderAttributes& map, const shared_ptr<RenderCanv
 
 	canvas->clear();
 
-	renderArea(area, canvas, width, height, map, cache);
+	// labels are placed within the full metatile, even if it is cut off at the border of the world
+	MetaTileBounds bounds(MetaIdentifier::Size(zoom) * TILE_SIZE);
+	renderArea(area, canvas, width, height, bounds, map, cache);
+
+	// tiles are encoded directly from the metatile
+	cairo_surface_flush(canvas->getImageLayers()[0].surface);
 
 #if RENDER_LOCK
 	renderLock.unlock();
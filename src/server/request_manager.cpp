@@ -26,48 +26,117 @@
 #include "server/tile_identifier.hpp"
 #include "server/renderer/render_canvas.hpp"
 #include "server/job.hpp"
+#include "server/cache.hpp"
+#include "server/empty_metatile_map.hpp"
+#include "server/request_scheduler.hpp"
+#include "server/worker_pool.hpp"
+#include "server/job_pipeline.hpp"
+#include "server/prerender_controller.hpp"
+#include "server/popularity_tracker.hpp"
+#include "server/prefetcher.hpp"
 #include "general/configuration.hpp"
+#include "utils/transform.hpp"
 
+#include <boost/unordered_map.hpp>
 
-class RequestManager::RunningQueue
+
+/**
+ * @brief Metatiles requested by users that are queued or rendered, and metatiles rendered in advance.
+ *
+ * Requests for such a metatile are attached to it instead of being queued again, so every
+ * metatile is rendered once no matter how many of its tiles are requested.
+ **/
+class RequestManager::InFlightTable
 {
+public:
+	typedef std::pair<shared_ptr<HttpRequest>, shared_ptr<TileIdentifier>> Request;
+
 private:
-	boost::mutex runningMutex;
-	std::list<Job*> jobs;
+	struct Entry
+	{
+		Entry() : job(nullptr) {}
+
+		//! job rendering the metatile, null while it is queued
+		Job* job;
+		//! requests attached while the metatile is queued
+		std::vector<Request> waiting;
+	};
+
+	boost::mutex lock;
+	//! indexed by the origin of the metatile
+	boost::unordered_map<TileIdentifier, Entry> entries;
 
 public:
-	bool start(Job* job, const shared_ptr<MetaIdentifier>& mid)
+	//! @return true if the request has to be enqueued, false if it was attached to a queued or running metatile
+	bool attach(const shared_ptr<HttpRequest>& r, const shared_ptr<TileIdentifier>& ti)
 	{
-		boost::mutex::scoped_lock lock(runningMutex);
-		for (auto j : jobs) {
-			if (j->getIdentifier() == mid)
-				return false;
+		boost::mutex::scoped_lock scopedLock(lock);
+		auto result = entries.emplace(MetaIdentifier::Origin(*ti), Entry());
+		if (result.second)
+			return true;
+
+		Entry& entry = result.first->second;
+		if (entry.job)
+			entry.job->addRequest(r, ti);
+		else
+			entry.waiting.push_back(Request(r, ti));
+		return false;
+	}
+
+	//! Removes a queued metatile that could not be enqueued. @return the attached requests
+	std::vector<Request> cancel(const TileIdentifier& origin)
+	{
+		boost::mutex::scoped_lock scopedLock(lock);
+		std::vector<Request> waiting;
+		auto it = entries.find(origin);
+		if (it != entries.end()) {
+			waiting.swap(it->second.waiting);
+			entries.erase(it);
 		}
+		return waiting;
+	}
 
-		jobs.push_back(job);
-		return true;
+	//! Removes a queued metatile whose requests were answered. @return the requests attached in the meantime, the metatile stays queued for them
+	std::vector<Request> finishQueued(const TileIdentifier& origin)
+	{
+		boost::mutex::scoped_lock scopedLock(lock);
+		std::vector<Request> waiting;
+		auto it = entries.find(origin);
+		if (it == entries.end())
+			return waiting;
+		if (it->second.waiting.empty())
+			entries.erase(it);
+		else
+			waiting.swap(it->second.waiting);
+		return waiting;
 	}
 
-	//! @return true if the job needs to be executed
-	bool start(Job* job, const shared_ptr<TileIdentifier>& ti, const shared_ptr<HttpRequest>& r)
+	//! Starts a queued metatile, requests are attached to the job from now on. @return the attached requests
+	std::vector<Request> start(Job* job)
 	{
-		boost::mutex::scoped_lock lock(runningMutex);
-		for (auto j : jobs) {
-			if (j->getIdentifier()->contains(ti)) {
-				j->addRequest(r, ti);
-				return false;
-			}
-		}
+		boost::mutex::scoped_lock scopedLock(lock);
+		Entry& entry = entries[*job->getIdentifier()];
+		entry.job = job;
+		std::vector<Request> waiting;
+		waiting.swap(entry.waiting);
+		return waiting;
+	}
 
-		jobs.push_back(job);
-		job->addRequest(r, ti);
+	//! Starts a metatile nobody requested. @return false if it is queued or running already
+	bool startUnlessQueued(Job* job)
+	{
+		boost::mutex::scoped_lock scopedLock(lock);
+		auto result = entries.emplace(*job->getIdentifier(), Entry());
+		if (!result.second)
+			return false;
+		result.first->second.job = job;
 		return true;
 	}
 
 	void finished(Job* job)
 	{
-		boost::mutex::scoped_lock lock(runningMutex);
-		jobs.remove(job);
+		boost::mutex::scoped_lock scopedLock(lock);
+		entries.erase(*job->getIdentifier());
 	}
 };
 
@@ -90,25 +159,50 @@ RequestManager::RequestManager( const shared_ptr<Configuration>& config,
 	, renderer(renderer)
 	, cache(cache)
 	, ssm(ssm)
-	, preventStop(jobPool)
-	, running(new RunningQueue())
+	, emptyMetatiles(new EmptyMetatileMap())
+	, scheduler(new RequestScheduler(config))
+	, inFlight(new InFlightTable())
 {
 	int threads = config->get<int>(opt::server::num_threads);
-	currentPrerenderingThreads = 0;
-	for (int i = 0; i < threads; ++i) {
-		auto worker = boost::make_shared<boost::thread>(
-			boost::bind(&boost::asio::io_service::run, &jobPool)
-		);
-		workers.push_back(worker);
-		factories.push(boost::make_shared<RenderCanvasFactory>());
+	maxStaleness = std::chrono::seconds(config->get<int>(opt::server::max_staleness));
+	threads = std::max(threads, 1);
+	workers.reset(new WorkerPool(threads));
+	pipeline.reset(new JobPipeline(config));
+	// enough canvases for every renderer and every job waiting to be encoded
+	canvases = boost::make_shared<RenderCanvasPool>(
+		  config->get<int>(opt::server::render_threads)
+		+ config->get<int>(opt::server::encode_threads)
+		+ config->get<int>(opt::server::stage_queue_size));
+
+	prerenderer.reset(new PrerenderController(config,
+		[this](const shared_ptr<MetaIdentifier>& mid) {
+			if (!scheduler->push(RequestScheduler::Prerender, mid, false))
+				return false;
+			dispatch();
+			return true;
+		},
+		[this]() { return scheduler->size(RequestScheduler::Interactive); }));
+
+	int popular = config->get<int>(opt::server::prerender_popular);
+	if (popular > 0) {
+		// enough room to tell popular metatiles from the rest
+		popularity.reset(new PopularityTracker(16 * popular));
+		std::size_t requests = popularity->load(config->get<string>(opt::server::access_log), config->get<string>(opt::server::path_to_default_style));
+		LOG_SEV(request_log, info) << "Read " << requests << " requests of " << popularity->size() << " metatiles from the access log.";
 	}
 
-	// start prerender timing
-        prerender_start = std::chrono::system_clock::now();
+	if (config->get<bool>(opt::server::prefetch_neighbours)) {
+		prefetcher.reset(new Prefetcher(
+			[this](const shared_ptr<MetaIdentifier>& mid) { return prefetch(mid); },
+			[this]() {
+				return scheduler->size(RequestScheduler::Interactive) == 0
+					&& pipeline->getStatistic(JobPipeline::Render).waiting == 0;
+			}));
+	}
 }
 
 /**
- * @brief Stops the io_service, joins all Threads and destructs the RequestManager.
+ * @brief Stops the workers, joins all Threads and destructs the RequestManager.
  *
  **/
 RequestManager::~RequestManager() {
@@ -122,177 +216,386 @@ RequestManager::~RequestManager() {
  **/
 void RequestManager::stop()
 {
-	jobPool.stop();
-	for (auto worker : workers) {
-		worker->join();
-	}
-	workers.clear();
+	prerenderer->stop();
+	workers->stop();
+	pipeline->stop();
+	if (prefetcher)
+		prefetcher->printStatistic();
+}
+
+/**
+ * @brief Lets a worker process the next request of the scheduler.
+ **/
+void RequestManager::dispatch()
+{
+	workers->post( boost::bind(&RequestManager::processNextRequest, shared_from_this()) );
 }
 
 
+
 /**
  * @brief Enqueues the HttpRequest.
  *
+ * Requests with an invalid URL or exceeding the queue are answered immediately.
+ *
  * @param r The HttpRequest which should be processed.
  **/
 void RequestManager::enqueue(const shared_ptr<HttpRequest>& r)
 {
-	boost::mutex::scoped_lock userLock(userRJMutex);
-	if (userRequests.size() >= config->get<int>(opt::server::max_queue_size)) {
+	shared_ptr<TileIdentifier> ti;
+	try
+	{
+		ti = TileIdentifier::Create(r->getURL(), this->ssm, config);
+	}
+	catch (excp::MalformedURLException &e)
+	{
+		LOG_SEV(request_log, info) << "MalformedURLException: "
+			<< e.what()  << " Url: " << r->getURL();
+
+		r->answer(HttpRequest::Reply::forbidden);
+		return;
+	}
+	catch (excp::UnknownImageFormatException &e)
+	{
+		LOG_SEV(request_log, info) << "UnknownImageFormatException: "
+			<< e.what()  << " Url: " << r->getURL();
+
+		r->answer(HttpRequest::Reply::not_implemented);
+		return;
+	}
+
+	if (popularity)
+		popularity->hit(*ti);
+	if (prefetcher)
+		prefetcher->requested(r->getClient(), *ti);
+
+	// answered together with the other requests for the same metatile
+	if (!inFlight->attach(r, ti))
+		return;
+
+	if (!scheduler->push(r, ti)) {
+		for (auto& waiting : inFlight->cancel(MetaIdentifier::Origin(*ti)))
+			waiting.first->answer(HttpRequest::Reply::service_unavailable);
 		r->answer(HttpRequest::Reply::service_unavailable);
 		return;
 	}
-	userRequests.push(r);
-	userLock.unlock();
 
-	jobPool.post( boost::bind(&RequestManager::processNextRequest, shared_from_this()) );
+	dispatch();
 }
 
 
 /**
- * @brief Enqueues the TileIdentifier.
+ * @brief Enqueues the TileIdentifier for prerendering.
  *
  * @param ti The MetaIdentifier which identifies the Tile which should be renderer.
+ * @param recursive true if the tiles below should be enqueued up to the prerender level.
  **/
-void RequestManager::enqueue(const shared_ptr<MetaIdentifier>& ti)
+void RequestManager::enqueue(const shared_ptr<MetaIdentifier>& ti, bool recursive)
 {
-	preRJMutex.lock();
-	preRenderRequests.push(ti);
-	preRJMutex.unlock();
+	if (!scheduler->push(RequestScheduler::Prerender, ti, recursive)) {
+		LOG_SEV(request_log, debug) << "Prerender queue is full, skipped metatile " << *ti;
+		if (!recursive) {
+			boost::mutex::scoped_lock lock(revalidatingMutex);
+			revalidating.erase(*ti);
+		}
+		return;
+	}
 
-	jobPool.post( boost::bind(&RequestManager::processNextRequest, shared_from_this()) );
+	dispatch();
 }
 
 /**
- * @brief Selects the next Job and runs it process Method.
+ * @brief Enqueues a metatile that will probably be requested soon.
+ *
+ * Prefetching is done before prerendering, but only if no user waits.
+ *
+ * @param ti The MetaIdentifier which identifies the Tile which should be renderer.
+ * @return false if the prefetch queue is full.
  **/
-void RequestManager::processNextRequest()
+bool RequestManager::prefetch(const shared_ptr<MetaIdentifier>& ti)
 {
-	if (!nextUserRequest())
-		if (!nextPreRenderRequest())
-			LOG_SEV(request_log, error) << "Trying to run a job, but there is none.";
+	if (!scheduler->push(RequestScheduler::Prefetch, ti))
+		return false;
+
+	dispatch();
+	return true;
 }
 
 /**
- * @brief Selects the next Job and runs it process Method.
- * @return true if a request was processed
+ * @brief Prerenders all metatiles of the stylesheet up to the prerender level.
+ *
+ * Continues the saved progress if the stylesheet did not change since.
+ * The most requested metatiles above the prerender level are rendered first.
+ *
+ * @param stylesheet path of the stylesheet.
+ * @param version modification time of the stylesheet.
  **/
-bool RequestManager::nextUserRequest()
+void RequestManager::prerender(const string& stylesheet, std::time_t version)
 {
-	boost::mutex::scoped_lock userLock(userRJMutex);
-	if (userRequests.empty())
-		return false;
+	std::vector<shared_ptr<MetaIdentifier>> popular;
+	if (popularity)
+		popular = popularity->top(stylesheet, config->get<int>(opt::server::prerender_popular), config->get<int>(opt::server::prerender_level) + 1);
+	prerenderer->start(stylesheet, version, popular);
+}
 
-	shared_ptr<HttpRequest> req = userRequests.front();
-	userRequests.pop();
-	userLock.unlock();
+/**
+ * @brief Stops prerendering a removed stylesheet and forgets its progress.
+ **/
+void RequestManager::cancelPrerendering(const string& stylesheet)
+{
+	prerenderer->remove(stylesheet);
+}
 
-	shared_ptr<TileIdentifier> ti;
-	try
-	{
-		ti = TileIdentifier::Create(req->getURL(), this->ssm, config);
+/**
+ * @brief Marks the cached tiles of an area as stale and enqueues them to be rendered again.
+ *
+ * @param area the area in mercator coordinates.
+ * @param minZoom lowest zoomlevel to invalidate.
+ * @param maxZoom highest zoomlevel to invalidate.
+ * @param stylesheet path of the stylesheet, empty for all stylesheets.
+ * @param rerender true if the affected metatiles should be rendered in the background.
+ * @return number of affected metatiles.
+ **/
+std::size_t RequestManager::invalidate(const FixedRect& area, int minZoom, int maxZoom, const string& stylesheet, bool rerender)
+{
+	std::vector<shared_ptr<MetaIdentifier>> metatiles = cache->invalidate(area, minZoom, maxZoom, stylesheet);
+	if (rerender) {
+		// lower zoomlevels cover more area and come first
+		for (auto& mid : metatiles)
+			enqueue(mid, false);
 	}
-	catch (excp::MalformedURLException &e)
-	{
-		LOG_SEV(request_log, info) << "MalformedURLException: "
-			<< e.what()  << " Url: " << req->getURL();
+	return metatiles.size();
+}
+
+/**
+ * @brief Marks the cached tiles of an area given in lat/lon as stale.
+ *
+ * @param bounds the area, x is the longitude and y the latitude.
+ **/
+std::size_t RequestManager::invalidate(const FloatRect& bounds, int minZoom, int maxZoom, const string& stylesheet, bool rerender)
+{
+	coord_t minX, minY, maxX, maxY;
+	projectMercator(FloatPoint(bounds.minX, bounds.minY), minX, minY);
+	projectMercator(FloatPoint(bounds.maxX, bounds.maxY), maxX, maxY);
+	return invalidate(FixedRect(minX, minY, maxX, maxY), minZoom, maxZoom, stylesheet, rerender);
+}
+
+/**
+ * @brief Enqueues a metatile with stale tiles to be rendered again, unless it already is.
+ *
+ * @param mid The MetaIdentifier of the metatile.
+ **/
+void RequestManager::revalidate(const shared_ptr<MetaIdentifier>& mid)
+{
+	boost::mutex::scoped_lock lock(revalidatingMutex);
+	if (!revalidating.insert(*mid).second)
+		return;
+	lock.unlock();
+
+	enqueue(mid, false);
+}
 
-		req->answer(HttpRequest::Reply::forbidden);
+/**
+ * @brief Selects the next Job and runs it process Method.
+ **/
+void RequestManager::processNextRequest()
+{
+	RequestScheduler::Task task;
+	if (!scheduler->pop(task)) {
+		LOG_SEV(request_log, error) << "Trying to run a job, but there is none.";
+		return;
 	}
-	catch (excp::UnknownImageFormatException &e)
-	{
-		LOG_SEV(request_log, info) << "UnknownImageFormatException: "
-			<< e.what()  << " Url: " << req->getURL();
 
-		req->answer(HttpRequest::Reply::not_implemented);
+	if (task.lane == RequestScheduler::Interactive) {
+		prerenderer->userRequestStarted(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - task.enqueued));
+		processUserRequest(task);
 	}
+	else if (task.expired)
+		drop(task);
+	else
+		processPreRenderRequest(task);
+}
 
-	// identifier could not be parsed
-	if (!ti)
+/**
+ * @brief Answers a request that waited longer than the deadline of its lane or whose client disconnected.
+ **/
+void RequestManager::drop(const shared_ptr<HttpRequest>& req, const shared_ptr<TileIdentifier>& ti, bool expired)
+{
+	LOG_SEV(request_log, debug) << "Dropped request for " << *ti << (expired ? " after the queue deadline." : ", the client disconnected.");
+	req->answer(HttpRequest::Reply::service_unavailable);
+}
+
+/**
+ * @brief Discards a metatile that waited longer than the deadline of its lane.
+ **/
+void RequestManager::drop(const RequestScheduler::Task& task)
+{
+	if (!task.recursive) {
+		boost::mutex::scoped_lock lock(revalidatingMutex);
+		revalidating.erase(*task.meta);
+	}
+}
+
+/**
+ * @return true if the metatile is known to be empty or its first tile is rendered and not stale.
+ **/
+bool RequestManager::isCached(const shared_ptr<MetaIdentifier>& mid)
+{
+	if (emptyMetatiles->isEmpty(*mid))
 		return true;
 
-	shared_ptr<MetaIdentifier> mid = MetaIdentifier::Create(ti);
+	shared_ptr<Tile> tile = cache->getTile(boost::make_shared<TileIdentifier>(*mid), false);
+	return tile->isRendered() && !tile->isStale();
+}
 
-	factoriesMutex.lock();
-	shared_ptr<RenderCanvasFactory> factory = factories.front();
-	factories.pop();
-	factoriesMutex.unlock();
+/**
+ * @brief Answers the request from the cache if the tile is rendered or known to be empty.
+ *
+ * @return false if the metatile of the tile has to be rendered.
+ **/
+bool RequestManager::answerFromCache(const shared_ptr<HttpRequest>& req, const shared_ptr<TileIdentifier>& ti)
+{
+	if (emptyMetatiles->isEmpty(*ti)) {
+		// answer with the empty tile if it is already rendered
+		shared_ptr<Tile> tile = cache->getTile(TileIdentifier::CreateEmptyTID(ti->getStylesheetPath(), ti->getImageFormat()));
+		if (tile->isRendered()) {
+			req->answer(tile);
+			return true;
+		}
+	}
 
-	shared_ptr<RenderCanvas> canvas = factory->getCanvas(ti->getImageFormat());
+	shared_ptr<Tile> tile = cache->getTile(ti);
+	if (tile->isRendered() && (!tile->isStale() || tile->getStaleness() < maxStaleness)) {
+		// stale tiles are served while they are rendered again in the background
+		if (tile->isStale())
+			revalidate(MetaIdentifier::Create(ti));
+		req->answer(tile);
+		return true;
+	}
 
-	Job job(mid, config, shared_from_this(), canvas);
+	return false;
+}
 
-	// check if tiles are already in progress
-	if (running->start(&job, ti, req))
-	{
-		job.process();
+/**
+ * @brief Answers a request from the cache, or drops it if it expired or its client disconnected.
+ *
+ * @return false if the metatile of the tile has to be rendered.
+ **/
+bool RequestManager::answerWithoutRendering(const shared_ptr<HttpRequest>& req, const shared_ptr<TileIdentifier>& ti, bool expired)
+{
+	if (expired || req->isDisconnected()) {
+		drop(req, ti, expired);
+		return true;
+	}
+	return answerFromCache(req, ti);
+}
 
-		running->finished(&job);
+/**
+ * @brief Answers the request of a user and the requests attached to its metatile, rendering it if needed.
+ *
+ * Requests that can be answered from the cache or the map of empty metatiles are answered
+ * before any job is built, the job is only created if something has to be rendered.
+ **/
+void RequestManager::processUserRequest(const RequestScheduler::Task& task)
+{
+	TileIdentifier origin = MetaIdentifier::Origin(*task.tile);
+
+	// only the request of the task waited for the whole time
+	std::vector<InFlightTable::Request> unanswered;
+	if (!answerWithoutRendering(task.request, task.tile, task.expired))
+		unanswered.push_back(InFlightTable::Request(task.request, task.tile));
+	while (unanswered.empty()) {
+		std::vector<InFlightTable::Request> waiting = inFlight->finishQueued(origin);
+		if (waiting.empty())
+			return;
+		for (auto& r : waiting) {
+			if (!answerWithoutRendering(r.first, r.second, false))
+				unanswered.push_back(r);
+		}
+	}
 
-		job.deliver();
+	shared_ptr<MetaIdentifier> mid = MetaIdentifier::Create(task.tile);
+	shared_ptr<Job> job = boost::make_shared<Job>(mid, config, shared_from_this(), canvases);
+	for (auto& r : unanswered)
+		job->addRequest(r.first, r.second);
+	for (auto& r : inFlight->start(job.get())) {
+		if (!answerWithoutRendering(r.first, r.second, false))
+			job->addRequest(r.first, r.second);
 	}
 
-	factoriesMutex.lock();
-	factories.push(factory);
-	factoriesMutex.unlock();
+	shared_ptr<RequestManager> self = shared_from_this();
+	pipeline->process(job, [self](const shared_ptr<Job>& job) { self->finishUserJob(job); });
+}
 
-	return true;
+/**
+ * @brief Answers the requests of a job that left the pipeline.
+ **/
+void RequestManager::finishUserJob(const shared_ptr<Job>& job)
+{
+	inFlight->finished(job.get());
+
+	job->deliver();
 }
 
-bool RequestManager::nextPreRenderRequest()
+/**
+ * @brief Renders a metatile that was prefetched, prerendered or became stale.
+ **/
+void RequestManager::processPreRenderRequest(const RequestScheduler::Task& task)
 {
-	boost::mutex::scoped_lock preLock(preRJMutex);
-	if (preRenderRequests.empty())
-		return false;
+	const shared_ptr<MetaIdentifier>& mid = task.meta;
 
-	shared_ptr<MetaIdentifier> mid = preRenderRequests.front();
-	preRenderRequests.pop();
-	currentPrerenderingThreads++;
-	preLock.unlock();
+	// predicted metatiles are only rendered if they are missing
+	if (task.lane == RequestScheduler::Prefetch && isCached(mid)) {
+		prerendered(task, false);
+		return;
+	}
 
-	factoriesMutex.lock();
-	shared_ptr<RenderCanvasFactory> factory = factories.front();
-	factories.pop();
-	factoriesMutex.unlock();
+	shared_ptr<Job> job = boost::make_shared<Job>(mid, config, shared_from_this(), canvases);
 
-	shared_ptr<RenderCanvas> canvas = factory->getCanvas(mid->getImageFormat());
+	// check if tiles are already queued or in progress
+	if (inFlight->startUnlessQueued(job.get())) {
+		shared_ptr<RequestManager> self = shared_from_this();
+		pipeline->process(job, [self, task](const shared_ptr<Job>& job) { self->finishPreRenderJob(job, task); });
+	} else
+		prerendered(task, false);
+}
 
-	Job job(mid, config, shared_from_this(), canvas);
+/**
+ * @brief Answers the requests attached to a prerendered job that left the pipeline.
+ **/
+void RequestManager::finishPreRenderJob(const shared_ptr<Job>& job, const RequestScheduler::Task& task)
+{
+	inFlight->finished(job.get());
 
-	// check if tiles are already in progress
-	if (running->start(&job, mid))
-	{
-		job.process();
+	job->deliver();
 
-		running->finished(&job);
+	// metatiles that were already cached do not show whether prefetching pays off
+	if (task.lane == RequestScheduler::Prefetch && job->wasRendered() && prefetcher)
+		prefetcher->rendered(*job->getIdentifier());
 
-		job.deliver();
-	}
+	prerendered(task, job->isEmpty());
+}
 
-	factoriesMutex.lock();
-	factories.push(factory);
-	factoriesMutex.unlock();
+/**
+ * @brief Enqueues the children of a prerendered metatile, unless it is empty.
+ **/
+void RequestManager::prerendered(const RequestScheduler::Task& task, bool empty)
+{
+	const shared_ptr<MetaIdentifier>& mid = task.meta;
+	if (!task.recursive) {
+		boost::mutex::scoped_lock lock(revalidatingMutex);
+		revalidating.erase(*mid);
+	}
 
-	if (!job.isEmpty() && mid->getZoom() < config->get<int>(opt::server::prerender_level)) {
+	if (task.recursive && !empty && mid->getZoom() < config->get<int>(opt::server::prerender_level)) {
 		std::vector<shared_ptr<MetaIdentifier>> children;
 		mid->getSubIdentifiers(children);
 		for (auto& c : children)
 			enqueue(c);
 	}
 
-	preLock.lock();
-	currentPrerenderingThreads--;
-	preLock.unlock();
-
-	if (currentPrerenderingThreads == 0 && preRenderRequests.size() == 0) {
-		prerender_stop = std::chrono::system_clock::now();
-		int elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>
-					 (prerender_stop-prerender_start).count();
-		LOG_SEV(request_log, info) << "Prerendering finished in "
-			<< std::setfill('0') << std::setw(2) << elapsed_seconds / 60 << ":" << elapsed_seconds % 60;
-	}
-
-	return true;
+	if (task.lane == RequestScheduler::Prerender)
+		prerenderer->finished(mid, empty);
 }
 
 /**
@@ -338,3 +641,19 @@ shared_ptr<Renderer> RequestManager::getRenderer() const
 	return renderer;
 }
 
+
+/**
+ * @brief Returns the metatiles known to contain no data
+ *
+ * @return The EmptyMetatileMap
+ **/
+EmptyMetatileMap& RequestManager::getEmptyMetatiles() const
+{
+	return *emptyMetatiles;
+}
+
+JobPipeline& RequestManager::getPipeline() const
+{
+	return *pipeline;
+}
+
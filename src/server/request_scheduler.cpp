@@ -0,0 +1,180 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/request_scheduler.hpp"
+
+#include <algorithm>
+
+#include "server/meta_identifier.hpp"
+#include "server/tile_identifier.hpp"
+#include "general/configuration.hpp"
+
+
+/**
+ * @brief Converts the name of a policy as used in the configuration.
+ *
+ * @param name "fifo", "lifo" or "zoom".
+ **/
+RequestScheduler::Policy RequestScheduler::ParsePolicy(const string& name)
+{
+	if (name == "fifo")
+		return Fifo;
+	if (name == "lifo")
+		return Lifo;
+	if (name == "zoom")
+		return ByZoom;
+
+	BOOST_THROW_EXCEPTION(excp::InputFormatException() << excp::InfoWhat("Unknown queue policy: " + name));
+}
+
+/**
+ * @brief Creates the lanes as given by the configuration.
+ *
+ * Interactive requests use the configured policy and deadline, prefetching shares the
+ * deadline but prefers new requests, prerendering works from low to high zoomlevels.
+ **/
+RequestScheduler::RequestScheduler(const shared_ptr<Configuration>& config)
+	: sequence(0)
+{
+	std::chrono::milliseconds deadline(std::max(config->get<int>(opt::server::queue_deadline), 0));
+	setLane(Interactive,
+			ParsePolicy(config->get<string>(opt::server::queue_policy)),
+			std::max(config->get<int>(opt::server::max_queue_size), 1),
+			deadline);
+	setLane(Prefetch, Lifo, std::max(config->get<int>(opt::server::prefetch_queue_size), 0), deadline);
+	setLane(Prerender, ByZoom, std::max(config->get<int>(opt::server::prerender_queue_size), 0), std::chrono::milliseconds(0));
+}
+
+/**
+ * @brief Changes the settings of a lane, waiting tasks are ordered again.
+ *
+ * @param capacity maximal number of waiting tasks, 0 for no limit.
+ * @param deadline maximal time a task may wait, 0 to wait forever.
+ **/
+void RequestScheduler::setLane(Lane lane, Policy policy, std::size_t capacity, std::chrono::milliseconds deadline)
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	Queue& queue = lanes[lane];
+	queue.order.policy = policy;
+	queue.capacity = capacity;
+	queue.deadline = deadline;
+	std::make_heap(queue.heap.begin(), queue.heap.end(), queue.order);
+}
+
+bool RequestScheduler::Later::operator()(const Task& a, const Task& b) const
+{
+	switch (policy) {
+	case Fifo:
+		return a.sequence > b.sequence;
+	case Lifo:
+		return a.sequence < b.sequence;
+	case ByZoom:
+	default:
+		if (a.zoom != b.zoom)
+			return a.zoom > b.zoom;
+		return a.sequence < b.sequence;
+	}
+}
+
+/**
+ * @brief Enqueues the request of a user.
+ *
+ * @return false if the interactive lane is full.
+ **/
+bool RequestScheduler::push(const shared_ptr<HttpRequest>& request, const shared_ptr<TileIdentifier>& tile)
+{
+	Task task;
+	task.lane = Interactive;
+	task.request = request;
+	task.tile = tile;
+	task.recursive = false;
+	task.zoom = tile->getZoom();
+	return insert(task);
+}
+
+/**
+ * @brief Enqueues a metatile to prefetch or prerender.
+ *
+ * @return false if the lane is full.
+ **/
+bool RequestScheduler::push(Lane lane, const shared_ptr<MetaIdentifier>& meta, bool recursive)
+{
+	assert(lane != Interactive);
+
+	Task task;
+	task.lane = lane;
+	task.meta = meta;
+	task.recursive = recursive;
+	task.zoom = meta->getZoom();
+	return insert(task);
+}
+
+bool RequestScheduler::insert(Task& task)
+{
+	task.expired = false;
+	task.enqueued = std::chrono::steady_clock::now();
+
+	boost::mutex::scoped_lock scopedLock(lock);
+	Queue& queue = lanes[task.lane];
+	if (queue.capacity > 0 && queue.heap.size() >= queue.capacity)
+		return false;
+
+	task.sequence = sequence++;
+	queue.heap.push_back(task);
+	std::push_heap(queue.heap.begin(), queue.heap.end(), queue.order);
+	return true;
+}
+
+/**
+ * @brief Removes the next task, taken from the first lane that is not empty.
+ *
+ * @param task set to the next task, which is marked as expired if it waited too long.
+ * @return false if all lanes are empty.
+ **/
+bool RequestScheduler::pop(Task& task)
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	for (Queue& queue : lanes) {
+		if (queue.heap.empty())
+			continue;
+
+		std::pop_heap(queue.heap.begin(), queue.heap.end(), queue.order);
+		task = queue.heap.back();
+		queue.heap.pop_back();
+		std::chrono::milliseconds deadline = queue.deadline;
+		scopedLock.unlock();
+
+		if (deadline.count() > 0)
+			task.expired = (std::chrono::steady_clock::now() - task.enqueued > deadline);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @return number of tasks waiting in the lane.
+ **/
+std::size_t RequestScheduler::size(Lane lane)
+{
+	boost::mutex::scoped_lock scopedLock(lock);
+	return lanes[lane].heap.size();
+}
@@ -96,8 +96,15 @@ shared_ptr<Stylesheet> StylesheetManager::getStylesheet(const string& path)
 	return result;
 }
 
-// calls must be locked by write-lock
-void StylesheetManager::onNewStylesheet(const fs::path& stylesheet_path)
+int StylesheetManager::getGeneration(const string& path)
+{
+	boost::shared_lock<boost::shared_mutex> readLock(stylesheetsLock);
+
+	auto entry = generations.find(path);
+	return (entry != generations.end()) ? entry->second : 0;
+}
+
+shared_ptr<Stylesheet> StylesheetManager::parseStylesheet(const fs::path& stylesheet_path)
 {
 	// lock the weak_ptr to manager
 	shared_ptr<RequestManager> manager = this->manager.lock();
@@ -129,7 +136,7 @@ void StylesheetManager::onNewStylesheet(const fs::path& stylesheet_path)
 		if(errColumn)
 			logger->errorStream() << string(*errColumn, ' ') << "^-here";
 
-		return;
+		return shared_ptr<Stylesheet>();
 	} catch(excp::TimeoutException&)
 	{
 		shared_ptr<ParserLogger> logger = boost::make_shared<ParserLogger>(stylesheet_path.string());
@@ -137,13 +144,33 @@ void StylesheetManager::onNewStylesheet(const fs::path& stylesheet_path)
 		logger->errorStream() << "Parsing of stylesheet " << stylesheet_path << " took more then " << timeout << " ms!";
 		logger->errorStream() << "Parsing canceled!";
 		logger->errorStream() << "You can configure the timeout via '--parse-timeout'.";
-		return;
+		return shared_ptr<Stylesheet>();
 	}
 
+	return stylesheet;
+}
+
+std::time_t StylesheetManager::getVersion(const fs::path& stylesheet_path)
+{
+	boost::system::error_code ec;
+	std::time_t version = fs::last_write_time(stylesheetFolder / (stylesheet_path.filename().string() + ".mapcss"), ec);
+	return ec ? 0 : version;
+}
+
+// calls must be locked by write-lock
+void StylesheetManager::onNewStylesheet(const fs::path& stylesheet_path)
+{
+	shared_ptr<RequestManager> manager = this->manager.lock();
+	assert(manager);
+
+	shared_ptr<Stylesheet> stylesheet = parseStylesheet(stylesheet_path);
+	if (!stylesheet)
+		return;
+
 	parsedStylesheets[stylesheet_path] = stylesheet;
 
-	// prerenders the upmost tile as well as all higher zoomlevels that are specified in the configuration
-	manager->enqueue(boost::make_shared<MetaIdentifier>(TileIdentifier(0, 0, 0, stylesheet_path.string(), TileIdentifier::PNG)));
+	// prerenders all zoomlevels up to the one specified in the configuration, continuing after a restart
+	manager->prerender(stylesheet_path.string(), getVersion(stylesheet_path));
 }
 
 // calls must be locked by write-lock
@@ -153,11 +180,34 @@ void StylesheetManager::onRemovedStylesheet(const fs::path& stylesheet_path)
 	shared_ptr<RequestManager> manager = this->manager.lock();
 	assert(manager);
 
+	manager->cancelPrerendering(stylesheet_path.string());
 	manager->getCache()->deleteTiles(stylesheet_path.string());
 	parsedStylesheets.erase(stylesheet_path);
+	generations[stylesheet_path]++;
 	LOG_SEV(style_log, info) << "Deleted Stylesheet[" << stylesheet_path << "] from Tile Cache and Stylesheet Cache.";
 }
 
+// calls must be locked by write-lock
+void StylesheetManager::onModifiedStylesheet(const fs::path& stylesheet_path)
+{
+	shared_ptr<RequestManager> manager = this->manager.lock();
+	assert(manager);
+
+	shared_ptr<Stylesheet> stylesheet = parseStylesheet(stylesheet_path);
+	if (!stylesheet) {
+		LOG_SEV(style_log, warning) << "Keeping the previous version of Stylesheet[" << stylesheet_path << "].";
+		return;
+	}
+
+	// jobs that already use the old stylesheet produce stale tiles
+	parsedStylesheets[stylesheet_path] = stylesheet;
+	generations[stylesheet_path]++;
+
+	// old tiles are served until they are rendered again
+	manager->getCache()->invalidateTiles(stylesheet_path.string());
+	manager->prerender(stylesheet_path.string(), getVersion(stylesheet_path));
+}
+
 void StylesheetManager::onFileSystemEvent(const boost::system::error_code &ec, const boost::asio::dir_monitor_event &ev)
 {
 	typedef boost::asio::dir_monitor_event eventtype;
@@ -199,8 +249,7 @@ void StylesheetManager::onFileSystemEvent(const boost::system::error_code &ec, c
 		case eventtype::modified:
 			{
 				LOG_SEV(style_log, info) << "Stylesheet[" << path << "] modified!";
-				onRemovedStylesheet(path);
-				onNewStylesheet(path);
+				onModifiedStylesheet(path);
 			}break;
 		default:
 			break;
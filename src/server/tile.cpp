@@ -30,7 +30,9 @@
  * @param id The TileIdentifier which identifies the Tile.
  **/
 Tile::Tile(const shared_ptr<TileIdentifier>& id)
-	: id(id)
+	: stale(false)
+	, staleSince(0)
+	, id(id)
 {
 }
 
@@ -67,6 +69,43 @@ const Tile::ImageType& Tile::getImage() const
 void Tile::setImage(const Tile::ImageType&  image)
 {
 	this->image = image;
+	stale = false;
+}
+
+/**
+ * @brief Returns if the image has to be rendered again.
+ *
+ * @return true if the Tile was invalidated after its image was rendered.
+ **/
+bool Tile::isStale() const
+{
+	return stale;
+}
+
+/**
+ * @brief Marks the image as outdated, it is replaced by the next call to setImage.
+ *
+ * Marking a stale Tile again keeps the time it was marked first.
+ **/
+void Tile::markStale()
+{
+	if (!stale) {
+		staleSince = std::chrono::steady_clock::now().time_since_epoch().count();
+		stale = true;
+	}
+}
+
+/**
+ * @brief Returns how long the image is outdated.
+ *
+ * @return time since the Tile was marked as stale, zero if it is not stale.
+ **/
+std::chrono::steady_clock::duration Tile::getStaleness() const
+{
+	if (!stale)
+		return std::chrono::steady_clock::duration::zero();
+	std::chrono::steady_clock::time_point since{std::chrono::steady_clock::duration(staleSince)};
+	return std::chrono::steady_clock::now() - since;
 }
 
 /**
@@ -0,0 +1,692 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/tile_store.hpp"
+
+#include "server/tile_identifier.hpp"
+#include "server/image_pool.hpp"
+
+#include "utils/exceptions.hpp"
+
+#include <boost/functional/hash.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+	const char BUNDLE_MAGIC[4] = { 'A', 'C', 'T', 'B' };
+	const uint32_t BUNDLE_VERSION = 1;
+	const int BUNDLE_ENTRIES = BundleTileStore::BUNDLE_SIZE * BundleTileStore::BUNDLE_SIZE;
+
+	struct BundleHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t count;
+		struct {
+			uint32_t offset;
+			uint32_t size;
+		} entries[BUNDLE_ENTRIES];
+	};
+
+	/**
+	 * @brief Reads exactly size bytes at offset.
+	 **/
+	bool readAt(int fd, void* data, std::size_t size, off_t offset)
+	{
+		char* dst = (char*) data;
+		while (size > 0) {
+			ssize_t n = ::pread(fd, dst, size, offset);
+			if (n <= 0)
+				return false;
+			dst += n;
+			size -= n;
+			offset += n;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Reads and validates the header of a bundle.
+	 **/
+	bool readHeader(int fd, BundleHeader& header)
+	{
+		return readAt(fd, &header, sizeof(header), 0)
+			&& std::memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) == 0
+			&& header.version == BUNDLE_VERSION
+			&& header.count == BUNDLE_ENTRIES;
+	}
+
+	/**
+	 * @return true if the header contains every tile of the stale bundle, or there is no stale bundle.
+	 **/
+	bool coversStale(const boost::filesystem::path& bundle, const BundleHeader& header)
+	{
+		string stale = bundle.string() + ".stale";
+		int fd = ::open(stale.c_str(), O_RDONLY);
+		if (fd < 0)
+			return true;
+
+		BundleHeader staleHeader;
+		bool covered = true;
+		if (readHeader(fd, staleHeader)) {
+			for (int i = 0; covered && i < BUNDLE_ENTRIES; i++)
+				covered = staleHeader.entries[i].size == 0 || header.entries[i].size > 0;
+		}
+		::close(fd);
+		return covered;
+	}
+
+	/**
+	 * @brief Parses a tile coordinate used as file or directory name.
+	 **/
+	bool parseNumber(const string& text, int& number)
+	{
+		if (text.empty() || text.size() > 9 || !std::all_of(text.begin(), text.end(), ::isdigit))
+			return false;
+		number = std::atoi(text.c_str());
+		return true;
+	}
+
+	/**
+	 * @brief Parses a file name of the form <y>.<format><suffix>.
+	 *
+	 * @return false for temporary, stale or unknown files.
+	 **/
+	bool parseFileName(const string& name, const string& suffix, int& y, TileIdentifier::Format& format)
+	{
+		std::size_t dot = name.find('.');
+		if (dot == string::npos || !parseNumber(name.substr(0, dot), y))
+			return false;
+
+		string extension = name.substr(dot);
+		for (int f = 0; f < TileIdentifier::enumSize; f++) {
+			TileIdentifier ti(0, 0, 0, "", (TileIdentifier::Format) f);
+			if (extension == "." + ti.getImageFormatString() + suffix) {
+				format = ti.getImageFormat();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Compares the content of two files.
+	 **/
+	bool sameContent(const boost::filesystem::path& a, const boost::filesystem::path& b)
+	{
+		boost::system::error_code ec;
+		if (boost::filesystem::file_size(a, ec) != boost::filesystem::file_size(b, ec) || ec)
+			return false;
+
+		std::ifstream fileA(a.string(), std::ios::binary);
+		std::ifstream fileB(b.string(), std::ios::binary);
+		return std::equal(std::istreambuf_iterator<char>(fileA), std::istreambuf_iterator<char>(),
+						  std::istreambuf_iterator<char>(fileB));
+	}
+}
+
+/**
+ * @brief Converts the name of a sync policy as used in the configuration.
+ *
+ * @param name one of "none", "batch" or "always".
+ **/
+TileStore::SyncPolicy TileStore::ParsePolicy(const string& name)
+{
+	if (name == "none")
+		return SyncNever;
+	if (name == "batch")
+		return SyncBatch;
+	if (name == "always")
+		return SyncAlways;
+
+	BOOST_THROW_EXCEPTION(excp::InputFormatException() << excp::InfoWhat("Unknown sync policy: " + name));
+}
+
+/**
+ * @brief Creates the store for a layout as used in the configuration.
+ *
+ * @param layout "bundle" to group tiles of a metatile or "files" for one file per tile.
+ * @param path directory containing the stored tiles.
+ * @param policy when written files are flushed to disk.
+ * @param pool used to detect images that should be stored only once, may be null.
+ **/
+shared_ptr<TileStore> TileStore::Create(const string& layout, const string& path, SyncPolicy policy, const shared_ptr<ImagePool>& pool)
+{
+	if (layout == "bundle")
+		return boost::make_shared<BundleTileStore>(path, policy, pool);
+	if (layout == "files")
+		return boost::make_shared<FileTileStore>(path, policy, pool);
+
+	BOOST_THROW_EXCEPTION(excp::InputFormatException() << excp::InfoWhat("Unknown cache layout: " + layout));
+}
+
+TileStore::TileStore(const string& path, SyncPolicy policy, const shared_ptr<ImagePool>& pool)
+	: path(path)
+	, policy(policy)
+	, pool(pool)
+	, linkedFiles(0)
+{
+}
+
+TileStore::~TileStore()
+{
+}
+
+/**
+ * @brief Deletes all stored tiles of a stylesheet.
+ **/
+void TileStore::remove(const string& stylesheet)
+{
+	boost::system::error_code ec;
+	boost::filesystem::remove_all(path / stylesheet, ec);
+	if (ec) {
+		LOG_SEV(cache_log, warning) << "could not delete all tiles in folder.";
+	}
+}
+
+/**
+ * @brief Marks all stored tiles of a stylesheet as stale.
+ *
+ * @return number of files that were marked.
+ **/
+std::size_t TileStore::markAllStale(const string& stylesheet)
+{
+	// renaming while iterating would stop the iterator
+	std::vector<boost::filesystem::path> files;
+	boost::system::error_code ec;
+	boost::filesystem::recursive_directory_iterator it(path / stylesheet, ec), end;
+	for (; !ec && it != end; it.increment(ec)) {
+		const boost::filesystem::path& file = it->path();
+		if (it.level() == 0 && file.filename() == "shared") {
+			// shared files are only reachable through their links
+			it.no_push();
+			continue;
+		}
+		string extension = file.extension().string();
+		if (extension == ".stale" || extension == ".tmp" || extension == ".link")
+			continue;
+		if (boost::filesystem::is_regular_file(it->status()))
+			files.push_back(file);
+	}
+
+	std::size_t marked = 0;
+	boost::mutex::scoped_lock scopedLock(lock);
+	for (const boost::filesystem::path& file : files) {
+		if (renameStale(file))
+			marked++;
+	}
+	return marked;
+}
+
+/**
+ * @brief Lists the files in the directories <stylesheet>/<zoom>/<x> with x0 <= x <= x1 that exist.
+ *
+ * @return the files with the x coordinate of their directory.
+ **/
+std::vector<std::pair<int, boost::filesystem::path>> TileStore::listFiles(const string& stylesheet, int zoom, int x0, int x1) const
+{
+	std::vector<std::pair<int, boost::filesystem::path>> files;
+	boost::system::error_code ec;
+	boost::filesystem::directory_iterator column(path / stylesheet / boost::lexical_cast<string>(zoom), ec), end;
+	for (; !ec && column != end; column.increment(ec)) {
+		int x;
+		if (!parseNumber(column->path().filename().string(), x) || x < x0 || x > x1)
+			continue;
+
+		boost::system::error_code fileEc;
+		boost::filesystem::directory_iterator file(column->path(), fileEc);
+		for (; !fileEc && file != end; file.increment(fileEc))
+			files.push_back(std::make_pair(x, file->path()));
+	}
+	return files;
+}
+
+/**
+ * @return number of written files that were replaced by a link to an identical file.
+ **/
+std::size_t TileStore::getLinkedFiles() const
+{
+	return linkedFiles;
+}
+
+/**
+ * @return path of the shared file for content with the given hash.
+ **/
+boost::filesystem::path TileStore::getSharedPath(const TileIdentifier& ti, std::size_t hash, const string& extension) const
+{
+	std::stringstream file;
+	file << std::hex << hash << extension;
+	return path / ti.getStylesheetPath() / "shared" / file.str();
+}
+
+/**
+ * @return true if the image is used by several tiles and should only be stored once.
+ **/
+bool TileStore::isDuplicate(const Tile::ImageType& image) const
+{
+	return pool && pool->isDuplicate(image);
+}
+
+/**
+ * @brief Opens a temporary file next to path.
+ *
+ * @return false if the file could not be created.
+ **/
+bool TileStore::beginFile(const boost::filesystem::path& path, PendingFile& file)
+{
+	boost::system::error_code ec;
+	boost::filesystem::create_directories(path.parent_path(), ec);
+	file.path = path;
+	file.dropStale = true;
+	string tmp = path.string() + ".tmp";
+	file.fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file.fd < 0) {
+		// e.g. Disk full
+		LOG_SEV(cache_log, debug) << "WriteFile: Could not open file " << tmp;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Appends data to a file opened with beginFile. The file is removed if writing fails.
+ **/
+bool TileStore::append(PendingFile& file, const void* data, std::size_t size)
+{
+	const char* src = (const char*) data;
+	while (size > 0) {
+		ssize_t written = ::write(file.fd, src, size);
+		if (written < 0) {
+			string tmp = file.path.string() + ".tmp";
+			LOG_SEV(cache_log, debug) << "WriteFile: Could not write file " << tmp;
+			::close(file.fd);
+			::unlink(tmp.c_str());
+			file.fd = -1;
+			return false;
+		}
+		src += written;
+		size -= written;
+	}
+	return true;
+}
+
+/**
+ * @brief Flushes the files according to the sync policy and moves them to their place.
+ *
+ * Has to be called with the lock held.
+ **/
+void TileStore::commitFiles(std::vector<PendingFile>& files)
+{
+	for (PendingFile& file : files) {
+		if (file.fd < 0)
+			continue;
+		if (policy != SyncNever)
+			::fsync(file.fd);
+	}
+
+	for (PendingFile& file : files) {
+		if (file.fd < 0)
+			continue;
+		::close(file.fd);
+		file.fd = -1;
+
+		boost::filesystem::path tmp = file.path.string() + ".tmp";
+		if (!file.shared.empty())
+			linkShared(file, tmp);
+
+		boost::system::error_code ec;
+		boost::filesystem::rename(tmp, file.path, ec);
+		if (ec) {
+			LOG_SEV(cache_log, warning) << "WriteFile: Could not move " << tmp.string() << ": " << ec.message();
+			boost::filesystem::remove(tmp, ec);
+		} else if (file.dropStale) {
+			boost::filesystem::remove(file.path.string() + ".stale", ec);
+		}
+	}
+	files.clear();
+}
+
+/**
+ * @brief Renames a stored file to <file>.stale, replacing an older stale file.
+ *
+ * @return false if the file does not exist.
+ **/
+bool TileStore::renameStale(const boost::filesystem::path& file)
+{
+	string stale = file.string() + ".stale";
+	return ::rename(file.string().c_str(), stale.c_str()) == 0;
+}
+
+/**
+ * @brief Replaces the temporary file by a link to its shared file or makes it the shared file.
+ **/
+void TileStore::linkShared(PendingFile& file, const boost::filesystem::path& tmp)
+{
+	boost::system::error_code ec;
+	if (boost::filesystem::exists(file.shared, ec)) {
+		if (sameContent(file.shared, tmp)) {
+			boost::filesystem::path link = tmp.string() + ".link";
+			boost::filesystem::remove(link, ec);
+			boost::filesystem::create_hard_link(file.shared, link, ec);
+			if (!ec) {
+				boost::filesystem::rename(link, tmp, ec);
+				linkedFiles++;
+			}
+			return;
+		}
+		// hash collision or an old file, the new content takes its place
+		boost::filesystem::remove(file.shared, ec);
+	}
+
+	boost::filesystem::create_directories(file.shared.parent_path(), ec);
+	boost::filesystem::create_hard_link(tmp, file.shared, ec);
+}
+
+
+FileTileStore::FileTileStore(const string& path, SyncPolicy policy, const shared_ptr<ImagePool>& pool)
+	: TileStore(path, policy, pool)
+{
+}
+
+boost::filesystem::path FileTileStore::getTilePath(const TileIdentifier& ti) const
+{
+	std::stringstream file;
+	file << ti.getStylesheetPath() << "/";
+	file << ti.getZoom() << "/";
+	file << ti.getX() << "/";
+	file << ti.getY();
+	file << "." << ti.getImageFormatString();
+	return path / file.str();
+}
+
+Tile::ImageType FileTileStore::read(const TileIdentifier& ti, bool* stale)
+{
+	boost::filesystem::path file = getTilePath(ti);
+	Tile::ImageType image = readFile(file);
+	if (stale)
+		*stale = false;
+	if (!image) {
+		image = readFile(file.string() + ".stale");
+		if (stale)
+			*stale = (bool) image;
+	}
+	return image;
+}
+
+Tile::ImageType FileTileStore::readFile(const boost::filesystem::path& file)
+{
+	string filename = file.string();
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		LOG_SEV(cache_log, debug) << "readFile: Not found: " << filename;
+		return Tile::ImageType();
+	}
+
+	Tile::ImageType image;
+	struct stat info;
+	if (::fstat(fd, &info) == 0) {
+		image = boost::make_shared<Tile::ImageType::element_type>(info.st_size);
+		if (!readAt(fd, image->data(), image->size(), 0))
+			image.reset();
+	}
+	::close(fd);
+	return image;
+}
+
+void FileTileStore::write(const std::vector<shared_ptr<Tile>>& tiles)
+{
+	// tiles invalidated before the lock is taken are already marked stale
+	boost::mutex::scoped_lock scopedLock(lock);
+	std::vector<PendingFile> files;
+	for (const shared_ptr<Tile>& tile : tiles) {
+		Tile::ImageType image = tile->getImage();
+		if (!image || tile->isStale()) {
+			LOG_SEV(cache_log, debug) << "WriteFile: Image not yet rendered " << *tile->getIdentifier();
+			continue;
+		}
+
+		const TileIdentifier& ti = *tile->getIdentifier();
+		PendingFile file;
+		if (!beginFile(getTilePath(ti), file))
+			continue;
+		if (isDuplicate(image))
+			file.shared = getSharedPath(ti, ImagePool::Hash(image), "." + ti.getImageFormatString());
+		if (append(file, image->data(), image->size()))
+			files.push_back(file);
+		if (policy == SyncAlways)
+			commitFiles(files);
+	}
+	commitFiles(files);
+}
+
+std::vector<TileIdentifier> FileTileStore::markStale(const string& stylesheet, int zoom, int x0, int y0, int x1, int y1)
+{
+	std::vector<TileIdentifier> marked;
+	boost::mutex::scoped_lock scopedLock(lock);
+	for (auto& file : listFiles(stylesheet, zoom, x0, x1)) {
+		int y;
+		TileIdentifier::Format format;
+		if (!parseFileName(file.second.filename().string(), "", y, format) || y < y0 || y > y1)
+			continue;
+		if (renameStale(file.second))
+			marked.push_back(TileIdentifier(file.first, y, zoom, stylesheet, format));
+	}
+	return marked;
+}
+
+
+BundleTileStore::BundleTileStore(const string& path, SyncPolicy policy, const shared_ptr<ImagePool>& pool)
+	: TileStore(path, policy, pool)
+{
+}
+
+boost::filesystem::path BundleTileStore::getBundlePath(const TileIdentifier& ti) const
+{
+	std::stringstream file;
+	file << ti.getStylesheetPath() << "/";
+	file << ti.getZoom() << "/";
+	file << ti.getX() / BUNDLE_SIZE << "/";
+	file << ti.getY() / BUNDLE_SIZE;
+	file << "." << ti.getImageFormatString() << ".bundle";
+	return path / file.str();
+}
+
+int BundleTileStore::getIndex(const TileIdentifier& ti)
+{
+	return (ti.getY() % BUNDLE_SIZE) * BUNDLE_SIZE + ti.getX() % BUNDLE_SIZE;
+}
+
+/**
+ * @brief Reads one tile from its bundle, or from the stale bundle if the fresh one does not contain it.
+ **/
+Tile::ImageType BundleTileStore::read(const TileIdentifier& ti, bool* stale)
+{
+	boost::filesystem::path bundle = getBundlePath(ti);
+	Tile::ImageType image = readEntry(bundle, getIndex(ti));
+	if (stale)
+		*stale = false;
+	if (!image) {
+		image = readEntry(bundle.string() + ".stale", getIndex(ti));
+		if (stale)
+			*stale = (bool) image;
+	}
+	return image;
+}
+
+/**
+ * @brief Reads one tile from a bundle using the index in the header.
+ **/
+Tile::ImageType BundleTileStore::readEntry(const boost::filesystem::path& bundle, int index)
+{
+	string filename = bundle.string();
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		LOG_SEV(cache_log, debug) << "readFile: Not found: " << filename;
+		return Tile::ImageType();
+	}
+
+	Tile::ImageType image;
+	BundleHeader header;
+	if (readHeader(fd, header)) {
+		if (header.entries[index].size > 0) {
+			image = boost::make_shared<Tile::ImageType::element_type>(header.entries[index].size);
+			if (!readAt(fd, image->data(), image->size(), header.entries[index].offset))
+				image.reset();
+		}
+	} else {
+		LOG_SEV(cache_log, warning) << "readFile: Invalid bundle " << filename;
+	}
+	::close(fd);
+	return image;
+}
+
+/**
+ * @brief Reads all tiles of a bundle, missing tiles are null pointers.
+ **/
+void BundleTileStore::readBundle(const boost::filesystem::path& bundle, std::vector<Tile::ImageType>& images)
+{
+	images.assign(BUNDLE_ENTRIES, Tile::ImageType());
+
+	int fd = ::open(bundle.string().c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+
+	BundleHeader header;
+	if (readHeader(fd, header)) {
+		for (int i = 0; i < BUNDLE_ENTRIES; i++) {
+			if (header.entries[i].size == 0)
+				continue;
+			images[i] = boost::make_shared<Tile::ImageType::element_type>(header.entries[i].size);
+			if (!readAt(fd, images[i]->data(), images[i]->size(), header.entries[i].offset))
+				images[i].reset();
+			else if (pool)
+				images[i] = pool->intern(images[i]);
+		}
+	}
+	::close(fd);
+}
+
+/**
+ * @brief Merges the tiles into their bundles. Every bundle is rewritten once per call.
+ *
+ * Reading, merging and replacing the bundles is done under the lock, so a bundle
+ * invalidated meanwhile is not republished with its old tiles.
+ **/
+void BundleTileStore::write(const std::vector<shared_ptr<Tile>>& tiles)
+{
+	// tiles invalidated before the lock is taken are already marked stale
+	boost::mutex::scoped_lock scopedLock(lock);
+	boost::unordered_map<string, std::vector<shared_ptr<Tile>>> bundles;
+	for (const shared_ptr<Tile>& tile : tiles) {
+		if (!tile->isRendered() || tile->isStale()) {
+			LOG_SEV(cache_log, debug) << "WriteFile: Image not yet rendered " << *tile->getIdentifier();
+			continue;
+		}
+		bundles[getBundlePath(*tile->getIdentifier()).string()].push_back(tile);
+	}
+
+	std::vector<PendingFile> files;
+	std::vector<Tile::ImageType> images;
+	for (auto& bundle : bundles) {
+		readBundle(bundle.first, images);
+		for (const shared_ptr<Tile>& tile : bundle.second)
+			images[getIndex(*tile->getIdentifier())] = tile->getImage();
+
+		BundleHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+		header.version = BUNDLE_VERSION;
+		header.count = BUNDLE_ENTRIES;
+		uint32_t offset = sizeof(header);
+		// bundles only made of duplicated images are shared as a whole
+		bool duplicate = true;
+		std::size_t hash = 0;
+		for (int i = 0; i < BUNDLE_ENTRIES; i++) {
+			boost::hash_combine(hash, i);
+			if (!images[i])
+				continue;
+
+			int same = 0;
+			while (same < i && !(images[same] && *images[same] == *images[i]))
+				same++;
+			if (same < i) {
+				header.entries[i] = header.entries[same];
+				images[i].reset();
+			} else {
+				header.entries[i].offset = offset;
+				header.entries[i].size = images[i]->size();
+				offset += images[i]->size();
+			}
+
+			duplicate = duplicate && (!images[i] || isDuplicate(images[i]));
+			boost::hash_combine(hash, header.entries[i].offset);
+			if (images[i])
+				boost::hash_combine(hash, ImagePool::Hash(images[i]));
+		}
+
+		const TileIdentifier& ti = *bundle.second.front()->getIdentifier();
+		PendingFile file;
+		if (!beginFile(bundle.first, file))
+			continue;
+		file.dropStale = coversStale(bundle.first, header);
+		if (duplicate)
+			file.shared = getSharedPath(ti, hash, "." + ti.getImageFormatString() + ".bundle");
+		bool ok = append(file, &header, sizeof(header));
+		for (int i = 0; ok && i < BUNDLE_ENTRIES; i++) {
+			if (images[i])
+				ok = append(file, images[i]->data(), images[i]->size());
+		}
+		if (ok)
+			files.push_back(file);
+		if (policy == SyncAlways)
+			commitFiles(files);
+	}
+	commitFiles(files);
+}
+
+std::vector<TileIdentifier> BundleTileStore::markStale(const string& stylesheet, int zoom, int x0, int y0, int x1, int y1)
+{
+	std::vector<TileIdentifier> marked;
+	boost::mutex::scoped_lock scopedLock(lock);
+	for (auto& file : listFiles(stylesheet, zoom, x0 / BUNDLE_SIZE, x1 / BUNDLE_SIZE)) {
+		int y;
+		TileIdentifier::Format format;
+		if (!parseFileName(file.second.filename().string(), ".bundle", y, format))
+			continue;
+		if (y < y0 / BUNDLE_SIZE || y > y1 / BUNDLE_SIZE)
+			continue;
+		if (renameStale(file.second))
+			marked.push_back(TileIdentifier(file.first * BUNDLE_SIZE, y * BUNDLE_SIZE, zoom, stylesheet, format));
+	}
+	return marked;
+}
@@ -0,0 +1,204 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/tile_writer.hpp"
+
+#include "server/tile.hpp"
+#include "server/tile_store.hpp"
+
+
+/**
+ * @brief Creates the writer and starts its thread.
+ *
+ * @param store where the tiles are written to.
+ * @param queueSize maximal number of tiles waiting to be written.
+ * @param batchSize number of tiles written at once.
+ **/
+TileWriter::TileWriter(const shared_ptr<TileStore>& store, std::size_t queueSize, std::size_t batchSize)
+	: store(store)
+	, queueSize(std::max<std::size_t>(queueSize, 1))
+	, batchSize(std::max<std::size_t>(batchSize, 1))
+	, writing(false)
+	, stopped(false)
+	, dropped(0)
+	, thread(boost::bind(&TileWriter::run, this))
+{
+}
+
+/**
+ * @brief Writes all queued tiles and stops the thread.
+ **/
+TileWriter::~TileWriter()
+{
+	{
+		boost::mutex::scoped_lock guard(lock);
+		stopped = true;
+	}
+	queueChanged.notify_all();
+	thread.join();
+}
+
+/**
+ * @brief Queues a tile to be written to the store.
+ *
+ * @return false if the write was dropped because the queue is full.
+ **/
+bool TileWriter::enqueue(const shared_ptr<Tile>& tile)
+{
+	const TileIdentifier& ti = *tile->getIdentifier();
+	{
+		boost::mutex::scoped_lock guard(lock);
+		auto pendingIt = pending.find(ti);
+		if (pendingIt != pending.end()) {
+			// already waiting, the newest tile will be written
+			pendingIt->second = tile;
+			return true;
+		}
+
+		if (queue.size() >= queueSize && !dropLeastValuable(ti.getZoom())) {
+			dropped++;
+			LOG_SEV(cache_log, debug) << "TileWriter: Queue full, dropped " << ti;
+			return false;
+		}
+
+		queue.push_back(ti);
+		pending[ti] = tile;
+	}
+	queueChanged.notify_one();
+	return true;
+}
+
+/**
+ * @brief Removes the queued tile with the highest zoomlevel if it is higher than zoom. Must be called with the lock held.
+ *
+ * @return true if a queued write was dropped.
+ **/
+bool TileWriter::dropLeastValuable(int zoom)
+{
+	auto victim = queue.end();
+	for (auto it = queue.begin(); it != queue.end(); ++it) {
+		if (it->getZoom() > zoom && (victim == queue.end() || it->getZoom() > victim->getZoom()))
+			victim = it;
+	}
+	if (victim == queue.end())
+		return false;
+
+	LOG_SEV(cache_log, debug) << "TileWriter: Queue full, dropped " << *victim;
+	pending.erase(*victim);
+	queue.erase(victim);
+	dropped++;
+	return true;
+}
+
+/**
+ * @brief Returns a tile that is waiting to be written.
+ *
+ * @return the tile or a null pointer if no tile with this identifier is pending.
+ **/
+shared_ptr<Tile> TileWriter::find(const TileIdentifier& ti)
+{
+	boost::mutex::scoped_lock guard(lock);
+	auto pendingIt = pending.find(ti);
+	if (pendingIt == pending.end())
+		return shared_ptr<Tile>();
+	return pendingIt->second;
+}
+
+/**
+ * @brief Forgets all pending tiles of a stylesheet and waits until the current batch is written.
+ **/
+void TileWriter::discard(const string& stylesheet)
+{
+	boost::mutex::scoped_lock guard(lock);
+	for (auto it = queue.begin(); it != queue.end();) {
+		if (it->getStylesheetPath() == stylesheet)
+			it = queue.erase(it);
+		else
+			++it;
+	}
+	for (auto it = pending.begin(); it != pending.end();) {
+		if (it->first.getStylesheetPath() == stylesheet)
+			it = pending.erase(it);
+		else
+			++it;
+	}
+	while (writing)
+		batchDone.wait(guard);
+}
+
+/**
+ * @brief Blocks until all queued tiles are written.
+ **/
+void TileWriter::flush()
+{
+	boost::mutex::scoped_lock guard(lock);
+	while (!queue.empty() || writing)
+		batchDone.wait(guard);
+}
+
+/**
+ * @return number of tile writes dropped because the queue was full.
+ **/
+std::size_t TileWriter::getDroppedCount()
+{
+	boost::mutex::scoped_lock guard(lock);
+	return dropped;
+}
+
+void TileWriter::run()
+{
+	std::vector<shared_ptr<Tile>> batch;
+	std::vector<TileIdentifier> ids;
+	boost::mutex::scoped_lock guard(lock);
+	while (true) {
+		while (queue.empty() && !stopped)
+			queueChanged.wait(guard);
+		if (queue.empty())
+			break;
+
+		batch.clear();
+		ids.clear();
+		while (!queue.empty() && batch.size() < batchSize) {
+			ids.push_back(queue.front());
+			batch.push_back(pending[queue.front()]);
+			queue.pop_front();
+		}
+		writing = true;
+
+		guard.unlock();
+		store->write(batch);
+		guard.lock();
+
+		for (std::size_t i = 0; i < ids.size(); i++) {
+			auto pendingIt = pending.find(ids[i]);
+			if (pendingIt == pending.end())
+				continue;
+			if (pendingIt->second == batch[i])
+				pending.erase(pendingIt);
+			else
+				// tile was replaced while it was written
+				queue.push_back(ids[i]);
+		}
+		writing = false;
+		batchDone.notify_all();
+	}
+}
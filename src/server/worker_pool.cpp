@@ -0,0 +1,164 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Simon Dreher
+ */
+
+
+
+#include "server/worker_pool.hpp"
+
+#include <algorithm>
+
+
+//! pool and index of the worker of the current thread
+static thread_local WorkerPool* currentPool = nullptr;
+static thread_local int currentWorker = -1;
+
+int WorkerPool::CurrentWorker()
+{
+	return currentWorker;
+}
+
+/**
+ * @brief Starts the given number of workers, at least one.
+ **/
+WorkerPool::WorkerPool(std::size_t threads)
+	: next(0)
+	, pending(0)
+	, sleeping(0)
+	, stopped(false)
+{
+	threads = std::max<std::size_t>(threads, 1);
+	for (std::size_t i = 0; i < threads; i++)
+		queues.push_back(boost::make_shared<Queue>());
+	for (std::size_t i = 0; i < threads; i++)
+		this->threads.push_back(boost::make_shared<boost::thread>(boost::bind(&WorkerPool::run, this, i)));
+}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+/**
+ * @brief Enqueues a task, it is ignored if the pool is stopped.
+ **/
+void WorkerPool::post(const Task& task)
+{
+	if (stopped)
+		return;
+
+	std::size_t index;
+	if (currentPool == this)
+		index = currentWorker;
+	else
+		index = next++ % queues.size();
+
+	// counted first, so pending never drops below zero when the task is taken at once
+	pending++;
+	{
+		Queue& queue = *queues[index];
+		boost::mutex::scoped_lock lock(queue.lock);
+		queue.tasks.push_back(task);
+	}
+
+	// a worker counts itself as sleeping before checking pending, so one of both sees the other
+	if (sleeping > 0) {
+		boost::mutex::scoped_lock lock(idleMutex);
+		wakeUp.notify_one();
+	}
+}
+
+/**
+ * @brief Discards all waiting tasks and waits for the running tasks.
+ *
+ * If called by a worker, this worker is not waited for.
+ **/
+void WorkerPool::stop()
+{
+	{
+		boost::mutex::scoped_lock lock(idleMutex);
+		stopped = true;
+		wakeUp.notify_all();
+	}
+
+	for (auto& thread : threads) {
+		if (thread->get_id() != boost::this_thread::get_id())
+			thread->join();
+		else
+			thread->detach();
+	}
+	threads.clear();
+
+	for (auto& queue : queues) {
+		boost::mutex::scoped_lock lock(queue->lock);
+		queue->tasks.clear();
+	}
+}
+
+std::size_t WorkerPool::getThreadCount() const
+{
+	return queues.size();
+}
+
+void WorkerPool::run(std::size_t index)
+{
+	currentPool = this;
+	currentWorker = index;
+
+	Task task;
+	while (!stopped) {
+		if (take(index, task)) {
+			task();
+			task.clear();
+			continue;
+		}
+
+		boost::mutex::scoped_lock lock(idleMutex);
+		sleeping++;
+		while (pending == 0 && !stopped)
+			wakeUp.wait(lock);
+		sleeping--;
+	}
+}
+
+/**
+ * @brief Takes the newest task of the own queue or the oldest task of another queue.
+ *
+ * @return false if all queues are empty.
+ **/
+bool WorkerPool::take(std::size_t index, Task& task)
+{
+	for (std::size_t i = 0; i < queues.size(); i++) {
+		Queue& queue = *queues[(index + i) % queues.size()];
+		boost::mutex::scoped_lock lock(queue.lock);
+		if (queue.tasks.empty())
+			continue;
+
+		if (i == 0) {
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+		} else {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+		}
+		pending--;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,160 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Tobias Kahlert
+ */
+
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  clipping.cpp
+ *
+ *    Description: Clipping of line segments and polygons against rectangles.
+ *
+ * =====================================================================================
+ */
+
+#include "utils/clipping.hpp"
+
+
+/**
+ * @brief Tests if the segment from a to b touches the rectangle (Liang-Barsky).
+ *
+ * @param a start of the segment
+ * @param b end of the segment
+ * @param rect rectangle to test against
+ * @return true if at least one point of the segment lies inside the rectangle
+ **/
+bool segmentIntersectsRect(const FloatPoint& a, const FloatPoint& b, const FloatRect& rect)
+{
+	double t0 = 0.0, t1 = 1.0;
+	const double dx = b.x - a.x;
+	const double dy = b.y - a.y;
+	const double p[4] = { -dx, dx, -dy, dy };
+	const double q[4] = { a.x - rect.minX, rect.maxX - a.x, a.y - rect.minY, rect.maxY - a.y };
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (p[i] == 0.0)
+		{
+			// parallel to this edge and outside
+			if (q[i] < 0.0)
+				return false;
+			continue;
+		}
+
+		double t = q[i] / p[i];
+		if (p[i] < 0.0)
+			t0 = std::max(t0, t);
+		else
+			t1 = std::min(t1, t);
+
+		if (t0 > t1)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Tests if a point lies inside of a polygon (even-odd rule).
+ *
+ * @param ring vertices of the polygon, the first vertex may be repeated at the end
+ * @param p point to test
+ * @return true if p lies inside
+ **/
+bool polygonContains(const std::vector<FloatPoint>& ring, const FloatPoint& p)
+{
+	bool result = false;
+	for (std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+	{
+		const FloatPoint& a = ring[i];
+		const FloatPoint& b = ring[j];
+		if ((a.y > p.y) != (b.y > p.y)
+			&& p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x)
+			result = !result;
+	}
+	return result;
+}
+
+namespace {
+	enum Edge { Left, Right, Bottom, Top };
+
+	inline bool inside(const FloatPoint& p, Edge edge, const FloatRect& rect)
+	{
+		switch (edge)
+		{
+		case Left:   return p.x >= rect.minX;
+		case Right:  return p.x <= rect.maxX;
+		case Bottom: return p.y >= rect.minY;
+		default:     return p.y <= rect.maxY;
+		}
+	}
+
+	inline FloatPoint intersection(const FloatPoint& a, const FloatPoint& b, Edge edge, const FloatRect& rect)
+	{
+		double t;
+		switch (edge)
+		{
+		case Left:   t = (rect.minX - a.x) / (b.x - a.x); return FloatPoint(rect.minX, a.y + t * (b.y - a.y));
+		case Right:  t = (rect.maxX - a.x) / (b.x - a.x); return FloatPoint(rect.maxX, a.y + t * (b.y - a.y));
+		case Bottom: t = (rect.minY - a.y) / (b.y - a.y); return FloatPoint(a.x + t * (b.x - a.x), rect.minY);
+		default:     t = (rect.maxY - a.y) / (b.y - a.y); return FloatPoint(a.x + t * (b.x - a.x), rect.maxY);
+		}
+	}
+}
+
+/**
+ * @brief Clips a polygon against a rectangle (Sutherland-Hodgman).
+ *
+ * Vertices of the input lying inside the rectangle are kept and marked with their index,
+ * new vertices are created where the polygon crosses the border of the rectangle.
+ *
+ * @param ring vertices of the polygon without repeating the first vertex at the end
+ * @param rect rectangle to clip against
+ * @param result vertices of the clipped polygon, empty if the polygon lies outside of the rectangle
+ **/
+void clipPolygon(const std::vector<FloatPoint>& ring, const FloatRect& rect, std::vector<ClippedVertex>& result)
+{
+	result.clear();
+	for (std::size_t i = 0; i < ring.size(); i++)
+		result.push_back(ClippedVertex{ ring[i], (int) i });
+
+	std::vector<ClippedVertex> input;
+	for (Edge edge : { Left, Right, Bottom, Top })
+	{
+		if (result.empty())
+			break;
+
+		input.swap(result);
+		result.clear();
+
+		const ClippedVertex* prev = &input.back();
+		for (const ClippedVertex& cur : input)
+		{
+			bool curInside = inside(cur.location, edge, rect);
+			bool prevInside = inside(prev->location, edge, rect);
+
+			if (curInside != prevInside)
+				result.push_back(ClippedVertex{ intersection(prev->location, cur.location, edge, rect), -1 });
+			if (curInside)
+				result.push_back(cur);
+
+			prev = &cur;
+		}
+	}
+}
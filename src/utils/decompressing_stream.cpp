@@ -0,0 +1,195 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Tobias Kahlert
+ */
+
+#include <fstream>
+
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+
+#include "utils/decompressing_stream.hpp"
+
+//! Number of bytes moved between decompressor and ring buffer at once
+#define DECOMPRESS_CHUNK_SIZE (64 * 1024)
+//! Number of times a thread checks the ring buffer again before it sleeps
+#define DECOMPRESS_SPIN_COUNT 64
+
+/**
+ * @brief Detects the compression of a file by its magic bytes.
+ *
+ * @param file the file to check
+ * @return the compression or None if the file is not compressed or can not be read
+ **/
+DecompressingStream::Compression DecompressingStream::DetectCompression(const boost::filesystem::path& file)
+{
+	std::ifstream in(file.string(), std::ios::in | std::ios::binary);
+	unsigned char magic[3] = {0, 0, 0};
+	in.read((char*) magic, sizeof(magic));
+
+	if (in.gcount() >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+		return Gzip;
+	if (in.gcount() >= 3 && magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h')
+		return Bzip2;
+	return None;
+}
+
+/**
+ * @brief Opens the file and starts the decompressing thread.
+ *
+ * @param file the compressed file
+ * @param compression the compression of the file, must not be None
+ * @param bufferSize size of the ring buffer between decompressor and reader
+ **/
+DecompressingStream::DecompressingStream(const boost::filesystem::path& file, Compression compression, std::size_t bufferSize)
+	: std::istream(nullptr)
+	, buf(bufferSize)
+{
+	assert(compression != None);
+	rdbuf(&buf);
+	producer = boost::thread(boost::bind(&StreamBuf::produce, &buf, file, compression));
+}
+
+DecompressingStream::~DecompressingStream()
+{
+	buf.cancelled = true;
+	buf.notify();
+	producer.join();
+}
+
+string DecompressingStream::getError() const
+{
+	// error is written before failed is set
+	return buf.failed.load(std::memory_order_acquire) ? buf.error : string();
+}
+
+DecompressingStream::StreamBuf::StreamBuf(std::size_t bufferSize)
+	: ring(bufferSize)
+	, compressedRead(0)
+	, cancelled(false)
+	, failed(false)
+	, readArea(DECOMPRESS_CHUNK_SIZE)
+	, sleeping(0)
+{
+	setg(readArea.data(), readArea.data(), readArea.data());
+}
+
+/**
+ * @brief Body of the producer thread. Decompresses the file into the ring buffer.
+ **/
+void DecompressingStream::StreamBuf::produce(const boost::filesystem::path& file, Compression compression)
+{
+	try {
+		std::ifstream compressed(file.string(), std::ios::in | std::ios::binary);
+		if (!compressed)
+			BOOST_THROW_EXCEPTION(excp::FileNotFoundException() << excp::InfoFileName(file.string()));
+
+		boost::iostreams::filtering_istream in;
+		if (compression == Gzip)
+			in.push(boost::iostreams::gzip_decompressor());
+		else
+			in.push(boost::iostreams::bzip2_decompressor());
+		in.push(compressed);
+		// let decompression errors escape instead of silently ending the stream
+		in.exceptions(std::ios::badbit);
+
+		std::vector<char> chunk(DECOMPRESS_CHUNK_SIZE);
+		while (!cancelled && in)
+		{
+			in.read(chunk.data(), chunk.size());
+			std::size_t size = in.gcount();
+			std::streamoff position = compressed.tellg();
+			if (position >= 0)
+				compressedRead.store(position, std::memory_order_relaxed);
+
+			std::size_t pushed = 0;
+			while (pushed < size && !cancelled)
+			{
+				std::size_t n = ring.push(chunk.data() + pushed, size - pushed);
+				if (n == 0)
+					waitUntil([this] { return cancelled || ring.size() < ring.capacity(); });
+				else
+					notify();
+				pushed += n;
+			}
+		}
+	} catch (std::exception& e) {
+		error = e.what();
+		failed.store(true, std::memory_order_release);
+	}
+
+	ring.close();
+	notify();
+}
+
+/**
+ * @brief Refills the get area from the ring buffer. Waits if the producer is slower.
+ **/
+DecompressingStream::StreamBuf::int_type DecompressingStream::StreamBuf::underflow()
+{
+	if (gptr() < egptr())
+		return traits_type::to_int_type(*gptr());
+
+	std::size_t n;
+	while ((n = ring.pop(readArea.data(), readArea.size())) == 0)
+	{
+		if (ring.isDrained())
+			return traits_type::eof();
+		waitUntil([this] { return ring.size() > 0 || ring.isDrained(); });
+	}
+	notify();
+
+	setg(readArea.data(), readArea.data(), readArea.data() + n);
+	return traits_type::to_int_type(*gptr());
+}
+
+/**
+ * @brief Wakes up the other thread if it sleeps. Called after pushing, popping, closing or cancelling.
+ **/
+void DecompressingStream::StreamBuf::notify()
+{
+	// pairs with the fence in waitUntil, so either the sleeper sees the change or we see the sleeper
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping.load(std::memory_order_relaxed) > 0) {
+		boost::mutex::scoped_lock lock(waitMutex);
+		changed.notify_all();
+	}
+}
+
+/**
+ * @brief Waits until ready returns true. Spins for a short while before sleeping.
+ *
+ * @param ready checks whether the ring buffer can be used again
+ **/
+void DecompressingStream::StreamBuf::waitUntil(const boost::function<bool()>& ready)
+{
+	// the other thread is usually only one chunk behind
+	for (int i = 0; i < DECOMPRESS_SPIN_COUNT; ++i) {
+		if (ready())
+			return;
+		boost::this_thread::yield();
+	}
+
+	boost::mutex::scoped_lock lock(waitMutex);
+	sleeping++;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	while (!ready())
+		changed.wait(lock);
+	sleeping--;
+}
@@ -0,0 +1,157 @@
+/**
+ *  This file is part of alaCarte.
+ *
+ *  alaCarte is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  alaCarte is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with alaCarte. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Copyright alaCarte 2012-2013 Simon Dreher, Florian Jacob, Tobias Kahlert, Patrick Niklaus, Bernhard Scheirle, Lisa Winter
+ *  Maintainer: Tobias Kahlert
+ */
+
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
+#include "utils/phase_timer.hpp"
+
+
+/**
+ * @brief Starts a new phase. The peak memory is reset if the system supports it.
+ *
+ * @param name name of the phase
+ **/
+void PhaseTimer::start(const string& name)
+{
+	assert(runningPhase.empty());
+
+	ResetPeakResidentSetSize();
+	runningPhase = name;
+	startTime = clock::now();
+}
+
+/**
+ * @brief Stops the running phase
+ *
+ * @param objects number of objects processed in this phase
+ **/
+void PhaseTimer::stop(uint64_t objects)
+{
+	assert(!runningPhase.empty());
+
+	double seconds = std::chrono::duration<double>(clock::now() - startTime).count();
+	phases.push_back(Phase{ runningPhase, seconds, objects, PeakResidentSetSize() });
+	runningPhase.clear();
+}
+
+/**
+ * @brief Adds a phase measured elsewhere, e.g. accumulated from many short measurements
+ **/
+void PhaseTimer::add(const string& name, double seconds, uint64_t objects)
+{
+	phases.push_back(Phase{ name, seconds, objects, 0 });
+}
+
+double PhaseTimer::getTotalSeconds() const
+{
+	double total = 0.0;
+	for (const Phase& p : phases)
+	{
+		// nested phases contain a '/' and are already part of their parent
+		if (p.name.find('/') == string::npos)
+			total += p.seconds;
+	}
+	return total;
+}
+
+void PhaseTimer::log() const
+{
+	for (const Phase& p : phases)
+	{
+		std::ostringstream rec;
+		rec << std::left << std::setw(24) << p.name << std::right << std::fixed << std::setprecision(3) << std::setw(10) << p.seconds << "s";
+		if (p.objects > 0 && p.seconds > 0.0)
+			rec << std::setw(14) << (uint64_t) (p.objects / p.seconds) << " objects/s";
+		if (p.peakRss > 0)
+			rec << std::setw(10) << p.peakRss / (1024 * 1024) << " MB peak";
+		LOG_SEV(importer_log, info) << rec.str();
+	}
+	LOG_SEV(importer_log, info) << "Total: " << std::fixed << std::setprecision(3) << getTotalSeconds() << "s";
+}
+
+/**
+ * @brief Writes all phases as one JSON object
+ *
+ * @param out stream to write to
+ **/
+void PhaseTimer::writeSummary(std::ostream& out) const
+{
+	out << "{\"total_seconds\":" << std::fixed << std::setprecision(6) << getTotalSeconds() << ",\"phases\":[";
+	for (std::size_t i = 0; i < phases.size(); i++)
+	{
+		const Phase& p = phases[i];
+		if (i > 0)
+			out << ",";
+		out << "{\"name\":\"" << p.name << "\""
+			<< ",\"seconds\":" << p.seconds
+			<< ",\"objects\":" << p.objects
+			<< ",\"objects_per_second\":" << (p.seconds > 0.0 ? p.objects / p.seconds : 0.0)
+			<< ",\"peak_rss_bytes\":" << p.peakRss
+			<< "}";
+	}
+	out << "]}";
+}
+
+/**
+ * @brief Returns the peak resident set size of the process in bytes or 0 if it is unknown.
+ *
+ * On Linux this is the peak since the last call of ResetPeakResidentSetSize.
+ **/
+std::size_t PhaseTimer::PeakResidentSetSize()
+{
+#ifdef __linux__
+	std::ifstream status("/proc/self/status");
+	string line;
+	while (std::getline(status, line))
+	{
+		if (line.compare(0, 6, "VmHWM:") == 0)
+			return std::stoull(line.substr(6)) * 1024;
+	}
+#endif
+#ifndef WIN32
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+#ifdef __APPLE__
+		return usage.ru_maxrss;
+#else
+		return usage.ru_maxrss * 1024;
+#endif
+	}
+#endif
+	return 0;
+}
+
+//! Resets the peak resident set size on Linux, does nothing on other systems
+void PhaseTimer::ResetPeakResidentSetSize()
+{
+#ifdef __linux__
+	std::ofstream clearRefs("/proc/self/clear_refs");
+	if (clearRefs)
+		clearRefs << "5";
+#endif
+}
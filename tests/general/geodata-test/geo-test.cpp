@@ -11,6 +11,8 @@
 #include "geodataMock.hpp"
 
 #include <boost/filesystem/operations.hpp>
+#include <fstream>
+#include <iterator>
 
 BOOST_AUTO_TEST_SUITE(geodata_test)
 
@@ -108,6 +110,52 @@ struct tile_test {
 	}
 };
 
+/* Saving builds the trees in parallel, the files must not depend on the number of threads.
+ */
+struct save_test {
+	path dir;
+	shared_ptr<Geodata> geodata;
+
+	save_test()
+		: dir("geodata-save-test")
+	{
+		boost::filesystem::remove_all(dir);
+		boost::filesystem::create_directories(dir);
+		path testData = getTestDynamicDataDirectory() / "karlsruhe_big.carte";
+		BOOST_CHECK(boost::filesystem::exists(testData));
+		geodata = boost::make_shared<Geodata>();
+		geodata->load(testData.string());
+	}
+
+	~save_test()
+	{
+		boost::filesystem::remove_all(dir);
+	}
+
+	string save(const string& name, unsigned int threads)
+	{
+		path file = dir / name;
+		geodata->setThreadCount(threads);
+		geodata->save(file.string());
+
+		std::ifstream input(file.string(), std::ios::binary);
+		return string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	}
+
+	void sameFiles()
+	{
+		string serial = save("serial.carte", 1);
+		BOOST_REQUIRE(!serial.empty());
+		BOOST_CHECK(save("parallel.carte", 4) == serial);
+		BOOST_CHECK(save("cores.carte", 0) == serial);
+		BOOST_CHECK(save("again.carte", 0) == serial);
+	}
+};
+
+ALAC_START_FIXTURE_TEST(save_test)
+	ALAC_FIXTURE_TEST(sameFiles);
+ALAC_END_FIXTURE_TEST()
+
 ALAC_START_FIXTURE_TEST(tile_test)
 	ALAC_FIXTURE_TEST(search,16,34297,22501);
 	ALAC_FIXTURE_TEST(search,16,34297,22504);
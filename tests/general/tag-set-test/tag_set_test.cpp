@@ -0,0 +1,47 @@
+
+#include "../../tests.hpp"
+#include "general/tag_set.hpp"
+#include "general/node.hpp"
+
+BOOST_AUTO_TEST_SUITE(tag_set_test)
+
+TagSet::TagMap makeTags(const string& highway, const string& name)
+{
+	TagSet::TagMap tags;
+	tags[CachedString("highway")] = CachedString(highway);
+	if (!name.empty())
+		tags[CachedString("name")] = CachedString(name);
+	return tags;
+}
+
+BOOST_AUTO_TEST_CASE(equal_tags_are_shared)
+{
+	TagSetTable table;
+
+	TagSet first = table.intern(makeTags("residential", "Kaiserstrasse"));
+	TagSet second = table.intern(makeTags("residential", "Kaiserstrasse"));
+	TagSet third = table.intern(makeTags("residential", ""));
+
+	BOOST_CHECK(first.isInterned());
+	BOOST_CHECK_EQUAL(first.getId(), second.getId());
+	BOOST_CHECK_EQUAL(&first.getTags(), &second.getTags());
+	BOOST_CHECK_NE(first.getId(), third.getId());
+	BOOST_CHECK_EQUAL(table.size(), 2);
+
+	BOOST_CHECK(table.get(third.getId()).getTags() == makeTags("residential", ""));
+}
+
+BOOST_AUTO_TEST_CASE(private_tag_sets)
+{
+	Node node(FloatPoint(1.0, 2.0), makeTags("bus_stop", ""));
+
+	BOOST_CHECK(!node.getTagSet().isInterned());
+	BOOST_CHECK(node.getTags() == makeTags("bus_stop", ""));
+
+	TagSetTable table;
+	node.setTagSet(table.intern(node.getTags()));
+	BOOST_CHECK(node.getTagSet().isInterned());
+	BOOST_CHECK_EQUAL(node.getTagSetId(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
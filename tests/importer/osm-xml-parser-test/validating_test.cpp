@@ -303,3 +303,88 @@ ALAC_END_FIXTURE_TEST();
 ALAC_START_FIXTURE_TEST(ValidatingFixture, 500, "tmp5.xml")
 	ALAC_FIXTURE_TEST(validateImporter);
 ALAC_END_FIXTURE_TEST();
+
+struct ClippingFixture
+{
+	ClippingFixture()
+		: path(getTestDynamicDataDirectory() / "importer" / "clipping.xml")
+	{
+		boost::filesystem::create_directories(path.parent_path());
+		std::ofstream xml(path.string(), std::ios::out);
+
+		BOOST_REQUIRE(xml.is_open());
+
+		// bounds are [0, 1] x [0, 1]
+		xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+		xml << "<osm>\n";
+		xml << "\t<node id=\"1\" lon=\"-2.0\" lat=\"0.5\"/>\n";
+		xml << "\t<node id=\"2\" lon=\"-1.0\" lat=\"0.5\"/>\n";
+		xml << "\t<node id=\"3\" lon=\"0.5\" lat=\"0.5\"/>\n";
+		xml << "\t<node id=\"4\" lon=\"3.0\" lat=\"3.0\"/>\n";
+		xml << "\t<node id=\"5\" lon=\"4.0\" lat=\"3.0\"/>\n";
+		xml << "\t<node id=\"6\" lon=\"-1.0\" lat=\"-1.0\"/>\n";
+		xml << "\t<node id=\"7\" lon=\"2.0\" lat=\"-1.0\"/>\n";
+		xml << "\t<node id=\"8\" lon=\"2.0\" lat=\"2.0\"/>\n";
+		xml << "\t<node id=\"9\" lon=\"-1.0\" lat=\"2.0\"/>\n";
+		// crosses the western border
+		xml << "\t<way id=\"10\"><nd ref=\"1\"/><nd ref=\"2\"/><nd ref=\"3\"/></way>\n";
+		// completely outside
+		xml << "\t<way id=\"11\"><nd ref=\"4\"/><nd ref=\"5\"/></way>\n";
+		// encloses the bounds
+		xml << "\t<way id=\"12\"><nd ref=\"6\"/><nd ref=\"7\"/><nd ref=\"8\"/><nd ref=\"9\"/><nd ref=\"6\"/></way>\n";
+		xml << "\t<relation id=\"20\"><member type=\"way\" ref=\"10\" role=\"\"/><member type=\"way\" ref=\"11\" role=\"\"/><member type=\"node\" ref=\"5\" role=\"\"/></relation>\n";
+		xml << "</osm>";
+	}
+
+	void keepBorderNodes()
+	{
+		Importer::OsmXmlParser parser(false, FloatRect(0.0, 0.0, 1.0, 1.0));
+		parser.parse(path);
+
+		auto ways = parser.getParsedWays();
+		BOOST_REQUIRE_EQUAL(ways->size(), 2);
+		// the first node is cut, the one just outside is kept
+		BOOST_CHECK_EQUAL(ways->at(0).getNodeIDs().size(), 2);
+		// the enclosing polygon is kept completely
+		BOOST_CHECK_EQUAL(ways->at(1).getNodeIDs().size(), 5);
+		BOOST_CHECK_EQUAL(parser.getNumberOfClippedWays(), 1);
+
+		// members outside are dropped instead of the whole relation
+		auto relations = parser.getParsedRelations();
+		BOOST_REQUIRE_EQUAL(relations->size(), 1);
+		BOOST_CHECK_EQUAL(relations->at(0).getWayIDs().size(), 1);
+		BOOST_CHECK_EQUAL(relations->at(0).getNodeIDs().size(), 0);
+
+		// node 2 and the polygon nodes are kept, nodes 1, 4 and 5 are clipped
+		BOOST_CHECK_EQUAL(parser.getParsedNodes()->size(), 6);
+		BOOST_CHECK_EQUAL(parser.getNumberOfClippedNodes(), 3);
+	}
+
+	void clipPolygons()
+	{
+		Importer::OsmXmlParser parser(false, FloatRect(0.0, 0.0, 1.0, 1.0), true, 0.1);
+		parser.parse(path);
+
+		auto ways = parser.getParsedWays();
+		BOOST_REQUIRE_EQUAL(ways->size(), 2);
+		// the enclosing polygon becomes the bounds plus margin
+		auto& ring = ways->at(1).getNodeIDs();
+		BOOST_REQUIRE_EQUAL(ring.size(), 5);
+		BOOST_CHECK(ring.front() == ring.back());
+		BOOST_CHECK_EQUAL(parser.getNumberOfClippedPolygons(), 1);
+
+		for (auto id : ring)
+		{
+			double lat, lon;
+			inverseMercator(parser.getParsedNodes()->at(id.getRaw()).getLocation(), lat, lon);
+			BOOST_CHECK(FloatRect(-0.11, -0.11, 1.11, 1.11).contains(FloatPoint(lon, lat)));
+		}
+	}
+
+	const boost::filesystem::path path;
+};
+
+ALAC_START_FIXTURE_TEST(ClippingFixture)
+	ALAC_FIXTURE_TEST(keepBorderNodes);
+	ALAC_FIXTURE_TEST(clipPolygons);
+ALAC_END_FIXTURE_TEST();
@@ -0,0 +1,114 @@
+#include "../../tests.hpp"
+#include "../../shared/compare.hpp"
+
+#include <boost/filesystem/operations.hpp>
+
+#include "utils/transform.hpp"
+#include "general/geodata.hpp"
+#include "server/renderer/renderer.hpp"
+#include "server/tile.hpp"
+#include "server/style.hpp"
+#include "server/tile_identifier.hpp"
+#include "server/meta_identifier.hpp"
+#include "server/render_attributes.hpp"
+#include "server/renderer/render_canvas.hpp"
+
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(encode_test)
+
+/* Tests that encoding the tiles directly from the metatile gives the same images as slicing them.
+ */
+struct encode_test
+{
+	shared_ptr<Renderer> renderer;
+	shared_ptr<Geodata> data;
+	shared_ptr<MetaIdentifier> mid;
+	shared_ptr<RenderCanvas> canvas;
+	RenderCanvasFactory factory;
+
+	encode_test()
+	{
+		path testData = getTestDynamicDataDirectory() / "renderer_test.carte";
+		BOOST_CHECK(boost::filesystem::exists(testData));
+
+		data = boost::make_shared<Geodata>();
+		data->load(testData.string());
+		renderer = boost::make_shared<Renderer>(data);
+
+		mid = MetaIdentifier::Create(boost::make_shared<TileIdentifier>(4286, 2812, 13, "none", TileIdentifier::PNG));
+		canvas = factory.getCanvas(TileIdentifier::PNG);
+		render();
+	}
+
+	//! renders all ways of the metatile as red lines on a white canvas
+	void render()
+	{
+		RenderAttributes attr;
+		attr.getCanvasStyle()->fill_color = Color(1.0f, 1.0f, 1.0f, 1.0f);
+
+		coord_t x0, x1, y0, y1;
+		tileToMercator(mid->getX(), mid->getY(), mid->getZoom(), x0, y0);
+		tileToMercator(mid->getX() + mid->getWidth(), mid->getY() + mid->getHeight(), mid->getZoom(), x1, y1);
+		FixedRect r = FixedRect(FixedPoint(x0, y0), FixedPoint(x1, y1));
+
+		for (auto id : *data->getWayIDs(r)) {
+			Style* s = attr.getNewStyle(id);
+			s->color = Color(1.0f, 0.0f, 0.0f, 1.0f);
+			s->width = 3.0;
+		}
+
+		renderer->renderMetaTile(attr, canvas, mid);
+	}
+
+	void sameImages()
+	{
+		for (auto& id : mid->getIdentifiers()) {
+			shared_ptr<Tile> sliced = boost::make_shared<Tile>(id);
+			renderer->sliceTile(canvas, mid, sliced);
+
+			shared_ptr<Tile> encoded = boost::make_shared<Tile>(id);
+			if (!renderer->encodeTile(canvas, mid, encoded)) {
+				BOOST_TEST_MESSAGE("Tiles are only sliced in this build.");
+				return;
+			}
+
+			BOOST_REQUIRE(sliced->getImage() && encoded->getImage());
+			BOOST_CHECK(*sliced->getImage() == *encoded->getImage());
+		}
+	}
+
+	void encodeConcurrently()
+	{
+		std::vector<shared_ptr<Tile>> tiles;
+		for (auto& id : mid->getIdentifiers())
+			tiles.push_back(boost::make_shared<Tile>(id));
+
+		// every thread encodes every second tile, like the helpers of the encode stage
+		boost::thread_group threads;
+		for (std::size_t t = 0; t < 2; t++) {
+			threads.create_thread([this, t, &tiles] {
+				for (std::size_t i = t; i < tiles.size(); i += 2)
+					renderer->encodeTile(canvas, mid, tiles[i]);
+			});
+		}
+		threads.join_all();
+
+		for (auto& tile : tiles) {
+			if (!tile->isRendered()) {
+				BOOST_TEST_MESSAGE("Tiles are only sliced in this build.");
+				return;
+			}
+			shared_ptr<Tile> sliced = boost::make_shared<Tile>(tile->getIdentifier());
+			renderer->sliceTile(canvas, mid, sliced);
+			BOOST_CHECK(*sliced->getImage() == *tile->getImage());
+		}
+	}
+};
+
+ALAC_START_FIXTURE_TEST(encode_test)
+	ALAC_FIXTURE_TEST(sameImages);
+	ALAC_FIXTURE_TEST(encodeConcurrently);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -54,7 +54,7 @@ public:
 		}
 
 		std::vector<shared_ptr<Label> > placed;
-		placeLabels(labels, placed);
+		placeLabels(labels, placed, MetaTileBounds(META_TILE_SIZE * TILE_SIZE));
 
 		for (auto& l: placed)
 		{
@@ -0,0 +1,121 @@
+
+#include "../../tests.hpp"
+#include <boost/test/unit_test.hpp>
+#include <boost/unordered_set.hpp>
+
+#include "server/cache_policy.hpp"
+#include "server/tile_identifier.hpp"
+
+BOOST_AUTO_TEST_SUITE(cache_policy_test)
+
+struct cache_policy_test
+{
+	//! Cache of tiles with size 1 driven only by the policy
+	struct SimulatedCache
+	{
+		SimulatedCache(const string& name, std::size_t capacity)
+			: policy(CachePolicy::Create(name, capacity))
+			, capacity(capacity)
+		{
+		}
+
+		bool access(int x, int y)
+		{
+			TileIdentifier ti(x, y, 17, "default", TileIdentifier::Format::PNG);
+			if (tiles.count(ti)) {
+				policy->onHit(ti);
+				return true;
+			}
+			tiles.insert(ti);
+			policy->onInsert(ti, 1);
+			while (tiles.size() > capacity) {
+				TileIdentifier victim = policy->victim();
+				BOOST_REQUIRE(tiles.erase(victim));
+				policy->onRemove(victim, true);
+			}
+			return false;
+		}
+
+		shared_ptr<CachePolicy> policy;
+		std::size_t capacity;
+		boost::unordered_set<TileIdentifier> tiles;
+	};
+
+	/**
+	 * @return share of requests for popular tiles answered from a cache of 200 tiles,
+	 * while a crawler requests every tile once.
+	 **/
+	double popularHitRatio(const string& name)
+	{
+		SimulatedCache cache(name, 200);
+		int hits = 0;
+		int requests = 0;
+		for (int round = 0; round < 50; round++) {
+			// two users view the popular tiles
+			for (int i = 0; i < 200; i++) {
+				bool hit = cache.access(0, i % 100);
+				if (round >= 10) {
+					hits += hit;
+					requests++;
+				}
+			}
+			for (int i = 0; i < 500; i++)
+				cache.access(1, round * 500 + i);
+		}
+		return (double) hits / requests;
+	}
+
+	void test_lru()
+	{
+		SimulatedCache cache("lru", 3);
+		cache.access(0, 0);
+		cache.access(0, 1);
+		cache.access(0, 2);
+		BOOST_CHECK(cache.access(0, 0));
+		// tile 1 is the least recently used
+		cache.access(0, 3);
+		BOOST_CHECK(!cache.tiles.count(TileIdentifier(0, 1, 17, "default", TileIdentifier::Format::PNG)));
+		BOOST_CHECK(cache.tiles.count(TileIdentifier(0, 0, 17, "default", TileIdentifier::Format::PNG)));
+	}
+
+	void test_scan_resistance()
+	{
+		double lru = popularHitRatio("lru");
+		double tinyLfu = popularHitRatio("tinylfu");
+		double arc = popularHitRatio("arc");
+		BOOST_TEST_MESSAGE("Popular hit ratio lru: " << lru << " tinylfu: " << tinyLfu << " arc: " << arc);
+
+		// the crawler flushes every popular tile out of the LRU cache
+		BOOST_CHECK_LE(lru, 0.5);
+		BOOST_CHECK_GT(tinyLfu, 0.9);
+		BOOST_CHECK_GT(arc, 0.9);
+	}
+
+	void test_resize_and_remove()
+	{
+		for (const string name : {"lru", "tinylfu", "arc"}) {
+			shared_ptr<CachePolicy> policy = CachePolicy::Create(name, 1000);
+			TileIdentifier first(0, 0, 5, "default", TileIdentifier::Format::PNG);
+			TileIdentifier second(0, 1, 5, "default", TileIdentifier::Format::PNG);
+			policy->onInsert(first, 10);
+			policy->onInsert(second, 10);
+			policy->onResize(first, 500);
+			policy->onRemove(first, false);
+			BOOST_CHECK(policy->victim() == second);
+		}
+	}
+
+	void test_create()
+	{
+		BOOST_CHECK_THROW(CachePolicy::Create("fifo", 100), excp::InputFormatException);
+	}
+};
+
+ALAC_START_FIXTURE_TEST(cache_policy_test)
+	ALAC_FIXTURE_TEST_NAMED(test_lru, testEvictLeastRecentlyUsed);
+	ALAC_FIXTURE_TEST_NAMED(test_scan_resistance, testPopularTilesSurviveScans);
+	ALAC_FIXTURE_TEST_NAMED(test_resize_and_remove, testResizeAndRemoveTiles);
+	ALAC_FIXTURE_TEST_NAMED(test_create, testCreatePolicyFromConfiguration);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END(/*cache_policy_test*/)
@@ -5,6 +5,13 @@
 #include <boost/filesystem.hpp>
 
 #include "server/cache.hpp"
+#include "server/image_pool.hpp"
+#include "server/meta_identifier.hpp"
+#include "server/tile_store.hpp"
+#include "utils/transform.hpp"
+
+#include <boost/thread/thread.hpp>
+#include <thread>
 
 BOOST_AUTO_TEST_SUITE(cache_test)
 
@@ -49,9 +56,10 @@ struct cache_test
 	}
 	
 	void test_get_tile() {
-		char* argv[] = {(char*)"ala.carte", (char*)"ala.carte", (char*)"--server.cache-size", (char*)"10"};
+		char* argv[] = {(char*)"ala.carte", (char*)"ala.carte", (char*)"--server.cache-size", (char*)"10", (char*)"--server.cache-layout", (char*)"files",
+						(char*)"--server.cache-policy", (char*)"lru"};
 		ConfigMockup* mock = new ConfigMockup();
-		shared_ptr<Configuration> config = mock->Config(argv, 4);
+		shared_ptr<Configuration> config = mock->Config(argv, 8);
 		shared_ptr<Cache> cache = shared_ptr<Cache>(new Cache(config));
 		// tileIdentifier is not in valid range, so it wont be prerendered.
 		shared_ptr<TileIdentifier> ti1 = boost::make_shared<TileIdentifier>(200, 1, 1, "default", TileIdentifier::Format::PNG);
@@ -74,6 +82,7 @@ struct cache_test
 			BOOST_CHECK_NO_THROW(cache->getTile(ti2));
 		}
 		// Main tile should not be evicted, because its not rendered yet.So check if theres no image on harddisk
+		cache->flush();
 		BOOST_CHECK(!boost::filesystem::exists(tileFilePath));
 		image->push_back('a');
 		tile->setImage(image);
@@ -83,18 +92,282 @@ struct cache_test
 			BOOST_CHECK_NO_THROW(cache->getTile(ti2));
 		}
 		// Check if main tile has been written to harddrive.
+		cache->flush();
 		const bool cacheWrittenToHDD = boost::filesystem::exists(tileFilePath);
 		BOOST_CHECK(cacheWrittenToHDD);
 		// Access a tile formerly evicted to hard drive. 
 		BOOST_CHECK_NO_THROW(cache->getTile(ti1));
 		// Change access rights on hdd
 	}
+
+	void test_concurrent_access() {
+		char* argv[] = {(char*)"ala.carte", (char*)"ala.carte", (char*)"--server.cache-size", (char*)"1024", (char*)"--server.cache-shards", (char*)"8"};
+		ConfigMockup* mock = new ConfigMockup();
+		shared_ptr<Configuration> config = mock->Config(argv, 6);
+		shared_ptr<Cache> cache = shared_ptr<Cache>(new Cache(config));
+		BOOST_CHECK_EQUAL(cache->getShardCount(), 8);
+
+		// All threads access the same tiles, every one has to be created only once.
+		const int tileCount = 512;
+		std::vector<shared_ptr<Tile>> tiles[4];
+		boost::thread_group threads;
+		for (int t = 0; t < 4; t++) {
+			threads.create_thread([&, t]() {
+				for (int i = 0; i < tileCount; i++) {
+					int y = (i * (t + 1)) % tileCount;
+					tiles[t].push_back(cache->getTile(boost::make_shared<TileIdentifier>(1, y, 15, "default", TileIdentifier::Format::PNG)));
+				}
+			});
+		}
+		threads.join_all();
+
+		for (int t = 0; t < 4; t++) {
+			BOOST_REQUIRE_EQUAL(tiles[t].size(), tileCount);
+			for (const shared_ptr<Tile>& tile : tiles[t]) {
+				BOOST_CHECK(cache->getTile(tile->getIdentifier()) == tile);
+			}
+		}
+	}
+
+	void test_memory_budget() {
+		char* argv[] = {(char*)"ala.carte", (char*)"ala.carte", (char*)"--server.cache-size", (char*)"0", (char*)"--server.cache-memory", (char*)"1",
+						(char*)"--server.cache-policy", (char*)"lru"};
+		ConfigMockup* mock = new ConfigMockup();
+		shared_ptr<Configuration> config = mock->Config(argv, 8);
+		shared_ptr<Cache> cache = shared_ptr<Cache>(new Cache(config));
+		BOOST_CHECK_EQUAL(cache->getMemoryBudget(), 1024 * 1024);
+		BOOST_CHECK_EQUAL(cache->getMemoryUsage(), 0);
+
+		// Render 40 tiles of 60 KB, only about 16 of them fit into the budget.
+		shared_ptr<Tile> first;
+		for (int i = 0; i < 40; i++) {
+			shared_ptr<Tile> tile = cache->getTile(boost::make_shared<TileIdentifier>(2, i, 15, "default", TileIdentifier::Format::SVG));
+			BOOST_CHECK(!tile->isRendered());
+			tile->setImage(boost::make_shared<Tile::ImageType::element_type>(60 * 1024, (uint8_t) i));
+			cache->updateTile(tile);
+			BOOST_CHECK_LE(cache->getMemoryUsage(), cache->getMemoryBudget());
+			if (i == 0)
+				first = tile;
+		}
+		BOOST_CHECK_GT(cache->getMemoryUsage(), 15 * 60 * 1024);
+
+		// The least recently used tiles were evicted.
+		BOOST_CHECK(cache->getTile(first->getIdentifier()) != first);
+		shared_ptr<TileIdentifier> last = boost::make_shared<TileIdentifier>(2, 39, 15, "default", TileIdentifier::Format::SVG);
+		BOOST_CHECK(cache->getTile(last)->isRendered());
+
+		Cache::Statistics stats = cache->getStatistics();
+		BOOST_CHECK_EQUAL(stats.hits, 1);
+		BOOST_CHECK_EQUAL(stats.misses, 41);
+		BOOST_CHECK_GT(stats.evictions, 20);
+
+		cache->deleteTiles("default");
+		BOOST_CHECK_EQUAL(cache->getMemoryUsage(), 0);
+	}
+
+	void test_shared_images() {
+		char* argv[] = {(char*)"ala.carte", (char*)"ala.carte", (char*)"--server.cache-size", (char*)"0", (char*)"--server.cache-memory", (char*)"1"};
+		ConfigMockup* mock = new ConfigMockup();
+		shared_ptr<Configuration> config = mock->Config(argv, 6);
+		shared_ptr<Cache> cache = shared_ptr<Cache>(new Cache(config));
+
+		// 40 identical tiles of 60 KB only need one buffer.
+		std::vector<shared_ptr<Tile>> tiles;
+		for (int i = 0; i < 40; i++) {
+			shared_ptr<Tile> tile = cache->getTile(boost::make_shared<TileIdentifier>(3, i, 15, i == 0 ? "other" : "default", TileIdentifier::Format::PNG));
+			tile->setImage(boost::make_shared<Tile::ImageType::element_type>(60 * 1024, 'o'));
+			cache->updateTile(tile);
+			tiles.push_back(tile);
+		}
+		for (auto& tile : tiles) {
+			BOOST_CHECK(tile->getImage() == tiles[0]->getImage());
+			BOOST_CHECK(cache->getTile(tile->getIdentifier()) == tile);
+		}
+		BOOST_CHECK_LT(cache->getMemoryUsage(), 2 * 60 * 1024);
+		BOOST_CHECK_EQUAL(cache->getImagePool()->getLookups(), 40);
+		BOOST_CHECK_EQUAL(cache->getImagePool()->getHits(), 39);
+
+		// the buffer is still charged after the tile that brought it is gone
+		cache->deleteTiles("other");
+		BOOST_CHECK_GT(cache->getMemoryUsage(), 60 * 1024);
+		cache->deleteTiles("default");
+		BOOST_CHECK_EQUAL(cache->getMemoryUsage(), 0);
+	}
+
+	void test_warm_restart() {
+		char* argv[] = {(char*)"ala.carte", (char*)"ala.carte", (char*)"--server.cache-path", (char*)"warm-cache",
+						(char*)"--server.cache-preload", (char*)"3", (char*)"--server.cache-memory", (char*)"1"};
+		ConfigMockup* mock = new ConfigMockup();
+		shared_ptr<Configuration> config = mock->Config(argv, 8);
+		boost::filesystem::remove_all("warm-cache");
+
+		{
+			shared_ptr<Cache> cache = shared_ptr<Cache>(new Cache(config));
+			BOOST_CHECK_EQUAL(cache->waitForPreload(), 0);
+			for (int i = 0; i < 5; i++) {
+				shared_ptr<Tile> tile = cache->getTile(boost::make_shared<TileIdentifier>(4, i, 10, "default", TileIdentifier::Format::PNG));
+				tile->setImage(boost::make_shared<Tile::ImageType::element_type>(100, (uint8_t) i));
+				cache->updateTile(tile);
+			}
+			// tiles 3 and 4 are the most requested
+			for (int i = 0; i < 3; i++) {
+				cache->getTile(boost::make_shared<TileIdentifier>(4, 3, 10, "default", TileIdentifier::Format::PNG));
+				cache->getTile(boost::make_shared<TileIdentifier>(4, 4, 10, "default", TileIdentifier::Format::PNG));
+			}
+			cache->getTile(boost::make_shared<TileIdentifier>(4, 0, 10, "default", TileIdentifier::Format::PNG));
+			// unrendered tiles are not saved
+			cache->getTile(boost::make_shared<TileIdentifier>(4, 5, 10, "default", TileIdentifier::Format::PNG));
+		}
+		BOOST_CHECK(boost::filesystem::exists("warm-cache/cache.index"));
+
+		shared_ptr<Cache> cache = shared_ptr<Cache>(new Cache(config));
+		BOOST_CHECK_EQUAL(cache->waitForPreload(), 3);
+		for (int i : {0, 3, 4}) {
+			shared_ptr<Tile> tile = cache->getTile(boost::make_shared<TileIdentifier>(4, i, 10, "default", TileIdentifier::Format::PNG));
+			BOOST_REQUIRE(tile->isRendered());
+			BOOST_CHECK_EQUAL(tile->getImage()->at(0), i);
+		}
+		BOOST_CHECK_EQUAL(cache->getStatistics().hits, 3);
+		BOOST_CHECK_EQUAL(cache->getStatistics().misses, 0);
+		// internal lookups are not counted
+		cache->getTile(boost::make_shared<TileIdentifier>(4, 3, 10, "default", TileIdentifier::Format::PNG), false);
+		cache->getTile(boost::make_shared<TileIdentifier>(4, 6, 10, "default", TileIdentifier::Format::PNG), false);
+		BOOST_CHECK_EQUAL(cache->getStatistics().hits, 3);
+		BOOST_CHECK_EQUAL(cache->getStatistics().misses, 0);
+
+		cache.reset();
+		boost::filesystem::remove_all("warm-cache");
+	}
+
+	void test_invalidate() {
+		char* argv[] = {(char*)"ala.carte", (char*)"ala.carte", (char*)"--server.cache-path", (char*)"invalidate-cache",
+						(char*)"--server.cache-layout", (char*)"bundle"};
+		ConfigMockup* mock = new ConfigMockup();
+		shared_ptr<Configuration> config = mock->Config(argv, 6);
+		boost::filesystem::remove_all("invalidate-cache");
+		shared_ptr<Cache> cache = shared_ptr<Cache>(new Cache(config));
+
+		// tiles in the north west quarter of the world on zoom 2 and 14
+		std::vector<shared_ptr<Tile>> tiles;
+		for (int z : {2, 14}) {
+			for (int x = 0; x < 4; x++) {
+				shared_ptr<Tile> tile = cache->getTile(boost::make_shared<TileIdentifier>(x, 0, z, "default", TileIdentifier::Format::PNG));
+				tile->setImage(boost::make_shared<Tile::ImageType::element_type>(10, (uint8_t) x));
+				cache->updateTile(tile);
+				tiles.push_back(tile);
+			}
+		}
+		// tile on the hard drive only
+		{
+			shared_ptr<TileStore> store = TileStore::Create("bundle", "invalidate-cache", TileStore::SyncNever);
+			std::vector<shared_ptr<Tile>> stored(1, boost::make_shared<Tile>(boost::make_shared<TileIdentifier>(0, 0, 3, "default", TileIdentifier::Format::PNG)));
+			stored[0]->setImage(boost::make_shared<Tile::ImageType::element_type>(10, 'd'));
+			store->write(stored);
+		}
+
+		coord_t x0, y0, x1, y1;
+		tileToMercator(0, 1, 1, x0, y0);
+		tileToMercator(1, 0, 1, x1, y1);
+		// slightly smaller than the tile, only the neighbours within the overlap are touched
+		FixedRect area(x0 + 10, y0 + 10, x1 - 10, y1 - 10);
+		std::vector<shared_ptr<MetaIdentifier>> metatiles = cache->invalidate(area, 2, 3, "/default");
+		BOOST_REQUIRE_EQUAL(metatiles.size(), 2);
+		BOOST_CHECK_EQUAL(metatiles[0]->getZoom(), 2);
+		BOOST_CHECK_EQUAL(metatiles[1]->getZoom(), 3);
+
+		BOOST_CHECK(tiles[0]->isStale());
+		BOOST_CHECK(tiles[1]->isStale());
+		BOOST_CHECK(tiles[2]->isStale());
+		BOOST_CHECK(!tiles[3]->isStale());
+		// outside of the zoom range
+		BOOST_CHECK(!tiles[4]->isStale());
+		BOOST_CHECK(cache->getTile(boost::make_shared<TileIdentifier>(0, 0, 3, "default", TileIdentifier::Format::PNG))->isStale());
+
+		// rendering the tile again replaces it, requests answered with the stale tile keep its image
+		Tile::ImageType old = tiles[0]->getImage();
+		shared_ptr<Tile> rendered = boost::make_shared<Tile>(tiles[0]->getIdentifier());
+		rendered->setImage(boost::make_shared<Tile::ImageType::element_type>(10, 'n'));
+		cache->updateTile(rendered);
+		BOOST_CHECK(tiles[0]->getImage() == old);
+		shared_ptr<Tile> cached = cache->getTile(tiles[0]->getIdentifier());
+		BOOST_CHECK(cached == rendered);
+		BOOST_CHECK(!cached->isStale());
+
+		// a tile rendered with an outdated stylesheet stays stale
+		rendered = boost::make_shared<Tile>(tiles[1]->getIdentifier());
+		rendered->setImage(boost::make_shared<Tile::ImageType::element_type>(10, 'o'));
+		rendered->markStale();
+		cache->updateTile(rendered);
+		BOOST_CHECK(cache->getTile(tiles[1]->getIdentifier())->isStale());
+
+		cache.reset();
+		boost::filesystem::remove_all("invalidate-cache");
+	}
+
+	void test_invalidate_stylesheet() {
+		char* argv[] = {(char*)"ala.carte", (char*)"ala.carte", (char*)"--server.cache-path", (char*)"stale-cache",
+						(char*)"--server.cache-layout", (char*)"bundle"};
+		ConfigMockup* mock = new ConfigMockup();
+		shared_ptr<Configuration> config = mock->Config(argv, 6);
+		boost::filesystem::remove_all("stale-cache");
+		shared_ptr<Cache> cache = shared_ptr<Cache>(new Cache(config));
+
+		std::vector<shared_ptr<Tile>> tiles;
+		for (const char* style : {"default", "other"}) {
+			shared_ptr<Tile> tile = cache->getTile(boost::make_shared<TileIdentifier>(1, 1, 3, style, TileIdentifier::Format::PNG));
+			tile->setImage(boost::make_shared<Tile::ImageType::element_type>(10, 'm'));
+			cache->updateTile(tile);
+			tiles.push_back(tile);
+		}
+		// tiles on the hard drive only
+		{
+			shared_ptr<TileStore> store = TileStore::Create("bundle", "stale-cache", TileStore::SyncNever);
+			std::vector<shared_ptr<Tile>> stored;
+			for (int x : {0, 8, 12}) {
+				stored.push_back(boost::make_shared<Tile>(boost::make_shared<TileIdentifier>(x, 0, 5, "default", TileIdentifier::Format::PNG)));
+				stored.back()->setImage(boost::make_shared<Tile::ImageType::element_type>(10, (uint8_t) x));
+			}
+			store->write(stored);
+		}
+
+		BOOST_CHECK(tiles[0]->getStaleness() == std::chrono::steady_clock::duration::zero());
+		BOOST_CHECK_EQUAL(cache->invalidateTiles("/default"), 1);
+		BOOST_CHECK(tiles[0]->isStale());
+		BOOST_CHECK(!tiles[1]->isStale());
+		// the old image is kept until the tile is rendered again
+		BOOST_CHECK(tiles[0]->isRendered());
+
+		// marking again keeps the time of the first invalidation
+		std::chrono::steady_clock::duration staleness = tiles[0]->getStaleness();
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		tiles[0]->markStale();
+		BOOST_CHECK(tiles[0]->getStaleness() > staleness);
+
+		for (int x : {0, 8, 12}) {
+			shared_ptr<Tile> tile = cache->getTile(boost::make_shared<TileIdentifier>(x, 0, 5, "default", TileIdentifier::Format::PNG));
+			BOOST_CHECK(tile->isRendered());
+			BOOST_CHECK(tile->isStale());
+		}
+
+		tiles[0]->setImage(boost::make_shared<Tile::ImageType::element_type>(10, 'n'));
+		BOOST_CHECK(!tiles[0]->isStale());
+		BOOST_CHECK(tiles[0]->getStaleness() == std::chrono::steady_clock::duration::zero());
+
+		cache.reset();
+		boost::filesystem::remove_all("stale-cache");
+	}
 };
 
 ALAC_START_FIXTURE_TEST(cache_test)
 	ALAC_FIXTURE_TEST_NAMED(test_default_tile, testOfTheDefaultTile);
 	ALAC_FIXTURE_TEST_NAMED(test_delete_tiles, testToDeleteTilesOfAStylesheet);
 	ALAC_FIXTURE_TEST_NAMED(test_get_tile, testToGetATile);
+	ALAC_FIXTURE_TEST_NAMED(test_concurrent_access, testConcurrentAccessOfShards);
+	ALAC_FIXTURE_TEST_NAMED(test_memory_budget, testEvictionByMemory);
+	ALAC_FIXTURE_TEST_NAMED(test_shared_images, testSharedImagesAreChargedOnce);
+	ALAC_FIXTURE_TEST_NAMED(test_warm_restart, testPreloadMostRequestedTiles);
+	ALAC_FIXTURE_TEST_NAMED(test_invalidate, testInvalidateArea);
+	ALAC_FIXTURE_TEST_NAMED(test_invalidate_stylesheet, testStaleTilesOfAChangedStylesheet);
 ALAC_END_FIXTURE_TEST()
 
 BOOST_AUTO_TEST_SUITE_END(/*cache_test*/)
@@ -26,13 +26,39 @@ shared_ptr<Configuration> ConfigMockup::Config(char* argv[], int argc)
 			(OPT(opt::server::path_to_default_style, "d"),	value<string>()/*->value_name("path")*/,										"default stylesheet")
 			(OPT(opt::server::path_to_default_tile, "t"),	value<string>()/*->value_name("image")*/,										"default tile")
 			(OPT(opt::server::num_threads, "n"),	value<int>()->default_value(8)/*->value_name("num")*/,									"number of threads used to process a request")
+			(opt::server::match_threads,				value<int>()->default_value(8)/*->value_name("num")*/,								"number of threads matching the stylesheet")
+			(opt::server::render_threads,				value<int>()->default_value(8)/*->value_name("num")*/,								"number of threads rendering metatiles")
+			(opt::server::encode_threads,				value<int>()->default_value(8)/*->value_name("num")*/,								"number of threads slicing and encoding rendered metatiles")
+			(opt::server::stage_queue_size,				value<int>()->default_value(4)/*->value_name("size")*/,								"maximal amount of metatiles waiting for each stage of rendering")
+			(opt::server::metatile_size,				value<string>()->default_value("4")/*->value_name("sizes")*/,						"tiles per metatile side, per zoomlevel as list of <first zoom>:<size>")
 			(OPT(opt::server::parse_timeout, "o"),	value<int>()/*->value_name("ms")*/,														"maximal time in ms to parse a stylesheet")
 			(OPT(opt::server::prerender_level, "z"),	value<int>()->default_value(8)/*->value_name("ms")*/,													"highest zoomlevel to enqueue for prerendering")
+			(opt::server::prerender_share,				value<int>()->default_value(50)/*->value_name("percent")*/,							"percentage of the render threads used for prerendering")
+			(opt::server::prerender_pause,				value<int>()->default_value(500)/*->value_name("ms")*/,								"milliseconds user requests may wait before prerendering pauses, 0 to never pause")
+			(opt::server::prerender_popular,			value<int>()->default_value(0)/*->value_name("num")*/,								"number of most requested metatiles above the prerender level to prerender, 0 to disable")
+			(opt::server::max_staleness,				value<int>()->default_value(3600)/*->value_name("seconds")*/,						"seconds a stale tile is served while it is rendered again, 0 to wait for the new tile")
 			(OPT(opt::server::server_port, "p"),	value<string>()->required()->default_value("8080")/*->value_name("port")*/,					"port to bind the server")
 			(OPT(opt::server::max_queue_size, "q"),	value<int>()->default_value(1024)/*->value_name("size")*/,								"size for server queue")
+			(opt::server::queue_policy,					value<string>()->default_value("lifo")/*->value_name("policy")*/,					"order of waiting requests: fifo, lifo or zoom")
+			(opt::server::queue_deadline,				value<int>()->default_value(30000)/*->value_name("ms")*/,							"milliseconds after which waiting requests are dropped, 0 to keep them")
+			(opt::server::prefetch_queue_size,			value<int>()->default_value(256)/*->value_name("size")*/,							"maximal amount of metatiles waiting to be prefetched")
+			(opt::server::prefetch_neighbours,			value<bool>()->default_value(false)/*->value_name("bool")*/,						"prefetch the metatiles clients will probably request next while the workers are idle")
+			(opt::server::prerender_queue_size,			value<int>()->default_value(1024)/*->value_name("size")*/,							"maximal amount of metatiles waiting to be prerendered, 0 for no limit")
+			(opt::server::render_abandoned,				value<bool>()->default_value(false)/*->value_name("bool")*/,						"finish and cache metatiles although all clients disconnected")
+			(opt::server::keep_half_closed,				value<bool>()->default_value(false)/*->value_name("bool")*/,						"answer clients that closed their sending side instead of treating them as disconnected")
 			(opt::server::cache_size,	value<int>()->default_value(10)/*->value_name("size")*/,											"cache size (amount of tiles)")
+			(opt::server::cache_memory,					value<int>()->default_value(256)/*->value_name("mb")*/,								"maximal memory in megabytes used by cached tiles")
 			(opt::server::cache_keep_tile,				value<int>()->default_value(12)/*->value_name("size")*/,							"from 0 this zoomlevel, tiles are written to harddrive")
 			(opt::server::cache_path,					value<string>()->default_value("cache")/*->value_name("path")*/,					"path to store evicted prerendered tiles")
+			(opt::server::cache_layout,					value<string>()->default_value("files")/*->value_name("layout")*/,					"how tiles are stored in the cache path: files or bundle")
+			(opt::server::cache_shards,					value<int>()->default_value(16)/*->value_name("num")*/,								"number of independently locked parts of the cache")
+			(opt::server::cache_write_queue,			value<int>()->default_value(1024)/*->value_name("size")*/,							"maximal amount of evicted tiles waiting to be written")
+			(opt::server::cache_write_batch,			value<int>()->default_value(32)/*->value_name("size")*/,							"amount of evicted tiles written at once")
+			(opt::server::cache_sync,					value<string>()->default_value("none")/*->value_name("policy")*/,					"when written tiles are flushed to disk: none, batch or always")
+			(opt::server::cache_policy,					value<string>()->default_value("tinylfu")/*->value_name("policy")*/,				"which tiles are evicted from memory: lru, tinylfu or arc")
+			(opt::server::cache_index_interval,			value<int>()->default_value(300)/*->value_name("seconds")*/,						"seconds between two snapshots of the most requested tiles, 0 to disable")
+			(opt::server::cache_preload,				value<int>()->default_value(0)/*->value_name("num")*/,							"maximal amount of tiles loaded from the hard drive on startup")
+			(opt::server::cache_preload_threads,		value<int>()->default_value(2)/*->value_name("num")*/,								"number of threads loading tiles on startup")
 			;
 
 
@@ -0,0 +1,211 @@
+
+#include "../../tests.hpp"
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "server/image_pool.hpp"
+#include "server/tile.hpp"
+#include "server/tile_identifier.hpp"
+#include "server/tile_store.hpp"
+
+BOOST_AUTO_TEST_SUITE(tile_store_test)
+
+struct tile_store_test
+{
+	boost::filesystem::path dir;
+
+	tile_store_test()
+		: dir("tile-store-test")
+	{
+		boost::filesystem::remove_all(dir);
+	}
+
+	~tile_store_test() {
+		boost::filesystem::remove_all(dir);
+	}
+
+	shared_ptr<Tile> createTile(int x, int y, std::size_t size)
+	{
+		shared_ptr<Tile> tile = boost::make_shared<Tile>(boost::make_shared<TileIdentifier>(x, y, 6, "default", TileIdentifier::Format::PNG));
+		if (size > 0)
+			tile->setImage(boost::make_shared<Tile::ImageType::element_type>(size, (uint8_t) (x * 8 + y)));
+		return tile;
+	}
+
+	std::size_t countStaleFiles()
+	{
+		std::size_t count = 0;
+		boost::filesystem::recursive_directory_iterator it(dir), end;
+		for (; it != end; ++it) {
+			if (it->path().extension() == ".stale")
+				count++;
+		}
+		return count;
+	}
+
+	void checkImage(TileStore& store, const shared_ptr<Tile>& tile)
+	{
+		Tile::ImageType image = store.read(*tile->getIdentifier());
+		BOOST_REQUIRE(image);
+		BOOST_CHECK(*image == *tile->getImage());
+	}
+
+	void test_bundle()
+	{
+		BundleTileStore store(dir.string(), TileStore::SyncBatch);
+
+		std::vector<shared_ptr<Tile>> tiles;
+		tiles.push_back(createTile(8, 4, 100));
+		tiles.push_back(createTile(11, 7, 50));
+		tiles.push_back(createTile(9, 5, 0));
+		store.write(tiles);
+
+		// all tiles of a metatile share one file
+		BOOST_CHECK(store.getBundlePath(*tiles[0]->getIdentifier()) == store.getBundlePath(*tiles[1]->getIdentifier()));
+		BOOST_CHECK(boost::filesystem::exists(store.getBundlePath(*tiles[0]->getIdentifier())));
+		checkImage(store, tiles[0]);
+		checkImage(store, tiles[1]);
+		// unrendered tiles are not stored
+		BOOST_CHECK(!store.read(*tiles[2]->getIdentifier()));
+
+		// later writes are merged into the bundle
+		std::vector<shared_ptr<Tile>> more;
+		more.push_back(createTile(9, 5, 30));
+		more.push_back(createTile(8, 4, 10));
+		store.write(more);
+		checkImage(store, more[0]);
+		checkImage(store, more[1]);
+		checkImage(store, tiles[1]);
+
+		BOOST_CHECK(!store.read(*createTile(12, 4, 0)->getIdentifier()));
+
+		store.remove("default");
+		BOOST_CHECK(!store.read(*tiles[1]->getIdentifier()));
+	}
+
+	void test_files()
+	{
+		FileTileStore store(dir.string(), TileStore::SyncNever);
+
+		std::vector<shared_ptr<Tile>> tiles;
+		tiles.push_back(createTile(3, 2, 20));
+		tiles.push_back(createTile(3, 3, 0));
+		store.write(tiles);
+
+		BOOST_CHECK_EQUAL(store.getTilePath(*tiles[0]->getIdentifier()).string(), (dir / "default/6/3/2.png").string());
+		checkImage(store, tiles[0]);
+		BOOST_CHECK(!store.read(*tiles[1]->getIdentifier()));
+	}
+
+	void test_shared_files()
+	{
+		shared_ptr<ImagePool> pool = boost::make_shared<ImagePool>();
+		BundleTileStore store(dir.string(), TileStore::SyncNever, pool);
+
+		// two metatiles of ocean
+		std::vector<shared_ptr<Tile>> tiles;
+		for (int x = 0; x < 8; x++) {
+			for (int y = 0; y < 4; y++) {
+				shared_ptr<Tile> tile = createTile(x, y, 0);
+				tile->setImage(pool->intern(boost::make_shared<Tile::ImageType::element_type>(80, 'o')));
+				tiles.push_back(tile);
+			}
+		}
+		BOOST_CHECK_EQUAL(pool->size(), 1);
+		BOOST_CHECK_EQUAL(pool->getHits(), 31);
+		BOOST_CHECK(pool->isDuplicate(tiles[0]->getImage()));
+		BOOST_CHECK(!pool->isDuplicate(boost::make_shared<Tile::ImageType::element_type>(80, 'o')));
+
+		store.write(tiles);
+		BOOST_CHECK_EQUAL(store.getLinkedFiles(), 1);
+		boost::filesystem::path first = store.getBundlePath(*tiles[0]->getIdentifier());
+		boost::filesystem::path second = store.getBundlePath(*tiles[31]->getIdentifier());
+		BOOST_CHECK(first != second);
+		BOOST_CHECK_EQUAL(boost::filesystem::hard_link_count(first), 3);
+		// identical tiles of a bundle are stored once
+		BOOST_CHECK_LT(boost::filesystem::file_size(first), 2 * 80 + 200);
+		checkImage(store, tiles[5]);
+		checkImage(store, tiles[31]);
+	}
+
+	void test_stale(TileStore& store)
+	{
+		std::vector<shared_ptr<Tile>> tiles;
+		tiles.push_back(createTile(8, 4, 100));
+		tiles.push_back(createTile(13, 6, 40));
+		store.write(tiles);
+
+		// only the first metatile is marked
+		BOOST_CHECK_EQUAL(store.markStale("default", 6, 7, 3, 10, 5).size(), 1);
+		bool stale;
+		Tile::ImageType image = store.read(*tiles[0]->getIdentifier(), &stale);
+		BOOST_REQUIRE(image);
+		BOOST_CHECK(stale);
+		BOOST_CHECK(*image == *tiles[0]->getImage());
+		store.read(*tiles[1]->getIdentifier(), &stale);
+		BOOST_CHECK(!stale);
+
+		// stale tiles are not written, rendered tiles replace the stale image
+		std::vector<shared_ptr<Tile>> rendered;
+		rendered.push_back(createTile(8, 4, 0));
+		rendered[0]->setImage(boost::make_shared<Tile::ImageType::element_type>(20, 'n'));
+		rendered.push_back(createTile(9, 4, 30));
+		rendered[1]->markStale();
+		store.write(rendered);
+		image = store.read(*tiles[0]->getIdentifier(), &stale);
+		BOOST_CHECK(!stale);
+		BOOST_CHECK(*image == *rendered[0]->getImage());
+		BOOST_CHECK(!store.read(*rendered[1]->getIdentifier()));
+		// the stale file is deleted once it is replaced
+		BOOST_CHECK_EQUAL(countStaleFiles(), 0);
+	}
+
+	void test_stale_bundle()
+	{
+		BundleTileStore store(dir.string(), TileStore::SyncNever);
+		test_stale(store);
+
+		std::vector<shared_ptr<Tile>> tiles;
+		tiles.push_back(createTile(0, 0, 10));
+		tiles.push_back(createTile(1, 1, 20));
+		store.write(tiles);
+		BOOST_CHECK_EQUAL(store.markStale("default", 6, 0, 0, 3, 3).size(), 1);
+
+		// the stale bundle is kept while the fresh one misses some of its tiles
+		tiles.pop_back();
+		store.write(tiles);
+		BOOST_CHECK_EQUAL(countStaleFiles(), 1);
+		bool stale;
+		BOOST_CHECK(store.read(*createTile(1, 1, 0)->getIdentifier(), &stale));
+		BOOST_CHECK(stale);
+
+		tiles.push_back(createTile(1, 1, 20));
+		store.write(tiles);
+		BOOST_CHECK_EQUAL(countStaleFiles(), 0);
+	}
+
+	void test_stale_files()
+	{
+		FileTileStore store(dir.string(), TileStore::SyncNever);
+		test_stale(store);
+	}
+
+	void test_create()
+	{
+		BOOST_CHECK(boost::dynamic_pointer_cast<BundleTileStore>(TileStore::Create("bundle", dir.string(), TileStore::SyncNever)));
+		BOOST_CHECK(boost::dynamic_pointer_cast<FileTileStore>(TileStore::Create("files", dir.string(), TileStore::SyncNever)));
+		BOOST_CHECK_THROW(TileStore::Create("tar", dir.string(), TileStore::SyncNever), excp::InputFormatException);
+		BOOST_CHECK_THROW(TileStore::ParsePolicy("sometimes"), excp::InputFormatException);
+	}
+};
+
+ALAC_START_FIXTURE_TEST(tile_store_test)
+	ALAC_FIXTURE_TEST_NAMED(test_bundle, testStoreTilesInBundles);
+	ALAC_FIXTURE_TEST_NAMED(test_files, testStoreTilesInFiles);
+	ALAC_FIXTURE_TEST_NAMED(test_shared_files, testShareIdenticalFiles);
+	ALAC_FIXTURE_TEST_NAMED(test_stale_bundle, testMarkBundlesStale);
+	ALAC_FIXTURE_TEST_NAMED(test_stale_files, testMarkFilesStale);
+	ALAC_FIXTURE_TEST_NAMED(test_create, testCreateStoreFromConfiguration);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END(/*tile_store_test*/)
@@ -0,0 +1,107 @@
+
+#include "../../tests.hpp"
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "server/tile.hpp"
+#include "server/tile_store.hpp"
+#include "server/tile_writer.hpp"
+
+BOOST_AUTO_TEST_SUITE(tile_writer_test)
+
+struct tile_writer_test
+{
+	boost::filesystem::path dir;
+	shared_ptr<FileTileStore> store;
+
+	tile_writer_test()
+		: dir("tile-writer-test")
+		, store(boost::make_shared<FileTileStore>(dir.string(), TileStore::SyncBatch))
+	{
+		boost::filesystem::remove_all(dir);
+	}
+
+	~tile_writer_test() {
+		boost::filesystem::remove_all(dir);
+	}
+
+	shared_ptr<Tile> createTile(int y, int zoom, bool rendered)
+	{
+		shared_ptr<Tile> tile = boost::make_shared<Tile>(boost::make_shared<TileIdentifier>(0, y, zoom, "default", TileIdentifier::Format::PNG));
+		if (rendered)
+			tile->setImage(boost::make_shared<Tile::ImageType::element_type>(100, (uint8_t) y));
+		return tile;
+	}
+
+	boost::filesystem::path pathOf(const shared_ptr<Tile>& tile)
+	{
+		return store->getTilePath(*tile->getIdentifier());
+	}
+
+	void test_write_tiles()
+	{
+		std::vector<shared_ptr<Tile>> tiles;
+		{
+			TileWriter writer(store, 64, 4);
+			for (int y = 0; y < 10; y++) {
+				tiles.push_back(createTile(y, 5, y != 3));
+				BOOST_CHECK(writer.enqueue(tiles.back()));
+			}
+			writer.flush();
+
+			BOOST_CHECK(!writer.find(*tiles[0]->getIdentifier()));
+			BOOST_CHECK_EQUAL(writer.getDroppedCount(), 0);
+		}
+
+		for (int y = 0; y < 10; y++) {
+			// unrendered tiles can not be written
+			BOOST_CHECK_EQUAL(boost::filesystem::exists(pathOf(tiles[y])), y != 3);
+			BOOST_CHECK(!boost::filesystem::exists(pathOf(tiles[y]).string() + ".tmp"));
+		}
+		BOOST_CHECK_EQUAL(boost::filesystem::file_size(pathOf(tiles[0])), 100);
+	}
+
+	void test_drop_high_zoom()
+	{
+		std::vector<shared_ptr<Tile>> tiles;
+		std::size_t accepted = 0;
+		{
+			TileWriter writer(store, 2, 1);
+			for (int y = 0; y < 50; y++) {
+				tiles.push_back(createTile(y, 10 + y % 5, true));
+				if (writer.enqueue(tiles.back()))
+					accepted++;
+				// queued tiles can still be read
+				shared_ptr<Tile> pending = writer.find(*tiles.back()->getIdentifier());
+				BOOST_CHECK(!pending || pending == tiles.back());
+			}
+			writer.flush();
+
+			std::size_t written = 0;
+			for (auto& tile : tiles)
+				written += boost::filesystem::exists(pathOf(tile));
+			BOOST_CHECK_EQUAL(written + writer.getDroppedCount(), tiles.size());
+			BOOST_CHECK_LE(written, accepted);
+		}
+	}
+
+	void test_discard()
+	{
+		TileWriter writer(store, 64, 8);
+		for (int y = 0; y < 20; y++) {
+			shared_ptr<Tile> tile = createTile(y, 5, true);
+			writer.enqueue(tile);
+		}
+		writer.discard("default");
+		BOOST_CHECK(!writer.find(*createTile(19, 5, true)->getIdentifier()));
+		writer.flush();
+	}
+};
+
+ALAC_START_FIXTURE_TEST(tile_writer_test)
+	ALAC_FIXTURE_TEST_NAMED(test_write_tiles, testWriteTilesInBatches);
+	ALAC_FIXTURE_TEST_NAMED(test_drop_high_zoom, testDropWritesWhenQueueIsFull);
+	ALAC_FIXTURE_TEST_NAMED(test_discard, testDiscardPendingTiles);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END(/*tile_writer_test*/)
@@ -0,0 +1,65 @@
+
+#include "settings.hpp"
+#include "../tests.hpp"
+
+#include "server/empty_metatile_map.hpp"
+#include "server/tile_identifier.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_emptyMetatileMap)
+
+struct test_emptyMetatileMap
+{
+	EmptyMetatileMap map;
+
+	TileIdentifier tile(int x, int y, int z)
+	{
+		return TileIdentifier(x, y, z, "default", TileIdentifier::PNG);
+	}
+
+	void markMetatile()
+	{
+		BOOST_CHECK(!map.isEmpty(tile(8, 4, 6)));
+		map.markEmpty(tile(8, 4, 6));
+		// all tiles of the metatile are empty
+		BOOST_CHECK(map.isEmpty(tile(11, 7, 6)));
+		BOOST_CHECK(!map.isEmpty(tile(12, 4, 6)));
+		BOOST_CHECK(!map.isEmpty(tile(8, 4, 7)));
+		map.markEmpty(tile(9, 5, 6));
+		BOOST_CHECK_EQUAL(map.getMarkedCount(), 1);
+
+		// small zoomlevels have a single metatile
+		map.markEmpty(tile(1, 1, 1));
+		BOOST_CHECK(map.isEmpty(tile(0, 0, 1)));
+		BOOST_CHECK(!map.isEmpty(tile(0, 0, 0)));
+	}
+
+	void inheritFromMaxZoom()
+	{
+		int z = EmptyMetatileMap::MAX_ZOOM;
+		map.markEmpty(tile(4000, 8000, z));
+		// higher zoomlevels use the ancestor on MAX_ZOOM
+		BOOST_CHECK(map.isEmpty(tile(4000 * 4 + 3, 8000 * 4, z + 2)));
+		BOOST_CHECK(!map.isEmpty(tile(4004 * 4, 8000 * 4, z + 2)));
+		// but are not marked themselves
+		map.markEmpty(tile(0, 0, z + 1));
+		BOOST_CHECK(!map.isEmpty(tile(0, 0, z + 1)));
+		BOOST_CHECK_EQUAL(map.getMarkedCount(), 1);
+	}
+
+	void ignoreInvalidTiles()
+	{
+		map.markEmpty(tile(-1, 0, 3));
+		map.markEmpty(tile(8, 0, 3));
+		map.markEmpty(tile(0, 0, -1));
+		BOOST_CHECK_EQUAL(map.getMarkedCount(), 0);
+		BOOST_CHECK(!map.isEmpty(tile(8, 0, 3)));
+	}
+};
+
+ALAC_START_FIXTURE_TEST(test_emptyMetatileMap)
+	ALAC_FIXTURE_TEST(markMetatile);
+	ALAC_FIXTURE_TEST(inheritFromMaxZoom);
+	ALAC_FIXTURE_TEST(ignoreInvalidTiles);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,134 @@
+
+#include "settings.hpp"
+#include "../tests.hpp"
+#include "../shared/test_config.hpp"
+
+#include "server/job_pipeline.hpp"
+#include "server/job.hpp"
+#include "server/meta_identifier.hpp"
+#include "server/tile_identifier.hpp"
+#include "utils/statistic.hpp"
+
+#include <thread>
+
+BOOST_AUTO_TEST_SUITE(test_jobPipeline)
+
+//! Records the threads running its stages instead of rendering
+class TestJob : public Job
+{
+public:
+	TestJob(const shared_ptr<Configuration>& config, bool nothingToRender = false)
+		: Job(MetaIdentifier::Create(boost::make_shared<TileIdentifier>(0, 0, 10, "default", TileIdentifier::PNG)), config, shared_ptr<RequestManager>(), shared_ptr<RenderCanvasPool>())
+		, nothingToRender(nothingToRender)
+		, delivered(false)
+		, blockRendering(false)
+	{
+	}
+
+	bool query() { threads[JobPipeline::Query] = std::this_thread::get_id(); return !nothingToRender; }
+	bool match() { threads[JobPipeline::Match] = std::this_thread::get_id(); return true; }
+	void render()
+	{
+		threads[JobPipeline::Render] = std::this_thread::get_id();
+		while (blockRendering)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	void deliver() { threads[JobPipeline::Encode] = std::this_thread::get_id(); delivered = true; }
+
+	bool nothingToRender;
+	std::atomic<bool> delivered;
+	std::atomic<bool> blockRendering;
+	std::thread::id threads[JobPipeline::StageCount];
+};
+
+struct test_jobPipeline
+{
+	TestConfig::Ptr config;
+
+	test_jobPipeline()
+	{
+		config = TestConfig::Create()
+		->add<int>(opt::server::match_threads, 2)
+		->add<int>(opt::server::render_threads, 1)
+		->add<int>(opt::server::encode_threads, 2)
+		->add<int>(opt::server::stage_queue_size, 1);
+		Statistic::Init(config);
+	}
+
+	static void deliver(const shared_ptr<Job>& job)
+	{
+		job->deliver();
+	}
+
+	static bool waitFor(const shared_ptr<TestJob>& job)
+	{
+		for (int i = 0; i < 500 && !job->delivered; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return job->delivered;
+	}
+
+	void runStagesOnTheirThreads()
+	{
+		JobPipeline pipeline(config);
+		shared_ptr<TestJob> job = boost::make_shared<TestJob>(config);
+		pipeline.process(job, &test_jobPipeline::deliver);
+		BOOST_REQUIRE(waitFor(job));
+
+		BOOST_CHECK(job->threads[JobPipeline::Query] == std::this_thread::get_id());
+		for (int stage = JobPipeline::Match; stage < JobPipeline::StageCount; stage++) {
+			BOOST_CHECK(job->threads[stage] != std::this_thread::get_id());
+			BOOST_CHECK(job->threads[stage] != job->threads[stage - 1]);
+			BOOST_CHECK_EQUAL(pipeline.getStatistic((JobPipeline::Stage) stage).processed, 1);
+		}
+		BOOST_CHECK_EQUAL(pipeline.getStatistic(JobPipeline::Render).threads, 1);
+	}
+
+	void finishEmptyJobEarly()
+	{
+		JobPipeline pipeline(config);
+		shared_ptr<TestJob> job = boost::make_shared<TestJob>(config, true);
+		pipeline.process(job, &test_jobPipeline::deliver);
+
+		// delivered by the query stage
+		BOOST_CHECK(job->delivered);
+		BOOST_CHECK(job->threads[JobPipeline::Encode] == std::this_thread::get_id());
+		BOOST_CHECK_EQUAL(pipeline.getStatistic(JobPipeline::Query).processed, 1);
+		BOOST_CHECK_EQUAL(pipeline.getStatistic(JobPipeline::Match).processed, 0);
+	}
+
+	void blockWhenStageIsFull()
+	{
+		JobPipeline pipeline(config);
+		std::vector<shared_ptr<TestJob>> jobs;
+		for (int i = 0; i < 4; i++) {
+			jobs.push_back(boost::make_shared<TestJob>(config));
+			jobs.back()->blockRendering = true;
+		}
+
+		std::thread producer([&] {
+			for (auto& job : jobs)
+				pipeline.process(job, &test_jobPipeline::deliver);
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+		// one job is rendered, one waits for the renderer and the matchers wait for its queue
+		BOOST_CHECK_EQUAL(pipeline.getStatistic(JobPipeline::Render).waiting, 1);
+		BOOST_CHECK_LE(pipeline.getStatistic(JobPipeline::Match).waiting, 1);
+		BOOST_CHECK_EQUAL(pipeline.getStatistic(JobPipeline::Encode).processed, 0);
+
+		for (auto& job : jobs)
+			job->blockRendering = false;
+		producer.join();
+		for (auto& job : jobs)
+			BOOST_CHECK(waitFor(job));
+		BOOST_CHECK_EQUAL(pipeline.getStatistic(JobPipeline::Encode).processed, 4);
+	}
+};
+
+ALAC_START_FIXTURE_TEST(test_jobPipeline)
+	ALAC_FIXTURE_TEST(runStagesOnTheirThreads);
+	ALAC_FIXTURE_TEST(finishEmptyJobEarly);
+	ALAC_FIXTURE_TEST(blockWhenStageIsFull);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,117 @@
+
+#include "settings.hpp"
+#include "../tests.hpp"
+#include "../shared/test_config.hpp"
+
+#include "server/meta_identifier.hpp"
+#include "server/tile_identifier.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_metaIdentifier)
+
+struct test_metaIdentifier
+{
+	~test_metaIdentifier()
+	{
+		MetaIdentifier::Init(TestConfig::Create());
+	}
+
+	void init(const string& sizes)
+	{
+		MetaIdentifier::Init(TestConfig::Create()->add<string>(opt::server::metatile_size, sizes));
+	}
+
+	MetaIdentifier meta(int x, int y, int z)
+	{
+		return MetaIdentifier(TileIdentifier(x, y, z, "default", TileIdentifier::PNG));
+	}
+
+	void defaultSize()
+	{
+		init("4");
+		BOOST_CHECK_EQUAL(MetaIdentifier::Size(0), META_TILE_SIZE);
+		BOOST_CHECK_EQUAL(MetaIdentifier::Size(ALAC_ZOOM_TOP), META_TILE_SIZE);
+		BOOST_CHECK_EQUAL(MetaIdentifier::MaxSize(), META_TILE_SIZE);
+
+		MetaIdentifier mid = meta(17155, 11258, 15);
+		BOOST_CHECK_EQUAL(mid.getX(), 17152);
+		BOOST_CHECK_EQUAL(mid.getY(), 11256);
+		BOOST_CHECK_EQUAL(mid.getIdentifiers().size(), 16);
+
+		// cut off at the border of the world
+		BOOST_CHECK_EQUAL(meta(1, 0, 1).getIdentifiers().size(), 4);
+	}
+
+	void sizePerZoom()
+	{
+		init("8, 10:4, 17:2");
+		BOOST_CHECK_EQUAL(MetaIdentifier::Size(9), 8);
+		BOOST_CHECK_EQUAL(MetaIdentifier::Size(10), 4);
+		BOOST_CHECK_EQUAL(MetaIdentifier::Size(16), 4);
+		BOOST_CHECK_EQUAL(MetaIdentifier::Size(17), 2);
+		BOOST_CHECK_EQUAL(MetaIdentifier::Size(ALAC_ZOOM_TOP + 1), 2);
+		BOOST_CHECK_EQUAL(MetaIdentifier::MaxSize(), 8);
+
+		MetaIdentifier low = meta(13, 21, 9);
+		BOOST_CHECK_EQUAL(low.getX(), 8);
+		BOOST_CHECK_EQUAL(low.getY(), 16);
+		BOOST_CHECK_EQUAL(low.getIdentifiers().size(), 64);
+		BOOST_CHECK_EQUAL(meta(70001, 40003, 17).getIdentifiers().size(), 4);
+
+		TileIdentifier origin = MetaIdentifier::Origin(TileIdentifier(70001, 40003, 17, "default", TileIdentifier::PNG));
+		BOOST_CHECK_EQUAL(origin.getX(), 70000);
+		BOOST_CHECK_EQUAL(origin.getY(), 40002);
+	}
+
+	void subIdentifiersOfOtherSize()
+	{
+		init("0:2, 5:8, 9:4");
+
+		// smaller metatiles below a large one
+		std::vector<shared_ptr<MetaIdentifier>> children;
+		meta(8, 16, 8).getSubIdentifiers(children);
+		BOOST_CHECK_EQUAL(children.size(), 16);
+		for (auto& child : children)
+			BOOST_CHECK_EQUAL(child->getIdentifiers().size(), 16);
+
+		// a larger metatile below four small ones is only returned once
+		children.clear();
+		meta(0, 0, 4).getSubIdentifiers(children);
+		meta(2, 0, 4).getSubIdentifiers(children);
+		meta(0, 2, 4).getSubIdentifiers(children);
+		meta(2, 2, 4).getSubIdentifiers(children);
+		BOOST_REQUIRE_EQUAL(children.size(), 1);
+		BOOST_CHECK_EQUAL(children[0]->getX(), 0);
+		BOOST_CHECK_EQUAL(children[0]->getY(), 0);
+		BOOST_CHECK_EQUAL(children[0]->getIdentifiers().size(), 64);
+	}
+
+	void rejectInvalidSizes()
+	{
+		BOOST_CHECK_THROW(init("3"), excp::InputFormatException);
+		BOOST_CHECK_THROW(init("16"), excp::InputFormatException);
+		BOOST_CHECK_THROW(init("4,10:8,5:2"), excp::InputFormatException);
+		BOOST_CHECK_THROW(init("19:2"), excp::InputFormatException);
+		BOOST_CHECK_THROW(init("10:x"), excp::InputFormatException);
+		// the previous sizes are kept
+		BOOST_CHECK_EQUAL(MetaIdentifier::Size(12), META_TILE_SIZE);
+	}
+
+	void parseWithoutInit()
+	{
+		std::vector<int> sizes = MetaIdentifier::ParseSizes(TestConfig::Create()->add<string>(opt::server::metatile_size, "8,10:2"));
+		BOOST_REQUIRE_EQUAL(sizes.size(), ALAC_ZOOM_TOP + 1);
+		BOOST_CHECK_EQUAL(sizes[9], 8);
+		BOOST_CHECK_EQUAL(sizes[10], 2);
+		BOOST_CHECK_EQUAL(MetaIdentifier::Size(10), META_TILE_SIZE);
+	}
+};
+
+ALAC_START_FIXTURE_TEST(test_metaIdentifier)
+	ALAC_FIXTURE_TEST(defaultSize);
+	ALAC_FIXTURE_TEST(sizePerZoom);
+	ALAC_FIXTURE_TEST(subIdentifiersOfOtherSize);
+	ALAC_FIXTURE_TEST(rejectInvalidSizes);
+	ALAC_FIXTURE_TEST(parseWithoutInit);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,106 @@
+
+#include "settings.hpp"
+#include "../tests.hpp"
+#include "../shared/test_config.hpp"
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+#include "server/popularity_tracker.hpp"
+#include "server/meta_identifier.hpp"
+#include "server/tile_identifier.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_popularityTracker)
+
+struct test_popularityTracker
+{
+	boost::filesystem::path log;
+
+	test_popularityTracker()
+		: log("popularity-test.log")
+	{
+		MetaIdentifier::Init(TestConfig::Create());
+	}
+
+	~test_popularityTracker()
+	{
+		boost::filesystem::remove(log);
+	}
+
+	TileIdentifier tile(int x, int y, int zoom, const string& stylesheet = "default")
+	{
+		return TileIdentifier(x, y, zoom, stylesheet, TileIdentifier::PNG);
+	}
+
+	void loadAccessLog()
+	{
+		{
+			std::ofstream file(log.string());
+			file << "80.101.90.180 - [2/Jun/2009:15:11:52] \"GET /default/15/17600/10747.png HTTP/1.1\" 200 2816\n";
+			file << "80.101.90.180 - [2/Jun/2009:15:11:53] \"GET /default/15/17601/10745.svg HTTP/1.1\" 200 2816\n";
+			file << "80.101.90.181 - [2/Jun/2009:15:11:54] \"GET /15/17600/10744.png HTTP/1.1\" 200 2816\n";
+			file << "80.101.90.181 - [2/Jun/2009:15:11:55] \"GET /night/15/3/4.png HTTP/1.1\" 200 2816\n";
+			// not tiles
+			file << "80.101.90.181 - [2/Jun/2009:15:11:56] \"GET /default/15/x/4.png HTTP/1.1\" 200 2816\n";
+			file << "80.101.90.181 - [2/Jun/2009:15:11:57] \"GET /default/2/7/0.png HTTP/1.1\" 200 2816\n";
+			file << "garbage\n";
+		}
+
+		PopularityTracker tracker(100);
+		BOOST_CHECK_EQUAL(tracker.load(log.string(), "default"), 4);
+		BOOST_CHECK_EQUAL(tracker.size(), 2);
+
+		std::vector<shared_ptr<MetaIdentifier>> top = tracker.top("default", 10, 0);
+		BOOST_REQUIRE_EQUAL(top.size(), 1);
+		BOOST_CHECK_EQUAL(top[0]->getX(), 17600);
+		BOOST_CHECK_EQUAL(top[0]->getY(), 10744);
+		BOOST_CHECK_EQUAL(top[0]->getImageFormat(), TileIdentifier::PNG);
+
+		BOOST_CHECK_EQUAL(tracker.load("does-not-exist.log", "default"), 0);
+	}
+
+	void rankByRequests()
+	{
+		PopularityTracker tracker(100);
+		for (int i = 0; i < 3; i++)
+			tracker.hit(tile(8, 8, 14));
+		for (int i = 0; i < 5; i++)
+			tracker.hit(tile(5, 1, 14));
+		tracker.hit(tile(0, 0, 14));
+		tracker.hit(tile(0, 0, 3));
+		tracker.hit(tile(0, 0, 14, "night"));
+
+		std::vector<shared_ptr<MetaIdentifier>> top = tracker.top("default", 2, 10);
+		BOOST_REQUIRE_EQUAL(top.size(), 2);
+		BOOST_CHECK_EQUAL(top[0]->getX(), 4);
+		BOOST_CHECK_EQUAL(top[1]->getX(), 8);
+
+		// lower zoomlevels are excluded
+		BOOST_CHECK_EQUAL(tracker.top("default", 10, 10).size(), 3);
+		BOOST_CHECK_EQUAL(tracker.top("night", 10, 0).size(), 1);
+	}
+
+	void decayWhenFull()
+	{
+		PopularityTracker tracker(4);
+		for (int i = 0; i < 4; i++)
+			tracker.hit(tile(8, 8, 14));
+		for (int x = 0; x < 3; x++)
+			tracker.hit(tile(x * 4, 0, 14));
+		BOOST_CHECK_EQUAL(tracker.size(), 4);
+
+		// metatiles requested once are forgotten
+		tracker.hit(tile(100, 100, 14));
+		BOOST_CHECK_EQUAL(tracker.size(), 2);
+		std::vector<shared_ptr<MetaIdentifier>> top = tracker.top("default", 1, 0);
+		BOOST_REQUIRE_EQUAL(top.size(), 1);
+		BOOST_CHECK_EQUAL(top[0]->getX(), 8);
+	}
+};
+
+ALAC_START_FIXTURE_TEST(test_popularityTracker)
+	ALAC_FIXTURE_TEST(loadAccessLog);
+	ALAC_FIXTURE_TEST(rankByRequests);
+	ALAC_FIXTURE_TEST(decayWhenFull);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,145 @@
+
+#include "settings.hpp"
+#include "../tests.hpp"
+#include "../shared/test_config.hpp"
+
+#include "server/prefetcher.hpp"
+#include "server/meta_identifier.hpp"
+#include "server/tile_identifier.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_prefetcher)
+
+struct test_prefetcher
+{
+	std::vector<shared_ptr<MetaIdentifier>> submitted;
+	//! number of submitted metatiles reported as rendered
+	std::size_t renderedCount;
+	bool idle;
+	shared_ptr<Prefetcher> prefetcher;
+
+	test_prefetcher()
+		: renderedCount(0)
+		, idle(true)
+	{
+		MetaIdentifier::Init(TestConfig::Create());
+		prefetcher = boost::make_shared<Prefetcher>(
+			[this](const shared_ptr<MetaIdentifier>& mid) { submitted.push_back(mid); return true; },
+			[this]() { return idle; });
+	}
+
+	void request(const string& client, int x, int y, int zoom)
+	{
+		prefetcher->requested(client, TileIdentifier(x, y, zoom, "default", TileIdentifier::PNG));
+	}
+
+	//! renders the metatiles submitted since the last call
+	void renderSubmitted()
+	{
+		for (; renderedCount < submitted.size(); renderedCount++)
+			prefetcher->rendered(*submitted[renderedCount]);
+	}
+
+	bool wasSubmitted(int x, int y, int zoom)
+	{
+		for (auto& mid : submitted) {
+			if (mid->getX() == x && mid->getY() == y && mid->getZoom() == zoom)
+				return true;
+		}
+		return false;
+	}
+
+	void predictPanAndZoom()
+	{
+		request("a", 1, 2, 10);
+		BOOST_CHECK(submitted.empty());
+		// tiles of the same metatile are no movement
+		request("a", 3, 3, 10);
+		BOOST_CHECK(submitted.empty());
+
+		request("a", 5, 2, 10);
+		BOOST_REQUIRE(!submitted.empty());
+		BOOST_CHECK(wasSubmitted(8, 0, 10));
+		BOOST_CHECK(wasSubmitted(0, 0, 9));
+		BOOST_CHECK(wasSubmitted(8, 0, 11));
+		BOOST_CHECK(wasSubmitted(12, 4, 11));
+		BOOST_CHECK_EQUAL(submitted.size(), 6);
+
+		// jumps only predict the zoomlevels above and below
+		submitted.clear();
+		request("a", 400, 400, 10);
+		BOOST_CHECK_EQUAL(submitted.size(), 5);
+		BOOST_CHECK(!wasSubmitted(404, 400, 10));
+	}
+
+	void streamPerClient()
+	{
+		request("a", 0, 0, 10);
+		request("b", 400, 400, 10);
+		request("a", 4, 4, 10);
+		BOOST_CHECK(wasSubmitted(8, 8, 10));
+
+		submitted.clear();
+		prefetcher->requested("a", TileIdentifier(8, 8, 10, "other", TileIdentifier::PNG));
+		BOOST_CHECK(submitted.empty());
+	}
+
+	void onlyWhileIdle()
+	{
+		idle = false;
+		request("a", 0, 0, 10);
+		request("a", 4, 0, 10);
+		BOOST_CHECK(submitted.empty());
+		BOOST_CHECK_EQUAL(prefetcher->getStatistics().submitted, 0);
+	}
+
+	void countHitsAndWaste()
+	{
+		request("a", 0, 0, 10);
+		request("a", 4, 0, 10);
+		renderSubmitted();
+
+		request("b", 9, 1, 10);
+		request("b", 9, 2, 10);
+		Prefetcher::Statistics stats = prefetcher->getStatistics();
+		BOOST_CHECK_EQUAL(stats.hits, 1);
+		BOOST_CHECK_EQUAL(stats.prefetched, submitted.size());
+		BOOST_CHECK_EQUAL(stats.submitted, submitted.size());
+
+		// old predictions are forgotten
+		for (int x = 0; x < 4 * 1024; x += 4) {
+			request("c", x, 0, 12);
+			renderSubmitted();
+		}
+		stats = prefetcher->getStatistics();
+		BOOST_CHECK_GT(stats.wasted, 0);
+		BOOST_CHECK_LE(stats.prefetched - stats.hits - stats.wasted, Prefetcher::MAX_PREFETCHED);
+	}
+
+	void countOnlyRendered()
+	{
+		request("a", 0, 0, 10);
+		request("a", 4, 0, 10);
+		BOOST_REQUIRE(wasSubmitted(8, 0, 10));
+
+		// the metatile was already cached, nothing was rendered for the prefetcher
+		request("b", 9, 1, 10);
+		Prefetcher::Statistics stats = prefetcher->getStatistics();
+		BOOST_CHECK_EQUAL(stats.submitted, submitted.size());
+		BOOST_CHECK_EQUAL(stats.prefetched, 0);
+		BOOST_CHECK_EQUAL(stats.hits, 0);
+
+		// reported after it was requested
+		prefetcher->rendered(TileIdentifier(8, 0, 10, "default", TileIdentifier::PNG));
+		BOOST_CHECK_EQUAL(prefetcher->getStatistics().prefetched, 0);
+	}
+};
+
+ALAC_START_FIXTURE_TEST(test_prefetcher)
+	ALAC_FIXTURE_TEST(predictPanAndZoom);
+	ALAC_FIXTURE_TEST(streamPerClient);
+	ALAC_FIXTURE_TEST(onlyWhileIdle);
+	ALAC_FIXTURE_TEST(countHitsAndWaste);
+	ALAC_FIXTURE_TEST(countOnlyRendered);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,210 @@
+
+#include "settings.hpp"
+#include "../tests.hpp"
+#include "../shared/test_config.hpp"
+#include <boost/filesystem.hpp>
+#include <deque>
+
+#include "server/prerender_controller.hpp"
+#include "server/meta_identifier.hpp"
+#include "general/configuration.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_prerenderController)
+
+struct test_prerenderController
+{
+	boost::filesystem::path dir;
+	std::deque<shared_ptr<MetaIdentifier>> submitted;
+	std::size_t submissions;
+	std::size_t maxSubmitted;
+	bool accept;
+	std::size_t backlog;
+
+	test_prerenderController()
+		: dir("prerender-test")
+		, submissions(0)
+		, maxSubmitted(0)
+		, accept(true)
+		, backlog(0)
+	{
+		boost::filesystem::remove_all(dir);
+	}
+
+	~test_prerenderController()
+	{
+		boost::filesystem::remove_all(dir);
+		MetaIdentifier::Init(TestConfig::Create());
+	}
+
+	shared_ptr<PrerenderController> create(const string& metatileSize = "4")
+	{
+		shared_ptr<Configuration> config = TestConfig::Create()
+			->add<string>(opt::server::cache_path, dir.string())
+			->add<string>(opt::server::metatile_size, metatileSize)
+			->add<int>(opt::server::prerender_level, 3)
+			->add<int>(opt::server::render_threads, 4)
+			->add<int>(opt::server::prerender_pause, 100);
+		MetaIdentifier::Init(config);
+
+		return boost::make_shared<PrerenderController>(config,
+			[this](const shared_ptr<MetaIdentifier>& mid) {
+				if (!accept)
+					return false;
+				submitted.push_back(mid);
+				submissions++;
+				maxSubmitted = std::max(maxSubmitted, submitted.size());
+				return true;
+			},
+			[this]() { return backlog; });
+	}
+
+	//! finishes the submitted metatiles in order, @return the zoomlevels of the finished metatiles
+	std::vector<int> finishAll(const shared_ptr<PrerenderController>& controller, int maxZoom = ALAC_ZOOM_TOP)
+	{
+		std::vector<int> zooms;
+		while (!submitted.empty() && submitted.front()->getZoom() <= maxZoom) {
+			shared_ptr<MetaIdentifier> mid = submitted.front();
+			submitted.pop_front();
+			zooms.push_back(mid->getZoom());
+			controller->finished(mid, false);
+		}
+		return zooms;
+	}
+
+	void walkZoomlevelsInOrder()
+	{
+		shared_ptr<PrerenderController> controller = create();
+		controller->start("default", 1);
+
+		// one metatile up to zoomlevel 2, four on zoomlevel 3
+		std::vector<int> zooms = finishAll(controller);
+		BOOST_REQUIRE_EQUAL(zooms.size(), 7);
+		BOOST_CHECK(std::is_sorted(zooms.begin(), zooms.end()));
+		BOOST_CHECK_EQUAL(controller->getRendered("default", 3), 4);
+		BOOST_CHECK_EQUAL(controller->getRunning(), 0);
+	}
+
+	void limitRunning()
+	{
+		shared_ptr<PrerenderController> controller = create();
+		BOOST_CHECK_EQUAL(controller->getMaxRunning(), 2);
+
+		// a full queue only delays prerendering
+		accept = false;
+		controller->start("default", 1);
+		BOOST_CHECK_EQUAL(controller->getRunning(), 0);
+		accept = true;
+		controller->userRequestStarted(std::chrono::milliseconds(0));
+		BOOST_CHECK_EQUAL(submitted.size(), 1);
+
+		finishAll(controller);
+		BOOST_CHECK_EQUAL(submissions, 7);
+		BOOST_CHECK_EQUAL(maxSubmitted, 2);
+	}
+
+	void skipChildrenOfEmpty()
+	{
+		shared_ptr<PrerenderController> controller = create("1");
+		controller->start("default", 1);
+		finishAll(controller, 0);
+
+		// the upper left metatile of zoomlevel 1 is empty
+		while (!submitted.empty() && submitted.front()->getZoom() == 1) {
+			shared_ptr<MetaIdentifier> mid = submitted.front();
+			submitted.pop_front();
+			controller->finished(mid, mid->getX() == 0 && mid->getY() == 0);
+		}
+		finishAll(controller);
+
+		BOOST_CHECK_EQUAL(submissions, 1 + 4 + 12 + 48);
+		BOOST_CHECK_EQUAL(controller->getRendered("default", 2), 16);
+		BOOST_CHECK_EQUAL(controller->getRendered("default", 3), 64);
+	}
+
+	void resumeAfterRestart()
+	{
+		{
+			shared_ptr<PrerenderController> controller = create();
+			controller->start("default", 1);
+			finishAll(controller, 2);
+			controller->stop();
+		}
+
+		// the same version continues on zoomlevel 3
+		submitted.clear();
+		shared_ptr<PrerenderController> controller = create();
+		controller->start("default", 1);
+		BOOST_REQUIRE(!submitted.empty());
+		BOOST_CHECK_EQUAL(submitted.front()->getZoom(), 3);
+		BOOST_CHECK_EQUAL(finishAll(controller).size(), 4);
+		controller->stop();
+
+		// a modified stylesheet is prerendered again
+		submitted.clear();
+		controller = create();
+		controller->start("default", 2);
+		BOOST_REQUIRE(!submitted.empty());
+		BOOST_CHECK_EQUAL(submitted.front()->getZoom(), 0);
+
+		// the progress of removed stylesheets is deleted
+		controller->remove("default");
+		BOOST_CHECK(!boost::filesystem::exists(dir / "default.prerender"));
+	}
+
+	void popularFirst()
+	{
+		std::vector<shared_ptr<MetaIdentifier>> popular;
+		popular.push_back(boost::make_shared<MetaIdentifier>(TileIdentifier(64, 32, 8, "default", TileIdentifier::PNG)));
+		popular.push_back(boost::make_shared<MetaIdentifier>(TileIdentifier(0, 0, 2, "default", TileIdentifier::PNG)));
+		popular.push_back(boost::make_shared<MetaIdentifier>(TileIdentifier(4096, 0, 14, "default", TileIdentifier::PNG)));
+
+		shared_ptr<PrerenderController> controller = create();
+		controller->start("default", 1, popular);
+
+		// metatiles of the walk are not rendered twice
+		BOOST_REQUIRE_EQUAL(submitted.size(), 2);
+		BOOST_CHECK_EQUAL(submitted[0]->getZoom(), 8);
+		BOOST_CHECK_EQUAL(submitted[1]->getZoom(), 14);
+		BOOST_CHECK_EQUAL(finishAll(controller).size(), 2 + 7);
+		BOOST_CHECK_EQUAL(controller->getRendered("default", 3), 4);
+
+		// tiles of an unchanged stylesheet up to the zoomlevel kept on the hard drive are still there
+		controller->start("default", 1, popular);
+		BOOST_REQUIRE_EQUAL(submitted.size(), 1);
+		BOOST_CHECK_EQUAL(submitted[0]->getZoom(), 14);
+	}
+
+	void pauseForSlowUserRequests()
+	{
+		shared_ptr<PrerenderController> controller = create();
+		controller->start("default", 1);
+		finishAll(controller, 2);
+
+		backlog = 3;
+		for (int i = 0; i < 10; i++)
+			controller->userRequestStarted(std::chrono::milliseconds(1000));
+		BOOST_CHECK(controller->isPaused());
+
+		std::size_t before = submissions;
+		finishAll(controller);
+		BOOST_CHECK_EQUAL(submissions, before);
+		BOOST_CHECK_EQUAL(controller->getRunning(), 0);
+
+		// continues once no user waits
+		backlog = 0;
+		BOOST_CHECK(!controller->isPaused());
+		controller->userRequestStarted(std::chrono::milliseconds(1000));
+		BOOST_CHECK_EQUAL(controller->getRunning(), 2);
+	}
+};
+
+ALAC_START_FIXTURE_TEST(test_prerenderController)
+	ALAC_FIXTURE_TEST(walkZoomlevelsInOrder);
+	ALAC_FIXTURE_TEST(limitRunning);
+	ALAC_FIXTURE_TEST(skipChildrenOfEmpty);
+	ALAC_FIXTURE_TEST(resumeAfterRestart);
+	ALAC_FIXTURE_TEST(popularFirst);
+	ALAC_FIXTURE_TEST(pauseForSlowUserRequests);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -26,6 +26,7 @@ public:
 	void answer ( const  shared_ptr<Tile>& tile, Reply::StatusType status = Reply::ok )
 	{
 		reply.status = status;
+		answeredTile = tile;
 		answered = true;
 	};
 	void answer ( Reply::StatusType status )
@@ -34,10 +35,12 @@ public:
 		answered = true;
 	};
 	bool isAnswered() {return answered;}
+	void disconnect() {disconnected = true;}
 	HttpRequest::Reply& getReply()
 	{
 		return reply;
 	}
+	shared_ptr<Tile> answeredTile;
 };
 
 struct test_requestManage
@@ -74,19 +77,87 @@ struct test_requestManage
 		//enqueue more request than the server can handle, so it has to reply with service_unavailable
 		boost::asio::io_service service;
 		DefaultConfig->add<int>(opt::server::max_queue_size, 1);
-		shared_ptr<TestHttpRequest> request = boost::make_shared<TestHttpRequest>("default/15/17150/11253.png", service, server, req_manager);
-		req_manager->enqueue(boost::make_shared<TestHttpRequest>("default/15/17143/11253.png", service, server, req_manager));
-		req_manager->enqueue(boost::make_shared<TestHttpRequest>("default/15/17144/11253.png", service, server, req_manager));
-		req_manager->enqueue(boost::make_shared<TestHttpRequest>("default/15/17145/11253.png", service, server, req_manager));
-		req_manager->enqueue(boost::make_shared<TestHttpRequest>("default/15/17146/11253.png", service, server, req_manager));
-		req_manager->enqueue(boost::make_shared<TestHttpRequest>("default/15/17147/11253.png", service, server, req_manager));
-		req_manager->enqueue(boost::make_shared<TestHttpRequest>("default/15/17148/11253.png", service, server, req_manager));
-		req_manager->enqueue(boost::make_shared<TestHttpRequest>("default/15/17149/11253.png", service, server, req_manager));
+		shared_ptr<TestHttpRequest> request = boost::make_shared<TestHttpRequest>("default/15/17160/11253.png", service, server, req_manager);
+		// every request needs its own metatile, requests for the same metatile are not queued again
+		for (int x = 17104; x < 17160; x += META_TILE_SIZE)
+			req_manager->enqueue(boost::make_shared<TestHttpRequest>("default/15/" + std::to_string(x) + "/11253.png", service, server, req_manager));
 		req_manager->enqueue(request);
 		BOOST_CHECK(request->isAnswered());
 		BOOST_CHECK_EQUAL(request->getReply().status, HttpRequest::Reply::service_unavailable);
 	}
 	
+	void coalesceRequests()
+	{
+		//requests for tiles of the same metatile wait for the queued one instead of exceeding the queue
+		boost::asio::io_service service;
+		std::vector<shared_ptr<TestHttpRequest>> requests;
+		for (int i = 0; i < 50; i++) {
+			int x = 17152 + i % META_TILE_SIZE;
+			int y = 11256 + i / META_TILE_SIZE % META_TILE_SIZE;
+			requests.push_back(boost::make_shared<TestHttpRequest>("default/15/" + std::to_string(x) + "/" + std::to_string(y) + ".png", service, server, req_manager));
+		}
+		for (auto& request : requests)
+			req_manager->enqueue(request);
+		boost::this_thread::sleep(boost::posix_time::milliseconds(3000));
+		for (auto& request : requests) {
+			BOOST_CHECK(request->isAnswered());
+			BOOST_CHECK_EQUAL(request->getReply().status, HttpRequest::Reply::ok);
+		}
+	}
+
+	void answerEveryTileOfMetatile()
+	{
+		//the tiles of a metatile are encoded in parallel, every request gets the image of its own tile
+		boost::asio::io_service service;
+		std::vector<shared_ptr<TestHttpRequest>> requests;
+		for (int y = 11260; y < 11260 + META_TILE_SIZE; y++) {
+			for (int x = 17156; x < 17156 + META_TILE_SIZE; x++)
+				requests.push_back(boost::make_shared<TestHttpRequest>("default/15/" + std::to_string(x) + "/" + std::to_string(y) + ".png", service, server, req_manager));
+		}
+		for (auto& request : requests)
+			req_manager->enqueue(request);
+		boost::this_thread::sleep(boost::posix_time::milliseconds(3000));
+
+		for (std::size_t i = 0; i < requests.size(); i++) {
+			BOOST_REQUIRE(requests[i]->isAnswered());
+			BOOST_CHECK_EQUAL(requests[i]->getReply().status, HttpRequest::Reply::ok);
+			const shared_ptr<Tile>& tile = requests[i]->answeredTile;
+			BOOST_REQUIRE(tile && tile->isRendered());
+			BOOST_CHECK_EQUAL(tile->getIdentifier()->getX(), 17156 + (int) i % META_TILE_SIZE);
+			BOOST_CHECK_EQUAL(tile->getIdentifier()->getY(), 11260 + (int) i / META_TILE_SIZE);
+			BOOST_CHECK(tile->getImage() == cache->getTile(tile->getIdentifier())->getImage());
+		}
+	}
+
+	void dropDisconnectedRequest()
+	{
+		//a request whose client left is not rendered
+		boost::asio::io_service service;
+		shared_ptr<TestHttpRequest> request = boost::make_shared<TestHttpRequest>("default/15/17150/11254.png", service, server, req_manager);
+		request->disconnect();
+		req_manager->enqueue(request);
+		boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+		BOOST_CHECK(request->isAnswered());
+		BOOST_CHECK_EQUAL(request->getReply().status, HttpRequest::Reply::service_unavailable);
+		BOOST_CHECK(!cache->getTile(boost::make_shared<TileIdentifier>(17150, 11254, 15, "default", TileIdentifier::PNG))->isRendered());
+	}
+
+	void answerCachedWithoutRendering()
+	{
+		//a cached tile is answered without rendering the rest of its metatile
+		boost::asio::io_service service;
+		shared_ptr<Tile> tile = cache->getTile(boost::make_shared<TileIdentifier>(17144, 11264, 15, "default", TileIdentifier::PNG));
+		tile->setImage(boost::make_shared<Tile::ImageType::element_type>(10, 'c'));
+		cache->updateTile(tile);
+
+		shared_ptr<TestHttpRequest> request = boost::make_shared<TestHttpRequest>("default/15/17144/11264.png", service, server, req_manager);
+		req_manager->enqueue(request);
+		boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+		BOOST_CHECK(request->isAnswered());
+		BOOST_CHECK_EQUAL(request->getReply().status, HttpRequest::Reply::ok);
+		BOOST_CHECK(!cache->getTile(boost::make_shared<TileIdentifier>(17145, 11264, 15, "default", TileIdentifier::PNG))->isRendered());
+	}
+
 	void isPrerendered()
 	{
 		//prerender a Tile and check if the (child?) Tiles are prerendered.
@@ -127,6 +198,10 @@ ALAC_START_FIXTURE_TEST(test_requestManage)
 	// functionname, name of test, arguments of function...
 	ALAC_FIXTURE_TEST(isPrerendered);
 	ALAC_FIXTURE_TEST(enqueueHttpRequest);
+	ALAC_FIXTURE_TEST(coalesceRequests);
+	ALAC_FIXTURE_TEST(answerEveryTileOfMetatile);
+	ALAC_FIXTURE_TEST(dropDisconnectedRequest);
+	ALAC_FIXTURE_TEST(answerCachedWithoutRendering);
 ALAC_END_FIXTURE_TEST()
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,120 @@
+
+#include "settings.hpp"
+#include "../tests.hpp"
+#include "../shared/test_config.hpp"
+
+#include "server/request_scheduler.hpp"
+#include "server/meta_identifier.hpp"
+#include "server/tile_identifier.hpp"
+
+#include <thread>
+
+BOOST_AUTO_TEST_SUITE(test_requestScheduler)
+
+struct test_requestScheduler
+{
+	TestConfig::Ptr config;
+
+	test_requestScheduler()
+	{
+		config = TestConfig::Create()
+		->add<int>(opt::server::max_queue_size, 4)
+		->add<string>(opt::server::queue_policy, "lifo")
+		->add<int>(opt::server::queue_deadline, 0)
+		->add<int>(opt::server::prefetch_queue_size, 2);
+	}
+
+	shared_ptr<TileIdentifier> tile(int x, int z)
+	{
+		return boost::make_shared<TileIdentifier>(x, 0, z, "default", TileIdentifier::PNG);
+	}
+
+	shared_ptr<MetaIdentifier> meta(int x, int z)
+	{
+		return MetaIdentifier::Create(tile(x, z));
+	}
+
+	void newestRequestFirst()
+	{
+		RequestScheduler scheduler(config);
+		for (int x = 0; x < 4; x++)
+			BOOST_CHECK(scheduler.push(shared_ptr<HttpRequest>(), tile(x, 10)));
+		// the interactive lane is full
+		BOOST_CHECK(!scheduler.push(shared_ptr<HttpRequest>(), tile(4, 10)));
+
+		RequestScheduler::Task task;
+		for (int x = 3; x >= 0; x--) {
+			BOOST_REQUIRE(scheduler.pop(task));
+			BOOST_CHECK_EQUAL(task.lane, RequestScheduler::Interactive);
+			BOOST_CHECK_EQUAL(task.tile->getX(), x);
+			BOOST_CHECK(!task.expired);
+		}
+		BOOST_CHECK(!scheduler.pop(task));
+	}
+
+	void usersBeforePrefetchBeforePrerender()
+	{
+		RequestScheduler scheduler(config);
+		BOOST_CHECK(scheduler.push(RequestScheduler::Prerender, meta(0, 5), true));
+		BOOST_CHECK(scheduler.push(RequestScheduler::Prefetch, meta(0, 6)));
+		BOOST_CHECK(scheduler.push(RequestScheduler::Prefetch, meta(4, 6)));
+		BOOST_CHECK(!scheduler.push(RequestScheduler::Prefetch, meta(8, 6)));
+		BOOST_CHECK(scheduler.push(shared_ptr<HttpRequest>(), tile(0, 7)));
+		BOOST_CHECK_EQUAL(scheduler.size(RequestScheduler::Prefetch), 2);
+
+		RequestScheduler::Task task;
+		BOOST_REQUIRE(scheduler.pop(task));
+		BOOST_CHECK_EQUAL(task.lane, RequestScheduler::Interactive);
+		BOOST_REQUIRE(scheduler.pop(task));
+		BOOST_CHECK_EQUAL(task.lane, RequestScheduler::Prefetch);
+		BOOST_CHECK_EQUAL(task.meta->getX(), 4);
+		BOOST_REQUIRE(scheduler.pop(task));
+		BOOST_CHECK_EQUAL(task.lane, RequestScheduler::Prefetch);
+		BOOST_REQUIRE(scheduler.pop(task));
+		BOOST_CHECK_EQUAL(task.lane, RequestScheduler::Prerender);
+		BOOST_CHECK(task.recursive);
+	}
+
+	void lowerZoomFirst()
+	{
+		RequestScheduler scheduler(config);
+		scheduler.setLane(RequestScheduler::Interactive, RequestScheduler::ByZoom, 0, std::chrono::milliseconds(0));
+		for (int z : {12, 3, 8, 3})
+			scheduler.push(shared_ptr<HttpRequest>(), tile(z, z));
+
+		RequestScheduler::Task task;
+		std::vector<int> zooms;
+		while (scheduler.pop(task))
+			zooms.push_back(task.zoom);
+		BOOST_REQUIRE_EQUAL(zooms.size(), 4);
+		BOOST_CHECK_EQUAL(zooms[0], 3);
+		BOOST_CHECK_EQUAL(zooms[1], 3);
+		BOOST_CHECK_EQUAL(zooms[2], 8);
+		BOOST_CHECK_EQUAL(zooms[3], 12);
+	}
+
+	void expireAfterDeadline()
+	{
+		RequestScheduler scheduler(config);
+		scheduler.setLane(RequestScheduler::Interactive, RequestScheduler::Fifo, 4, std::chrono::milliseconds(20));
+		scheduler.push(shared_ptr<HttpRequest>(), tile(0, 10));
+		std::this_thread::sleep_for(std::chrono::milliseconds(40));
+		scheduler.push(shared_ptr<HttpRequest>(), tile(1, 10));
+
+		RequestScheduler::Task task;
+		BOOST_REQUIRE(scheduler.pop(task));
+		BOOST_CHECK_EQUAL(task.tile->getX(), 0);
+		BOOST_CHECK(task.expired);
+		BOOST_REQUIRE(scheduler.pop(task));
+		BOOST_CHECK(!task.expired);
+	}
+};
+
+ALAC_START_FIXTURE_TEST(test_requestScheduler)
+	ALAC_FIXTURE_TEST(newestRequestFirst);
+	ALAC_FIXTURE_TEST(usersBeforePrefetchBeforePrerender);
+	ALAC_FIXTURE_TEST(lowerZoomFirst);
+	ALAC_FIXTURE_TEST(expireAfterDeadline);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,109 @@
+
+#include "settings.hpp"
+#include "../tests.hpp"
+
+#include "server/worker_pool.hpp"
+
+#include <boost/thread/barrier.hpp>
+#include <thread>
+
+BOOST_AUTO_TEST_SUITE(test_workerPool)
+
+struct test_workerPool
+{
+	std::atomic<int> done;
+
+	test_workerPool()
+		: done(0)
+	{
+	}
+
+	void count()
+	{
+		done++;
+	}
+
+	void waitFor(int expected)
+	{
+		for (int i = 0; i < 500 && done < expected; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	void runAllTasks()
+	{
+		WorkerPool pool(4);
+		BOOST_CHECK_EQUAL(pool.getThreadCount(), 4);
+		BOOST_CHECK_EQUAL(WorkerPool::CurrentWorker(), -1);
+		for (int i = 0; i < 1000; i++)
+			pool.post(boost::bind(&test_workerPool::count, this));
+		waitFor(1000);
+		BOOST_CHECK_EQUAL(done, 1000);
+	}
+
+	void spawn(WorkerPool* pool, int depth)
+	{
+		done++;
+		if (depth > 0) {
+			pool->post(boost::bind(&test_workerPool::spawn, this, pool, depth - 1));
+			pool->post(boost::bind(&test_workerPool::spawn, this, pool, depth - 1));
+		}
+	}
+
+	void stealTasksOfBusyWorker()
+	{
+		WorkerPool pool(2);
+		std::atomic<int> first(-1), second(-1);
+
+		// the first task posts the second into the queue of its own worker and waits
+		// for it, so the other worker has to steal it
+		pool.post([&] {
+			first = WorkerPool::CurrentWorker();
+			pool.post([&] {
+				second = WorkerPool::CurrentWorker();
+			});
+			for (int i = 0; i < 500 && second < 0; i++)
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		});
+		for (int i = 0; i < 500 && second < 0; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		BOOST_CHECK_GE(first, 0);
+		BOOST_CHECK_GE(second, 0);
+		BOOST_CHECK_NE(first, second);
+	}
+
+	void postFromWorkers()
+	{
+		WorkerPool pool(3);
+		pool.post(boost::bind(&test_workerPool::spawn, this, &pool, 9));
+		waitFor(1023);
+		BOOST_CHECK_EQUAL(done, 1023);
+	}
+
+	void stopDiscardsWaitingTasks()
+	{
+		WorkerPool pool(1);
+		boost::barrier started(2);
+		pool.post([&] {
+			started.wait();
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		});
+		started.wait();
+		for (int i = 0; i < 10; i++)
+			pool.post(boost::bind(&test_workerPool::count, this));
+		pool.stop();
+		BOOST_CHECK_EQUAL(done, 0);
+
+		pool.post(boost::bind(&test_workerPool::count, this));
+		BOOST_CHECK_EQUAL(done, 0);
+	}
+};
+
+ALAC_START_FIXTURE_TEST(test_workerPool)
+	ALAC_FIXTURE_TEST(runAllTasks);
+	ALAC_FIXTURE_TEST(stealTasksOfBusyWorker);
+	ALAC_FIXTURE_TEST(postFromWorkers);
+	ALAC_FIXTURE_TEST(stopDiscardsWaitingTasks);
+ALAC_END_FIXTURE_TEST()
+
+BOOST_AUTO_TEST_SUITE_END()
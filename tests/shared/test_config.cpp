@@ -26,17 +26,43 @@ shared_ptr<TestConfig> TestConfig::Create()
 	->add<string>(opt::server::access_log, 			"unitTest_access_log.log")
 	->add<string>(opt::server::cache_path, 			"cache")
 	->add<int>(opt::server::cache_size, 			1024)
+	->add<int>(opt::server::cache_memory, 			256)
 	->add<int>(opt::server::cache_keep_tile, 		12)
+	->add<string>(opt::server::cache_layout, 		"bundle")
+	->add<int>(opt::server::cache_shards, 			16)
+	->add<int>(opt::server::cache_write_queue, 		1024)
+	->add<int>(opt::server::cache_write_batch, 		32)
+	->add<string>(opt::server::cache_sync, 			"none")
+	->add<string>(opt::server::cache_policy, 		"tinylfu")
+	->add<int>(opt::server::cache_index_interval, 	300)
+	->add<int>(opt::server::cache_preload, 			0)
+	->add<int>(opt::server::cache_preload_threads, 	2)
 	//->add<int>(opt::server::request_timeout, 		XXX)
 	//->add<string>(opt::server::log_mute_component, 	"") //doesn’t work in unitTest
 	//->add<string>(opt::server::performance_log, 	"")
 	->add<int>(opt::server::max_queue_size, 		1024)
+	->add<string>(opt::server::queue_policy, 		"lifo")
+	->add<int>(opt::server::queue_deadline, 		30000)
+	->add<int>(opt::server::prefetch_queue_size, 	256)
+	->add<bool>(opt::server::prefetch_neighbours, 	false)
+	->add<int>(opt::server::prerender_queue_size, 	1024)
+	->add<bool>(opt::server::render_abandoned, 		false)
+	->add<bool>(opt::server::keep_half_closed, 		false)
 	->add<int>(opt::server::num_threads, 			1)
+	->add<int>(opt::server::match_threads, 			1)
+	->add<int>(opt::server::render_threads, 		1)
+	->add<int>(opt::server::encode_threads, 		1)
+	->add<int>(opt::server::stage_queue_size, 		4)
+	->add<string>(opt::server::metatile_size, 		"4")
 	->add<int>(opt::server::parse_timeout, 			750)
 	->add<string>(opt::server::path_to_default_style, "default")
 	->add<string>(opt::server::path_to_default_tile,(getAlaCarteStaticDataDirectory() / "default.png").string())
 	//->add<string>(opt::server::path_to_geodata, 	(getTestDynamicDataDirectory() / "/input/karlsruhe_big.carte").string())
 	->add<int>(opt::server::prerender_level, 		12)
+	->add<int>(opt::server::prerender_share, 		50)
+	->add<int>(opt::server::prerender_pause, 		500)
+	->add<int>(opt::server::prerender_popular, 		0)
+	->add<int>(opt::server::max_staleness, 			3600)
 	->add<string>(opt::server::server_address, 		"localhost")
 	->add<string>(opt::server::server_port, 		"8080")
 	->add<string>(opt::server::log_mute_component, 	"comp1, comp2")
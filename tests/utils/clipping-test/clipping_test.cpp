@@ -0,0 +1,90 @@
+#include "../../tests.hpp"
+#include "utils/clipping.hpp"
+
+BOOST_AUTO_TEST_SUITE(clipping_test)
+
+const FloatRect unit(0.0, 0.0, 1.0, 1.0);
+
+void intersects_test(const FloatPoint& a, const FloatPoint& b)
+{
+	BOOST_CHECK(segmentIntersectsRect(a, b, unit));
+}
+
+void misses_test(const FloatPoint& a, const FloatPoint& b)
+{
+	BOOST_CHECK(!segmentIntersectsRect(a, b, unit));
+}
+
+ALAC_PARAM_TEST(intersects_test, FloatPoint(0.5, 0.5), FloatPoint(0.6, 0.6));
+ALAC_PARAM_TEST(intersects_test, FloatPoint(-1.0, 0.5), FloatPoint(2.0, 0.5));
+ALAC_PARAM_TEST(intersects_test, FloatPoint(-1.0, -1.0), FloatPoint(2.0, 2.0));
+ALAC_PARAM_TEST(intersects_test, FloatPoint(0.5, -1.0), FloatPoint(0.5, 0.2));
+ALAC_PARAM_TEST(misses_test, FloatPoint(-1.0, 2.0), FloatPoint(2.0, 2.0));
+ALAC_PARAM_TEST(misses_test, FloatPoint(-1.0, 0.5), FloatPoint(0.5, 2.0));
+ALAC_PARAM_TEST(misses_test, FloatPoint(2.0, 2.0), FloatPoint(3.0, -3.0));
+
+BOOST_AUTO_TEST_CASE(polygon_contains)
+{
+	std::vector<FloatPoint> square = { FloatPoint(-1.0, -1.0), FloatPoint(2.0, -1.0), FloatPoint(2.0, 2.0), FloatPoint(-1.0, 2.0) };
+
+	BOOST_CHECK(polygonContains(square, FloatPoint(0.5, 0.5)));
+	BOOST_CHECK(!polygonContains(square, FloatPoint(3.0, 0.5)));
+}
+
+BOOST_AUTO_TEST_CASE(clip_polygon_inside)
+{
+	std::vector<FloatPoint> triangle = { FloatPoint(0.1, 0.1), FloatPoint(0.9, 0.1), FloatPoint(0.5, 0.9) };
+	std::vector<ClippedVertex> clipped;
+
+	clipPolygon(triangle, unit, clipped);
+
+	BOOST_REQUIRE_EQUAL(clipped.size(), 3);
+	for (int i = 0; i < 3; i++)
+		BOOST_CHECK_EQUAL(clipped[i].source, i);
+}
+
+BOOST_AUTO_TEST_CASE(clip_polygon_enclosing)
+{
+	std::vector<FloatPoint> square = { FloatPoint(-1.0, -1.0), FloatPoint(2.0, -1.0), FloatPoint(2.0, 2.0), FloatPoint(-1.0, 2.0) };
+	std::vector<ClippedVertex> clipped;
+
+	clipPolygon(square, unit, clipped);
+
+	BOOST_REQUIRE_EQUAL(clipped.size(), 4);
+	for (const ClippedVertex& v : clipped)
+	{
+		BOOST_CHECK_EQUAL(v.source, -1);
+		BOOST_CHECK(unit.contains(v.location));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(clip_polygon_crossing)
+{
+	// half of the triangle lies left of the rect
+	std::vector<FloatPoint> triangle = { FloatPoint(-0.5, 0.2), FloatPoint(0.5, 0.2), FloatPoint(0.5, 0.8) };
+	std::vector<ClippedVertex> clipped;
+
+	clipPolygon(triangle, unit, clipped);
+
+	BOOST_REQUIRE_EQUAL(clipped.size(), 4);
+	int kept = 0;
+	for (const ClippedVertex& v : clipped)
+	{
+		BOOST_CHECK(unit.contains(v.location));
+		if (v.source >= 0)
+			kept++;
+	}
+	BOOST_CHECK_EQUAL(kept, 2);
+}
+
+BOOST_AUTO_TEST_CASE(clip_polygon_outside)
+{
+	std::vector<FloatPoint> triangle = { FloatPoint(2.0, 2.0), FloatPoint(3.0, 2.0), FloatPoint(2.5, 3.0) };
+	std::vector<ClippedVertex> clipped;
+
+	clipPolygon(triangle, unit, clipped);
+
+	BOOST_CHECK(clipped.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+#include "../../tests.hpp"
+#include "../../shared/compare.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+
+#include "utils/decompressing_stream.hpp"
+#include "utils/ring_buffer.hpp"
+
+BOOST_AUTO_TEST_SUITE(decompressing_stream_test)
+
+string testContent()
+{
+	std::stringstream ss;
+	ss << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<osm>\n";
+	for (int i = 0; i < 20000; ++i)
+		ss << "\t<node id=\"" << i << "\" lon=\"8.4\" lat=\"49.0\"/>\n";
+	ss << "</osm>";
+	return ss.str();
+}
+
+boost::filesystem::path writeCompressed(const string& name, DecompressingStream::Compression compression, const string& content)
+{
+	boost::filesystem::path path = getTestDynamicDataDirectory() / "decompress" / name;
+	boost::filesystem::create_directories(path.parent_path());
+
+	std::ofstream file(path.string(), std::ios::out | std::ios::binary);
+	boost::iostreams::filtering_ostream out;
+	if (compression == DecompressingStream::Gzip)
+		out.push(boost::iostreams::gzip_compressor());
+	else if (compression == DecompressingStream::Bzip2)
+		out.push(boost::iostreams::bzip2_compressor());
+	out.push(file);
+	out << content;
+
+	return path;
+}
+
+void decompress_test(DecompressingStream::Compression compression, const string& name)
+{
+	const string content = testContent();
+	boost::filesystem::path path = writeCompressed(name, compression, content);
+
+	BOOST_CHECK_EQUAL(DecompressingStream::DetectCompression(path), compression);
+
+	// use a tiny ring buffer so producer and consumer have to wait for each other
+	DecompressingStream stream(path, compression, 1024);
+	std::stringstream result;
+	result << stream.rdbuf();
+
+	BOOST_CHECK(stream.getError().empty());
+	BOOST_CHECK(result.str() == content);
+	BOOST_CHECK_EQUAL(stream.getCompressedBytesRead(), boost::filesystem::file_size(path));
+}
+
+ALAC_PARAM_TEST(decompress_test, DecompressingStream::Gzip, "test.osm.gz");
+ALAC_PARAM_TEST(decompress_test, DecompressingStream::Bzip2, "test.osm.bz2");
+
+BOOST_AUTO_TEST_CASE(detect_uncompressed)
+{
+	boost::filesystem::path path = writeCompressed("test.osm", DecompressingStream::None, testContent());
+	BOOST_CHECK_EQUAL(DecompressingStream::DetectCompression(path), DecompressingStream::None);
+}
+
+BOOST_AUTO_TEST_CASE(corrupt_archive)
+{
+	string content = testContent();
+	boost::filesystem::path path = writeCompressed("corrupt.osm.gz", DecompressingStream::Gzip, content);
+	boost::filesystem::resize_file(path, boost::filesystem::file_size(path) / 2);
+
+	DecompressingStream stream(path, DecompressingStream::Gzip);
+	std::stringstream result;
+	result << stream.rdbuf();
+
+	BOOST_CHECK(!stream.getError().empty());
+	BOOST_CHECK(result.str().size() < content.size());
+}
+
+BOOST_AUTO_TEST_CASE(ring_buffer_wrap_around)
+{
+	RingBuffer<char> ring(5);
+	BOOST_CHECK_EQUAL(ring.capacity(), 8);
+
+	char out[8];
+	for (int i = 0; i < 10; ++i)
+	{
+		BOOST_CHECK_EQUAL(ring.push("abcdef", 6), 6);
+		BOOST_CHECK_EQUAL(ring.push("xyz", 3), 2);
+		BOOST_CHECK_EQUAL(ring.pop(out, 8), 8);
+		BOOST_CHECK_EQUAL(string(out, 8), "abcdefxy");
+	}
+
+	BOOST_CHECK(!ring.isDrained());
+	ring.close();
+	BOOST_CHECK(ring.isDrained());
+}
+
+BOOST_AUTO_TEST_SUITE_END(/*decompressing_stream_test*/)
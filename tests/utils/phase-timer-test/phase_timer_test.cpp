@@ -0,0 +1,45 @@
+#include "../../tests.hpp"
+#include "utils/phase_timer.hpp"
+
+#include <sstream>
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(phase_timer_test)
+
+BOOST_AUTO_TEST_CASE(measure_phases)
+{
+	PhaseTimer timer;
+
+	timer.start("first");
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+	timer.stop(100);
+	timer.add("first/part", 0.01, 50);
+	timer.start("second");
+	timer.stop();
+
+	auto& phases = timer.getPhases();
+	BOOST_REQUIRE_EQUAL(phases.size(), 3);
+	BOOST_CHECK_EQUAL(phases[0].name, "first");
+	BOOST_CHECK_GE(phases[0].seconds, 0.015);
+	BOOST_CHECK_EQUAL(phases[0].objects, 100);
+
+	// nested phases are not counted twice
+	BOOST_CHECK_CLOSE(timer.getTotalSeconds(), phases[0].seconds + phases[2].seconds, 0.001);
+}
+
+BOOST_AUTO_TEST_CASE(write_summary)
+{
+	PhaseTimer timer;
+	timer.add("parse", 2.0, 1000);
+
+	std::ostringstream out;
+	timer.writeSummary(out);
+	string summary = out.str();
+
+	BOOST_CHECK_EQUAL(summary.front(), '{');
+	BOOST_CHECK_EQUAL(summary.back(), '}');
+	BOOST_CHECK(summary.find("\"name\":\"parse\"") != string::npos);
+	BOOST_CHECK(summary.find("\"objects_per_second\":500.000000") != string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,88 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Generates a synthetic osm xml file for benchmarking the importer.
+# The output only depends on the number of nodes and the seed, so imports
+# of different builds can be compared.
+#
+# usage: generate_osm.py <output.osm> [nodes] [seed]
+
+import random
+import sys
+
+HIGHWAYS = ["residential", "service", "primary", "secondary", "tertiary", "footway", "track"]
+LANDUSE = ["residential", "forest", "meadow", "farmland", "industrial"]
+NAMES = ["Kaiserstrasse", "Hauptstrasse", "Bahnhofstrasse", "Schlossplatz", "Waldweg", "Am Markt"]
+
+
+def tags(out, pairs):
+    for k, v in pairs:
+        out.write('\t\t<tag k="%s" v="%s"/>\n' % (k, v))
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("usage: %s <output.osm> [nodes] [seed]\n" % sys.argv[0])
+        return 1
+
+    path = sys.argv[1]
+    node_count = int(sys.argv[2]) if len(sys.argv) > 2 else 1000000
+    seed = int(sys.argv[3]) if len(sys.argv) > 3 else 42
+    rnd = random.Random(seed)
+
+    # nodes are placed around Karlsruhe
+    min_lon, min_lat, size = 8.3, 48.95, 0.2
+
+    with open(path, "w") as out:
+        out.write('<?xml version="1.0" encoding="UTF-8"?>\n')
+        out.write('<osm version="0.6" generator="alacarte-maps benchmark">\n')
+
+        for i in range(1, node_count + 1):
+            lon = min_lon + rnd.random() * size
+            lat = min_lat + rnd.random() * size
+            if rnd.random() < 0.02:
+                out.write('\t<node id="%d" lat="%.7f" lon="%.7f">\n' % (i, lat, lon))
+                tags(out, [("amenity", rnd.choice(["bench", "restaurant", "post_box"]))])
+                out.write('\t</node>\n')
+            else:
+                out.write('\t<node id="%d" lat="%.7f" lon="%.7f"/>\n' % (i, lat, lon))
+
+        # ways use consecutive node ids, so they stay local like real data
+        way_ids = []
+        node = 1
+        way_id = 1
+        while node < node_count:
+            length = min(rnd.randint(2, 20), node_count - node + 1)
+            refs = list(range(node, node + length))
+            node += length
+            closed = length > 3 and rnd.random() < 0.3
+
+            out.write('\t<way id="%d">\n' % way_id)
+            for ref in refs:
+                out.write('\t\t<nd ref="%d"/>\n' % ref)
+            if closed:
+                out.write('\t\t<nd ref="%d"/>\n' % refs[0])
+                tags(out, [("building", "yes")] if rnd.random() < 0.7 else [("landuse", rnd.choice(LANDUSE))])
+            else:
+                pairs = [("highway", rnd.choice(HIGHWAYS))]
+                if rnd.random() < 0.5:
+                    pairs.append(("name", rnd.choice(NAMES)))
+                tags(out, pairs)
+            out.write('\t</way>\n')
+
+            way_ids.append(way_id)
+            way_id += 1
+
+        for rel_id in range(1, len(way_ids) // 50 + 1):
+            out.write('\t<relation id="%d">\n' % rel_id)
+            for member in rnd.sample(way_ids, min(len(way_ids), rnd.randint(1, 8))):
+                out.write('\t\t<member type="way" ref="%d" role="outer"/>\n' % member)
+            tags(out, [("type", "multipolygon"), ("landuse", rnd.choice(LANDUSE))])
+            out.write('\t</relation>\n')
+
+        out.write('</osm>\n')
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
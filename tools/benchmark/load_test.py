@@ -0,0 +1,124 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Requests random tiles from a running alacarte-maps-server with concurrent
+# clients and reports the throughput and latency. The requested tiles only
+# depend on the seed, so runs of different builds can be compared.
+#
+# usage: load_test.py <server url> [requests] [clients] [seed] [summary.json]
+#
+# example: load_test.py http://localhost:8080/default 2000 32
+
+import json
+import math
+import random
+import sys
+import threading
+import time
+
+try:
+    from urllib.request import urlopen
+    from urllib.error import HTTPError
+except ImportError:
+    from urllib2 import urlopen, HTTPError
+
+# tiles are requested around Karlsruhe, like the osm file of the importer benchmark
+MIN_LON, MIN_LAT, SIZE = 8.3, 48.95, 0.2
+ZOOMS = range(10, 17)
+
+
+def tile(lon, lat, zoom):
+    n = 2 ** zoom
+    x = int((lon + 180.0) / 360.0 * n)
+    lat_rad = math.radians(lat)
+    y = int((1.0 - math.log(math.tan(lat_rad) + 1.0 / math.cos(lat_rad)) / math.pi) / 2.0 * n)
+    return x, y
+
+
+def generate(count, seed):
+    rnd = random.Random(seed)
+    urls = []
+    for _ in range(count):
+        zoom = rnd.choice(ZOOMS)
+        x, y = tile(MIN_LON + rnd.random() * SIZE, MIN_LAT + rnd.random() * SIZE, zoom)
+        urls.append("/%d/%d/%d.png" % (zoom, x, y))
+    return urls
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    index = min(int(len(values) * p), len(values) - 1)
+    return values[index]
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("usage: %s <server url> [requests] [clients] [seed] [summary.json]\n" % sys.argv[0])
+        return 1
+
+    base = sys.argv[1].rstrip("/")
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 1000
+    clients = int(sys.argv[3]) if len(sys.argv) > 3 else 16
+    seed = int(sys.argv[4]) if len(sys.argv) > 4 else 42
+    summary_path = sys.argv[5] if len(sys.argv) > 5 else None
+
+    urls = generate(count, seed)
+    lock = threading.Lock()
+    latencies = []
+    statuses = {}
+
+    def client(index):
+        for url in urls[index::clients]:
+            start = time.time()
+            try:
+                response = urlopen(base + url)
+                response.read()
+                status = response.getcode()
+            except HTTPError as e:
+                status = e.code
+            except Exception:
+                status = 0
+            elapsed = time.time() - start
+            with lock:
+                latencies.append(elapsed)
+                statuses[status] = statuses.get(status, 0) + 1
+
+    threads = [threading.Thread(target=client, args=(i,)) for i in range(clients)]
+    start = time.time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    duration = time.time() - start
+
+    latencies.sort()
+    summary = {
+        "requests": count,
+        "clients": clients,
+        "seed": seed,
+        "duration": duration,
+        "throughput": count / duration if duration > 0 else 0.0,
+        "latency": {
+            "mean": sum(latencies) / len(latencies) if latencies else 0.0,
+            "p50": percentile(latencies, 0.5),
+            "p95": percentile(latencies, 0.95),
+            "p99": percentile(latencies, 0.99),
+            "max": latencies[-1] if latencies else 0.0,
+        },
+        "status": dict((str(k), v) for k, v in statuses.items()),
+    }
+
+    print("%d requests with %d clients in %.2f s: %.1f tiles/s" % (count, clients, duration, summary["throughput"]))
+    print("latency p50 %.1f ms, p95 %.1f ms, p99 %.1f ms" % (
+        summary["latency"]["p50"] * 1000, summary["latency"]["p95"] * 1000, summary["latency"]["p99"] * 1000))
+    print("status %s" % ", ".join("%s: %d" % (k, v) for k, v in sorted(summary["status"].items())))
+
+    if summary_path:
+        with open(summary_path, "w") as out:
+            json.dump(summary, out, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())